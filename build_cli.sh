@@ -0,0 +1,25 @@
+#!/bin/sh
+# Builds the headless command-line tool (src/CliBuild.cpp) with the system C++ compiler.
+# Usage: ./build_cli.sh [release]. Set CXX to pick a compiler other than c++.
+
+cd "$(dirname "$0")"
+
+debug_flags="-O0 -g"
+release_flags="-O2 -DNDEBUG"
+common_flags="-std=c++14 -pthread -I ../../src -I ../../ext ../../src/CliBuild.cpp -o imagecli"
+
+mode=debug
+if [ "$1" = "release" ]; then mode=release; fi
+if [ $mode = debug ]; then flags="$common_flags $debug_flags"; else flags="$common_flags $release_flags"; fi
+
+echo "Building in $mode mode."
+mkdir -p bin/$mode
+cd bin/$mode
+
+echo "    -Compiling:"
+if ! ${CXX:-c++} $flags; then
+	echo "Build failed!"
+	exit 1
+fi
+
+echo "Build complete!"
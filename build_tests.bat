@@ -0,0 +1,63 @@
+@echo off
+REM Build script for the headless tests (src\TestBuild.cpp). Same setup as build_cli.bat; once the build
+REM succeeds it runs the tests in the build directory.
+
+REM Set build tool and library paths as well as compile flags here.
+
+set debug_flags=/Od /Z7 /MTd
+set release_flags=/O2 /GL /MT /analyze- /D NDEBUG
+set common_flags=/W3 /Gm- /EHsc /nologo /Fe: imagetests.exe /I ..\..\src /I ..\..\ext ..\..\src\TestBuild.cpp
+set linker_flags=/INCREMENTAL:no /NOLOGO /SUBSYSTEM:CONSOLE user32.lib
+REM Run the build tools, but only if they aren't set up already.
+
+cl >nul 2>nul
+if %errorlevel% neq 9009 goto :build
+echo Running VS build tool setup.
+echo Initializing MS build tools...
+call scripts\setup_cl.bat
+cl >nul 2>nul
+if %errorlevel% neq 9009 goto :build
+echo Unable to find build tools! Make sure that you have Microsoft Visual Studio 10 or above installed!
+exit /b 1
+
+REM Use the first command-line argument to set the build mode to debug or release (defaulting to debug).
+REM If the build directory doesn't exist, create one.
+
+:build
+set mode=debug
+if /i $%1 equ $release (set mode=release)
+if %mode% equ debug (
+set flags=%common_flags% %debug_flags%
+) else (
+set flags=%common_flags% %release_flags%
+)
+echo Building in %mode% mode.
+if not exist bin\%mode% mkdir bin\%mode%
+pushd bin\%mode%
+
+REM Perform the actual build.
+
+echo.     -Compiling:
+call cl %flags% /link %linker_flags%
+if %errorlevel% neq 0 (
+echo Error during compilation!
+popd
+goto :fail
+)
+popd
+
+REM If we made it here, the build was successful, so run the tests.
+
+echo Build complete!
+echo.     -Running:
+pushd bin\%mode%
+imagetests.exe
+set test_result=%errorlevel%
+popd
+exit /b %test_result%
+
+REM Error state. Print failure message and exit.
+
+:fail
+echo Build failed!
+exit /b %errorlevel%
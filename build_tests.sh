@@ -0,0 +1,27 @@
+#!/bin/sh
+# Builds the headless tests (src/TestBuild.cpp) the same way build_cli.sh builds the command-line tool,
+# then runs them in the build directory. Usage: ./build_tests.sh [release] [test name filters...].
+
+cd "$(dirname "$0")"
+
+debug_flags="-O0 -g"
+release_flags="-O2 -DNDEBUG"
+common_flags="-std=c++14 -pthread -I ../../src -I ../../ext ../../src/TestBuild.cpp -o imagetests"
+
+mode=debug
+if [ "$1" = "release" ]; then mode=release; shift; fi
+if [ $mode = debug ]; then flags="$common_flags $debug_flags"; else flags="$common_flags $release_flags"; fi
+
+echo "Building in $mode mode."
+mkdir -p bin/$mode
+cd bin/$mode
+
+echo "    -Compiling:"
+if ! ${CXX:-c++} $flags; then
+	echo "Build failed!"
+	exit 1
+fi
+
+echo "Build complete!"
+echo "    -Running:"
+./imagetests "$@"
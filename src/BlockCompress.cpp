@@ -0,0 +1,515 @@
+#include "BlockCompress.h"
+
+#include <math.h>
+
+#define BLOCK_PIXELS 16
+
+// Mean and principal axis (unit length, or zero if the points are all the same) of count points with
+// dims components each, by power iteration on the covariance matrix.
+static void FitBlockAxis(const float (*points)[4], int count, int dims, float* mean, float* axis)
+{
+	float min[4] = {255.0f, 255.0f, 255.0f, 255.0f};
+	float max[4] = {};
+	for (int d = 0; d < dims; ++d) mean[d] = 0.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		for (int d = 0; d < dims; ++d)
+		{
+			mean[d] += points[i][d];
+			if (points[i][d] < min[d]) min[d] = points[i][d];
+			if (points[i][d] > max[d]) max[d] = points[i][d];
+		}
+	}
+	for (int d = 0; d < dims; ++d) mean[d] /= (float)count;
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < count; ++i)
+	{
+		float delta[4];
+		for (int d = 0; d < dims; ++d) delta[d] = points[i][d] - mean[d];
+		for (int r = 0; r < dims; ++r)
+		{
+			for (int c = 0; c < dims; ++c) covariance[r][c] += delta[r] * delta[c];
+		}
+	}
+
+	// The bounding box diagonal is usually close already, so a few iterations are plenty.
+	for (int d = 0; d < dims; ++d) axis[d] = max[d] - min[d];
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[4] = {};
+		float length = 0.0f;
+		for (int r = 0; r < dims; ++r)
+		{
+			for (int c = 0; c < dims; ++c) next[r] += covariance[r][c] * axis[c];
+			length += next[r] * next[r];
+		}
+		if (length < 1e-12f)
+		{
+			for (int d = 0; d < dims; ++d) axis[d] = 0.0f;
+			return;
+		}
+		length = 1.0f / sqrtf(length);
+		for (int d = 0; d < dims; ++d) axis[d] = next[d] * length;
+	}
+}
+
+// Endpoints along the axis that span the points, pulled in by 1/16 of the range at each end since the
+// extremes are rarely hit exactly by the interpolated palette.
+static void GetAxisEndpoints(const float (*points)[4], int count, int dims, const float* mean, const float* axis, float* e0, float* e1)
+{
+	float t_min = 0.0f;
+	float t_max = 0.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		float t = 0.0f;
+		for (int d = 0; d < dims; ++d) t += (points[i][d] - mean[d]) * axis[d];
+		if (t < t_min) t_min = t;
+		if (t > t_max) t_max = t;
+	}
+	float inset = (t_max - t_min) / 16.0f;
+	t_min += inset;
+	t_max -= inset;
+	for (int d = 0; d < dims; ++d)
+	{
+		e0[d] = mean[d] + axis[d] * t_min;
+		e1[d] = mean[d] + axis[d] * t_max;
+	}
+}
+
+// Least squares endpoints for points interpolated at the given weights (0 at e0, 1 at e1). Returns false
+// if the weights can't pin both endpoints down (all the same, for instance).
+static bool SolveBlockEndpoints(const float (*points)[4], const float* weights, int count, int dims, float* e0, float* e1)
+{
+	float a = 0.0f, b = 0.0f, c = 0.0f;
+	float r0[4] = {};
+	float r1[4] = {};
+	for (int i = 0; i < count; ++i)
+	{
+		float w = weights[i];
+		float iw = 1.0f - w;
+		a += iw * iw;
+		b += iw * w;
+		c += w * w;
+		for (int d = 0; d < dims; ++d)
+		{
+			r0[d] += iw * points[i][d];
+			r1[d] += w * points[i][d];
+		}
+	}
+	float det = a * c - b * b;
+	if (fabsf(det) < 1e-6f) return false;
+
+	det = 1.0f / det;
+	for (int d = 0; d < dims; ++d)
+	{
+		float v0 = (c * r0[d] - b * r1[d]) * det;
+		float v1 = (a * r1[d] - b * r0[d]) * det;
+		e0[d] = (v0 < 0.0f) ? 0.0f : ((v0 > 255.0f) ? 255.0f : v0);
+		e1[d] = (v1 < 0.0f) ? 0.0f : ((v1 > 255.0f) ? 255.0f : v1);
+	}
+	return true;
+}
+
+// BC1 color
+
+static u16 PackRgb565(const float* color)
+{
+	int r = (int)(color[0] * (31.0f / 255.0f) + 0.5f);
+	int g = (int)(color[1] * (63.0f / 255.0f) + 0.5f);
+	int b = (int)(color[2] * (31.0f / 255.0f) + 0.5f);
+	return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRgb565(u16 value, int* color)
+{
+	int r = (value >> 11) & 31;
+	int g = (value >> 5) & 63;
+	int b = value & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+struct ColorBlock
+{
+	u16 colors[2];
+	u32 indices;
+	float error;
+};
+
+// Quantizes a pair of endpoints and picks the closest palette entry for every pixel. Three color mode
+// (c0 <= c1) is used when some pixels are transparent, four color mode (c0 > c1) otherwise.
+static ColorBlock EvaluateColorBlock(const u8* pixels, const bool* is_transparent, bool has_transparent, const float* e0, const float* e1)
+{
+	ColorBlock block = {};
+	u16 c0 = PackRgb565(e0);
+	u16 c1 = PackRgb565(e1);
+	if (has_transparent ? (c0 > c1) : (c0 < c1))
+	{
+		u16 swap = c0;
+		c0 = c1;
+		c1 = swap;
+	}
+	block.colors[0] = c0;
+	block.colors[1] = c1;
+
+	int palette[4][3];
+	UnpackRgb565(c0, palette[0]);
+	UnpackRgb565(c1, palette[1]);
+	int palette_size = 4;
+	for (int d = 0; d < 3; ++d)
+	{
+		if (has_transparent)
+		{
+			palette[2][d] = (palette[0][d] + palette[1][d]) / 2;
+			palette_size = 3;
+		}
+		else
+		{
+			palette[2][d] = (2 * palette[0][d] + palette[1][d]) / 3;
+			palette[3][d] = (palette[0][d] + 2 * palette[1][d]) / 3;
+		}
+	}
+	// With equal endpoints the decoder drops to three color mode, where index 3 is transparent.
+	if (c0 == c1) palette_size = 1;
+
+	for (int i = 0; i < BLOCK_PIXELS; ++i)
+	{
+		if (is_transparent[i])
+		{
+			block.indices |= 3u << (i * 2);
+			continue;
+		}
+		const u8* pixel = pixels + i * 4;
+		int best = 0;
+		int best_error = 0x7FFFFFFF;
+		for (int p = 0; p < palette_size; ++p)
+		{
+			int dr = pixel[0] - palette[p][0];
+			int dg = pixel[1] - palette[p][1];
+			int db = pixel[2] - palette[p][2];
+			int error = dr * dr + dg * dg + db * db;
+			if (error < best_error)
+			{
+				best = p;
+				best_error = error;
+			}
+		}
+		block.indices |= (u32)best << (i * 2);
+		block.error += (float)best_error;
+	}
+	return block;
+}
+
+// Writes the 8-byte color half of a BC1/BC3 block.
+static void EncodeColorBlock(const u8* pixels, bool allow_transparent, u8* dst)
+{
+	float points[BLOCK_PIXELS][4];
+	bool is_transparent[BLOCK_PIXELS];
+	int count = 0;
+	for (int i = 0; i < BLOCK_PIXELS; ++i)
+	{
+		const u8* pixel = pixels + i * 4;
+		is_transparent[i] = (allow_transparent && pixel[3] < 128);
+		if (is_transparent[i]) continue;
+		points[count][0] = pixel[0];
+		points[count][1] = pixel[1];
+		points[count][2] = pixel[2];
+		++count;
+	}
+	bool has_transparent = (count < BLOCK_PIXELS);
+
+	ColorBlock block = {};
+	if (count == 0)
+	{
+		// Entirely transparent: equal endpoints and every index 3.
+		block.indices = 0xFFFFFFFF;
+	}
+	else
+	{
+		float mean[4], axis[4], e0[4], e1[4];
+		FitBlockAxis(points, count, 3, mean, axis);
+		GetAxisEndpoints(points, count, 3, mean, axis, e0, e1);
+		block = EvaluateColorBlock(pixels, is_transparent, has_transparent, e0, e1);
+
+		// Refit against the indices that were picked. Palette entries are the interpolation weights
+		// between colors[0] and colors[1].
+		static const float four_color_weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+		static const float three_color_weights[4] = {0.0f, 1.0f, 0.5f, 0.0f};
+		const float* palette_weights = has_transparent ? three_color_weights : four_color_weights;
+		float weights[BLOCK_PIXELS];
+		int weight_count = 0;
+		for (int i = 0; i < BLOCK_PIXELS; ++i)
+		{
+			if (!is_transparent[i]) weights[weight_count++] = palette_weights[(block.indices >> (i * 2)) & 3];
+		}
+		if (block.error > 0.0f && SolveBlockEndpoints(points, weights, count, 3, e0, e1))
+		{
+			ColorBlock refined = EvaluateColorBlock(pixels, is_transparent, has_transparent, e0, e1);
+			if (refined.error < block.error) block = refined;
+		}
+	}
+
+	dst[0] = (u8)block.colors[0];
+	dst[1] = (u8)(block.colors[0] >> 8);
+	dst[2] = (u8)block.colors[1];
+	dst[3] = (u8)(block.colors[1] >> 8);
+	for (int i = 0; i < 4; ++i) dst[4 + i] = (u8)(block.indices >> (i * 8));
+}
+
+void CompressBlockBC1(const u8* pixels, u8* dst)
+{
+	assert(pixels && dst);
+	EncodeColorBlock(pixels, true, dst);
+}
+
+// BC3 alpha
+
+static void EncodeAlphaBlock(const u8* pixels, u8* dst)
+{
+	int a_min = 255;
+	int a_max = 0;
+	for (int i = 0; i < BLOCK_PIXELS; ++i)
+	{
+		int a = pixels[i * 4 + 3];
+		if (a < a_min) a_min = a;
+		if (a > a_max) a_max = a;
+	}
+
+	// a0 > a1 selects the eight value palette: the endpoints and six steps between them.
+	int palette[8];
+	palette[0] = a_max;
+	palette[1] = a_min;
+	for (int i = 2; i < 8; ++i) palette[i] = ((8 - i) * a_max + (i - 1) * a_min) / 7;
+
+	u64 indices = 0;
+	if (a_max > a_min)
+	{
+		for (int i = 0; i < BLOCK_PIXELS; ++i)
+		{
+			int a = pixels[i * 4 + 3];
+			int best = 0;
+			int best_error = 256;
+			for (int p = 0; p < 8; ++p)
+			{
+				int error = abs(a - palette[p]);
+				if (error < best_error)
+				{
+					best = p;
+					best_error = error;
+				}
+			}
+			indices |= (u64)best << (i * 3);
+		}
+	}
+
+	dst[0] = (u8)a_max;
+	dst[1] = (u8)a_min;
+	for (int i = 0; i < 6; ++i) dst[2 + i] = (u8)(indices >> (i * 8));
+}
+
+void CompressBlockBC3(const u8* pixels, u8* dst)
+{
+	assert(pixels && dst);
+	EncodeAlphaBlock(pixels, dst);
+	EncodeColorBlock(pixels, false, dst + 8);
+}
+
+// BC7 mode 6
+
+static const int bc7_weights_4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Block
+{
+	int endpoints[2][4]; // 7-bit values.
+	int p_bits[2];
+	u8 indices[BLOCK_PIXELS];
+	float error;
+};
+
+// Quantizes an endpoint to 7 bits per channel plus a shared p-bit, trying both p-bits.
+static void QuantizeBc7Endpoint(const float* endpoint, int* quantized, int* p_bit)
+{
+	float best_error = 1e30f;
+	for (int p = 0; p < 2; ++p)
+	{
+		int values[4];
+		float error = 0.0f;
+		for (int d = 0; d < 4; ++d)
+		{
+			int value = (int)((endpoint[d] - p) * 0.5f + 0.5f);
+			values[d] = (value < 0) ? 0 : ((value > 127) ? 127 : value);
+			float delta = (float)((values[d] << 1) | p) - endpoint[d];
+			error += delta * delta;
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			*p_bit = p;
+			for (int d = 0; d < 4; ++d) quantized[d] = values[d];
+		}
+	}
+}
+
+static Bc7Block EvaluateBc7Block(const u8* pixels, const float* e0, const float* e1)
+{
+	Bc7Block block = {};
+	QuantizeBc7Endpoint(e0, block.endpoints[0], &block.p_bits[0]);
+	QuantizeBc7Endpoint(e1, block.endpoints[1], &block.p_bits[1]);
+
+	int lo[4], hi[4];
+	int palette[16][4];
+	float direction[4];
+	float length = 0.0f;
+	for (int d = 0; d < 4; ++d)
+	{
+		lo[d] = (block.endpoints[0][d] << 1) | block.p_bits[0];
+		hi[d] = (block.endpoints[1][d] << 1) | block.p_bits[1];
+		direction[d] = (float)(hi[d] - lo[d]);
+		length += direction[d] * direction[d];
+	}
+	for (int i = 0; i < 16; ++i)
+	{
+		int w = bc7_weights_4[i];
+		for (int d = 0; d < 4; ++d) palette[i][d] = ((64 - w) * lo[d] + w * hi[d] + 32) >> 6;
+	}
+
+	// Project onto the endpoint line for a first guess, then check the neighbouring palette entries,
+	// since the weights aren't evenly spaced and rounding moves things around.
+	float scale = (length > 0.0f) ? 64.0f / length : 0.0f;
+	for (int i = 0; i < BLOCK_PIXELS; ++i)
+	{
+		const u8* pixel = pixels + i * 4;
+		float t = 0.0f;
+		for (int d = 0; d < 4; ++d) t += (pixel[d] - lo[d]) * direction[d];
+		t *= scale;
+
+		int guess = 0;
+		for (int w = 1; w < 16; ++w)
+		{
+			if (fabsf(bc7_weights_4[w] - t) < fabsf(bc7_weights_4[guess] - t)) guess = w;
+		}
+		int best = guess;
+		int best_error = 0x7FFFFFFF;
+		for (int index = guess - 1; index <= guess + 1; ++index)
+		{
+			if (index < 0 || index > 15) continue;
+			int error = 0;
+			for (int d = 0; d < 4; ++d)
+			{
+				int delta = pixel[d] - palette[index][d];
+				error += delta * delta;
+			}
+			if (error < best_error)
+			{
+				best = index;
+				best_error = error;
+			}
+		}
+		block.indices[i] = (u8)best;
+		block.error += (float)best_error;
+	}
+	return block;
+}
+
+// Little endian bit packer for one 128-bit block.
+struct BlockBits
+{
+	u64 words[2];
+	int position;
+};
+
+static void PutBlockBits(BlockBits* bits, u32 value, int count)
+{
+	for (int i = 0; i < count; ++i, ++bits->position)
+	{
+		if (value & (1u << i)) bits->words[bits->position >> 6] |= 1ull << (bits->position & 63);
+	}
+}
+
+void CompressBlockBC7(const u8* pixels, u8* dst)
+{
+	assert(pixels && dst);
+	float points[BLOCK_PIXELS][4];
+	for (int i = 0; i < BLOCK_PIXELS; ++i)
+	{
+		for (int d = 0; d < 4; ++d) points[i][d] = pixels[i * 4 + d];
+	}
+
+	float mean[4], axis[4], e0[4], e1[4];
+	FitBlockAxis(points, BLOCK_PIXELS, 4, mean, axis);
+	GetAxisEndpoints(points, BLOCK_PIXELS, 4, mean, axis, e0, e1);
+	Bc7Block block = EvaluateBc7Block(pixels, e0, e1);
+
+	float weights[BLOCK_PIXELS];
+	for (int i = 0; i < BLOCK_PIXELS; ++i) weights[i] = bc7_weights_4[block.indices[i]] / 64.0f;
+	if (block.error > 0.0f && SolveBlockEndpoints(points, weights, BLOCK_PIXELS, 4, e0, e1))
+	{
+		Bc7Block refined = EvaluateBc7Block(pixels, e0, e1);
+		if (refined.error < block.error) block = refined;
+	}
+
+	// The first pixel's index is stored with its top bit implied to be zero, so swap the endpoints
+	// (which mirrors the indices) if it isn't.
+	if (block.indices[0] & 8)
+	{
+		for (int d = 0; d < 4; ++d)
+		{
+			int swap = block.endpoints[0][d];
+			block.endpoints[0][d] = block.endpoints[1][d];
+			block.endpoints[1][d] = swap;
+		}
+		int swap = block.p_bits[0];
+		block.p_bits[0] = block.p_bits[1];
+		block.p_bits[1] = swap;
+		for (int i = 0; i < BLOCK_PIXELS; ++i) block.indices[i] = (u8)(15 - block.indices[i]);
+	}
+
+	BlockBits bits = {};
+	PutBlockBits(&bits, 1 << 6, 7); // Mode 6.
+	for (int d = 0; d < 4; ++d)
+	{
+		PutBlockBits(&bits, block.endpoints[0][d], 7);
+		PutBlockBits(&bits, block.endpoints[1][d], 7);
+	}
+	PutBlockBits(&bits, block.p_bits[0], 1);
+	PutBlockBits(&bits, block.p_bits[1], 1);
+	PutBlockBits(&bits, block.indices[0], 3);
+	for (int i = 1; i < BLOCK_PIXELS; ++i) PutBlockBits(&bits, block.indices[i], 4);
+
+	for (int i = 0; i < 8; ++i)
+	{
+		dst[i] = (u8)(bits.words[0] >> (i * 8));
+		dst[8 + i] = (u8)(bits.words[1] >> (i * 8));
+	}
+}
+
+void CompressBlockRow(BlockFormat format, const u8* rows, size_t stride, int width, int row_count, u8* dst)
+{
+	assert(rows && dst && width > 0 && row_count >= 1 && row_count <= 4);
+	int block_size = GetBlockFormatSize(format);
+	int block_count = (width + 3) / 4;
+	for (int b = 0; b < block_count; ++b)
+	{
+		u8 pixels[BLOCK_PIXELS * 4];
+		for (int y = 0; y < 4; ++y)
+		{
+			const u8* row = rows + (size_t)((y < row_count) ? y : row_count - 1) * stride;
+			for (int x = 0; x < 4; ++x)
+			{
+				int source_x = b * 4 + x;
+				if (source_x >= width) source_x = width - 1;
+				memcpy(pixels + (y * 4 + x) * 4, row + (size_t)source_x * 4, 4);
+			}
+		}
+
+		u8* block = dst + (size_t)b * block_size;
+		switch (format)
+		{
+			case BlockFormat::BC1: CompressBlockBC1(pixels, block); break;
+			case BlockFormat::BC3: CompressBlockBC3(pixels, block); break;
+			case BlockFormat::BC7: CompressBlockBC7(pixels, block); break;
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef _BLOCK_COMPRESS_H
+#define _BLOCK_COMPRESS_H
+
+// CPU encoders for the BCn texture formats. Each works on one 4x4 block of RGBA8 pixels, 16 pixels in
+// row order. The encoders fit endpoints along the principal axis of the block's colors, then refine
+// them once by least squares against the chosen indices, keeping whichever result is closer.
+
+enum class BlockFormat : u8
+{
+	BC7 = 0, // First so that zeroed export params get the best quality.
+	BC1,
+	BC3
+};
+
+// Bytes per 4x4 block.
+inline int GetBlockFormatSize(BlockFormat format)
+{
+	return (format == BlockFormat::BC1) ? 8 : 16;
+}
+
+// RGB with 1-bit alpha: pixels with alpha below 128 use the transparent index.
+void CompressBlockBC1(const u8* pixels, u8* dst);
+
+// BC1 color (always in four color mode) plus an interpolated 8-bit alpha block.
+void CompressBlockBC3(const u8* pixels, u8* dst);
+
+// Mode 6 only: one subset, RGBA endpoints with a shared p-bit each and 4-bit indices. It's the mode that
+// suits smooth photographic blocks best, and on its own is much faster than searching all eight.
+void CompressBlockBC7(const u8* pixels, u8* dst);
+
+// Compresses one row of blocks from row_count (1 to 4) rows of RGBA8 pixels, stride bytes apart. Pixels
+// past the right or bottom edge repeat the last column or row.
+void CompressBlockRow(BlockFormat format, const u8* rows, size_t stride, int width, int row_count, u8* dst);
+
+#endif //_BLOCK_COMPRESS_H
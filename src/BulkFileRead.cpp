@@ -0,0 +1,116 @@
+#include "BulkFileRead.h"
+#include "Platform/Platform.h"
+#include <mutex>
+#include <condition_variable>
+
+// Files read but not yet handed back by their jobs. The reader stops here and waits if the jobs fall
+// behind, so a fast disk can't pull a whole folder into memory ahead of the decoders.
+#define BULK_READ_MAX_PENDING 64
+
+#define BULK_READ_QUEUE_DEPTH 128
+
+struct BulkRead
+{
+	const char* const* file_paths;
+	BulkReadFunction function;
+	void* user_data;
+
+	JobCounter counter;
+	std::atomic<int> failed_count;
+	std::atomic<u64> byte_count;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	int pending_count;
+};
+
+struct BulkReadItem
+{
+	BulkRead* bulk;
+	int index;
+	void* data;
+	u64 size;
+};
+
+static void FinishBulkFile(BulkRead* bulk, int index, void* data, u64 size)
+{
+	if (data) bulk->byte_count += size;
+	else ++bulk->failed_count;
+	bulk->function(index, data, size, bulk->user_data);
+}
+
+static void RunBulkReadItem(void* data)
+{
+	BulkReadItem* item = (BulkReadItem*)data;
+	BulkRead* bulk = item->bulk;
+	FinishBulkFile(bulk, item->index, item->data, item->size);
+	free(item);
+
+	std::lock_guard<std::mutex> lock(bulk->mutex);
+	--bulk->pending_count;
+	bulk->cv.notify_one();
+}
+
+// Called on the reading thread as each file completes.
+static void OnBulkFileRead(int index, void* data, u64 size, void* user_data)
+{
+	BulkRead* bulk = (BulkRead*)user_data;
+	{
+		std::unique_lock<std::mutex> lock(bulk->mutex);
+		bulk->cv.wait(lock, [bulk] { return bulk->pending_count < BULK_READ_MAX_PENDING; });
+		++bulk->pending_count;
+	}
+
+	BulkReadItem* item = (BulkReadItem*)malloc(sizeof(BulkReadItem)); // @malloc
+	item->bulk = bulk;
+	item->index = index;
+	item->data = data;
+	item->size = size;
+	PushJob(RunBulkReadItem, item, &bulk->counter);
+}
+
+static void ReadBulkFileRange(int begin, int end, void* data)
+{
+	BulkRead* bulk = (BulkRead*)data;
+	for (int i = begin; i < end; ++i)
+	{
+		const char* file_path = bulk->file_paths[i];
+		s64 size = Platform::GetFileSize(file_path);
+		void* buffer = (size >= 0) ? malloc(size ? (size_t)size : 1) : 0; // @malloc
+		if (buffer && size && !Platform::ReadFileToBuffer(file_path, buffer, (u64)size))
+		{
+			free(buffer);
+			buffer = 0;
+		}
+		FinishBulkFile(bulk, i, buffer, buffer ? (u64)size : 0);
+	}
+}
+
+void ReadFilesInBulk(const char* const* file_paths, int file_count, BulkReadFunction function, void* user_data, BulkReadBackend backend, BulkReadStats* stats)
+{
+	assert(file_paths && function);
+	BulkRead bulk;
+	bulk.file_paths = file_paths;
+	bulk.function = function;
+	bulk.user_data = user_data;
+	bulk.counter.pending = 0;
+	bulk.failed_count = 0;
+	bulk.byte_count = 0;
+	bulk.pending_count = 0;
+
+	bool used_async_io = false;
+	if (backend == BulkReadBackend::Auto && file_count > 0)
+	{
+		used_async_io = Platform::ReadFilesAsync(file_paths, file_count, BULK_READ_QUEUE_DEPTH, OnBulkFileRead, &bulk);
+		WaitForJobs(&bulk.counter);
+	}
+	if (!used_async_io) ParallelFor(file_count, 1, ReadBulkFileRange, &bulk);
+
+	if (stats)
+	{
+		stats->file_count = file_count;
+		stats->failed_count = bulk.failed_count;
+		stats->byte_count = bulk.byte_count;
+		stats->used_async_io = used_async_io;
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef _BULK_FILE_READ_H
+#define _BULK_FILE_READ_H
+
+#include "Core/JobSystem.h"
+
+// Reads a whole batch of files and hands each one to a job as soon as it's in, so work on the first
+// files (usually decoding) overlaps the reads of the rest. Where the platform has a batched reader
+// (io_uring on Linux) one thread does all the I/O; elsewhere every file is read on a job by itself.
+
+// Runs as a job, once per file. data is a malloc'd copy of the whole file that the function takes
+// ownership of, or null if the file couldn't be read.
+typedef void (*BulkReadFunction)(int index, void* data, u64 size, void* user_data);
+
+enum class BulkReadBackend : u8
+{
+	Auto = 0, // Platform::ReadFilesAsync if it works, jobs otherwise.
+	Jobs // Always read on jobs, for comparisons.
+};
+
+struct BulkReadStats
+{
+	int file_count;
+	int failed_count;
+	u64 byte_count;
+	bool used_async_io; // Whether Platform::ReadFilesAsync did the reading.
+};
+
+// Blocks until every file has been read and every call to function has returned. stats is optional.
+void ReadFilesInBulk(const char* const* file_paths, int file_count, BulkReadFunction function, void* user_data, BulkReadBackend backend, BulkReadStats* stats);
+
+#endif //_BULK_FILE_READ_H
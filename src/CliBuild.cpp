@@ -0,0 +1,36 @@
+
+// Unity build for the headless command-line tool (CliMain.cpp). It is the same code as UnityBuild.cpp
+// minus ImGui, D3D and anything else that needs a window, so it also builds on platforms the viewer
+// doesn't run on.
+#define CORE_HEADLESS
+
+// Core stuff.
+#include "Core/EngineCore.cpp"
+#include "Core/JobSystem.cpp"
+#include "Core/FrameScheduler.cpp"
+
+// Platform stuff.
+#include "Platform/Platform.cpp"
+
+// Decoding, encoding and analysis.
+#include "ImageDecode.cpp"
+#include "ThumbnailDecode.cpp"
+#include "ProgressiveDecode.cpp"
+#include "ThumbnailCache.cpp"
+#include "MipChain.cpp"
+#include "UploadScheduler.cpp"
+#include "Deflate.cpp"
+#include "EncoderFile.cpp"
+#include "PngWriter.cpp"
+#include "SimpleImageWriters.cpp"
+#include "JpegWriter.cpp"
+#include "BlockCompress.cpp"
+#include "DdsWriter.cpp"
+#include "ImageExport.cpp"
+#include "ImageStats.cpp"
+#include "ImageDiff.cpp"
+#include "ImageSsim.cpp"
+#include "BulkFileRead.cpp"
+
+// Entry point.
+#include "CliMain.cpp"
@@ -0,0 +1,1032 @@
+// Headless entry point, built by CliBuild.cpp. It drives the same decode, export and comparison code as
+// the viewer, so batch jobs on build machines produce exactly what the GUI would.
+#include "ImageDecode.h"
+#include "ImageExport.h"
+#include "ImageDiff.h"
+#include "ImageSsim.h"
+#include "BulkFileRead.h"
+#include "ThumbnailDecode.h"
+#include "MipChain.h"
+#include "PngWriter.h"
+#include "ImageStats.h"
+#include "Core/CpuFeatures.h"
+#include "Platform/Platform.h"
+#include <math.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#define CLI_DEFAULT_MEMORY_MB 1024
+
+// Exit codes. Differences found by diff count as failures, so scripts can use it as a regression check.
+#define CLI_EXIT_SUCCESS 0
+#define CLI_EXIT_FAILURE 1
+#define CLI_EXIT_USAGE 2
+
+static void PrintCliUsage()
+{
+	Print("Usage:\n"
+		  "  imagecli convert [options] <inputs...>\n"
+		  "      Decodes each input, optionally crops it, and encodes it into the output directory under the\n"
+		  "      same name with the new extension. An input of @file reads paths from file, one per line.\n"
+		  "    -o, --output <dir>     Output directory (required)\n"
+		  "    -f, --format <type>    png, bmp, tga, jpg, hdr or dds (default png)\n"
+		  "    --crop <x,y,w,h>       Region to keep; images it doesn't fit inside fail\n"
+		  "    --thumbnail <size>     Shrink to fit in size x size first, using the fast thumbnail decode\n"
+		  "    --level <1-9>          PNG compression level\n"
+		  "    --quality <1-100>      JPEG quality\n"
+		  "    --full-chroma          JPEG without chroma subsampling\n"
+		  "    --rle                  Run-length encoded TGA\n"
+		  "    --block <bc1|bc3|bc7>  DDS block format (default bc7)\n"
+		  "    -j, --jobs <n>         Worker threads (default: one per hardware thread)\n"
+		  "    --memory <mb>          Memory that images in flight may use (default 1024)\n"
+		  "    -v, --verbose          Print every file as it is written\n"
+		  "\n"
+		  "  imagecli diff [options] <a> <b>\n"
+		  "      Compares two images of the same size. Exits with 1 if they differ.\n"
+		  "    --threshold <t>        Fraction of full scale a channel may differ by (default 0)\n"
+		  "    --ssim                 Also compute SSIM and MS-SSIM\n"
+		  "    --min-ssim <s>         Pass if SSIM is at least s, however many pixels differ\n"
+		  "    --mask <file.png>      Write the mismatch mask\n"
+		  "\n"
+		  "  imagecli scan [options] <inputs...>\n"
+		  "      Reads every input as fast as possible and reports the throughput. Takes @file inputs too.\n"
+		  "    --decode               Decode each file as well, the way opening a folder would\n"
+		  "    --cold                 Drop the inputs from the OS file cache first (Linux)\n"
+		  "    --no-async             Read on worker threads even where io_uring is available\n"
+		  "    -j, --jobs <n>         Worker threads (default: one per hardware thread)\n"
+		  "\n"
+		  "  imagecli bench decode [options] <inputs...>\n"
+		  "      Decodes each input in turn and reports the time to pixels and the peak memory use. Takes\n"
+		  "      @file inputs too. Peak memory only ever goes up, so compare the two paths in separate runs.\n"
+		  "    --stdio                Let stb_image read the files through stdio instead of mapping them\n"
+		  "\n"
+		  "  imagecli bench mips [options] <input>\n"
+		  "      Builds the mip chain of the input with the scalar box filter and each SIMD one, and reports\n"
+		  "      the best time of each in GB/s of source pixels.\n"
+		  "    --runs <n>             Builds per kernel (default 5)\n"
+		  "    -j, --jobs <n>         Worker threads (default: one per hardware thread)\n"
+		  "\n"
+		  "  imagecli bench png [options] <input>\n"
+		  "      Encodes the input as an 8-bit PNG at every compress level, with PngWriter and with\n"
+		  "      stb_image_write, and compares their time and size.\n"
+		  "    --level <n>            Only this compress level (1 to 9)\n"
+		  "    -o, --output <file>    Scratch file to write, deleted afterwards (default imagecli_bench.png)\n"
+		  "    -j, --jobs <n>         Worker threads (default: one per hardware thread)\n"
+		  "\n"
+		  "  imagecli bench stats [options] <input>\n"
+		  "      Times histograms and stats of the whole input, building the tile cache they come from, and\n"
+		  "      random selections from that cache against scanning each selection from scratch.\n"
+		  "    --queries <n>          Random selections to time (default 200)\n"
+		  "    -j, --jobs <n>         Worker threads (default: one per hardware thread)\n"
+		  "\n"
+		  "  imagecli bench ssim [options] <a> [b]\n"
+		  "      Computes SSIM and MS-SSIM of the two inputs (or of one with itself) with the scalar filter\n"
+		  "      and the AVX2 one, and reports the best time of each in megapixels per second.\n"
+		  "    --runs <n>             Comparisons per kernel (default 5)\n"
+		  "    -j, --jobs <n>         Worker threads (default: one per hardware thread)\n");
+}
+
+static double GetCliTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool ParseCliInt(const char* text, int min_value, int max_value, int* value)
+{
+	char* end = 0;
+	long result = strtol(text, &end, 10);
+	if (end == text || *end || result < min_value || result > max_value) return false;
+	*value = (int)result;
+	return true;
+}
+
+static bool ParseCliDouble(const char* text, double* value)
+{
+	char* end = 0;
+	double result = strtod(text, &end);
+	if (end == text || *end) return false;
+	*value = result;
+	return true;
+}
+
+static bool ParseCliCrop(const char* text, int* crop)
+{
+	char extra;
+	if (sscanf(text, "%d,%d,%d,%d%c", &crop[0], &crop[1], &crop[2], &crop[3], &extra) != 4) return false;
+	return crop[0] >= 0 && crop[1] >= 0 && crop[2] > 0 && crop[3] > 0;
+}
+
+static bool ParseCliFormat(const char* text, ImageExportParams::FileType* type)
+{
+	static const char* names[] = {"png", "bmp", "tga", "jpg", "hdr", "dds"};
+	for (int i = 0; i < (int)ARRAYCOUNT(names); ++i)
+	{
+		if (strcmp(text, names[i]) == 0)
+		{
+			*type = (ImageExportParams::FileType)(i + 1);
+			return true;
+		}
+	}
+	if (strcmp(text, "jpeg") == 0)
+	{
+		*type = ImageExportParams::FileType::JPG;
+		return true;
+	}
+	return false;
+}
+
+static const char* GetCliExtension(ImageExportParams::FileType type)
+{
+	switch (type)
+	{
+		case ImageExportParams::FileType::PNG: return "png";
+		case ImageExportParams::FileType::BMP: return "bmp";
+		case ImageExportParams::FileType::TGA: return "tga";
+		case ImageExportParams::FileType::JPG: return "jpg";
+		case ImageExportParams::FileType::HDR: return "hdr";
+		case ImageExportParams::FileType::DDS: return "dds";
+		default: return "";
+	}
+}
+
+static char* CopyCliString(const char* text, size_t length)
+{
+	char* result = (char*)malloc(length + 1); // @malloc
+	memcpy(result, text, length);
+	result[length] = 0;
+	return result;
+}
+
+// Appends every input to paths, expanding @file arguments into the lines of the file. Each path is a
+// heap copy.
+static bool AddCliInput(const char* arg, char*** paths)
+{
+	if (arg[0] != '@')
+	{
+		arrput(*paths, CopyCliString(arg, strlen(arg)));
+		return true;
+	}
+
+	FILE* list = fopen(arg + 1, "r");
+	if (!list)
+	{
+		ErrPrintF("Unable to open input list %s\n", arg + 1);
+		return false;
+	}
+	char line[4096];
+	while (fgets(line, sizeof(line), list))
+	{
+		size_t length = strlen(line);
+		while (length && (line[length - 1] == '\n' || line[length - 1] == '\r')) --length;
+		if (length) arrput(*paths, CopyCliString(line, length));
+	}
+	fclose(list);
+	return true;
+}
+
+// <output_dir>/<input name without extension>.<extension>
+static char* BuildCliOutputPath(const char* output_dir, const char* input_path, const char* extension)
+{
+	const char* name = input_path;
+	for (const char* c = input_path; *c; ++c)
+	{
+		if (*c == '/' || *c == '\\') name = c + 1;
+	}
+	const char* dot = strrchr(name, '.');
+	int stem_length = dot ? (int)(dot - name) : (int)strlen(name);
+
+	size_t dir_length = strlen(output_dir);
+	bool has_separator = dir_length && (output_dir[dir_length - 1] == '/' || output_dir[dir_length - 1] == '\\');
+	size_t size = dir_length + 1 + stem_length + 1 + strlen(extension) + 1;
+	char* result = (char*)malloc(size); // @malloc
+	snprintf(result, size, "%s%s%.*s.%s", output_dir, has_separator ? "" : "/", stem_length, name, extension);
+	return result;
+}
+
+// Caps the memory held by images in flight. Conversions reserve their share before they are queued and
+// hand it back once they are done, so the dispatcher simply blocks while the budget is used up.
+struct CliMemoryBudget
+{
+	std::mutex mutex;
+	std::condition_variable released;
+	u64 limit;
+	u64 in_use;
+};
+
+// Reservations bigger than the whole budget are clamped to it, so an image that doesn't fit on its own
+// still runs, just with nothing else alongside it. Returns what was actually reserved.
+static u64 ReserveCliMemory(CliMemoryBudget* budget, u64 size)
+{
+	if (size > budget->limit) size = budget->limit;
+	std::unique_lock<std::mutex> lock(budget->mutex);
+	while (budget->in_use + size > budget->limit) budget->released.wait(lock);
+	budget->in_use += size;
+	return size;
+}
+
+static void ReleaseCliMemory(CliMemoryBudget* budget, u64 size)
+{
+	{
+		std::lock_guard<std::mutex> lock(budget->mutex);
+		budget->in_use -= size;
+	}
+	budget->released.notify_all();
+}
+
+struct CliConvert
+{
+	ImageExportParams params;
+	bool has_crop;
+	int crop[4]; // x, y, width, height.
+	int thumbnail_size; // 0 decodes at full size.
+	bool is_verbose;
+
+	CliMemoryBudget budget;
+	std::mutex print_mutex; // PrintF shares one buffer.
+	std::atomic<int> converted_count;
+	std::atomic<int> failed_count;
+};
+
+struct CliConvertTask
+{
+	CliConvert* convert;
+	const char* input_path;
+	char* output_path;
+	u64 reserved;
+};
+
+static void ReportCliConversion(CliConvert* convert, const char* input_path, const char* output_path, const char* failure)
+{
+	if (failure) convert->failed_count.fetch_add(1);
+	else convert->converted_count.fetch_add(1);
+
+	std::lock_guard<std::mutex> lock(convert->print_mutex);
+	if (failure)
+	{
+		ErrPrintF("%s: %s\n", input_path, failure);
+	}
+	else if (convert->is_verbose)
+	{
+		PrintF("%s -> %s\n", input_path, output_path);
+	}
+}
+
+static void RunCliConvertTask(void* data)
+{
+	CliConvertTask* task = (CliConvertTask*)data;
+	CliConvert* convert = task->convert;
+
+	DecodedImage image = {};
+	const char* failure = 0;
+	bool is_decoded = convert->thumbnail_size ? DecodeThumbnail(task->input_path, convert->thumbnail_size, &image) : DecodeImageFile(task->input_path, &image);
+	if (is_decoded)
+	{
+		int x = 0, y = 0, width = image.width, height = image.height;
+		if (convert->has_crop)
+		{
+			x = convert->crop[0];
+			y = convert->crop[1];
+			width = convert->crop[2];
+			height = convert->crop[3];
+		}
+
+		if ((s64)x + width > image.width || (s64)y + height > image.height) failure = "crop region doesn't fit inside the image";
+		else if (!ExportImageRegion(&image, x, y, width, height, task->output_path, convert->params)) failure = "unable to write output";
+		FreeDecodedImage(&image);
+	}
+	else
+	{
+		failure = "unable to decode";
+	}
+
+	ReportCliConversion(convert, task->input_path, task->output_path, failure);
+	ReleaseCliMemory(&convert->budget, task->reserved);
+	free(task->output_path);
+	free(task);
+}
+
+static int RunCliConvert(int argc, char** argv)
+{
+	CliConvert* convert = new CliConvert();
+	convert->params.type = ImageExportParams::FileType::PNG;
+	const char* output_dir = 0;
+	int job_count = 0;
+	int memory_mb = CLI_DEFAULT_MEMORY_MB;
+	char** inputs = 0;
+	bool is_valid = true;
+
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : 0;
+		bool takes_value = true;
+		if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) output_dir = value;
+		else if (strcmp(arg, "-f") == 0 || strcmp(arg, "--format") == 0) is_valid = value && ParseCliFormat(value, &convert->params.type);
+		else if (strcmp(arg, "--crop") == 0) is_valid = convert->has_crop = (value && ParseCliCrop(value, convert->crop));
+		else if (strcmp(arg, "--thumbnail") == 0) is_valid = value && ParseCliInt(value, 1, 65535, &convert->thumbnail_size);
+		else if (strcmp(arg, "--level") == 0) is_valid = value && ParseCliInt(value, 1, 9, &convert->params.PNG.compress_level);
+		else if (strcmp(arg, "--quality") == 0) is_valid = value && ParseCliInt(value, 1, 100, &convert->params.JPG.quality);
+		else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) is_valid = value && ParseCliInt(value, 1, 1024, &job_count);
+		else if (strcmp(arg, "--memory") == 0) is_valid = value && ParseCliInt(value, 1, S32_MAX, &memory_mb);
+		else if (strcmp(arg, "--block") == 0)
+		{
+			if (value && strcmp(value, "bc1") == 0) convert->params.DDS.format = BlockFormat::BC1;
+			else if (value && strcmp(value, "bc3") == 0) convert->params.DDS.format = BlockFormat::BC3;
+			else if (value && strcmp(value, "bc7") == 0) convert->params.DDS.format = BlockFormat::BC7;
+			else is_valid = false;
+		}
+		else
+		{
+			takes_value = false;
+			if (strcmp(arg, "--full-chroma") == 0) convert->params.JPG.use_full_chroma = true;
+			else if (strcmp(arg, "--rle") == 0) convert->params.TGA.use_rle = true;
+			else if (strcmp(arg, "-v") == 0 || strcmp(arg, "--verbose") == 0) convert->is_verbose = true;
+			else if (arg[0] == '-' && arg[1]) is_valid = false;
+			else is_valid = AddCliInput(arg, &inputs);
+		}
+		if (takes_value)
+		{
+			if (!value) is_valid = false;
+			++i;
+		}
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && (!output_dir || !arrlen(inputs)))
+	{
+		ErrPrint("convert needs an output directory and at least one input.\n");
+		is_valid = false;
+	}
+	if (!is_valid)
+	{
+		for (int i = 0; i < arrlen(inputs); ++i) free(inputs[i]);
+		arrfree(inputs);
+		delete convert;
+		return CLI_EXIT_USAGE;
+	}
+
+	// The dispatcher mostly sleeps on the budget, so every hardware thread gets a worker.
+	if (!job_count)
+	{
+		job_count = (int)std::thread::hardware_concurrency();
+		if (job_count < 1) job_count = 1;
+	}
+	StartJobSystem(job_count);
+	convert->budget.limit = (u64)memory_mb << 20;
+
+	double start_time = GetCliTime();
+	int input_count = (int)arrlen(inputs);
+	const char* extension = GetCliExtension(convert->params.type);
+	JobCounter counter = {};
+	for (int i = 0; i < input_count; ++i)
+	{
+		int width, height;
+		PixelLayout layout;
+		if (!ProbeImageFile(inputs[i], &width, &height, &layout))
+		{
+			ReportCliConversion(convert, inputs[i], 0, "not a supported image");
+			continue;
+		}
+
+		// stb_image holds roughly a second copy of the pixels while it decodes (the unfiltered PNG rows,
+		// or the JPEG component planes), and the encoders only ever buffer a band, so twice the decoded
+		// size covers a conversion.
+		u64 estimate = (u64)width * (u64)height * (u64)GetPixelSize(layout) * 2;
+
+		CliConvertTask* task = (CliConvertTask*)malloc(sizeof(CliConvertTask)); // @malloc
+		task->convert = convert;
+		task->input_path = inputs[i];
+		task->output_path = BuildCliOutputPath(output_dir, inputs[i], extension);
+		task->reserved = ReserveCliMemory(&convert->budget, estimate);
+		PushJob(RunCliConvertTask, task, &counter);
+	}
+	WaitForJobs(&counter);
+	double elapsed = GetCliTime() - start_time;
+
+	int failed_count = convert->failed_count.load();
+	PrintF("Converted %d of %d files in %.2f s.\n", convert->converted_count.load(), input_count, elapsed);
+	StopJobSystem();
+
+	for (int i = 0; i < input_count; ++i) free(inputs[i]);
+	arrfree(inputs);
+	delete convert;
+	return failed_count ? CLI_EXIT_FAILURE : CLI_EXIT_SUCCESS;
+}
+
+static int RunCliDiff(int argc, char** argv)
+{
+	const char* paths[2] = {};
+	int path_count = 0;
+	const char* mask_path = 0;
+	double threshold = 0.0;
+	double min_ssim = -1.0;
+	bool with_ssim = false;
+	bool is_valid = true;
+
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : 0;
+		bool takes_value = true;
+		if (strcmp(arg, "--threshold") == 0) is_valid = value && ParseCliDouble(value, &threshold) && threshold >= 0.0;
+		else if (strcmp(arg, "--min-ssim") == 0) is_valid = with_ssim = (value && ParseCliDouble(value, &min_ssim));
+		else if (strcmp(arg, "--mask") == 0) mask_path = value;
+		else
+		{
+			takes_value = false;
+			if (strcmp(arg, "--ssim") == 0) with_ssim = true;
+			else if (arg[0] == '-' || path_count == 2) is_valid = false;
+			else paths[path_count++] = arg;
+		}
+		if (takes_value)
+		{
+			if (!value) is_valid = false;
+			++i;
+		}
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && path_count != 2)
+	{
+		ErrPrint("diff needs exactly two images.\n");
+		is_valid = false;
+	}
+	if (!is_valid) return CLI_EXIT_USAGE;
+
+	StartJobSystem();
+	DecodedImage images[2] = {};
+	int result = CLI_EXIT_USAGE;
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!DecodeImageFile(paths[i], &images[i])) ErrPrintF("Unable to decode %s\n", paths[i]);
+	}
+
+	ImageDiff diff = {};
+	ImageDiffParams params = {};
+	params.threshold = threshold;
+	params.keep_mask = (mask_path != 0);
+	double start_time = GetCliTime();
+	if (!images[0].pixels || !images[1].pixels)
+	{
+		// Already reported.
+	}
+	else if (!DiffImages(&images[0], &images[1], params, &diff))
+	{
+		ErrPrintF("Sizes differ: %d x %d and %d x %d\n", images[0].width, images[0].height, images[1].width, images[1].height);
+	}
+	else
+	{
+		double diff_time = GetCliTime() - start_time;
+		double pixel_count = (double)diff.width * (double)diff.height;
+		PrintF("Compared %d x %d as %d x %d-bit in %.1f ms\n", diff.width, diff.height, diff.layout.channel_count, GetPixelTypeSize(diff.layout.type) * 8, diff_time * 1000.0);
+		if (isinf(diff.total_psnr)) Print("Identical\n");
+		else PrintF("PSNR: %.2f dB\n", diff.total_psnr);
+		PrintF("Mismatched pixels: %llu (%.4f%%)\n", (unsigned long long)diff.mismatch_count, 100.0 * (double)diff.mismatch_count / pixel_count);
+		for (int c = 0; c < diff.layout.channel_count; ++c)
+		{
+			PrintF("Channel %d: max error %g, PSNR %.2f dB\n", c, diff.max_error[c], diff.psnr[c]);
+		}
+		bool is_match = (diff.mismatch_count == 0);
+
+		if (with_ssim)
+		{
+			SsimResult ssim = {};
+			start_time = GetCliTime();
+			if (ComputeSsim(&images[0], &images[1], &ssim))
+			{
+				PrintF("SSIM: %.5f, MS-SSIM: %.5f (%d scales) in %.1f ms\n", ssim.ssim, ssim.ms_ssim, ssim.scale_count, (GetCliTime() - start_time) * 1000.0);
+				if (min_ssim >= 0.0) is_match = (ssim.ssim >= min_ssim);
+			}
+			else
+			{
+				Print("SSIM: images are smaller than the window\n");
+			}
+		}
+
+		if (mask_path)
+		{
+			DecodedImage mask = {diff.mask, diff.width, diff.height, {1, PixelType::U8}};
+			ImageExportParams mask_params = {};
+			mask_params.type = ImageExportParams::FileType::PNG;
+			if (!ExportImageRegion(&mask, 0, 0, mask.width, mask.height, mask_path, mask_params)) ErrPrintF("Unable to write %s\n", mask_path);
+		}
+		FreeImageDiff(&diff);
+		result = is_match ? CLI_EXIT_SUCCESS : CLI_EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < 2; ++i) FreeDecodedImage(&images[i]);
+	StopJobSystem();
+	return result;
+}
+
+struct CliScan
+{
+	bool with_decode;
+	std::atomic<int> decode_failed_count;
+};
+
+static void ScanCliFile(int, void* data, u64 size, void* user_data)
+{
+	CliScan* scan = (CliScan*)user_data;
+	if (data && scan->with_decode)
+	{
+		DecodedImage image;
+		if (DecodeImageFromMemory(data, size, &image)) FreeDecodedImage(&image);
+		else ++scan->decode_failed_count;
+	}
+	free(data);
+}
+
+// A benchmark of the bulk reader, in files per second, for comparing the io_uring and thread backends
+// on a warm and a cold cache.
+static int RunCliScan(int argc, char** argv)
+{
+	CliScan scan = {};
+	BulkReadBackend backend = BulkReadBackend::Auto;
+	bool is_cold = false;
+	int job_count = 0;
+	char** inputs = 0;
+	bool is_valid = true;
+
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 1024, &job_count);
+			++i;
+		}
+		else if (strcmp(arg, "--decode") == 0) scan.with_decode = true;
+		else if (strcmp(arg, "--cold") == 0) is_cold = true;
+		else if (strcmp(arg, "--no-async") == 0) backend = BulkReadBackend::Jobs;
+		else if (arg[0] == '-' && arg[1]) is_valid = false;
+		else is_valid = AddCliInput(arg, &inputs);
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && !arrlen(inputs))
+	{
+		ErrPrint("scan needs at least one input.\n");
+		is_valid = false;
+	}
+	if (!is_valid)
+	{
+		for (int i = 0; i < arrlen(inputs); ++i) free(inputs[i]);
+		arrfree(inputs);
+		return CLI_EXIT_USAGE;
+	}
+
+	int input_count = (int)arrlen(inputs);
+	if (is_cold)
+	{
+		int dropped_count = 0;
+		for (int i = 0; i < input_count; ++i) dropped_count += Platform::DropFileCache(inputs[i]) ? 1 : 0;
+		if (dropped_count < input_count) ErrPrintF("Couldn't drop %d of the files from the cache.\n", input_count - dropped_count);
+	}
+
+	// With io_uring the calling thread only submits and hands out buffers, so it doesn't need a core.
+	if (!job_count)
+	{
+		job_count = (int)std::thread::hardware_concurrency();
+		if (job_count < 1) job_count = 1;
+	}
+	StartJobSystem(job_count);
+
+	double start_time = GetCliTime();
+	BulkReadStats stats = {};
+	ReadFilesInBulk(inputs, input_count, ScanCliFile, &scan, backend, &stats);
+	double elapsed = GetCliTime() - start_time;
+	StopJobSystem();
+
+	double megabytes = (double)stats.byte_count / (1024.0 * 1024.0);
+	PrintF("Read %d files (%.1f MB) in %.3f s with %s: %.0f files/s, %.1f MB/s\n", stats.file_count - stats.failed_count, megabytes, elapsed,
+		   stats.used_async_io ? "io_uring" : "worker threads", (double)stats.file_count / elapsed, megabytes / elapsed);
+	int failed_count = stats.failed_count + scan.decode_failed_count.load();
+	if (stats.failed_count) ErrPrintF("%d files couldn't be read.\n", stats.failed_count);
+	if (scan.decode_failed_count) ErrPrintF("%d files couldn't be decoded.\n", scan.decode_failed_count.load());
+
+	for (int i = 0; i < input_count; ++i) free(inputs[i]);
+	arrfree(inputs);
+	return failed_count ? CLI_EXIT_FAILURE : CLI_EXIT_SUCCESS;
+}
+
+// Decodes files one at a time, for comparing the time to pixels and the peak memory of decoding from a
+// mapped file against letting stb_image read through stdio.
+static int RunCliBenchDecode(int argc, char** argv)
+{
+	bool is_buffered = false;
+	char** inputs = 0;
+	bool is_valid = true;
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "--stdio") == 0) is_buffered = true;
+		else if (arg[0] == '-' && arg[1]) is_valid = false;
+		else is_valid = AddCliInput(arg, &inputs);
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && !arrlen(inputs))
+	{
+		ErrPrint("bench decode needs at least one input.\n");
+		is_valid = false;
+	}
+	if (!is_valid)
+	{
+		for (int i = 0; i < arrlen(inputs); ++i) free(inputs[i]);
+		arrfree(inputs);
+		return CLI_EXIT_USAGE;
+	}
+
+	// One file at a time, so the peak is that of the biggest decode rather than of several at once.
+	int input_count = (int)arrlen(inputs);
+	int failed_count = 0;
+	u64 start_memory = Platform::GetPeakMemoryUsage();
+	double total_time = 0.0;
+	double max_time = 0.0;
+	double pixel_megabytes = 0.0;
+	for (int i = 0; i < input_count; ++i)
+	{
+		DecodedImage image;
+		double start_time = GetCliTime();
+		bool is_decoded = is_buffered ? DecodeImageFileBuffered(inputs[i], &image) : DecodeImageFile(inputs[i], &image);
+		double elapsed = GetCliTime() - start_time;
+		if (!is_decoded)
+		{
+			ErrPrintF("Unable to decode %s\n", inputs[i]);
+			++failed_count;
+			continue;
+		}
+		total_time += elapsed;
+		if (elapsed > max_time) max_time = elapsed;
+		pixel_megabytes += (double)image.width * image.height * GetPixelSize(image.layout) / (1024.0 * 1024.0);
+		FreeDecodedImage(&image);
+	}
+	u64 peak_memory = Platform::GetPeakMemoryUsage();
+
+	int decoded_count = input_count - failed_count;
+	PrintF("Decoded %d files (%.1f MB of pixels) %s in %.3f s: %.1f ms per file on average, %.1f ms at most\n", decoded_count, pixel_megabytes,
+		   is_buffered ? "through stdio" : "from mapped files", total_time, decoded_count ? total_time * 1000.0 / decoded_count : 0.0, max_time * 1000.0);
+	if (peak_memory) PrintF("Peak memory: %.1f MB, %.1f MB above where it started\n", peak_memory / (1024.0 * 1024.0), (peak_memory - start_memory) / (1024.0 * 1024.0));
+
+	for (int i = 0; i < input_count; ++i) free(inputs[i]);
+	arrfree(inputs);
+	return failed_count ? CLI_EXIT_FAILURE : CLI_EXIT_SUCCESS;
+}
+
+// Builds the mip chain of one image with each box filter kernel in turn, in GB/s of source pixels, so the
+// SIMD kernels can be compared against the scalar one they replaced.
+static int RunCliBenchMips(int argc, char** argv)
+{
+	int run_count = 5;
+	int job_count = 0;
+	const char* input = 0;
+	bool is_valid = true;
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 1024, &job_count);
+			++i;
+		}
+		else if (strcmp(arg, "--runs") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 1000, &run_count);
+			++i;
+		}
+		else if (arg[0] == '-' && arg[1]) is_valid = false;
+		else if (!input) input = arg;
+		else is_valid = false;
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && !input)
+	{
+		ErrPrint("bench mips needs an input.\n");
+		is_valid = false;
+	}
+	if (!is_valid) return CLI_EXIT_USAGE;
+
+	DecodedImage image;
+	if (!DecodeImageFile(input, &image))
+	{
+		ErrPrintF("Unable to decode %s\n", input);
+		return CLI_EXIT_FAILURE;
+	}
+
+	struct
+	{
+		MipKernel kernel;
+		const char* name;
+	} kernels[] = {{MipKernel::Scalar, "scalar"}, {MipKernel::SSE2, "SSE2"}, {MipKernel::AVX2, "AVX2"}};
+	int kernel_count = CpuHasAVX2() ? 3 : 2;
+#ifndef CORE_SIMD_X86
+	kernel_count = 1;
+#endif
+
+	StartJobSystem(job_count);
+	double gigabytes = (double)image.width * image.height * GetPixelSize(image.layout) / (1024.0 * 1024.0 * 1024.0);
+	PrintF("%s: %dx%d, %d runs each, best of them:\n", input, image.width, image.height, run_count);
+	double scalar_time = 0.0;
+	for (int k = 0; k < kernel_count; ++k)
+	{
+		double best_time = 0.0;
+		for (int run = 0; run < run_count; ++run)
+		{
+			MipChain chain;
+			double start_time = GetCliTime();
+			BuildMipChain(image.pixels, image.layout, image.width, image.height, &chain, kernels[k].kernel);
+			double elapsed = GetCliTime() - start_time;
+			FreeMipChain(&chain);
+			if (run == 0 || elapsed < best_time) best_time = elapsed;
+		}
+		if (k == 0) scalar_time = best_time;
+		PrintF("  %-8s %8.2f ms  %6.2f GB/s  %5.2fx\n", kernels[k].name, best_time * 1000.0, gigabytes / best_time, scalar_time / best_time);
+	}
+	StopJobSystem();
+	FreeDecodedImage(&image);
+	return CLI_EXIT_SUCCESS;
+}
+
+// Encodes one image at each compress level with PngWriter and with stb_image_write, which the exporter
+// used before, and compares their time and file size.
+static int RunCliBenchPng(int argc, char** argv)
+{
+	int job_count = 0;
+	const char* input = 0;
+	const char* output_path = "imagecli_bench.png";
+	int first_level = 1;
+	int last_level = 9;
+	bool is_valid = true;
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 1024, &job_count);
+			++i;
+		}
+		else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0)
+		{
+			is_valid = (i + 1 < argc);
+			if (is_valid) output_path = argv[++i];
+		}
+		else if (strcmp(arg, "--level") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 9, &first_level);
+			last_level = first_level;
+			++i;
+		}
+		else if (arg[0] == '-' && arg[1]) is_valid = false;
+		else if (!input) input = arg;
+		else is_valid = false;
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && !input)
+	{
+		ErrPrint("bench png needs an input.\n");
+		is_valid = false;
+	}
+	if (!is_valid) return CLI_EXIT_USAGE;
+
+	DecodedImage image;
+	if (!DecodeImageFile(input, &image))
+	{
+		ErrPrintF("Unable to decode %s\n", input);
+		return CLI_EXIT_FAILURE;
+	}
+
+	// stb_image_write only does 8-bit, so both get the same 8-bit pixels.
+	int channel_count = image.layout.channel_count;
+	size_t pixel_count = (size_t)image.width * image.height;
+	u8* pixels = (u8*)image.pixels;
+	if (image.layout.type != PixelType::U8)
+	{
+		pixels = (u8*)malloc(pixel_count * channel_count); // @malloc
+		ConvertPixelsToU8(image.pixels, image.layout, pixel_count, pixels);
+	}
+	size_t stride = (size_t)image.width * channel_count;
+
+	StartJobSystem(job_count);
+	double megabytes = (double)pixel_count * channel_count / (1024.0 * 1024.0);
+	PrintF("%s: %dx%d, %d channels, %.1f MB of pixels\n", input, image.width, image.height, channel_count, megabytes);
+	Print("  level  PngWriter                   stb_image_write             PngWriter vs stb\n");
+	bool is_written = true;
+	for (int level = first_level; level <= last_level && is_written; ++level)
+	{
+		double start_time = GetCliTime();
+		is_written = WritePng(output_path, pixels, image.width, image.height, channel_count, 8, stride, level);
+		double png_time = GetCliTime() - start_time;
+		s64 png_size = Platform::GetFileSize(output_path);
+
+		stbi_write_png_compression_level = level;
+		start_time = GetCliTime();
+		is_written = is_written && stbi_write_png(output_path, image.width, image.height, channel_count, pixels, (int)stride);
+		double stb_time = GetCliTime() - start_time;
+		s64 stb_size = Platform::GetFileSize(output_path);
+
+		PrintF("  %5d  %8.1f ms %9.2f MB     %8.1f ms %9.2f MB     %5.2fx speed, %+.1f%% size\n", level, png_time * 1000.0, png_size / (1024.0 * 1024.0),
+			   stb_time * 1000.0, stb_size / (1024.0 * 1024.0), stb_time / png_time, 100.0 * (png_size - stb_size) / stb_size);
+	}
+	StopJobSystem();
+	remove(output_path);
+
+	if (pixels != image.pixels) free(pixels);
+	FreeDecodedImage(&image);
+	if (!is_written)
+	{
+		ErrPrintF("Unable to write %s\n", output_path);
+		return CLI_EXIT_FAILURE;
+	}
+	return CLI_EXIT_SUCCESS;
+}
+
+// Times the stats the viewer shows for a selection: scanning the whole image, building the per-tile
+// cache once, and then random selections from the cache against scanning each of them from scratch.
+static int RunCliBenchStats(int argc, char** argv)
+{
+	int query_count = 200;
+	int job_count = 0;
+	const char* input = 0;
+	bool is_valid = true;
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 1024, &job_count);
+			++i;
+		}
+		else if (strcmp(arg, "--queries") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 100000, &query_count);
+			++i;
+		}
+		else if (arg[0] == '-' && arg[1]) is_valid = false;
+		else if (!input) input = arg;
+		else is_valid = false;
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && !input)
+	{
+		ErrPrint("bench stats needs an input.\n");
+		is_valid = false;
+	}
+	if (!is_valid) return CLI_EXIT_USAGE;
+
+	DecodedImage image;
+	if (!DecodeImageFile(input, &image))
+	{
+		ErrPrintF("Unable to decode %s\n", input);
+		return CLI_EXIT_FAILURE;
+	}
+
+	StartJobSystem(job_count);
+	PrintF("%s: %dx%d\n", input, image.width, image.height);
+	ImageStats stats;
+	double start_time = GetCliTime();
+	ComputeImageStats(image.pixels, image.layout, image.width, 0, 0, image.width, image.height, &stats);
+	PrintF("  Whole image from scratch:  %8.2f ms\n", (GetCliTime() - start_time) * 1000.0);
+
+	ImageStatsCache cache;
+	start_time = GetCliTime();
+	BuildImageStatsCache(&cache, image.pixels, image.layout, image.width, image.height);
+	PrintF("  Building the tile cache:   %8.2f ms\n", (GetCliTime() - start_time) * 1000.0);
+
+	// The same selections both ways, from a fixed seed so runs compare.
+	u32 seed = 12345;
+	double cached_time = 0.0;
+	double scratch_time = 0.0;
+	for (int i = 0; i < query_count; ++i)
+	{
+		int rect[4];
+		for (int j = 0; j < 4; ++j)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			rect[j] = (int)((seed >> 8) % (u32)((j % 2) ? image.height : image.width));
+		}
+		int x = (rect[0] < rect[2]) ? rect[0] : rect[2];
+		int y = (rect[1] < rect[3]) ? rect[1] : rect[3];
+		int width = abs(rect[2] - rect[0]) + 1;
+		int height = abs(rect[3] - rect[1]) + 1;
+
+		start_time = GetCliTime();
+		GetImageStats(&cache, x, y, width, height, &stats);
+		cached_time += GetCliTime() - start_time;
+		start_time = GetCliTime();
+		ComputeImageStats(image.pixels, image.layout, image.width, x, y, width, height, &stats);
+		scratch_time += GetCliTime() - start_time;
+	}
+	PrintF("  Each of %d random selections: %.3f ms from the cache, %.3f ms from scratch\n", query_count, cached_time * 1000.0 / query_count,
+		   scratch_time * 1000.0 / query_count);
+	StopJobSystem();
+
+	FreeImageStatsCache(&cache);
+	FreeDecodedImage(&image);
+	return CLI_EXIT_SUCCESS;
+}
+
+// Compares two images with each SSIM filter kernel in turn, in megapixels per second, so the AVX2 kernels
+// can be compared against the scalar ones. The results are printed too, since the kernels should agree.
+static int RunCliBenchSsim(int argc, char** argv)
+{
+	int run_count = 5;
+	int job_count = 0;
+	const char* inputs[2] = {};
+	bool is_valid = true;
+	for (int i = 0; i < argc && is_valid; ++i)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 1024, &job_count);
+			++i;
+		}
+		else if (strcmp(arg, "--runs") == 0)
+		{
+			is_valid = (i + 1 < argc) && ParseCliInt(argv[i + 1], 1, 1000, &run_count);
+			++i;
+		}
+		else if (arg[0] == '-' && arg[1]) is_valid = false;
+		else if (!inputs[0]) inputs[0] = arg;
+		else if (!inputs[1]) inputs[1] = arg;
+		else is_valid = false;
+		if (!is_valid) ErrPrintF("Invalid argument: %s\n", arg);
+	}
+	if (is_valid && !inputs[0])
+	{
+		ErrPrint("bench ssim needs an input.\n");
+		is_valid = false;
+	}
+	if (!is_valid) return CLI_EXIT_USAGE;
+	if (!inputs[1]) inputs[1] = inputs[0];
+
+	DecodedImage images[2] = {};
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!DecodeImageFile(inputs[i], &images[i]))
+		{
+			ErrPrintF("Unable to decode %s\n", inputs[i]);
+			FreeDecodedImage(&images[0]);
+			return CLI_EXIT_FAILURE;
+		}
+	}
+
+	struct
+	{
+		SsimKernel kernel;
+		const char* name;
+	} kernels[] = {{SsimKernel::Scalar, "scalar"}, {SsimKernel::AVX2, "AVX2"}};
+	int kernel_count = CpuHasAVX2() ? 2 : 1;
+
+	StartJobSystem(job_count);
+	double megapixels = (double)images[0].width * images[0].height / 1000000.0;
+	PrintF("%s vs %s: %dx%d, %d runs each, best of them:\n", inputs[0], inputs[1], images[0].width, images[0].height, run_count);
+	double scalar_time = 0.0;
+	bool is_compared = true;
+	for (int k = 0; k < kernel_count && is_compared; ++k)
+	{
+		double best_time = 0.0;
+		SsimResult result;
+		for (int run = 0; run < run_count && is_compared; ++run)
+		{
+			double start_time = GetCliTime();
+			is_compared = ComputeSsim(&images[0], &images[1], &result, kernels[k].kernel);
+			double elapsed = GetCliTime() - start_time;
+			if (run == 0 || elapsed < best_time) best_time = elapsed;
+		}
+		if (!is_compared) break;
+		if (k == 0) scalar_time = best_time;
+		PrintF("  %-8s %8.2f ms  %7.1f MP/s  %5.2fx   SSIM %.6f, MS-SSIM %.6f\n", kernels[k].name, best_time * 1000.0, megapixels / best_time,
+			   scalar_time / best_time, result.ssim, result.ms_ssim);
+	}
+	StopJobSystem();
+	FreeDecodedImage(&images[0]);
+	FreeDecodedImage(&images[1]);
+	if (!is_compared)
+	{
+		ErrPrint("The inputs differ in size, or are too small to compare.\n");
+		return CLI_EXIT_FAILURE;
+	}
+	return CLI_EXIT_SUCCESS;
+}
+
+// Benchmarks of single stages of the pipeline, each against the path it replaced.
+static int RunCliBench(int argc, char** argv)
+{
+	if (argc >= 1 && strcmp(argv[0], "decode") == 0) return RunCliBenchDecode(argc - 1, argv + 1);
+	if (argc >= 1 && strcmp(argv[0], "mips") == 0) return RunCliBenchMips(argc - 1, argv + 1);
+	if (argc >= 1 && strcmp(argv[0], "png") == 0) return RunCliBenchPng(argc - 1, argv + 1);
+	if (argc >= 1 && strcmp(argv[0], "stats") == 0) return RunCliBenchStats(argc - 1, argv + 1);
+	if (argc >= 1 && strcmp(argv[0], "ssim") == 0) return RunCliBenchSsim(argc - 1, argv + 1);
+	PrintCliUsage();
+	return CLI_EXIT_USAGE;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "convert") == 0) return RunCliConvert(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "diff") == 0) return RunCliDiff(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "scan") == 0) return RunCliScan(argc - 2, argv + 2);
+	if (argc >= 2 && strcmp(argv[1], "bench") == 0) return RunCliBench(argc - 2, argv + 2);
+	PrintCliUsage();
+	return CLI_EXIT_USAGE;
+}
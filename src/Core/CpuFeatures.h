@@ -0,0 +1,49 @@
+#ifndef _CPU_FEATURES_H
+#define _CPU_FEATURES_H
+
+// x86 SIMD support. SSE2 is part of the x64 baseline, so only AVX2 needs checking at runtime. Kernels
+// that use AVX2 intrinsics must be marked SIMD_TARGET_AVX2 so GCC/Clang will compile them without
+// -mavx2 for the whole program (MSVC allows the intrinsics anywhere).
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CORE_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CORE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_AVX2
+#endif
+
+inline bool CpuHasAVX2()
+{
+#if defined(CORE_SIMD_X86) && defined(_MSC_VER)
+	static const bool result = []
+	{
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		// The OS has to save the YMM registers (OSXSAVE + XCR0 bits 1 and 2) as well.
+		__cpuid(info, 1);
+		bool has_osxsave = (info[2] & (1 << 27)) != 0;
+		bool has_avx = (info[2] & (1 << 28)) != 0;
+		if (!has_osxsave || !has_avx || (_xgetbv(0) & 6) != 6) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}();
+	return result;
+#elif defined(CORE_SIMD_X86)
+	static const bool result = __builtin_cpu_supports("avx2");
+	return result;
+#else
+	return false;
+#endif
+}
+
+#endif //_CPU_FEATURES_H
@@ -2,8 +2,10 @@
 // Definitions for single-header libraries.
 #include "EngineCore.h"
 
+#ifndef CORE_HEADLESS
 #define GMATH_IMPLEMENTATION
 #include "GMath.h"
+#endif
 
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
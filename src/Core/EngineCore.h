@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <assert.h>
 
 // Integer typedefs.
 #define U8_MAX UINT8_MAX
@@ -55,6 +56,12 @@ StrPrintF(OUTPUT_BUFFER, OUTPUT_BUFFER_SIZE, format, __VA_ARGS__); \
 ErrPrint(OUTPUT_BUFFER);                                           \
 }
 
+// Only Windows has DebugBreak; elsewhere a trap does the same job under a debugger.
+#ifndef _WIN32
+#include <signal.h>
+#define DebugBreak() raise(SIGTRAP)
+#endif
+
 // Assert macros. TODO(Matt): Use function overloading to allow both custom message and straight asserts.
 #ifndef NDEBUG
 #define Assert(x)                                                                      \
@@ -83,7 +90,12 @@ if (Platform::ShowAssertDialog(message, __FILE__, (u32)__LINE__)) DebugBreak();
 #include "stb_ds.h"
 #include "stb_image.h"
 #include "stb_image_write.h"
+
+// GMath's vector types rely on MSVC accepting members with constructors in anonymous unions, and only the
+// GUI uses them, so headless builds (CliBuild.cpp) leave it out.
+#ifndef CORE_HEADLESS
 #include "GMath.h"
+#endif
 
 // Helper for bitfield enum types. Takes an enum name (x) and underlying type
 // (y), and overloads the bitwise operators.
@@ -0,0 +1,88 @@
+#include "Core/FrameScheduler.h"
+
+#include <atomic>
+#include <chrono>
+
+typedef std::chrono::steady_clock FrameClock;
+
+struct FrameScheduler
+{
+	int pending_frames;
+	bool has_deadline;
+	FrameClock::time_point deadline;
+	std::atomic<bool> is_woken; // Set by WakeFrameScheduler, possibly from a worker.
+
+	FrameWakeFunction wake_function;
+	void* wake_data;
+
+	FrameSchedulerStats stats;
+};
+
+// The first frame always renders.
+static FrameScheduler g_frame_scheduler = {1, false, FrameClock::time_point(), {false}, 0, 0, {}};
+
+void SetFrameWakeFunction(FrameWakeFunction function, void* data)
+{
+	g_frame_scheduler.wake_function = function;
+	g_frame_scheduler.wake_data = data;
+}
+
+void RequestFrames(int count)
+{
+	if (g_frame_scheduler.pending_frames < count) g_frame_scheduler.pending_frames = count;
+}
+
+void RequestFrameIn(double seconds)
+{
+	FrameScheduler* fs = &g_frame_scheduler;
+	FrameClock::time_point deadline = FrameClock::now() + std::chrono::duration_cast<FrameClock::duration>(std::chrono::duration<double>(seconds));
+	if (!fs->has_deadline || deadline < fs->deadline)
+	{
+		fs->deadline = deadline;
+		fs->has_deadline = true;
+	}
+}
+
+void WakeFrameScheduler()
+{
+	// Only the first wake since the last frame needs to poke the main loop.
+	if (!g_frame_scheduler.is_woken.exchange(true) && g_frame_scheduler.wake_function)
+	{
+		g_frame_scheduler.wake_function(g_frame_scheduler.wake_data);
+	}
+}
+
+double GetFrameWaitTime()
+{
+	FrameScheduler* fs = &g_frame_scheduler;
+	if (fs->pending_frames > 0 || fs->is_woken.load()) return 0.0;
+	if (!fs->has_deadline) return -1.0;
+
+	double remaining = std::chrono::duration<double>(fs->deadline - FrameClock::now()).count();
+	return (remaining > 0.0) ? remaining : 0.0;
+}
+
+bool BeginScheduledFrame()
+{
+	FrameScheduler* fs = &g_frame_scheduler;
+	bool is_due = fs->is_woken.exchange(false);
+	if (fs->has_deadline && FrameClock::now() >= fs->deadline)
+	{
+		fs->has_deadline = false;
+		is_due = true;
+	}
+	if (fs->pending_frames > 0)
+	{
+		--fs->pending_frames;
+		is_due = true;
+	}
+
+	if (is_due) ++fs->stats.frames_rendered;
+	else ++fs->stats.frames_skipped;
+	return is_due;
+}
+
+FrameSchedulerStats GetFrameSchedulerStats()
+{
+	return g_frame_scheduler.stats;
+}
@@ -0,0 +1,41 @@
+#ifndef _FRAME_SCHEDULER_H
+#define _FRAME_SCHEDULER_H
+
+// Decides when the main loop actually needs to build and present a frame. Anything that changes what's
+// on screen asks for frames (input, a finished decode, a panel that still has tiles to stream in), and
+// when nobody has, the loop sleeps until the next event or deadline instead of redrawing the same image.
+// Everything here is main-thread only, except WakeFrameScheduler.
+
+// ImGui reacts to input a frame late (hover, focus, popups), so input keeps the loop going a few frames.
+#define FRAME_SETTLE_COUNT 3
+
+typedef void (*FrameWakeFunction)(void* data);
+
+struct FrameSchedulerStats
+{
+	u64 frames_rendered;
+	u64 frames_skipped; // Wakeups that turned out to need no frame.
+};
+
+// Called (from any thread) to break the main loop out of its wait, e.g. by posting a window message.
+void SetFrameWakeFunction(FrameWakeFunction function, void* data);
+
+// Renders at least count more frames.
+void RequestFrames(int count = 1);
+
+// Renders a frame once this many seconds have passed. Only the earliest pending deadline is kept.
+void RequestFrameIn(double seconds);
+
+// Thread-safe. Used by background work that finishes with something to show.
+void WakeFrameScheduler();
+
+// Seconds the main loop can wait for events before the next frame is due: 0 if one is due now, or a
+// negative value if nothing is scheduled at all.
+double GetFrameWaitTime();
+
+// Returns true if a frame should be rendered now, and counts it as rendered or skipped.
+bool BeginScheduledFrame();
+
+FrameSchedulerStats GetFrameSchedulerStats();
+
+#endif //_FRAME_SCHEDULER_H
@@ -0,0 +1,245 @@
+#include "Core/JobSystem.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct Job
+{
+	JobFunction function;
+	void* data;
+	JobCounter* counter;
+};
+
+struct JobSystem
+{
+	std::mutex mutex;
+	std::condition_variable work_available; // Signalled when a job is pushed (or on shutdown).
+	std::condition_variable work_finished; // Signalled when a job with a counter completes.
+
+	Job* queue; // stb_ds array, consumed from queue_head.
+	int queue_head;
+
+	std::thread* workers;
+	int worker_count;
+	bool is_stopping;
+};
+
+static JobSystem g_job_system;
+
+// Pops the oldest job. Must be called with the mutex held.
+static bool PopJobLocked(Job* job)
+{
+	JobSystem* js = &g_job_system;
+	if (js->queue_head >= (int)arrlen(js->queue)) return false;
+
+	*job = js->queue[js->queue_head++];
+
+	// Compact once the consumed prefix dominates, so the array doesn't grow forever.
+	if (js->queue_head == (int)arrlen(js->queue))
+	{
+		arrsetlen(js->queue, 0);
+		js->queue_head = 0;
+	}
+	else if (js->queue_head > 64 && js->queue_head * 2 > (int)arrlen(js->queue))
+	{
+		arrdeln(js->queue, 0, js->queue_head);
+		js->queue_head = 0;
+	}
+	return true;
+}
+
+static void RunJob(Job job)
+{
+	job.function(job.data);
+	if (job.counter && job.counter->pending.fetch_sub(1) == 1)
+	{
+		// Take the lock so a waiter can't miss the notification between checking and sleeping.
+		std::lock_guard<std::mutex> lock(g_job_system.mutex);
+		g_job_system.work_finished.notify_all();
+	}
+}
+
+static void WorkerThreadMain()
+{
+	JobSystem* js = &g_job_system;
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(js->mutex);
+			js->work_available.wait(lock, [js]{ return js->is_stopping || js->queue_head < (int)arrlen(js->queue); });
+			if (!PopJobLocked(&job)) return; // Stopping, and the queue has drained.
+		}
+		RunJob(job);
+	}
+}
+
+void StartJobSystem(int worker_count)
+{
+	JobSystem* js = &g_job_system;
+	assert(!js->workers && !js->worker_count);
+
+	if (worker_count <= 0)
+	{
+		int hardware_threads = (int)std::thread::hardware_concurrency();
+		worker_count = (hardware_threads > 1) ? hardware_threads - 1 : 0;
+	}
+
+	js->is_stopping = false;
+	js->worker_count = worker_count;
+	if (worker_count > 0)
+	{
+		js->workers = new std::thread[worker_count];
+		for (int i = 0; i < worker_count; ++i) js->workers[i] = std::thread(WorkerThreadMain);
+	}
+}
+
+void StopJobSystem()
+{
+	JobSystem* js = &g_job_system;
+	{
+		std::lock_guard<std::mutex> lock(js->mutex);
+		js->is_stopping = true;
+	}
+	js->work_available.notify_all();
+
+	for (int i = 0; i < js->worker_count; ++i) js->workers[i].join();
+	delete[] js->workers;
+	js->workers = 0;
+	js->worker_count = 0;
+
+	arrfree(js->queue);
+	js->queue_head = 0;
+}
+
+int GetJobWorkerCount()
+{
+	return g_job_system.worker_count;
+}
+
+void PushJob(JobFunction function, void* data, JobCounter* counter)
+{
+	assert(function);
+	JobSystem* js = &g_job_system;
+	if (counter) counter->pending.fetch_add(1);
+
+	Job job = {function, data, counter};
+	if (!js->worker_count)
+	{
+		RunJob(job);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(js->mutex);
+		arrput(js->queue, job);
+	}
+	js->work_available.notify_one();
+}
+
+bool IsJobCounterDone(JobCounter* counter)
+{
+	return !counter || counter->pending.load() <= 0;
+}
+
+void WaitForJobs(JobCounter* counter)
+{
+	JobSystem* js = &g_job_system;
+	while (!IsJobCounterDone(counter))
+	{
+		Job job;
+		bool has_job = false;
+		{
+			std::unique_lock<std::mutex> lock(js->mutex);
+			has_job = PopJobLocked(&job);
+			if (!has_job)
+			{
+				// Nothing to help with; sleep until some job finishes. The timeout covers jobs pushed
+				// without a counter that might still feed this one.
+				js->work_finished.wait_for(lock, std::chrono::milliseconds(2), [counter]{ return IsJobCounterDone(counter); });
+				continue;
+			}
+		}
+		RunJob(job);
+	}
+}
+
+struct ParallelForBatch
+{
+	ParallelForFunction function;
+	void* data;
+	int begin;
+	int end;
+};
+
+static void RunParallelForBatch(void* data)
+{
+	ParallelForBatch* batch = (ParallelForBatch*)data;
+	batch->function(batch->begin, batch->end, batch->data);
+}
+
+void ParallelFor(int count, int min_batch, ParallelForFunction function, void* data)
+{
+	if (count <= 0) return;
+	if (min_batch < 1) min_batch = 1;
+
+	// Aim for a few batches per thread so uneven rows still balance out.
+	int thread_count = g_job_system.worker_count + 1;
+	int batch_size = count / (thread_count * 4);
+	if (batch_size < min_batch) batch_size = min_batch;
+	int batch_count = (count + batch_size - 1) / batch_size;
+
+	if (batch_count == 1 || thread_count == 1)
+	{
+		function(0, count, data);
+		return;
+	}
+
+	ParallelForBatch* batches = (ParallelForBatch*)malloc(sizeof(ParallelForBatch) * batch_count);
+	JobCounter counter = {};
+	for (int i = 0; i < batch_count; ++i)
+	{
+		batches[i].function = function;
+		batches[i].data = data;
+		batches[i].begin = i * batch_size;
+		batches[i].end = (i == batch_count - 1) ? count : (i + 1) * batch_size;
+
+		// The last batch runs on this thread.
+		if (i < batch_count - 1) PushJob(RunParallelForBatch, &batches[i], &counter);
+	}
+	RunParallelForBatch(&batches[batch_count - 1]);
+	WaitForJobs(&counter);
+	free(batches);
+}
+
+static void RunSharedJob(void* data)
+{
+	SharedJob* job = (SharedJob*)data;
+	if (!job->is_cancelled.load()) job->run(job->data);
+	ReleaseSharedJob(job);
+}
+
+void PushSharedJob(SharedJob* job, JobFunction run, JobFunction destroy, void* data)
+{
+	assert(job && run && destroy);
+	job->run = run;
+	job->destroy = destroy;
+	job->data = data;
+	job->ref_count.store(2); // One for the caller, one for the worker.
+	job->is_cancelled.store(false);
+	PushJob(RunSharedJob, job);
+}
+
+void CancelSharedJob(SharedJob* job)
+{
+	assert(job);
+	job->is_cancelled.store(true);
+}
+
+void ReleaseSharedJob(SharedJob* job)
+{
+	assert(job);
+	// destroy usually frees the struct job is embedded in, so nothing of it can be read afterwards.
+	if (job->ref_count.fetch_sub(1) == 1) job->destroy(job->data);
+}
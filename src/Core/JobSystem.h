@@ -0,0 +1,63 @@
+#ifndef _JOB_SYSTEM_H
+#define _JOB_SYSTEM_H
+
+#include <atomic>
+
+// A small fixed pool of worker threads pulling from one FIFO queue. Jobs are plain function pointers
+// with a user data pointer, so anything that needs to outlive the call has to be owned by that data.
+typedef void (*JobFunction)(void* data);
+
+// Range callback for ParallelFor. Processes indices in [begin, end).
+typedef void (*ParallelForFunction)(int begin, int end, void* data);
+
+// Tracks a group of outstanding jobs. Zero-initialize it, pass it to PushJob for every job in the
+// group, then call WaitForJobs (or poll IsJobCounterDone) to find out when they have all finished.
+struct JobCounter
+{
+	std::atomic<int> pending;
+};
+
+// Starts the worker threads. A worker_count of 0 uses one worker per hardware thread, minus one for
+// the calling (main) thread. If no workers are started, PushJob runs jobs immediately on the caller.
+void StartJobSystem(int worker_count = 0);
+
+// Finishes any queued jobs and joins all workers.
+void StopJobSystem();
+
+int GetJobWorkerCount();
+
+void PushJob(JobFunction function, void* data, JobCounter* counter = 0);
+
+// Blocks until every job pushed with this counter has finished. The calling thread helps by running
+// queued jobs while it waits, so it is safe to call from inside a job.
+void WaitForJobs(JobCounter* counter);
+
+bool IsJobCounterDone(JobCounter* counter);
+
+// Splits [0, count) into batches of at least min_batch indices, runs them across the workers and the
+// calling thread, and returns once all of them are done.
+void ParallelFor(int count, int min_batch, ParallelForFunction function, void* data);
+
+// The lifetime of a job whose result is polled for instead of waited on. The requester and the worker
+// each hold a reference, and whichever lets go last calls destroy, so neither has to wait for the other.
+// Embed one in the job's own struct (which holds its state and result) and queue it with PushSharedJob.
+struct SharedJob
+{
+	JobFunction run; // Skipped if the job is cancelled before a worker gets to it.
+	JobFunction destroy; // Frees data once both references are gone.
+	void* data;
+
+	std::atomic<int> ref_count;
+	std::atomic<bool> is_cancelled; // run may also check this, to give up early.
+};
+
+// Takes a reference for the caller and one for the worker, and queues run(data).
+void PushSharedJob(SharedJob* job, JobFunction run, JobFunction destroy, void* data);
+
+// Asks the job to stop. Doesn't drop the caller's reference.
+void CancelSharedJob(SharedJob* job);
+
+// Drops a reference, destroying the job if it was the last.
+void ReleaseSharedJob(SharedJob* job);
+
+#endif //_JOB_SYSTEM_H
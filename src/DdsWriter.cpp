@@ -0,0 +1,131 @@
+#include "DdsWriter.h"
+#include "Core/JobSystem.h"
+
+#define DDS_HEADER_SIZE 124
+#define DDS_PIXEL_FORMAT_SIZE 32
+#define DDS_DX10_HEADER_SIZE 20
+
+// Header flags.
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_TEXTURE 0x1000
+
+#define DXGI_FORMAT_BC7_UNORM_VALUE 98
+#define D3D10_RESOURCE_DIMENSION_TEXTURE2D_VALUE 3
+
+// Block rows per band, per worker, so each gets a few to chew on.
+#define DDS_BLOCK_ROWS_PER_WORKER 4
+
+struct DdsCompressJob
+{
+	DdsWriter* writer;
+	int row_count; // Pending rows in this band.
+};
+
+// ParallelFor callback: compresses block rows [begin, end) of the pending band.
+static void CompressDdsBlockRows(int begin, int end, void* data)
+{
+	DdsCompressJob* job = (DdsCompressJob*)data;
+	DdsWriter* writer = job->writer;
+	size_t stride = (size_t)writer->width * 4;
+	size_t block_row_size = (size_t)((writer->width + 3) / 4) * GetBlockFormatSize(writer->format);
+	for (int i = begin; i < end; ++i)
+	{
+		int row_count = job->row_count - i * 4;
+		if (row_count > 4) row_count = 4;
+		CompressBlockRow(writer->format, writer->pending + (size_t)i * 4 * stride, stride, writer->width, row_count, writer->blocks + (size_t)i * block_row_size);
+	}
+}
+
+static void FlushDdsBand(DdsWriter* writer)
+{
+	if (!writer->pending_rows) return;
+
+	int block_rows = (writer->pending_rows + 3) / 4;
+	DdsCompressJob job = {writer, writer->pending_rows};
+	ParallelFor(block_rows, 1, CompressDdsBlockRows, &job);
+
+	size_t block_row_size = (size_t)((writer->width + 3) / 4) * GetBlockFormatSize(writer->format);
+	WriteEncoderFile(&writer->file, writer->blocks, block_row_size * block_rows);
+	writer->pending_rows = 0;
+}
+
+bool BeginDdsWrite(DdsWriter* writer, const char* file_path, int width, int height, BlockFormat format)
+{
+	assert(writer && file_path);
+	*writer = {};
+	if (width <= 0 || height <= 0) return false;
+
+	if (!OpenEncoderFile(&writer->file, file_path)) return false;
+	writer->width = width;
+	writer->height = height;
+	writer->format = format;
+
+	int band_rows = (GetJobWorkerCount() + 1) * DDS_BLOCK_ROWS_PER_WORKER * 4;
+	writer->band_rows = (band_rows < height) ? band_rows : (height + 3) & ~3;
+	size_t block_row_size = (size_t)((width + 3) / 4) * GetBlockFormatSize(format);
+	writer->pending = (u8*)malloc((size_t)width * 4 * writer->band_rows); // @malloc
+	writer->blocks = (u8*)malloc(block_row_size * (writer->band_rows / 4)); // @malloc
+
+	u8 header[4 + DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE] = {};
+	memcpy(header, "DDS ", 4);
+	u8* dds = header + 4;
+	u64 linear_size = block_row_size * (u64)((height + 3) / 4);
+	PutU32LittleEndian(dds, DDS_HEADER_SIZE);
+	PutU32LittleEndian(dds + 4, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE);
+	PutU32LittleEndian(dds + 8, (u32)height);
+	PutU32LittleEndian(dds + 12, (u32)width);
+	PutU32LittleEndian(dds + 16, (linear_size <= U32_MAX) ? (u32)linear_size : 0); // Readers work it out when it doesn't fit.
+	PutU32LittleEndian(dds + 24, 1); // Mip count.
+
+	u8* pixel_format = dds + 72;
+	PutU32LittleEndian(pixel_format, DDS_PIXEL_FORMAT_SIZE);
+	PutU32LittleEndian(pixel_format + 4, DDPF_FOURCC);
+	const char* four_cc = (format == BlockFormat::BC1) ? "DXT1" : ((format == BlockFormat::BC3) ? "DXT5" : "DX10");
+	memcpy(pixel_format + 8, four_cc, 4);
+	PutU32LittleEndian(dds + 104, DDSCAPS_TEXTURE);
+
+	size_t header_size = 4 + DDS_HEADER_SIZE;
+	if (format == BlockFormat::BC7)
+	{
+		u8* dx10 = dds + DDS_HEADER_SIZE;
+		PutU32LittleEndian(dx10, DXGI_FORMAT_BC7_UNORM_VALUE);
+		PutU32LittleEndian(dx10 + 4, D3D10_RESOURCE_DIMENSION_TEXTURE2D_VALUE);
+		PutU32LittleEndian(dx10 + 12, 1); // Array size.
+		header_size += DDS_DX10_HEADER_SIZE;
+	}
+	return WriteEncoderFile(&writer->file, header, header_size);
+}
+
+bool WriteDdsRows(DdsWriter* writer, const u8* rows, int row_count, size_t stride)
+{
+	assert(writer && rows);
+	if (!writer->file.file || writer->file.has_error) return false;
+	if (row_count > writer->height - writer->rows_written) row_count = writer->height - writer->rows_written;
+
+	size_t row_size = (size_t)writer->width * 4;
+	for (int y = 0; y < row_count; ++y)
+	{
+		memcpy(writer->pending + (size_t)writer->pending_rows * row_size, rows + (size_t)y * stride, row_size);
+		++writer->pending_rows;
+		if (writer->pending_rows == writer->band_rows) FlushDdsBand(writer);
+	}
+	writer->rows_written += row_count;
+	return !writer->file.has_error;
+}
+
+bool EndDdsWrite(DdsWriter* writer)
+{
+	assert(writer);
+	bool is_complete = (writer->file.file && writer->rows_written == writer->height);
+	if (is_complete) FlushDdsBand(writer);
+	bool success = CloseEncoderFile(&writer->file, is_complete);
+	free(writer->pending);
+	free(writer->blocks);
+	*writer = {};
+	return success;
+}
@@ -0,0 +1,29 @@
+#ifndef _DDS_WRITER_H
+#define _DDS_WRITER_H
+
+#include "EncoderFile.h"
+#include "BlockCompress.h"
+
+// Block compressed DDS textures (one mip level). Rows come in as RGBA8 and are held until there's a
+// band of them, whose block rows are then compressed in parallel and written out. BC1 and BC3 use the
+// legacy DXT1/DXT5 headers, BC7 the DX10 extension header.
+
+struct DdsWriter
+{
+	EncoderFile file;
+	int width;
+	int height;
+	BlockFormat format;
+	int rows_written;
+
+	u8* pending; // Rows waiting to be compressed, RGBA8, tightly packed.
+	int pending_rows;
+	int band_rows; // A multiple of 4.
+	u8* blocks; // Compressed output for one band.
+};
+
+bool BeginDdsWrite(DdsWriter* writer, const char* file_path, int width, int height, BlockFormat format);
+bool WriteDdsRows(DdsWriter* writer, const u8* rows, int row_count, size_t stride);
+bool EndDdsWrite(DdsWriter* writer);
+
+#endif //_DDS_WRITER_H
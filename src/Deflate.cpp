@@ -0,0 +1,740 @@
+#include "Deflate.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+#define DEFLATE_WINDOW_MASK (DEFLATE_WINDOW_SIZE - 1)
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_MAX_BLOCK_TOKENS 16384
+#define DEFLATE_MAX_STORED_BLOCK 65535
+#define DEFLATE_MAX_SHORT_MATCH_DISTANCE 4096 // Minimum length matches further back than this cost more than literals.
+
+#define DEFLATE_LITERAL_SYMBOLS 286
+#define DEFLATE_DISTANCE_SYMBOLS 30
+#define DEFLATE_CODE_LENGTH_SYMBOLS 19
+#define DEFLATE_MAX_CODE_BITS 15
+#define DEFLATE_MAX_CODE_LENGTH_BITS 7
+#define DEFLATE_END_OF_BLOCK 256
+
+static const u16 LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const u8 LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const u16 DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const u8 DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const u8 CODE_LENGTH_ORDER[DEFLATE_CODE_LENGTH_SYMBOLS] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Same trade-offs as zlib's levels.
+struct DeflateLevelConfig
+{
+	int good_length; // Search a quarter as hard for a lazy match once we already have one this long.
+	int lazy_length; // Don't look for a lazy match at all once we have one this long.
+	int nice_length; // Stop searching once a match is at least this long.
+	int max_chain; // Hash chain entries checked per position.
+	bool is_lazy; // Check whether the next position has a longer match before taking one.
+};
+
+static const DeflateLevelConfig DEFLATE_LEVELS[DEFLATE_MAX_LEVEL + 1] =
+{
+	{0, 0, 0, 0, false}, // Level 0 isn't used; callers get the default instead.
+	{4, 4, 8, 4, false},
+	{4, 5, 16, 8, false},
+	{4, 6, 32, 32, false},
+	{4, 4, 16, 16, true},
+	{8, 16, 32, 32, true},
+	{8, 16, 128, 128, true},
+	{8, 32, 128, 256, true},
+	{32, 128, DEFLATE_MAX_MATCH, 1024, true},
+	{32, DEFLATE_MAX_MATCH, DEFLATE_MAX_MATCH, 4096, true},
+};
+
+struct DeflateTables
+{
+	u8 length_symbol[DEFLATE_MAX_MATCH + 1]; // Match length -> length symbol minus 257.
+	u8 distance_symbol[512]; // See GetDistanceSymbol.
+	u8 fixed_literal_lengths[288];
+	u16 fixed_literal_codes[288];
+	u8 fixed_distance_lengths[DEFLATE_DISTANCE_SYMBOLS];
+	u16 fixed_distance_codes[DEFLATE_DISTANCE_SYMBOLS];
+	u32 crc[256];
+};
+
+static u16 ReverseBits(u32 code, int bit_count)
+{
+	u32 result = 0;
+	for (int i = 0; i < bit_count; ++i)
+	{
+		result = (result << 1) | (code & 1);
+		code >>= 1;
+	}
+	return (u16)result;
+}
+
+// Canonical Huffman codes for a set of code lengths, bit-reversed because deflate writes them LSB first.
+static void BuildHuffmanCodes(const u8* lengths, int count, u16* codes)
+{
+	int length_counts[DEFLATE_MAX_CODE_BITS + 1] = {};
+	for (int i = 0; i < count; ++i) ++length_counts[lengths[i]];
+	length_counts[0] = 0;
+
+	u32 next_code[DEFLATE_MAX_CODE_BITS + 1] = {};
+	u32 code = 0;
+	for (int bits = 1; bits <= DEFLATE_MAX_CODE_BITS; ++bits)
+	{
+		code = (code + length_counts[bits - 1]) << 1;
+		next_code[bits] = code;
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		codes[i] = lengths[i] ? ReverseBits(next_code[lengths[i]]++, lengths[i]) : 0;
+	}
+}
+
+static DeflateTables CreateDeflateTables()
+{
+	DeflateTables result = {};
+	for (int symbol = 0; symbol < 29; ++symbol)
+	{
+		for (int i = 0; i < (1 << LENGTH_EXTRA[symbol]) && LENGTH_BASE[symbol] + i <= DEFLATE_MAX_MATCH; ++i)
+		{
+			result.length_symbol[LENGTH_BASE[symbol] + i] = (u8)symbol; // 258 ends up with its own symbol, 28.
+		}
+	}
+	for (int symbol = 0; symbol < DEFLATE_DISTANCE_SYMBOLS; ++symbol)
+	{
+		for (int i = 0; i < (1 << DISTANCE_EXTRA[symbol]); ++i)
+		{
+			int d = DISTANCE_BASE[symbol] - 1 + i;
+			if (d < 256) result.distance_symbol[d] = (u8)symbol;
+			else result.distance_symbol[256 + (d >> 7)] = (u8)symbol;
+		}
+	}
+
+	for (int i = 0; i < 288; ++i) result.fixed_literal_lengths[i] = (i < 144) ? 8 : ((i < 256) ? 9 : ((i < 280) ? 7 : 8));
+	for (int i = 0; i < DEFLATE_DISTANCE_SYMBOLS; ++i) result.fixed_distance_lengths[i] = 5;
+	BuildHuffmanCodes(result.fixed_literal_lengths, 288, result.fixed_literal_codes);
+	BuildHuffmanCodes(result.fixed_distance_lengths, DEFLATE_DISTANCE_SYMBOLS, result.fixed_distance_codes);
+
+	for (u32 i = 0; i < 256; ++i)
+	{
+		u32 c = i;
+		for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		result.crc[i] = c;
+	}
+	return result;
+}
+
+static const DeflateTables* GetDeflateTables()
+{
+	static const DeflateTables tables = CreateDeflateTables(); // Thread-safe static init; chunks compress on workers.
+	return &tables;
+}
+
+static int GetDistanceSymbol(const DeflateTables* tables, int distance)
+{
+	int d = distance - 1;
+	return (d < 256) ? tables->distance_symbol[d] : tables->distance_symbol[256 + (d >> 7)];
+}
+
+struct HuffmanSymbol
+{
+	u32 key; // Frequency going in, code length coming out.
+	u16 symbol;
+};
+
+static int CompareHuffmanSymbols(const void* a, const void* b)
+{
+	u32 key_a = ((const HuffmanSymbol*)a)->key;
+	u32 key_b = ((const HuffmanSymbol*)b)->key;
+	return (key_a < key_b) ? -1 : ((key_a > key_b) ? 1 : 0);
+}
+
+// Length-limited Huffman code lengths. Optimal lengths come from Moffat and Katajainen's in-place
+// algorithm over the symbols sorted by frequency; if any come out longer than max_bits, the tree is
+// flattened by moving leaves up until the Kraft sum fits again.
+static void BuildHuffmanLengths(const u32* frequencies, int count, int max_bits, u8* lengths)
+{
+	HuffmanSymbol symbols[288];
+	int used = 0;
+	memset(lengths, 0, count);
+	for (int i = 0; i < count; ++i)
+	{
+		if (frequencies[i]) symbols[used++] = {frequencies[i], (u16)i};
+	}
+	if (used == 0) return;
+	if (used == 1)
+	{
+		lengths[symbols[0].symbol] = 1;
+		return;
+	}
+	qsort(symbols, used, sizeof(HuffmanSymbol), CompareHuffmanSymbols);
+
+	HuffmanSymbol* a = symbols;
+	int n = used;
+	a[0].key += a[1].key;
+	int root = 0;
+	int leaf = 2;
+	for (int next = 1; next < n - 1; ++next)
+	{
+		if (leaf >= n || a[root].key < a[leaf].key)
+		{
+			a[next].key = a[root].key;
+			a[root++].key = next;
+		}
+		else a[next].key = a[leaf++].key;
+
+		if (leaf >= n || (root < next && a[root].key < a[leaf].key))
+		{
+			a[next].key += a[root].key;
+			a[root++].key = next;
+		}
+		else a[next].key += a[leaf++].key;
+	}
+	a[n - 2].key = 0;
+	for (int next = n - 3; next >= 0; --next) a[next].key = a[a[next].key].key + 1;
+
+	int available = 1;
+	int depth = 0;
+	int consumed = 0;
+	root = n - 2;
+	int next = n - 1;
+	while (available > 0)
+	{
+		while (root >= 0 && (int)a[root].key == depth)
+		{
+			++consumed;
+			--root;
+		}
+		while (available > consumed)
+		{
+			a[next--].key = depth;
+			--available;
+		}
+		available = 2 * consumed;
+		++depth;
+		consumed = 0;
+	}
+
+	// Count codes per length, folding anything too long into max_bits and then fixing up the Kraft sum.
+	int length_counts[289] = {};
+	for (int i = 0; i < n; ++i) ++length_counts[a[i].key];
+	for (int i = max_bits + 1; i <= n; ++i) length_counts[max_bits] += length_counts[i];
+	u32 total = 0;
+	for (int i = max_bits; i > 0; --i) total += (u32)length_counts[i] << (max_bits - i);
+	while (total != (1u << max_bits))
+	{
+		--length_counts[max_bits];
+		for (int i = max_bits - 1; i > 0; --i)
+		{
+			if (length_counts[i])
+			{
+				--length_counts[i];
+				length_counts[i + 1] += 2;
+				break;
+			}
+		}
+		--total;
+	}
+
+	// Shortest codes to the most frequent symbols, which are at the end of the sorted list.
+	for (int bits = 1, j = n; bits <= max_bits; ++bits)
+	{
+		for (int k = length_counts[bits]; k > 0; --k) lengths[symbols[--j].symbol] = (u8)bits;
+	}
+}
+
+void AppendDeflateOutput(DeflateOutput* out, const void* data, size_t size)
+{
+	if (out->size + size > out->capacity)
+	{
+		size_t capacity = out->capacity ? out->capacity * 2 : 65536;
+		while (capacity < out->size + size) capacity *= 2;
+		out->data = (u8*)realloc(out->data, capacity); // @malloc
+		out->capacity = capacity;
+	}
+	if (data) memcpy(out->data + out->size, data, size);
+	out->size += size;
+}
+
+void FreeDeflateOutput(DeflateOutput* out)
+{
+	free(out->data);
+	*out = {};
+}
+
+static void ReserveDeflateOutput(DeflateOutput* out, size_t size)
+{
+	size_t old_size = out->size;
+	AppendDeflateOutput(out, 0, size);
+	out->size = old_size;
+}
+
+struct BitWriter
+{
+	DeflateOutput* out; // Space has to be reserved before writing.
+	u64 bits;
+	int bit_count;
+};
+
+static void PutBits(BitWriter* writer, u32 value, int count)
+{
+	writer->bits |= (u64)value << writer->bit_count;
+	writer->bit_count += count;
+	while (writer->bit_count >= 8)
+	{
+		writer->out->data[writer->out->size++] = (u8)writer->bits;
+		writer->bits >>= 8;
+		writer->bit_count -= 8;
+	}
+}
+
+static void AlignToByte(BitWriter* writer)
+{
+	if (writer->bit_count) PutBits(writer, 0, 8 - writer->bit_count);
+}
+
+struct DeflateToken
+{
+	u16 length; // Literal byte if distance is 0.
+	u16 distance;
+};
+
+struct DeflateCompressor
+{
+	const DeflateTables* tables;
+	const u8* base; // Start of the dictionary; positions are relative to this.
+	s32* head; // Most recent position for each hash, or -1.
+	s32* prev; // Previous position with the same hash, indexed by position & DEFLATE_WINDOW_MASK.
+
+	DeflateToken* tokens;
+	int token_count;
+	u32 literal_frequencies[DEFLATE_LITERAL_SYMBOLS];
+	u32 distance_frequencies[DEFLATE_DISTANCE_SYMBOLS];
+	size_t block_start; // Input covered by the tokens so far is [block_start, covered).
+	size_t covered;
+
+	BitWriter writer;
+};
+
+static u32 HashBytes(const u8* p)
+{
+	u32 v = (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16);
+	return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+static void InsertHash(DeflateCompressor* c, size_t pos)
+{
+	u32 hash = HashBytes(c->base + pos);
+	c->prev[pos & DEFLATE_WINDOW_MASK] = c->head[hash];
+	c->head[hash] = (s32)pos;
+}
+
+static int CountTrailingZeros64(u64 value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+// Compares eight bytes at a time; the first differing bit tells how far the match goes (little endian).
+static int GetMatchLength(const u8* a, const u8* b, int max_length)
+{
+	int length = 0;
+	while (length + 8 <= max_length)
+	{
+		u64 x, y;
+		memcpy(&x, a + length, 8);
+		memcpy(&y, b + length, 8);
+		if (x != y) return length + CountTrailingZeros64(x ^ y) / 8;
+		length += 8;
+	}
+	while (length < max_length && a[length] == b[length]) ++length;
+	return length;
+}
+
+static int FindMatch(DeflateCompressor* c, const DeflateLevelConfig* config, size_t pos, size_t end, int max_chain, int* distance)
+{
+	size_t remaining = end - pos;
+	int max_length = (remaining < DEFLATE_MAX_MATCH) ? (int)remaining : DEFLATE_MAX_MATCH;
+	if (max_length < DEFLATE_MIN_MATCH) return 0;
+
+	const u8* current = c->base + pos;
+	s32 candidate = c->head[HashBytes(current)];
+	s64 limit = (s64)pos - DEFLATE_WINDOW_SIZE;
+	int best_length = DEFLATE_MIN_MATCH - 1;
+	for (int chain = max_chain; candidate >= 0 && candidate > limit && chain > 0; --chain)
+	{
+		const u8* match = c->base + candidate;
+		if (match[best_length] == current[best_length] && match[0] == current[0] && match[1] == current[1])
+		{
+			int length = GetMatchLength(match, current, max_length);
+			if (length > best_length)
+			{
+				best_length = length;
+				*distance = (int)(pos - candidate);
+				if (length >= config->nice_length || length >= max_length) break;
+			}
+		}
+
+		// Chains only ever go backwards; anything else is a slot that has since been reused.
+		s32 next = c->prev[candidate & DEFLATE_WINDOW_MASK];
+		if (next >= candidate) break;
+		candidate = next;
+	}
+	if (best_length == DEFLATE_MIN_MATCH && *distance > DEFLATE_MAX_SHORT_MATCH_DISTANCE) return 0;
+	return (best_length >= DEFLATE_MIN_MATCH) ? best_length : 0;
+}
+
+static void WriteStoredBlocks(DeflateCompressor* c, size_t start, size_t end)
+{
+	BitWriter* writer = &c->writer;
+	do
+	{
+		size_t size = end - start;
+		if (size > DEFLATE_MAX_STORED_BLOCK) size = DEFLATE_MAX_STORED_BLOCK;
+		PutBits(writer, 0, 3);
+		AlignToByte(writer);
+		PutBits(writer, (u32)size, 16);
+		PutBits(writer, (u32)size ^ 0xFFFF, 16);
+		memcpy(writer->out->data + writer->out->size, c->base + start, size);
+		writer->out->size += size;
+		start += size;
+	} while (start < end);
+}
+
+static void WriteTokens(DeflateCompressor* c, const u16* literal_codes, const u8* literal_lengths, const u16* distance_codes, const u8* distance_lengths)
+{
+	BitWriter* writer = &c->writer;
+	const DeflateTables* tables = c->tables;
+	for (int i = 0; i < c->token_count; ++i)
+	{
+		DeflateToken token = c->tokens[i];
+		if (!token.distance)
+		{
+			PutBits(writer, literal_codes[token.length], literal_lengths[token.length]);
+			continue;
+		}
+		int length_symbol = tables->length_symbol[token.length];
+		PutBits(writer, literal_codes[257 + length_symbol], literal_lengths[257 + length_symbol]);
+		PutBits(writer, token.length - LENGTH_BASE[length_symbol], LENGTH_EXTRA[length_symbol]);
+		int distance_symbol = GetDistanceSymbol(tables, token.distance);
+		PutBits(writer, distance_codes[distance_symbol], distance_lengths[distance_symbol]);
+		PutBits(writer, token.distance - DISTANCE_BASE[distance_symbol], DISTANCE_EXTRA[distance_symbol]);
+	}
+	PutBits(writer, literal_codes[DEFLATE_END_OF_BLOCK], literal_lengths[DEFLATE_END_OF_BLOCK]);
+}
+
+static u64 GetTokenBits(const DeflateCompressor* c, const u8* literal_lengths, const u8* distance_lengths)
+{
+	u64 result = 0;
+	for (int i = 0; i < DEFLATE_LITERAL_SYMBOLS; ++i)
+	{
+		u32 extra = (i > DEFLATE_END_OF_BLOCK) ? LENGTH_EXTRA[i - 257] : 0;
+		result += (u64)c->literal_frequencies[i] * (literal_lengths[i] + extra);
+	}
+	for (int i = 0; i < DEFLATE_DISTANCE_SYMBOLS; ++i)
+	{
+		result += (u64)c->distance_frequencies[i] * (distance_lengths[i] + DISTANCE_EXTRA[i]);
+	}
+	return result;
+}
+
+// Writes the buffered tokens as whichever block type comes out smallest: dynamic Huffman, fixed
+// Huffman, or stored.
+static void FlushBlock(DeflateCompressor* c)
+{
+	if (c->covered == c->block_start) return;
+	c->literal_frequencies[DEFLATE_END_OF_BLOCK] = 1;
+
+	u8 literal_lengths[DEFLATE_LITERAL_SYMBOLS];
+	u8 distance_lengths[DEFLATE_DISTANCE_SYMBOLS];
+	BuildHuffmanLengths(c->literal_frequencies, DEFLATE_LITERAL_SYMBOLS, DEFLATE_MAX_CODE_BITS, literal_lengths);
+	BuildHuffmanLengths(c->distance_frequencies, DEFLATE_DISTANCE_SYMBOLS, DEFLATE_MAX_CODE_BITS, distance_lengths);
+
+	// The format needs at least one distance code even if no matches were found.
+	int literal_count = DEFLATE_LITERAL_SYMBOLS;
+	while (literal_count > 257 && !literal_lengths[literal_count - 1]) --literal_count;
+	int distance_count = DEFLATE_DISTANCE_SYMBOLS;
+	while (distance_count > 1 && !distance_lengths[distance_count - 1]) --distance_count;
+	if (!distance_lengths[0] && distance_count == 1) distance_lengths[0] = 1;
+
+	// Run-length encode both sets of code lengths with symbols 16 (repeat previous), 17 and 18 (zeros).
+	u8 all_lengths[DEFLATE_LITERAL_SYMBOLS + DEFLATE_DISTANCE_SYMBOLS];
+	memcpy(all_lengths, literal_lengths, literal_count);
+	memcpy(all_lengths + literal_count, distance_lengths, distance_count);
+	int total_count = literal_count + distance_count;
+
+	u8 rle_symbols[DEFLATE_LITERAL_SYMBOLS + DEFLATE_DISTANCE_SYMBOLS];
+	u8 rle_extra[DEFLATE_LITERAL_SYMBOLS + DEFLATE_DISTANCE_SYMBOLS];
+	int rle_count = 0;
+	u32 code_length_frequencies[DEFLATE_CODE_LENGTH_SYMBOLS] = {};
+	for (int i = 0; i < total_count;)
+	{
+		u8 length = all_lengths[i];
+		int run = 1;
+		while (i + run < total_count && all_lengths[i + run] == length) ++run;
+
+		if (length == 0 && run >= 3)
+		{
+			if (run > 138) run = 138;
+			rle_symbols[rle_count] = (run >= 11) ? 18 : 17;
+			rle_extra[rle_count++] = (u8)((run >= 11) ? run - 11 : run - 3);
+		}
+		else if (length != 0 && run >= 4)
+		{
+			// The first one is sent as is, the rest repeat it.
+			rle_symbols[rle_count] = length;
+			rle_extra[rle_count++] = 0;
+			run = (run - 1 > 6) ? 6 : run - 1;
+			rle_symbols[rle_count] = 16;
+			rle_extra[rle_count++] = (u8)(run - 3);
+			++code_length_frequencies[length];
+			++run;
+		}
+		else
+		{
+			run = 1;
+			rle_symbols[rle_count] = length;
+			rle_extra[rle_count++] = 0;
+		}
+		++code_length_frequencies[rle_symbols[rle_count - 1]];
+		i += run;
+	}
+
+	u8 code_length_lengths[DEFLATE_CODE_LENGTH_SYMBOLS];
+	u16 code_length_codes[DEFLATE_CODE_LENGTH_SYMBOLS];
+	BuildHuffmanLengths(code_length_frequencies, DEFLATE_CODE_LENGTH_SYMBOLS, DEFLATE_MAX_CODE_LENGTH_BITS, code_length_lengths);
+	BuildHuffmanCodes(code_length_lengths, DEFLATE_CODE_LENGTH_SYMBOLS, code_length_codes);
+	int code_length_count = DEFLATE_CODE_LENGTH_SYMBOLS;
+	while (code_length_count > 4 && !code_length_lengths[CODE_LENGTH_ORDER[code_length_count - 1]]) --code_length_count;
+
+	u64 dynamic_bits = 3 + 5 + 5 + 4 + 3 * code_length_count;
+	for (int i = 0; i < rle_count; ++i)
+	{
+		u8 symbol = rle_symbols[i];
+		dynamic_bits += code_length_lengths[symbol] + ((symbol == 16) ? 2 : ((symbol == 17) ? 3 : ((symbol == 18) ? 7 : 0)));
+	}
+	dynamic_bits += GetTokenBits(c, literal_lengths, distance_lengths);
+	u64 fixed_bits = 3 + GetTokenBits(c, c->tables->fixed_literal_lengths, c->tables->fixed_distance_lengths);
+	size_t stored_size = c->covered - c->block_start;
+	u64 stored_bits = (u64)stored_size * 8 + ((stored_size + DEFLATE_MAX_STORED_BLOCK - 1) / DEFLATE_MAX_STORED_BLOCK) * (3 + 7 + 32);
+
+	BitWriter* writer = &c->writer;
+	u64 min_bits = (dynamic_bits < fixed_bits) ? dynamic_bits : fixed_bits;
+	if (stored_bits < min_bits) min_bits = stored_bits;
+	ReserveDeflateOutput(writer->out, (size_t)(min_bits / 8) + 64);
+
+	if (stored_bits == min_bits)
+	{
+		WriteStoredBlocks(c, c->block_start, c->covered);
+	}
+	else if (fixed_bits == min_bits)
+	{
+		PutBits(writer, 0, 1);
+		PutBits(writer, 1, 2);
+		WriteTokens(c, c->tables->fixed_literal_codes, c->tables->fixed_literal_lengths, c->tables->fixed_distance_codes, c->tables->fixed_distance_lengths);
+	}
+	else
+	{
+		u16 literal_codes[DEFLATE_LITERAL_SYMBOLS];
+		u16 distance_codes[DEFLATE_DISTANCE_SYMBOLS];
+		BuildHuffmanCodes(literal_lengths, DEFLATE_LITERAL_SYMBOLS, literal_codes);
+		BuildHuffmanCodes(distance_lengths, DEFLATE_DISTANCE_SYMBOLS, distance_codes);
+
+		PutBits(writer, 0, 1);
+		PutBits(writer, 2, 2);
+		PutBits(writer, literal_count - 257, 5);
+		PutBits(writer, distance_count - 1, 5);
+		PutBits(writer, code_length_count - 4, 4);
+		for (int i = 0; i < code_length_count; ++i) PutBits(writer, code_length_lengths[CODE_LENGTH_ORDER[i]], 3);
+		for (int i = 0; i < rle_count; ++i)
+		{
+			u8 symbol = rle_symbols[i];
+			PutBits(writer, code_length_codes[symbol], code_length_lengths[symbol]);
+			if (symbol == 16) PutBits(writer, rle_extra[i], 2);
+			else if (symbol == 17) PutBits(writer, rle_extra[i], 3);
+			else if (symbol == 18) PutBits(writer, rle_extra[i], 7);
+		}
+		WriteTokens(c, literal_codes, literal_lengths, distance_codes, distance_lengths);
+	}
+
+	c->token_count = 0;
+	memset(c->literal_frequencies, 0, sizeof(c->literal_frequencies));
+	memset(c->distance_frequencies, 0, sizeof(c->distance_frequencies));
+	c->block_start = c->covered;
+}
+
+static void PushLiteral(DeflateCompressor* c, u8 literal)
+{
+	c->tokens[c->token_count++] = {literal, 0};
+	++c->literal_frequencies[literal];
+	++c->covered;
+	if (c->token_count == DEFLATE_MAX_BLOCK_TOKENS) FlushBlock(c);
+}
+
+static void PushMatch(DeflateCompressor* c, int length, int distance)
+{
+	c->tokens[c->token_count++] = {(u16)length, (u16)distance};
+	++c->literal_frequencies[257 + c->tables->length_symbol[length]];
+	++c->distance_frequencies[GetDistanceSymbol(c->tables, distance)];
+	c->covered += length;
+	if (c->token_count == DEFLATE_MAX_BLOCK_TOKENS) FlushBlock(c);
+}
+
+void DeflateChunk(const u8* data, size_t dict_size, size_t size, int level, DeflateOutput* out)
+{
+	assert(data && out && dict_size <= DEFLATE_WINDOW_SIZE);
+	if (level <= 0 || level > DEFLATE_MAX_LEVEL) level = DEFLATE_DEFAULT_LEVEL;
+	const DeflateLevelConfig* config = &DEFLATE_LEVELS[level];
+
+	DeflateCompressor* c = (DeflateCompressor*)calloc(1, sizeof(DeflateCompressor)); // @malloc
+	c->tables = GetDeflateTables();
+	c->base = data - dict_size;
+	c->head = (s32*)malloc(sizeof(s32) * (DEFLATE_HASH_SIZE + DEFLATE_WINDOW_SIZE)); // @malloc
+	c->prev = c->head + DEFLATE_HASH_SIZE;
+	memset(c->head, 0xFF, sizeof(s32) * DEFLATE_HASH_SIZE);
+	c->tokens = (DeflateToken*)malloc(sizeof(DeflateToken) * DEFLATE_MAX_BLOCK_TOKENS); // @malloc
+	c->block_start = c->covered = dict_size;
+	c->writer.out = out;
+
+	size_t end = dict_size + size;
+	for (size_t pos = 0; pos < dict_size && pos + DEFLATE_MIN_MATCH <= end; ++pos) InsertHash(c, pos);
+
+	// With lazy matching, a match found at pos is held back one position in case pos + 1 has a longer one.
+	bool has_pending = false;
+	int pending_length = 0;
+	int pending_distance = 0;
+	size_t pos = dict_size;
+	while (pos < end)
+	{
+		// A pending match that is already long enough is taken without looking any further.
+		if (has_pending && pending_length >= config->lazy_length)
+		{
+			PushMatch(c, pending_length, pending_distance);
+			size_t match_end = pos - 1 + pending_length;
+			for (; pos < match_end; ++pos)
+			{
+				if (pos + DEFLATE_MIN_MATCH <= end) InsertHash(c, pos);
+			}
+			has_pending = false;
+			continue;
+		}
+
+		int max_chain = (has_pending && pending_length >= config->good_length) ? config->max_chain / 4 : config->max_chain;
+		int distance = 0;
+		int length = FindMatch(c, config, pos, end, max_chain, &distance);
+		if (pos + DEFLATE_MIN_MATCH <= end) InsertHash(c, pos);
+
+		if (has_pending)
+		{
+			if (length > pending_length)
+			{
+				PushLiteral(c, c->base[pos - 1]);
+				pending_length = length;
+				pending_distance = distance;
+				++pos;
+				continue;
+			}
+			PushMatch(c, pending_length, pending_distance);
+			size_t match_end = pos - 1 + pending_length;
+			for (++pos; pos < match_end; ++pos)
+			{
+				if (pos + DEFLATE_MIN_MATCH <= end) InsertHash(c, pos);
+			}
+			has_pending = false;
+			continue;
+		}
+
+		if (length)
+		{
+			if (config->is_lazy && length < config->lazy_length)
+			{
+				has_pending = true;
+				pending_length = length;
+				pending_distance = distance;
+				++pos;
+				continue;
+			}
+			PushMatch(c, length, distance);
+			size_t match_end = pos + length;
+			for (++pos; pos < match_end; ++pos)
+			{
+				if (pos + DEFLATE_MIN_MATCH <= end) InsertHash(c, pos);
+			}
+			continue;
+		}
+
+		PushLiteral(c, c->base[pos]);
+		++pos;
+	}
+	if (has_pending) PushMatch(c, pending_length, pending_distance);
+	FlushBlock(c);
+
+	// Sync flush: an empty stored block leaves the stream byte aligned for whatever chunk comes next.
+	ReserveDeflateOutput(out, 16);
+	PutBits(&c->writer, 0, 3);
+	AlignToByte(&c->writer);
+	PutBits(&c->writer, 0x0000, 16);
+	PutBits(&c->writer, 0xFFFF, 16);
+
+	free(c->tokens);
+	free(c->head);
+	free(c);
+}
+
+void DeflateFinish(DeflateOutput* out)
+{
+	// A final fixed Huffman block holding nothing but the end-of-block code.
+	const u8 final_block[2] = {0x03, 0x00};
+	AppendDeflateOutput(out, final_block, sizeof(final_block));
+}
+
+#define ADLER_MOD 65521
+#define ADLER_MAX_RUN 5552 // Longest run before the sums could overflow 32 bits.
+
+u32 ComputeAdler32(u32 adler, const u8* data, size_t size)
+{
+	u32 a = adler & 0xFFFF;
+	u32 b = adler >> 16;
+	while (size)
+	{
+		size_t run = (size < ADLER_MAX_RUN) ? size : ADLER_MAX_RUN;
+		size -= run;
+		while (run--)
+		{
+			a += *data++;
+			b += a;
+		}
+		a %= ADLER_MOD;
+		b %= ADLER_MOD;
+	}
+	return a | (b << 16);
+}
+
+u32 CombineAdler32(u32 adler1, u32 adler2, size_t size2)
+{
+	u32 remainder = (u32)(size2 % ADLER_MOD);
+	u32 sum1 = adler1 & 0xFFFF;
+	u32 sum2 = (u32)(((u64)remainder * sum1) % ADLER_MOD);
+	sum1 += (adler2 & 0xFFFF) + ADLER_MOD - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_MOD - remainder;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum2 >= ((u32)ADLER_MOD << 1)) sum2 -= ((u32)ADLER_MOD << 1);
+	if (sum2 >= ADLER_MOD) sum2 -= ADLER_MOD;
+	return sum1 | (sum2 << 16);
+}
+
+u32 ComputeCrc32(u32 crc, const u8* data, size_t size)
+{
+	const u32* table = GetDeflateTables()->crc;
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
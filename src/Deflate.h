@@ -0,0 +1,40 @@
+#ifndef _DEFLATE_H
+#define _DEFLATE_H
+
+// Deflate (RFC 1951) compression in independent chunks, plus the checksums zlib and PNG need around it.
+// Each chunk ends on a byte boundary with a sync flush (an empty stored block) rather than a final
+// block, so chunks compressed on different threads can simply be concatenated into one valid stream,
+// the same way pigz does it. A chunk may also reference up to 32K of the data in front of it, which
+// keeps the ratio close to single-threaded compression.
+
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_MAX_LEVEL 9
+#define DEFLATE_DEFAULT_LEVEL 6
+
+// Growable output buffer. Zero-initialize it; the compressor appends to whatever is already there.
+struct DeflateOutput
+{
+	u8* data;
+	size_t size;
+	size_t capacity;
+};
+
+// Compresses data[0, size) as non-final blocks followed by a sync flush, appending to out. The dict_size
+// bytes right in front of data (at most DEFLATE_WINDOW_SIZE) must be readable; matches may refer to
+// them. Level runs from 1 (fastest) to 9 (smallest).
+void DeflateChunk(const u8* data, size_t dict_size, size_t size, int level, DeflateOutput* out);
+
+// Appends the empty final block that ends a stream made of DeflateChunk output.
+void DeflateFinish(DeflateOutput* out);
+
+void AppendDeflateOutput(DeflateOutput* out, const void* data, size_t size);
+void FreeDeflateOutput(DeflateOutput* out);
+
+// Adler-32 and CRC-32 of data, continuing from a previous value (start from 1 and 0 respectively).
+u32 ComputeAdler32(u32 adler, const u8* data, size_t size);
+u32 ComputeCrc32(u32 crc, const u8* data, size_t size);
+
+// Adler-32 of two blocks of data back to back, given the checksum of each and the size of the second.
+u32 CombineAdler32(u32 adler1, u32 adler2, size_t size2);
+
+#endif //_DEFLATE_H
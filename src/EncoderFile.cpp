@@ -0,0 +1,35 @@
+#include "EncoderFile.h"
+
+bool OpenEncoderFile(EncoderFile* file, const char* file_path)
+{
+	assert(file && file_path);
+	*file = {};
+	file->file = fopen(file_path, "wb");
+	if (!file->file) return false;
+
+	size_t path_size = strlen(file_path) + 1;
+	file->file_path = (char*)malloc(path_size); // @malloc
+	memcpy(file->file_path, file_path, path_size);
+	return true;
+}
+
+bool WriteEncoderFile(EncoderFile* file, const void* data, size_t size)
+{
+	assert(file);
+	if (!file->file || file->has_error) return false;
+	if (size && fwrite(data, 1, size, file->file) != size) file->has_error = true;
+	return !file->has_error;
+}
+
+bool CloseEncoderFile(EncoderFile* file, bool is_complete)
+{
+	assert(file);
+	if (!file->file) return false;
+
+	bool is_kept = (is_complete && !file->has_error);
+	if (fclose(file->file) != 0) is_kept = false;
+	if (!is_kept) remove(file->file_path);
+	free(file->file_path);
+	*file = {};
+	return is_kept;
+}
@@ -0,0 +1,36 @@
+#ifndef _ENCODER_FILE_H
+#define _ENCODER_FILE_H
+
+// Output file shared by the streaming image writers. It keeps its path so that a file that was never
+// finished (because a write failed, or the export was cancelled) can be deleted when it is closed.
+struct EncoderFile
+{
+	FILE* file;
+	char* file_path;
+	bool has_error; // Sticky: once a write fails, the file is thrown away when closed.
+};
+
+bool OpenEncoderFile(EncoderFile* file, const char* file_path);
+
+// Returns false (and from then on keeps returning false) if anything failed to write.
+bool WriteEncoderFile(EncoderFile* file, const void* data, size_t size);
+
+// Closes the file, deleting it unless it is complete and every write succeeded. Safe to call on a file
+// that failed to open. Returns true if the file was kept.
+bool CloseEncoderFile(EncoderFile* file, bool is_complete);
+
+inline void PutU16LittleEndian(u8* dst, u32 value)
+{
+	dst[0] = (u8)value;
+	dst[1] = (u8)(value >> 8);
+}
+
+inline void PutU32LittleEndian(u8* dst, u32 value)
+{
+	dst[0] = (u8)value;
+	dst[1] = (u8)(value >> 8);
+	dst[2] = (u8)(value >> 16);
+	dst[3] = (u8)(value >> 24);
+}
+
+#endif //_ENCODER_FILE_H
@@ -0,0 +1,424 @@
+#include "ImageDecode.h"
+#include "Platform/Platform.h"
+#include "MipChain.h"
+#include "ProgressiveDecode.h"
+#include "Core/FrameScheduler.h"
+
+// Decodes with the stb_image variant matching the file's bit depth. Exactly one of memory/file_path is used.
+static void* DecodeNativePixels(const stbi_uc* memory, int memory_size, const char* file_path, int* width, int* height, PixelLayout* layout)
+{
+	void* result = 0;
+	int channel_count = 0;
+	if (memory)
+	{
+		if (stbi_is_hdr_from_memory(memory, memory_size))
+		{
+			layout->type = PixelType::F32;
+			result = stbi_loadf_from_memory(memory, memory_size, width, height, &channel_count, 0);
+		}
+		else if (stbi_is_16_bit_from_memory(memory, memory_size))
+		{
+			layout->type = PixelType::U16;
+			result = stbi_load_16_from_memory(memory, memory_size, width, height, &channel_count, 0);
+		}
+		else
+		{
+			layout->type = PixelType::U8;
+			result = stbi_load_from_memory(memory, memory_size, width, height, &channel_count, 0);
+		}
+	}
+	else
+	{
+		if (stbi_is_hdr(file_path))
+		{
+			layout->type = PixelType::F32;
+			result = stbi_loadf(file_path, width, height, &channel_count, 0);
+		}
+		else if (stbi_is_16_bit(file_path))
+		{
+			layout->type = PixelType::U16;
+			result = stbi_load_16(file_path, width, height, &channel_count, 0);
+		}
+		else
+		{
+			layout->type = PixelType::U8;
+			result = stbi_load(file_path, width, height, &channel_count, 0);
+		}
+	}
+	layout->channel_count = channel_count;
+	return result;
+}
+
+bool DecodeImageFile(const char* file_path, DecodedImage* image)
+{
+	assert(file_path && image);
+	*image = {};
+
+	// Decode straight out of a mapped view of the file, so the compressed data is never copied into a
+	// heap buffer first. stb_image takes an int length, so anything bigger goes through stdio instead.
+	Platform::MappedFile mapped_file = {};
+	if (Platform::MapFileForRead(file_path, &mapped_file) && mapped_file.size <= (u64)S32_MAX)
+	{
+		image->pixels = DecodeNativePixels((stbi_uc*)mapped_file.data, (int)mapped_file.size, 0, &image->width, &image->height, &image->layout);
+	}
+	else
+	{
+		image->pixels = DecodeNativePixels(0, 0, file_path, &image->width, &image->height, &image->layout);
+	}
+	Platform::UnmapFile(&mapped_file);
+
+	if (!image->pixels)
+	{
+		*image = {};
+		return false;
+	}
+	return true;
+}
+
+bool DecodeImageFileBuffered(const char* file_path, DecodedImage* image)
+{
+	assert(file_path && image);
+	*image = {};
+	image->pixels = DecodeNativePixels(0, 0, file_path, &image->width, &image->height, &image->layout);
+	if (!image->pixels)
+	{
+		*image = {};
+		return false;
+	}
+	return true;
+}
+
+bool DecodeImageFromMemory(const void* data, u64 size, DecodedImage* image)
+{
+	assert(data && image);
+	*image = {};
+	if (size > (u64)S32_MAX) return false;
+
+	image->pixels = DecodeNativePixels((const stbi_uc*)data, (int)size, 0, &image->width, &image->height, &image->layout);
+	if (!image->pixels)
+	{
+		*image = {};
+		return false;
+	}
+	return true;
+}
+
+bool ProbeImageFile(const char* file_path, int* width, int* height, PixelLayout* layout)
+{
+	assert(file_path && width && height && layout);
+	*width = 0;
+	*height = 0;
+	*layout = {};
+
+	// Mapping only faults in the pages the header parsers actually touch.
+	Platform::MappedFile mapped_file = {};
+	if (!Platform::MapFileForRead(file_path, &mapped_file) || mapped_file.size > (u64)S32_MAX)
+	{
+		Platform::UnmapFile(&mapped_file);
+		return false;
+	}
+
+	const stbi_uc* memory = (const stbi_uc*)mapped_file.data;
+	int memory_size = (int)mapped_file.size;
+	bool success = stbi_info_from_memory(memory, memory_size, width, height, &layout->channel_count) != 0;
+	if (success)
+	{
+		if (stbi_is_hdr_from_memory(memory, memory_size)) layout->type = PixelType::F32;
+		else if (stbi_is_16_bit_from_memory(memory, memory_size)) layout->type = PixelType::U16;
+		else layout->type = PixelType::U8;
+	}
+	Platform::UnmapFile(&mapped_file);
+	return success;
+}
+
+void FreeDecodedImage(DecodedImage* image)
+{
+	assert(image);
+	if (image->pixels) stbi_image_free(image->pixels);
+	*image = {};
+}
+
+// Extensions of the formats stb_image reads.
+static const char* image_file_extensions[] = {"png", "jpg", "jpeg", "bmp", "tga", "psd", "gif", "hdr", "pic", "pnm", "ppm", "pgm"};
+
+static char LowerAscii(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static int CompareNoCase(const char* a, const char* b)
+{
+	while (*a && LowerAscii(*a) == LowerAscii(*b))
+	{
+		++a;
+		++b;
+	}
+	return (int)(unsigned char)LowerAscii(*a) - (int)(unsigned char)LowerAscii(*b);
+}
+
+static int CompareImageFileNames(const void* a, const void* b)
+{
+	return CompareNoCase(*(const char* const*)a, *(const char* const*)b);
+}
+
+bool IsImageFileName(const char* file_name)
+{
+	assert(file_name);
+	const char* dot = strrchr(file_name, '.');
+	if (!dot) return false;
+	for (int i = 0; i < (int)ARRAYCOUNT(image_file_extensions); ++i)
+	{
+		if (CompareNoCase(dot + 1, image_file_extensions[i]) == 0) return true;
+	}
+	return false;
+}
+
+char** ListImageFileNames(const char* directory_path, int* count)
+{
+	assert(directory_path && count);
+	int name_count = 0;
+	char** names = Platform::ListDirectory(directory_path, &name_count);
+	*count = 0;
+	if (!names) return 0;
+	for (int i = 0; i < name_count; ++i)
+	{
+		if (IsImageFileName(names[i])) names[(*count)++] = names[i];
+		else free(names[i]);
+	}
+	qsort(names, *count, sizeof(char*), CompareImageFileNames);
+	return names;
+}
+
+template <typename T>
+static void ExpandToRGBA(const T* src, int channel_count, size_t pixel_count, T* dst, T opaque)
+{
+	switch (channel_count)
+	{
+		case 1:
+		for (size_t i = 0; i < pixel_count; ++i, dst += 4)
+		{
+			dst[0] = dst[1] = dst[2] = src[i];
+			dst[3] = opaque;
+		}
+		break;
+		case 2:
+		for (size_t i = 0; i < pixel_count; ++i, src += 2, dst += 4)
+		{
+			dst[0] = dst[1] = dst[2] = src[0];
+			dst[3] = src[1];
+		}
+		break;
+		case 3:
+		for (size_t i = 0; i < pixel_count; ++i, src += 3, dst += 4)
+		{
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst[3] = opaque;
+		}
+		break;
+		default:
+		memcpy(dst, src, pixel_count * 4 * sizeof(T));
+		break;
+	}
+}
+
+void ExpandPixelsToRGBA(const void* src, PixelLayout layout, size_t pixel_count, void* dst)
+{
+	assert(src && dst);
+	switch (layout.type)
+	{
+		case PixelType::U8: ExpandToRGBA((const u8*)src, layout.channel_count, pixel_count, (u8*)dst, (u8)U8_MAX); break;
+		case PixelType::U16: ExpandToRGBA((const u16*)src, layout.channel_count, pixel_count, (u16*)dst, (u16)U16_MAX); break;
+		case PixelType::F32: ExpandToRGBA((const float*)src, layout.channel_count, pixel_count, (float*)dst, 1.0f); break;
+	}
+}
+
+void ConvertPixelsToU8(const void* src, PixelLayout layout, size_t pixel_count, u8* dst)
+{
+	assert(src && dst);
+	size_t value_count = pixel_count * layout.channel_count;
+	switch (layout.type)
+	{
+		case PixelType::U8:
+		{
+			memcpy(dst, src, value_count);
+		}
+		break;
+		case PixelType::U16:
+		{
+			const u16* values = (const u16*)src;
+			for (size_t i = 0; i < value_count; ++i) dst[i] = (u8)(values[i] >> 8);
+		}
+		break;
+		case PixelType::F32:
+		{
+			// Grey + alpha and RGBA keep their alpha linear; everything else gets the 2.2 gamma curve.
+			bool has_alpha = (layout.channel_count == 2 || layout.channel_count == 4);
+			const float* values = (const float*)src;
+			for (size_t i = 0; i < value_count; ++i)
+			{
+				bool is_alpha = has_alpha && (i % layout.channel_count == (size_t)layout.channel_count - 1);
+				float value = values[i];
+				if (!is_alpha) value = powf(value > 0.0f ? value : 0.0f, 1.0f / 2.2f);
+				value = value * 255.0f + 0.5f;
+				dst[i] = (u8)(value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value));
+			}
+		}
+		break;
+	}
+}
+
+void ConvertPixelsToF32(const void* src, PixelLayout layout, size_t pixel_count, float* dst)
+{
+	assert(src && dst);
+	size_t value_count = pixel_count * layout.channel_count;
+	if (layout.type == PixelType::F32)
+	{
+		memcpy(dst, src, value_count * sizeof(float));
+		return;
+	}
+
+	// The inverse of ConvertPixelsToU8: color is linearized with the 2.2 gamma curve, alpha is left alone.
+	bool has_alpha = (layout.channel_count == 2 || layout.channel_count == 4);
+	float scale = (layout.type == PixelType::U8) ? 1.0f / U8_MAX : 1.0f / U16_MAX;
+	for (size_t i = 0; i < value_count; ++i)
+	{
+		bool is_alpha = has_alpha && (i % layout.channel_count == (size_t)layout.channel_count - 1);
+		float value = ((layout.type == PixelType::U8) ? ((const u8*)src)[i] : ((const u16*)src)[i]) * scale;
+		dst[i] = is_alpha ? value : powf(value, 2.2f);
+	}
+}
+
+template <typename T>
+static void ConvertChannels(const T* src, int src_channels, size_t pixel_count, T* dst, int dst_channels, T opaque)
+{
+	bool is_src_gray = (src_channels <= 2);
+	bool src_has_alpha = (src_channels == 2 || src_channels == 4);
+	int dst_colors = (dst_channels <= 2) ? 1 : 3;
+	bool dst_has_alpha = (dst_channels == 2 || dst_channels == 4);
+	for (size_t i = 0; i < pixel_count; ++i, src += src_channels, dst += dst_channels)
+	{
+		for (int c = 0; c < dst_colors; ++c) dst[c] = is_src_gray ? src[0] : src[c];
+		if (dst_has_alpha) dst[dst_colors] = src_has_alpha ? src[src_channels - 1] : opaque;
+	}
+}
+
+void ConvertPixelChannels(const void* src, PixelLayout layout, size_t pixel_count, void* dst, int channel_count)
+{
+	assert(src && dst && channel_count >= 1 && channel_count <= 4);
+	assert(layout.channel_count <= 2 || channel_count >= 3);
+	if (channel_count == layout.channel_count)
+	{
+		memcpy(dst, src, pixel_count * GetPixelSize(layout));
+		return;
+	}
+	switch (layout.type)
+	{
+		case PixelType::U8: ConvertChannels((const u8*)src, layout.channel_count, pixel_count, (u8*)dst, channel_count, (u8)U8_MAX); break;
+		case PixelType::U16: ConvertChannels((const u16*)src, layout.channel_count, pixel_count, (u16*)dst, channel_count, (u16)U16_MAX); break;
+		case PixelType::F32: ConvertChannels((const float*)src, layout.channel_count, pixel_count, (float*)dst, channel_count, 1.0f); break;
+	}
+}
+
+PixelBuffer* CreatePixelBuffer(DecodedImage* image)
+{
+	assert(image && image->pixels);
+	PixelBuffer* buffer = new PixelBuffer();
+	buffer->image = *image;
+	buffer->ref_count.store(1);
+	*image = {};
+	return buffer;
+}
+
+PixelBuffer* RetainPixelBuffer(PixelBuffer* buffer)
+{
+	assert(buffer);
+	buffer->ref_count.fetch_add(1);
+	return buffer;
+}
+
+void ReleasePixelBuffer(PixelBuffer* buffer)
+{
+	if (!buffer || buffer->ref_count.fetch_sub(1) != 1) return;
+	FreeDecodedImage(&buffer->image);
+	delete buffer;
+}
+
+static void DestroyImageLoadJob(void* data)
+{
+	ImageLoadJob* job = (ImageLoadJob*)data;
+	FreeDecodedImage(&job->image);
+	if (job->mips)
+	{
+		FreeMipChain(job->mips);
+		free(job->mips);
+	}
+	FreeDecodeProgress(job->progress);
+	free(job->file_path);
+	delete job;
+}
+
+static void RunImageLoadJob(void* data)
+{
+	ImageLoadJob* job = (ImageLoadJob*)data;
+	job->state.store(ImageLoadState::Decoding);
+	bool success = job->progress ? DecodeImageFileProgressive(job->file_path, job->progress, &job->image, &job->shared.is_cancelled) : DecodeImageFile(job->file_path, &job->image);
+	
+	// Every image is displayed with a full mip chain, and building it here keeps it off the render thread.
+	if (success && !job->shared.is_cancelled.load())
+	{
+		job->mips = (MipChain*)malloc(sizeof(MipChain)); // @malloc
+		BuildMipChain(job->image.pixels, job->image.layout, job->image.width, job->image.height, job->mips);
+	}
+	job->state.store(success ? ImageLoadState::Ready : ImageLoadState::Failed);
+	
+	// The main loop may be asleep; it has to wake up to upload the result.
+	WakeFrameScheduler();
+}
+
+ImageLoadJob* QueueImageLoad(const char* file_path, bool is_progressive)
+{
+	assert(file_path);
+	ImageLoadJob* job = new ImageLoadJob();
+
+	size_t path_size = strlen(file_path) + 1;
+	job->file_path = (char*)malloc(path_size);
+	memcpy(job->file_path, file_path, path_size);
+
+	job->image = {};
+	job->mips = 0;
+	job->progress = is_progressive ? CreateDecodeProgress() : 0;
+	job->state.store(ImageLoadState::Queued);
+	PushSharedJob(&job->shared, RunImageLoadJob, DestroyImageLoadJob, job);
+	return job;
+}
+
+ImageLoadState GetImageLoadState(ImageLoadJob* job)
+{
+	assert(job);
+	return job->state.load();
+}
+
+DecodedImage TakeDecodedImage(ImageLoadJob* job)
+{
+	assert(job && job->state.load() == ImageLoadState::Ready);
+	DecodedImage result = job->image;
+	job->image = {};
+	return result;
+}
+
+MipChain* TakeMipChain(ImageLoadJob* job)
+{
+	assert(job && job->state.load() == ImageLoadState::Ready);
+	MipChain* result = job->mips;
+	job->mips = 0;
+	return result;
+}
+
+void ReleaseImageLoad(ImageLoadJob* job)
+{
+	if (!job) return;
+	CancelSharedJob(&job->shared);
+	ReleaseSharedJob(&job->shared);
+}
@@ -0,0 +1,138 @@
+#ifndef _IMAGE_DECODE_H
+#define _IMAGE_DECODE_H
+
+#include "Core/JobSystem.h"
+
+struct MipChain;
+struct DecodeProgress;
+
+// CPU side of image loading. Nothing in here touches the renderer, so it can be driven headless; the
+// D3D upload half lives in ImageLoader.cpp.
+
+// Storage type of a single channel.
+enum class PixelType : u8
+{
+	U8 = 0,
+	U16,
+	F32
+};
+
+// How pixels are laid out in memory: channel_count interleaved channels of one type, rows tightly packed.
+struct PixelLayout
+{
+	int channel_count; // 1 (grey), 2 (grey + alpha), 3 (RGB) or 4 (RGBA).
+	PixelType type;
+};
+
+inline int GetPixelTypeSize(PixelType type)
+{
+	switch (type)
+	{
+		case PixelType::U16: return 2;
+		case PixelType::F32: return 4;
+		default: return 1;
+	}
+}
+
+inline int GetPixelSize(PixelLayout layout)
+{
+	return layout.channel_count * GetPixelTypeSize(layout.type);
+}
+
+struct DecodedImage
+{
+	void* pixels; // Allocated by stb_image, free with FreeDecodedImage.
+	int width;
+	int height;
+	PixelLayout layout; // Native layout of the file; nothing is expanded at decode time.
+};
+
+// Reference counted pixels, so work that reads an image (an export, say) can hold on to it without
+// copying, even if the panel it came from is closed in the meantime. Shared pixels are never modified.
+struct PixelBuffer
+{
+	DecodedImage image;
+	std::atomic<int> ref_count;
+};
+
+enum class ImageLoadState : u32
+{
+	Queued = 0,
+	Decoding,
+	Ready,
+	Failed
+};
+
+// One in-flight decode.
+struct ImageLoadJob
+{
+	SharedJob shared;
+
+	char* file_path; // Owned copy of the requested path.
+	DecodedImage image;
+	MipChain* mips; // Built on the worker as well, so the render thread only has to upload it.
+	DecodeProgress* progress; // Only for progressive decodes, which show what they have while they run.
+
+	std::atomic<ImageLoadState> state;
+};
+
+// Synchronously decodes a file in its native layout: 8-bit, 16-bit (stbi_load_16) or float (stbi_loadf)
+// with whatever channel count the file has. Returns false (and leaves image zeroed) on failure.
+bool DecodeImageFile(const char* file_path, DecodedImage* image);
+
+// Same, for a file that is already in memory. data isn't kept.
+bool DecodeImageFromMemory(const void* data, u64 size, DecodedImage* image);
+
+// Same as DecodeImageFile, but lets stb_image read the file through stdio into buffers of its own instead
+// of mapping it. Only there for benchmarks to compare against.
+bool DecodeImageFileBuffered(const char* file_path, DecodedImage* image);
+
+// Reads just enough of the file's header to tell what DecodeImageFile would produce, without decoding
+// any pixels. Returns false if stb_image doesn't recognize the file.
+bool ProbeImageFile(const char* file_path, int* width, int* height, PixelLayout* layout);
+void FreeDecodedImage(DecodedImage* image);
+
+// True for the file extensions DecodeImageFile understands, whatever their case.
+bool IsImageFileName(const char* file_name);
+
+// Names of the images directly inside a folder, sorted without regard to case. Returns null if the folder
+// can't be read. The caller frees each name and the array.
+char** ListImageFileNames(const char* directory_path, int* count);
+
+// Expands pixel_count pixels to four channels of the same type, filling in grey and opaque alpha.
+// dst must hold pixel_count * 4 channels.
+void ExpandPixelsToRGBA(const void* src, PixelLayout layout, size_t pixel_count, void* dst);
+
+// Converts pixel_count pixels to 8 bits per channel, keeping the channel count. Float color channels
+// are treated as linear and gamma encoded, the same way stb_image maps HDR to LDR.
+void ConvertPixelsToU8(const void* src, PixelLayout layout, size_t pixel_count, u8* dst);
+
+// Converts to F32, keeping the channel count. Integer color is linearized with the inverse of the curve
+// ConvertPixelsToU8 applies; alpha stays linear.
+void ConvertPixelsToF32(const void* src, PixelLayout layout, size_t pixel_count, float* dst);
+
+// Changes the channel count, keeping the type. Gray is replicated into RGB, missing alpha becomes opaque
+// and unwanted alpha is dropped. Color can't be reduced to gray.
+void ConvertPixelChannels(const void* src, PixelLayout layout, size_t pixel_count, void* dst, int channel_count);
+
+// Takes ownership of the image's pixels. The caller holds the first reference.
+PixelBuffer* CreatePixelBuffer(DecodedImage* image);
+PixelBuffer* RetainPixelBuffer(PixelBuffer* buffer);
+void ReleasePixelBuffer(PixelBuffer* buffer);
+
+// Queues a decode on the job system and returns immediately. The caller owns one reference and must
+// eventually hand it back with ReleaseImageLoad. A progressive decode (see ProgressiveDecode.h) publishes
+// rows to job->progress as it goes, and stops as soon as it's released.
+ImageLoadJob* QueueImageLoad(const char* file_path, bool is_progressive = false);
+ImageLoadState GetImageLoadState(ImageLoadJob* job);
+
+// Moves the decoded pixels out of a Ready job. The caller becomes responsible for freeing them.
+DecodedImage TakeDecodedImage(ImageLoadJob* job);
+
+// Moves the mip chain out of a Ready job. Free it with FreeMipChain and free().
+MipChain* TakeMipChain(ImageLoadJob* job);
+
+// Drops the caller's reference. If the decode hasn't started yet, it is skipped.
+void ReleaseImageLoad(ImageLoadJob* job);
+
+#endif //_IMAGE_DECODE_H
@@ -0,0 +1,532 @@
+#include "ImageDiff.h"
+#include "Core/CpuFeatures.h"
+#include "Core/JobSystem.h"
+#include "Core/FrameScheduler.h"
+#include <math.h>
+
+// Rows per ParallelFor index. Each band keeps its own totals, which are combined at the end.
+#define DIFF_BAND_ROWS 16
+
+struct DiffTotals
+{
+	double max_error[4];
+	double squared_error[4];
+	u64 mismatch_count;
+};
+
+// Scalar reference for every type, starting at pixel first_x. Differences are taken in the source type
+// (float for float, exact for integers) and squared in double. A pixel is a mismatch if any of its
+// channels differ by more than the threshold; mask may be null if only the count is wanted.
+template <typename T>
+static void DiffRowScalar(const T* a, const T* b, int channel_count, int first_x, int width, T threshold, T* difference, u8* mask, DiffTotals* totals)
+{
+	for (int x = first_x; x < width; ++x)
+	{
+		bool is_mismatch = false;
+		for (int c = 0; c < channel_count; ++c)
+		{
+			size_t i = (size_t)x * channel_count + c;
+			T d = (a[i] > b[i]) ? (T)(a[i] - b[i]) : (T)(b[i] - a[i]);
+			difference[i] = d;
+			is_mismatch |= (d > threshold);
+
+			if ((double)d > totals->max_error[c]) totals->max_error[c] = (double)d;
+			totals->squared_error[c] += (double)d * (double)d;
+		}
+		totals->mismatch_count += is_mismatch;
+		if (mask) mask[x] = is_mismatch ? 255 : 0;
+	}
+}
+
+#ifdef CORE_SIMD_X86
+// The SSE2 kernels below all take channel_count vectors per step, so every step covers whole pixels and
+// lane k of vector j always holds channel (j * lanes + k) % channel_count. Maxima and sums stay in
+// their lanes until the end of the row and are sorted out by channel here.
+template <typename L>
+static void AddDiffLanes(const L* lanes, int lane_count, int first_value, int value_step, int channel_count, bool is_max, double* totals)
+{
+	for (int k = 0; k < lane_count; ++k)
+	{
+		int c = (first_value + k * value_step) % channel_count;
+		if (is_max)
+		{
+			if ((double)lanes[k] > totals[c]) totals[c] = (double)lanes[k];
+		}
+		else
+		{
+			totals[c] += (double)lanes[k];
+		}
+	}
+}
+
+// Marks one step's worth of pixels given one bit per value, set for values over the threshold. Most
+// steps of most diffs have none, so those are a single test.
+static void MarkDiffStep(u64 over_bits, int channel_count, int pixel_count, u8* mask, DiffTotals* totals)
+{
+	if (!over_bits)
+	{
+		if (mask) memset(mask, 0, pixel_count);
+		return;
+	}
+
+	u64 pixel_bits = ((u64)1 << channel_count) - 1;
+	for (int x = 0; x < pixel_count; ++x)
+	{
+		bool is_mismatch = ((over_bits >> (x * channel_count)) & pixel_bits) != 0;
+		totals->mismatch_count += is_mismatch;
+		if (mask) mask[x] = is_mismatch ? 255 : 0;
+	}
+}
+
+// Sixteen values per vector. The squares fit in 16 bits, and are widened to 32-bit lanes that are
+// emptied often enough not to overflow.
+template <int channel_count>
+static void DiffRowU8(const u8* a, const u8* b, int width, u8 threshold, u8* difference, u8* mask, DiffTotals* totals)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i limit = _mm_set1_epi8((char)threshold);
+	__m128i maxs[channel_count];
+	__m128i squares[channel_count][4];
+	for (int j = 0; j < channel_count; ++j)
+	{
+		maxs[j] = zero;
+		squares[j][0] = squares[j][1] = squares[j][2] = squares[j][3] = zero;
+	}
+
+	int x = 0;
+	int steps = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		size_t offset = (size_t)x * channel_count;
+		u64 over_bits = 0;
+		for (int j = 0; j < channel_count; ++j)
+		{
+			__m128i va = _mm_loadu_si128((const __m128i*)(a + offset + j * 16));
+			__m128i vb = _mm_loadu_si128((const __m128i*)(b + offset + j * 16));
+			__m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+			_mm_storeu_si128((__m128i*)(difference + offset + j * 16), d);
+			maxs[j] = _mm_max_epu8(maxs[j], d);
+
+			// Over the threshold exactly where subtracting it doesn't saturate to zero.
+			u32 within = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(d, limit), zero));
+			over_bits |= (u64)(~within & 0xFFFF) << (j * 16);
+
+			__m128i low = _mm_unpacklo_epi8(d, zero);
+			__m128i high = _mm_unpackhi_epi8(d, zero);
+			low = _mm_mullo_epi16(low, low);
+			high = _mm_mullo_epi16(high, high);
+			squares[j][0] = _mm_add_epi32(squares[j][0], _mm_unpacklo_epi16(low, zero));
+			squares[j][1] = _mm_add_epi32(squares[j][1], _mm_unpackhi_epi16(low, zero));
+			squares[j][2] = _mm_add_epi32(squares[j][2], _mm_unpacklo_epi16(high, zero));
+			squares[j][3] = _mm_add_epi32(squares[j][3], _mm_unpackhi_epi16(high, zero));
+		}
+		MarkDiffStep(over_bits, channel_count, 16, mask ? mask + x : 0, totals);
+
+		// Each lane gains at most 255^2 per step.
+		bool is_last = (x + 32 > width);
+		if (++steps == 65536 || is_last)
+		{
+			for (int j = 0; j < channel_count; ++j)
+			{
+				for (int q = 0; q < 4; ++q)
+				{
+					u32 lanes[4];
+					_mm_storeu_si128((__m128i*)lanes, squares[j][q]);
+					AddDiffLanes(lanes, 4, j * 16 + q * 4, 1, channel_count, false, totals->squared_error);
+					squares[j][q] = zero;
+				}
+			}
+			steps = 0;
+		}
+	}
+	for (int j = 0; j < channel_count; ++j)
+	{
+		u8 lanes[16];
+		_mm_storeu_si128((__m128i*)lanes, maxs[j]);
+		AddDiffLanes(lanes, 16, j * 16, 1, channel_count, true, totals->max_error);
+	}
+	DiffRowScalar(a, b, channel_count, x, width, threshold, difference, mask, totals);
+}
+
+// Eight values per vector. SSE2 has no unsigned 16-bit max, so it's done with a saturating subtract,
+// and the squares go into 64-bit lanes two at a time (even values, then odd).
+template <int channel_count>
+static void DiffRowU16(const u16* a, const u16* b, int width, u16 threshold, u16* difference, u8* mask, DiffTotals* totals)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i limit = _mm_set1_epi16((short)threshold);
+	__m128i maxs[channel_count];
+	__m128i squares[channel_count][4];
+	for (int j = 0; j < channel_count; ++j)
+	{
+		maxs[j] = zero;
+		squares[j][0] = squares[j][1] = squares[j][2] = squares[j][3] = zero;
+	}
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		size_t offset = (size_t)x * channel_count;
+		u64 over_bits = 0;
+		for (int j = 0; j < channel_count; ++j)
+		{
+			__m128i va = _mm_loadu_si128((const __m128i*)(a + offset + j * 8));
+			__m128i vb = _mm_loadu_si128((const __m128i*)(b + offset + j * 8));
+			__m128i d = _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va));
+			_mm_storeu_si128((__m128i*)(difference + offset + j * 8), d);
+			maxs[j] = _mm_add_epi16(_mm_subs_epu16(maxs[j], d), d);
+
+			__m128i within = _mm_cmpeq_epi16(_mm_subs_epu16(d, limit), zero);
+			u32 within_bits = (u32)_mm_movemask_epi8(_mm_packs_epi16(within, zero));
+			over_bits |= (u64)(~within_bits & 0xFF) << (j * 8);
+
+			__m128i low = _mm_unpacklo_epi16(d, zero);
+			__m128i high = _mm_unpackhi_epi16(d, zero);
+			squares[j][0] = _mm_add_epi64(squares[j][0], _mm_mul_epu32(low, low));
+			squares[j][1] = _mm_add_epi64(squares[j][1], _mm_mul_epu32(_mm_srli_epi64(low, 32), _mm_srli_epi64(low, 32)));
+			squares[j][2] = _mm_add_epi64(squares[j][2], _mm_mul_epu32(high, high));
+			squares[j][3] = _mm_add_epi64(squares[j][3], _mm_mul_epu32(_mm_srli_epi64(high, 32), _mm_srli_epi64(high, 32)));
+		}
+		MarkDiffStep(over_bits, channel_count, 8, mask ? mask + x : 0, totals);
+	}
+	for (int j = 0; j < channel_count; ++j)
+	{
+		u16 max_lanes[8];
+		_mm_storeu_si128((__m128i*)max_lanes, maxs[j]);
+		AddDiffLanes(max_lanes, 8, j * 8, 1, channel_count, true, totals->max_error);
+
+		// squares[j][q] holds values 0 and 2, 1 and 3, 4 and 6, then 5 and 7 of vector j.
+		static const int first_values[4] = {0, 1, 4, 5};
+		for (int q = 0; q < 4; ++q)
+		{
+			u64 lanes[2];
+			_mm_storeu_si128((__m128i*)lanes, squares[j][q]);
+			AddDiffLanes(lanes, 2, j * 8 + first_values[q], 2, channel_count, false, totals->squared_error);
+		}
+	}
+	DiffRowScalar(a, b, channel_count, x, width, threshold, difference, mask, totals);
+}
+
+// Four values per vector, squared in double two at a time.
+template <int channel_count>
+static void DiffRowF32(const float* a, const float* b, int width, float threshold, float* difference, u8* mask, DiffTotals* totals)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 limit = _mm_set1_ps(threshold);
+	__m128 maxs[channel_count];
+	__m128d squares[channel_count][2];
+	for (int j = 0; j < channel_count; ++j)
+	{
+		maxs[j] = _mm_setzero_ps();
+		squares[j][0] = squares[j][1] = _mm_setzero_pd();
+	}
+
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		size_t offset = (size_t)x * channel_count;
+		u64 over_bits = 0;
+		for (int j = 0; j < channel_count; ++j)
+		{
+			__m128 d = _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(a + offset + j * 4), _mm_loadu_ps(b + offset + j * 4)));
+			_mm_storeu_ps(difference + offset + j * 4, d);
+			maxs[j] = _mm_max_ps(d, maxs[j]); // Returns the second operand for NaNs, so they're skipped.
+			over_bits |= (u64)_mm_movemask_ps(_mm_cmpgt_ps(d, limit)) << (j * 4);
+
+			__m128d low = _mm_cvtps_pd(d);
+			__m128d high = _mm_cvtps_pd(_mm_movehl_ps(d, d));
+			squares[j][0] = _mm_add_pd(squares[j][0], _mm_mul_pd(low, low));
+			squares[j][1] = _mm_add_pd(squares[j][1], _mm_mul_pd(high, high));
+		}
+		MarkDiffStep(over_bits, channel_count, 4, mask ? mask + x : 0, totals);
+	}
+	for (int j = 0; j < channel_count; ++j)
+	{
+		float max_lanes[4];
+		_mm_storeu_ps(max_lanes, maxs[j]);
+		AddDiffLanes(max_lanes, 4, j * 4, 1, channel_count, true, totals->max_error);
+		for (int q = 0; q < 2; ++q)
+		{
+			double lanes[2];
+			_mm_storeu_pd(lanes, squares[j][q]);
+			AddDiffLanes(lanes, 2, j * 4 + q * 2, 1, channel_count, false, totals->squared_error);
+		}
+	}
+	DiffRowScalar(a, b, channel_count, x, width, threshold, difference, mask, totals);
+}
+
+#define DIFF_ROW_DISPATCH(function, T) \
+switch (layout.channel_count) \
+{ \
+	case 1: function<1>((const T*)a, (const T*)b, width, (T)threshold, (T*)difference, mask, totals); break; \
+	case 2: function<2>((const T*)a, (const T*)b, width, (T)threshold, (T*)difference, mask, totals); break; \
+	case 3: function<3>((const T*)a, (const T*)b, width, (T)threshold, (T*)difference, mask, totals); break; \
+	case 4: function<4>((const T*)a, (const T*)b, width, (T)threshold, (T*)difference, mask, totals); break; \
+	default: assert(false); break; \
+}
+#else
+#define DIFF_ROW_DISPATCH(function, T) DiffRowScalar((const T*)a, (const T*)b, layout.channel_count, 0, width, (T)threshold, (T*)difference, mask, totals)
+#endif
+
+static void DiffRow(const void* a, const void* b, PixelLayout layout, int width, double threshold, void* difference, u8* mask, DiffTotals* totals)
+{
+	switch (layout.type)
+	{
+		case PixelType::U8: DIFF_ROW_DISPATCH(DiffRowU8, u8); break;
+		case PixelType::U16: DIFF_ROW_DISPATCH(DiffRowU16, u16); break;
+		case PixelType::F32: DIFF_ROW_DISPATCH(DiffRowF32, float); break;
+	}
+}
+
+struct DiffPass
+{
+	const DecodedImage* images[2];
+	ImageDiff* diff;
+	double threshold; // In the units of diff->layout.type.
+	DiffTotals* totals; // One per band.
+};
+
+// Brings row y of an image to the compared layout, going through scratch if it has to.
+static const u8* GetDiffRow(const DecodedImage* image, PixelLayout layout, int y, u8* type_scratch, u8* channel_scratch)
+{
+	const u8* row = (const u8*)image->pixels + (size_t)y * image->width * GetPixelSize(image->layout);
+	PixelLayout current = image->layout;
+	if (current.type != layout.type)
+	{
+		assert(layout.type == PixelType::U8);
+		ConvertPixelsToU8(row, current, image->width, type_scratch);
+		row = type_scratch;
+		current.type = PixelType::U8;
+	}
+	if (current.channel_count != layout.channel_count)
+	{
+		ConvertPixelChannels(row, current, image->width, channel_scratch, layout.channel_count);
+		row = channel_scratch;
+	}
+	return row;
+}
+
+// ParallelFor callback: diffs bands [begin, end).
+static void DiffImageBands(int begin, int end, void* data)
+{
+	DiffPass* pass = (DiffPass*)data;
+	ImageDiff* diff = pass->diff;
+	PixelLayout layout = diff->layout;
+	size_t row_size = (size_t)diff->width * GetPixelSize(layout);
+
+	// Per-batch scratch: two conversion rows per image (they're only touched if the image needs them),
+	// and a difference row for when the whole difference image isn't being kept.
+	u8* scratch = (u8*)malloc(row_size * 5); // @malloc
+	u8* difference_row = scratch + row_size * 4;
+
+	for (int band = begin; band < end; ++band)
+	{
+		DiffTotals* totals = &pass->totals[band];
+		*totals = {};
+		int first_row = band * DIFF_BAND_ROWS;
+		int end_row = (first_row + DIFF_BAND_ROWS < diff->height) ? first_row + DIFF_BAND_ROWS : diff->height;
+		for (int y = first_row; y < end_row; ++y)
+		{
+			const u8* a = GetDiffRow(pass->images[0], layout, y, scratch, scratch + row_size);
+			const u8* b = GetDiffRow(pass->images[1], layout, y, scratch + row_size * 2, scratch + row_size * 3);
+			u8* difference = diff->difference ? (u8*)diff->difference + (size_t)y * row_size : difference_row;
+			u8* mask = diff->mask ? diff->mask + (size_t)y * diff->width : 0;
+			DiffRow(a, b, layout, diff->width, pass->threshold, difference, mask, totals);
+		}
+	}
+	free(scratch);
+}
+
+bool DiffImages(const DecodedImage* a, const DecodedImage* b, ImageDiffParams params, ImageDiff* diff)
+{
+	assert(a && b && a->pixels && b->pixels && diff);
+	*diff = {};
+	if (a->width != b->width || a->height != b->height || a->width <= 0 || a->height <= 0) return false;
+
+	PixelLayout layout = a->layout;
+	if (b->layout.channel_count > layout.channel_count) layout.channel_count = b->layout.channel_count;
+	if (a->layout.type != b->layout.type) layout.type = PixelType::U8;
+
+	diff->width = a->width;
+	diff->height = a->height;
+	diff->layout = layout;
+	diff->peak = (layout.type == PixelType::U8) ? 255.0 : ((layout.type == PixelType::U16) ? 65535.0 : 1.0);
+
+	size_t pixel_count = (size_t)diff->width * diff->height;
+	if (params.keep_mask) diff->mask = (u8*)malloc(pixel_count); // @malloc
+	if (params.keep_difference) diff->difference = malloc(pixel_count * GetPixelSize(layout)); // @malloc
+
+	// Integer differences are integers, so "more than t" is the same as "more than floor(t)".
+	double threshold = params.threshold * diff->peak;
+	if (layout.type != PixelType::F32) threshold = floor(threshold);
+	if (threshold < 0.0) threshold = 0.0;
+	if (threshold > diff->peak) threshold = diff->peak;
+
+	int band_count = (diff->height + DIFF_BAND_ROWS - 1) / DIFF_BAND_ROWS;
+	DiffPass pass = {};
+	pass.images[0] = a;
+	pass.images[1] = b;
+	pass.diff = diff;
+	pass.threshold = threshold;
+	pass.totals = (DiffTotals*)malloc(sizeof(DiffTotals) * band_count); // @malloc
+	ParallelFor(band_count, 1, DiffImageBands, &pass);
+
+	double squared_error[4] = {};
+	for (int band = 0; band < band_count; ++band)
+	{
+		const DiffTotals* totals = &pass.totals[band];
+		for (int c = 0; c < layout.channel_count; ++c)
+		{
+			if (totals->max_error[c] > diff->max_error[c]) diff->max_error[c] = totals->max_error[c];
+			squared_error[c] += totals->squared_error[c];
+		}
+		diff->mismatch_count += totals->mismatch_count;
+	}
+	free(pass.totals);
+
+	double total_mse = 0.0;
+	double peak_squared = diff->peak * diff->peak;
+	for (int c = 0; c < layout.channel_count; ++c)
+	{
+		diff->mse[c] = squared_error[c] / (double)pixel_count;
+		diff->psnr[c] = (diff->mse[c] > 0.0) ? 10.0 * log10(peak_squared / diff->mse[c]) : INFINITY;
+		total_mse += diff->mse[c];
+	}
+	total_mse /= layout.channel_count;
+	diff->total_psnr = (total_mse > 0.0) ? 10.0 * log10(peak_squared / total_mse) : INFINITY;
+	return true;
+}
+
+void FreeImageDiff(ImageDiff* diff)
+{
+	if (!diff) return;
+	free(diff->mask);
+	free(diff->difference);
+	*diff = {};
+}
+
+struct DiffOverlayBuild
+{
+	const ImageDiff* diff;
+	int block_size;
+	int overlay_width;
+	u8 color[4];
+	u8* pixels;
+};
+
+// ParallelFor callback: fills overlay rows [begin, end).
+static void BuildDiffOverlayRows(int begin, int end, void* data)
+{
+	DiffOverlayBuild* build = (DiffOverlayBuild*)data;
+	const ImageDiff* diff = build->diff;
+	for (int overlay_y = begin; overlay_y < end; ++overlay_y)
+	{
+		u8* dst = build->pixels + (size_t)overlay_y * build->overlay_width * 4;
+		memset(dst, 0, (size_t)build->overlay_width * 4);
+
+		int first_row = overlay_y * build->block_size;
+		int end_row = (first_row + build->block_size < diff->height) ? first_row + build->block_size : diff->height;
+		for (int y = first_row; y < end_row; ++y)
+		{
+			const u8* mask = diff->mask + (size_t)y * diff->width;
+			for (int x = 0; x < diff->width; ++x)
+			{
+				if (mask[x]) memcpy(dst + (x / build->block_size) * 4, build->color, 4);
+			}
+		}
+	}
+}
+
+u8* BuildDiffMaskOverlay(const ImageDiff* diff, int max_size, const u8 color[4], int* overlay_width, int* overlay_height)
+{
+	assert(diff && diff->mask && max_size > 0 && overlay_width && overlay_height);
+	int largest = (diff->width > diff->height) ? diff->width : diff->height;
+	int block_size = (largest + max_size - 1) / max_size;
+
+	DiffOverlayBuild build = {};
+	build.diff = diff;
+	build.block_size = block_size;
+	build.overlay_width = (diff->width + block_size - 1) / block_size;
+	memcpy(build.color, color, 4);
+	int height = (diff->height + block_size - 1) / block_size;
+	build.pixels = (u8*)malloc((size_t)build.overlay_width * height * 4); // @malloc
+	ParallelFor(height, 4, BuildDiffOverlayRows, &build);
+
+	*overlay_width = build.overlay_width;
+	*overlay_height = height;
+	return build.pixels;
+}
+
+static void DestroyDiffJob(void* data)
+{
+	DiffJob* job = (DiffJob*)data;
+	ReleasePixelBuffer(job->a);
+	ReleasePixelBuffer(job->b);
+	FreeImageDiff(&job->diff);
+	free(job->overlay);
+	delete job;
+}
+
+static void RunDiffJob(void* data)
+{
+	DiffJob* job = (DiffJob*)data;
+	bool success = DiffImages(&job->a->image, &job->b->image, job->params, &job->diff);
+	if (success && job->overlay_max_size)
+	{
+		job->overlay = BuildDiffMaskOverlay(&job->diff, job->overlay_max_size, job->overlay_color, &job->overlay_width, &job->overlay_height);
+
+		// Only the overlay was wanted, and the full mask is as big as the image.
+		free(job->diff.mask);
+		job->diff.mask = 0;
+	}
+
+	ReleasePixelBuffer(job->a);
+	ReleasePixelBuffer(job->b);
+	job->a = job->b = 0;
+
+	job->state.store(success ? DiffState::Ready : DiffState::Failed);
+	WakeFrameScheduler();
+}
+
+DiffJob* QueueImageDiff(PixelBuffer* a, PixelBuffer* b, ImageDiffParams params, int overlay_max_size, const u8 overlay_color[4])
+{
+	assert(a && b);
+	assert(!overlay_max_size || (overlay_color && params.keep_mask));
+	DiffJob* job = new DiffJob();
+	job->a = RetainPixelBuffer(a);
+	job->b = RetainPixelBuffer(b);
+	job->params = params;
+	job->overlay_max_size = overlay_max_size;
+	if (overlay_color) memcpy(job->overlay_color, overlay_color, 4);
+	job->diff = {};
+	job->overlay = 0;
+	job->overlay_width = job->overlay_height = 0;
+	job->state.store(DiffState::Running);
+	PushSharedJob(&job->shared, RunDiffJob, DestroyDiffJob, job);
+	return job;
+}
+
+DiffState GetDiffState(DiffJob* job)
+{
+	assert(job);
+	return job->state.load();
+}
+
+ImageDiff TakeImageDiff(DiffJob* job, u8** overlay, int* overlay_width, int* overlay_height)
+{
+	assert(job && job->state.load() == DiffState::Ready);
+	ImageDiff result = job->diff;
+	job->diff = {};
+	*overlay = job->overlay;
+	*overlay_width = job->overlay_width;
+	*overlay_height = job->overlay_height;
+	job->overlay = 0;
+	return result;
+}
+
+void ReleaseDiffJob(DiffJob* job)
+{
+	if (!job) return;
+	CancelSharedJob(&job->shared);
+	ReleaseSharedJob(&job->shared);
+}
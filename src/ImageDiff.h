@@ -0,0 +1,81 @@
+#ifndef _IMAGE_DIFF_H
+#define _IMAGE_DIFF_H
+
+#include "ImageDecode.h"
+
+// Pixel-by-pixel comparison of two images of the same size. Like ImageDecode, nothing in here touches
+// the renderer, so it can run headless as well.
+
+struct ImageDiffParams
+{
+	double threshold; // Pixels with any channel differing by more than this fraction of full scale are mismatches.
+	bool keep_mask;
+	bool keep_difference;
+};
+
+struct ImageDiff
+{
+	int width;
+	int height;
+	PixelLayout layout; // What the images were compared as; see DiffImages.
+	double peak; // Full scale for layout.type: 255, 65535, or 1 for float.
+
+	double max_error[4];
+	double mse[4];
+	double psnr[4]; // In dB, and INFINITY for channels that match exactly.
+	double total_psnr; // Over all channels together.
+	u64 mismatch_count;
+
+	u8* mask; // width x height, 255 where a pixel is a mismatch and 0 elsewhere. Null unless asked for.
+	void* difference; // Absolute differences in layout. Null unless asked for.
+};
+
+// Images with the same layout are compared as they are. Otherwise both are brought to the larger of the
+// two channel counts (grey is replicated, missing alpha is opaque), and if their types differ, to 8 bits
+// the way they'd be displayed. Returns false, with diff zeroed, if the sizes differ.
+bool DiffImages(const DecodedImage* a, const DecodedImage* b, ImageDiffParams params, ImageDiff* diff);
+void FreeImageDiff(ImageDiff* diff);
+
+// Shrinks the mask to fit within max_size on a side for display, as RGBA8 that is color wherever any
+// pixel of the block it covers is a mismatch and transparent elsewhere, so no mismatch is ever lost
+// to the scaling. The caller frees the result.
+u8* BuildDiffMaskOverlay(const ImageDiff* diff, int max_size, const u8 color[4], int* overlay_width, int* overlay_height);
+
+enum class DiffState : u32
+{
+	Running = 0,
+	Ready,
+	Failed
+};
+
+// A comparison running in the background.
+struct DiffJob
+{
+	SharedJob shared;
+	PixelBuffer* a; // References, dropped as soon as the comparison is done.
+	PixelBuffer* b;
+	ImageDiffParams params;
+	int overlay_max_size; // If set, the mask is shrunk with BuildDiffMaskOverlay on the worker and then freed.
+	u8 overlay_color[4];
+
+	ImageDiff diff;
+	u8* overlay;
+	int overlay_width;
+	int overlay_height;
+
+	std::atomic<DiffState> state;
+};
+
+// Queues DiffImages and returns immediately. The caller owns one reference and must eventually hand it
+// back with ReleaseDiffJob.
+DiffJob* QueueImageDiff(PixelBuffer* a, PixelBuffer* b, ImageDiffParams params, int overlay_max_size = 0, const u8 overlay_color[4] = 0);
+DiffState GetDiffState(DiffJob* job);
+
+// Moves the results out of a Ready job. The caller frees the diff with FreeImageDiff and the overlay (null
+// unless one was asked for) with free().
+ImageDiff TakeImageDiff(DiffJob* job, u8** overlay, int* overlay_width, int* overlay_height);
+
+// Drops the caller's reference. If the comparison hasn't started yet, it is skipped.
+void ReleaseDiffJob(DiffJob* job);
+
+#endif //_IMAGE_DIFF_H
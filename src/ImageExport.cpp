@@ -0,0 +1,237 @@
+#include "ImageExport.h"
+#include "Core/FrameScheduler.h"
+
+PixelLayout GetEncodedLayout(ImageExportParams::FileType type, PixelLayout layout)
+{
+	int channels = layout.channel_count;
+	bool has_alpha = (channels == 2 || channels == 4);
+	PixelLayout result = {channels, PixelType::U8};
+	switch (type)
+	{
+		case ImageExportParams::FileType::PNG: if (layout.type == PixelType::U16) result.type = PixelType::U16; break;
+		case ImageExportParams::FileType::BMP: result.channel_count = has_alpha ? 4 : 3; break;
+		case ImageExportParams::FileType::TGA: result.channel_count = (channels == 1) ? 1 : (has_alpha ? 4 : 3); break;
+		case ImageExportParams::FileType::JPG: result.channel_count = (channels <= 2) ? 1 : 3; break;
+		case ImageExportParams::FileType::HDR: result = {3, PixelType::F32}; break;
+		case ImageExportParams::FileType::DDS: result.channel_count = 4; break;
+		default: break;
+	}
+	return result;
+}
+
+bool BeginImageEncode(ImageEncoder* encoder, const char* file_path, int width, int height, PixelLayout layout, ImageExportParams params)
+{
+	assert(encoder && file_path);
+	*encoder = {};
+	encoder->type = params.type;
+	encoder->width = width;
+	encoder->source_layout = layout;
+	encoder->encoded_layout = GetEncodedLayout(params.type, layout);
+	if (width <= 0 || height <= 0) return false;
+
+	PixelLayout encoded = encoder->encoded_layout;
+	if (encoded.type != layout.type)
+	{
+		PixelLayout converted = {layout.channel_count, encoded.type};
+		encoder->converted = (u8*)malloc((size_t)width * GetPixelSize(converted) * EXPORT_BAND_ROWS); // @malloc
+	}
+	if (encoded.channel_count != layout.channel_count)
+	{
+		encoder->remapped = (u8*)malloc((size_t)width * GetPixelSize(encoded) * EXPORT_BAND_ROWS); // @malloc
+	}
+
+	int channels = encoded.channel_count;
+	switch (params.type)
+	{
+		case ImageExportParams::FileType::PNG:
+		{
+			int bit_depth = (encoded.type == PixelType::U16) ? 16 : 8;
+			return BeginPngWrite(&encoder->png, file_path, width, height, channels, bit_depth, params.PNG.compress_level);
+		}
+		case ImageExportParams::FileType::BMP: return BeginBmpWrite(&encoder->bmp, file_path, width, height, channels);
+		case ImageExportParams::FileType::TGA: return BeginTgaWrite(&encoder->tga, file_path, width, height, channels, params.TGA.use_rle);
+		case ImageExportParams::FileType::JPG: return BeginJpegWrite(&encoder->jpg, file_path, width, height, channels, params.JPG.quality, !params.JPG.use_full_chroma);
+		case ImageExportParams::FileType::HDR: return BeginHdrWrite(&encoder->hdr, file_path, width, height);
+		case ImageExportParams::FileType::DDS: return BeginDdsWrite(&encoder->dds, file_path, width, height, params.DDS.format);
+		default: return false;
+	}
+}
+
+bool EncodeImageRows(ImageEncoder* encoder, const void* rows, int row_count, size_t stride)
+{
+	assert(encoder && rows);
+	PixelLayout source = encoder->source_layout;
+	PixelLayout encoded = encoder->encoded_layout;
+	PixelLayout converted = {source.channel_count, encoded.type};
+	int width = encoder->width;
+
+	bool success = true;
+	for (int y = 0; y < row_count && success; y += EXPORT_BAND_ROWS)
+	{
+		int count = (row_count - y < EXPORT_BAND_ROWS) ? row_count - y : EXPORT_BAND_ROWS;
+		const u8* band = (const u8*)rows + (size_t)y * stride;
+		size_t band_stride = stride;
+
+		if (encoder->converted)
+		{
+			size_t converted_stride = (size_t)width * GetPixelSize(converted);
+			for (int i = 0; i < count; ++i)
+			{
+				const u8* src = band + (size_t)i * band_stride;
+				u8* dst = encoder->converted + (size_t)i * converted_stride;
+				if (encoded.type == PixelType::F32) ConvertPixelsToF32(src, source, width, (float*)dst);
+				else ConvertPixelsToU8(src, source, width, dst);
+			}
+			band = encoder->converted;
+			band_stride = converted_stride;
+		}
+		if (encoder->remapped)
+		{
+			size_t remapped_stride = (size_t)width * GetPixelSize(encoded);
+			for (int i = 0; i < count; ++i)
+			{
+				ConvertPixelChannels(band + (size_t)i * band_stride, converted, width, encoder->remapped + (size_t)i * remapped_stride, encoded.channel_count);
+			}
+			band = encoder->remapped;
+			band_stride = remapped_stride;
+		}
+
+		switch (encoder->type)
+		{
+			case ImageExportParams::FileType::PNG: success = WritePngRows(&encoder->png, band, count, band_stride); break;
+			case ImageExportParams::FileType::BMP: success = WriteBmpRows(&encoder->bmp, band, count, band_stride); break;
+			case ImageExportParams::FileType::TGA: success = WriteTgaRows(&encoder->tga, band, count, band_stride); break;
+			case ImageExportParams::FileType::JPG: success = WriteJpegRows(&encoder->jpg, band, count, band_stride); break;
+			case ImageExportParams::FileType::HDR: success = WriteHdrRows(&encoder->hdr, (const float*)band, count, band_stride); break;
+			case ImageExportParams::FileType::DDS: success = WriteDdsRows(&encoder->dds, band, count, band_stride); break;
+			default: success = false; break;
+		}
+	}
+	return success;
+}
+
+bool EndImageEncode(ImageEncoder* encoder)
+{
+	assert(encoder);
+	bool success = false;
+	switch (encoder->type)
+	{
+		case ImageExportParams::FileType::PNG: success = EndPngWrite(&encoder->png); break;
+		case ImageExportParams::FileType::BMP: success = EndBmpWrite(&encoder->bmp); break;
+		case ImageExportParams::FileType::TGA: success = EndTgaWrite(&encoder->tga); break;
+		case ImageExportParams::FileType::JPG: success = EndJpegWrite(&encoder->jpg); break;
+		case ImageExportParams::FileType::HDR: success = EndHdrWrite(&encoder->hdr); break;
+		case ImageExportParams::FileType::DDS: success = EndDdsWrite(&encoder->dds); break;
+		default: break;
+	}
+	free(encoder->converted);
+	free(encoder->remapped);
+	*encoder = {};
+	return success;
+}
+
+bool ExportImageRegion(const DecodedImage* image, int x, int y, int width, int height, const char* file_path, ImageExportParams params, ExportProgress* progress)
+{
+	assert(image && image->pixels && file_path && file_path[0]);
+	assert(x >= 0 && y >= 0 && width > 0 && height > 0);
+	assert(x + width <= image->width && y + height <= image->height);
+
+	size_t pixel_size = GetPixelSize(image->layout);
+	size_t stride = (size_t)image->width * pixel_size;
+	const u8* start = (const u8*)image->pixels + (size_t)y * stride + (size_t)x * pixel_size;
+
+	// The encoder keeps around whatever state its format needs, so the region is simply fed to it a band
+	// at a time. Stopping early leaves rows unwritten, which makes EndImageEncode delete the file.
+	ImageEncoder encoder;
+	if (BeginImageEncode(&encoder, file_path, width, height, image->layout, params))
+	{
+		for (int row = 0; row < height; row += EXPORT_BAND_ROWS)
+		{
+			if (progress && progress->is_cancelled.load()) break;
+
+			int row_count = (height - row < EXPORT_BAND_ROWS) ? height - row : EXPORT_BAND_ROWS;
+			if (!EncodeImageRows(&encoder, start + (size_t)row * stride, row_count, stride)) break;
+			if (progress) progress->rows_done.fetch_add(row_count);
+		}
+	}
+	return EndImageEncode(&encoder);
+}
+
+static void DestroyExportJob(void* data)
+{
+	ExportJob* job = (ExportJob*)data;
+	ReleasePixelBuffer(job->pixels);
+	free(job->file_path);
+	delete job;
+}
+
+static void RunExportJob(void* data)
+{
+	ExportJob* job = (ExportJob*)data;
+
+	if (job->progress.is_cancelled.load())
+	{
+		job->state.store(ExportState::Cancelled);
+	}
+	else
+	{
+		job->state.store(ExportState::Encoding);
+		bool success = ExportImageRegion(&job->pixels->image, job->x, job->y, job->width, job->height, job->file_path, job->params, &job->progress);
+
+		if (success) job->state.store(ExportState::Done);
+		else if (job->progress.is_cancelled.load()) job->state.store(ExportState::Cancelled);
+		else job->state.store(ExportState::Failed);
+	}
+
+	// Whoever is showing the queue wants to know it finished.
+	WakeFrameScheduler();
+}
+
+ExportJob* QueueImageExport(PixelBuffer* pixels, int x, int y, int width, int height, const char* file_path, ImageExportParams params)
+{
+	assert(pixels && file_path);
+	ExportJob* job = new ExportJob();
+
+	size_t path_size = strlen(file_path) + 1;
+	job->file_path = (char*)malloc(path_size); // @malloc
+	memcpy(job->file_path, file_path, path_size);
+
+	job->pixels = RetainPixelBuffer(pixels);
+	job->x = x;
+	job->y = y;
+	job->width = width;
+	job->height = height;
+	job->params = params;
+
+	job->progress.rows_done.store(0);
+	job->progress.is_cancelled.store(false);
+	job->state.store(ExportState::Queued);
+	PushSharedJob(&job->shared, RunExportJob, DestroyExportJob, job);
+	return job;
+}
+
+ExportState GetExportState(ExportJob* job)
+{
+	assert(job);
+	return job->state.load();
+}
+
+float GetExportProgress(ExportJob* job)
+{
+	assert(job);
+	ExportState state = job->state.load();
+	if (state == ExportState::Done) return 1.0f;
+	return (float)job->progress.rows_done.load() / (float)job->height;
+}
+
+void CancelExport(ExportJob* job)
+{
+	assert(job);
+	job->progress.is_cancelled.store(true);
+}
+
+void ReleaseExport(ExportJob* job)
+{
+	if (!job) return;
+	ReleaseSharedJob(&job->shared);
+}
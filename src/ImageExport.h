@@ -0,0 +1,153 @@
+#ifndef _IMAGE_EXPORT_H
+#define _IMAGE_EXPORT_H
+
+#include "ImageDecode.h"
+#include "PngWriter.h"
+#include "JpegWriter.h"
+#include "DdsWriter.h"
+#include "SimpleImageWriters.h"
+
+// Encoding images to files, either right away or as background jobs. Like ImageDecode, nothing in here
+// touches the renderer.
+
+struct ImageExportParams
+{
+    // TODO(Matt): Extension
+    // TODO(Matt): Channel count
+    // TODO(Matt): I dunno, like compression amount or something (this really depends on format, maybe this should be a union).
+
+    // TODO(Matt): Gif support? I guess we can't handle animated ones anyway (should we? Nah).
+    enum class FileType : u8
+    {
+        None = 0,
+        PNG,
+        BMP,
+        TGA,
+        JPG,
+        HDR,
+        DDS
+    };
+
+    FileType type;
+
+    union
+    {
+        struct
+        {
+            int channel_count;
+            int compress_level; // 1 (fastest) to 9 (smallest), 0 for the default.
+
+        } PNG;
+
+        struct
+        {
+            int dummy;
+        } BMP;
+        
+        struct
+        {
+            bool use_rle;
+        } TGA;
+        
+        struct
+        {
+            int quality; // 1 to 100, 0 for the default.
+            bool use_full_chroma; // 4:4:4 instead of 4:2:0.
+        } JPG;
+        
+        struct
+        {
+            BlockFormat format;
+        } DDS;
+    };
+};
+
+// Rows are converted and handed to the writers this many at a time. Exports report progress and check
+// for cancellation at the same granularity.
+#define EXPORT_BAND_ROWS 64
+
+// Streams rows into a file of any of the export formats. Rows go in in the source's own layout and are
+// converted to whatever the format can store a band at a time, so nothing the size of the image is ever
+// allocated on the way.
+struct ImageEncoder
+{
+	ImageExportParams::FileType type;
+	int width;
+	PixelLayout source_layout;
+	PixelLayout encoded_layout;
+	u8* converted; // One band with the encoded type but the source channel count, if the types differ.
+	u8* remapped; // One band in the encoded layout, if the channel counts differ.
+
+	union
+	{
+		PngWriter png;
+		BmpWriter bmp;
+		TgaWriter tga;
+		JpegWriter jpg;
+		HdrWriter hdr;
+		DdsWriter dds;
+	};
+};
+
+// The layout a format stores a source layout as: PNG keeps 8 and 16-bit sources as they are, HDR is
+// float RGB, DDS is RGBA8, and everything else is 8-bit with whatever channels the format supports.
+PixelLayout GetEncodedLayout(ImageExportParams::FileType type, PixelLayout layout);
+
+// Call EndImageEncode afterwards even if this fails.
+bool BeginImageEncode(ImageEncoder* encoder, const char* file_path, int width, int height, PixelLayout layout, ImageExportParams params);
+bool EncodeImageRows(ImageEncoder* encoder, const void* rows, int row_count, size_t stride);
+
+// Finishes the file, or deletes it if not every row was written.
+bool EndImageEncode(ImageEncoder* encoder);
+
+struct ExportProgress
+{
+	std::atomic<int> rows_done;
+	std::atomic<bool> is_cancelled; // Checked between bands; a cancelled export leaves no file behind.
+};
+
+// Encodes the width x height region at (x, y) of an image, which must lie inside it. progress may be null.
+bool ExportImageRegion(const DecodedImage* image, int x, int y, int width, int height, const char* file_path, ImageExportParams params, ExportProgress* progress = 0);
+
+enum class ExportState : u32
+{
+	Queued = 0,
+	Encoding,
+	Done,
+	Failed,
+	Cancelled
+};
+
+// One background export. It's cancelled through progress rather than its SharedJob, so a cancelled export
+// still runs far enough to report Cancelled.
+struct ExportJob
+{
+	SharedJob shared;
+	char* file_path; // Owned copy of the destination path.
+	PixelBuffer* pixels; // A reference to the source, not a copy; the panel can go away while this runs.
+	int x;
+	int y;
+	int width;
+	int height;
+	ImageExportParams params;
+
+	ExportProgress progress;
+	std::atomic<ExportState> state;
+};
+
+// Queues an export of a region of pixels and returns immediately. The job takes its own reference to the
+// pixels. The caller owns one reference to the job and must eventually hand it back with ReleaseExport.
+ExportJob* QueueImageExport(PixelBuffer* pixels, int x, int y, int width, int height, const char* file_path, ImageExportParams params);
+ExportState GetExportState(ExportJob* job);
+
+// Fraction of rows encoded so far, from 0 to 1.
+float GetExportProgress(ExportJob* job);
+
+// Stops the export at the next band. Any partially written file is deleted.
+void CancelExport(ExportJob* job);
+
+// Drops the caller's reference. Unlike ReleaseImageLoad this doesn't cancel, so an export the caller
+// has lost interest in still finishes.
+void ReleaseExport(ExportJob* job);
+
+#endif //_IMAGE_EXPORT_H
@@ -2,75 +2,39 @@
 #include "ImageLoader.h"
 #include "d3d_proto.h"
 
-ImagePanel LoadImageFromFile(ID3D11Device* device, ID3D11DeviceContext* ctx, char* image_path, int panel_id, Vec2 viewport_size)
+// Takes ownership of image_path. The label keeps the panel ID after the ###, so imgui sees the same window
+// whatever file it shows.
+static void SetImagePanelPath(ImagePanel* panel, char* image_path)
 {
-	assert(image_path);
-	ImagePanel result = {};
-	result.file_path = image_path;
+	free(panel->file_path);
+	free(panel->window_label);
+	panel->file_path = image_path;
 	
-	size_t len = strlen(result.file_path);
+	size_t len = strlen(panel->file_path);
 	size_t start = len;
-	while (start > 0 && result.file_path[start - 1] != '\\' && result.file_path[start - 1] != '/') --start;
-	result.file_name = &result.file_path[start];
+	while (start > 0 && panel->file_path[start - 1] != '\\' && panel->file_path[start - 1] != '/') --start;
+	panel->file_name = &panel->file_path[start];
 	
 	size_t label_size = len - start + 12;
 	char* label = (char*)malloc(label_size);
-	sprintf_s(label, label_size, "%s###%d", result.file_name, panel_id);
-	result.window_label = label;
+	sprintf_s(label, label_size, "%s###%d", panel->file_name, panel->panel_id);
+	panel->window_label = label;
+}
+
+ImagePanel LoadImageFromFile(ID3D11Device* device, ID3D11DeviceContext* ctx, char* image_path, int panel_id, Vec2 viewport_size)
+{
+	assert(image_path);
+	ImagePanel result = {};
+	result.panel_id = panel_id;
+	SetImagePanelPath(&result, image_path);
 	
-	result.source_data = stbi_load(image_path, &result.source_width, &result.source_height, &result.source_channel_count, 4);
+	// Decoding happens on the job system, unless another panel already has the file open; the texture is
+	// picked up by UpdateImagePanelLoad once it's ready. Until then the panel only has its (cleared) canvas.
+	result.stored = AcquireStoredImage(image_path);
 	
-	
-	D3D11_TEXTURE2D_DESC tex_desc = {};
-	tex_desc.Width = result.source_width;
-	tex_desc.Height = result.source_height;
-	tex_desc.MipLevels = 1;
-	tex_desc.ArraySize = 1;
-	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	tex_desc.SampleDesc.Count = 1;
-	tex_desc.Usage = D3D11_USAGE_DEFAULT;
-	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	tex_desc.CPUAccessFlags = 0;
-	
-	D3D11_SUBRESOURCE_DATA sr_data;
-	sr_data.pSysMem = result.source_data;
-	sr_data.SysMemPitch = tex_desc.Width * 4; // True only for 4 component images.
-	sr_data.SysMemSlicePitch = 0;
-	device->CreateTexture2D(&tex_desc, &sr_data, &result.texture);
-	
-	D3D11_SHADER_RESOURCE_VIEW_DESC src_srv_desc = {};
-	src_srv_desc.Format = tex_desc.Format;
-	src_srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	src_srv_desc.Texture2D.MipLevels = tex_desc.MipLevels;
-	src_srv_desc.Texture2D.MostDetailedMip = 0;
-	device->CreateShaderResourceView(result.texture, &src_srv_desc, &result.src_srv);
-	
-	D3D11_TEXTURE2D_DESC render_target_desc = {};
-	render_target_desc.Width = (int)viewport_size.x;
-	render_target_desc.Height = (int)viewport_size.y;
-	render_target_desc.MipLevels = render_target_desc.ArraySize = 1;
-	render_target_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	render_target_desc.SampleDesc.Count = 1;
-	render_target_desc.Usage = D3D11_USAGE_DEFAULT;
-	render_target_desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	render_target_desc.CPUAccessFlags = 0;
-	render_target_desc.MiscFlags = 0;
-	
-	device->CreateTexture2D( &render_target_desc, 0, &result.render_target);
-	
-	D3D11_RENDER_TARGET_VIEW_DESC rtv_desc = {};
-	rtv_desc.Format = render_target_desc.Format;
-	rtv_desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	rtv_desc.Texture2D.MipSlice = 0;
-	
-	device->CreateRenderTargetView(result.render_target, &rtv_desc, &result.rtv);
-	
-	D3D11_SHADER_RESOURCE_VIEW_DESC dst_srv_desc = {};
-	dst_srv_desc.Format = rtv_desc.Format;
-	dst_srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	dst_srv_desc.Texture2D.MipLevels = 1;
-	dst_srv_desc.Texture2D.MostDetailedMip = 0;
-	device->CreateShaderResourceView(result.render_target, &dst_srv_desc, &result.dst_srv);
+	if (viewport_size.x < 1.0f) viewport_size.x = 1.0f;
+	if (viewport_size.y < 1.0f) viewport_size.y = 1.0f;
+	result.canvas = AcquireRenderTarget(device, (int)viewport_size.x, (int)viewport_size.y);
 	
 	CoolVertex vertices[4] =
 	{
@@ -96,31 +60,482 @@ ImagePanel LoadImageFromFile(ID3D11Device* device, ID3D11DeviceContext* ctx, cha
 	result.constant_buffer = CreateConstantBuffer(device, ctx, &constant_buffer);
 	
 	result.image_offset = {};
-	result.image_size = Vec2((float)result.source_width, (float)result.source_height);
+	result.image_size = {};
 	result.is_visible = true;
 	result.should_redraw = true;
-	result.panel_id = panel_id;
     result.last_image_size = viewport_size;
     result.selection_start = {-1, -1};
     result.selection_end = {-1, -1};
 	return result;
 }
 
+// Maximum number of tile quads drawn per panel, and tiles uploaded per panel per frame.
+#define MAX_TILE_QUADS 1024
+#define TILE_UPLOADS_PER_FRAME 16
+
+static void CreateImagePanelTileAtlas(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel)
+{
+	D3D11_TEXTURE2D_DESC tex_desc = {};
+	tex_desc.Width = TILE_ATLAS_SIZE;
+	tex_desc.Height = TILE_ATLAS_SIZE;
+	tex_desc.MipLevels = 1;
+	tex_desc.ArraySize = 1;
+	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	tex_desc.SampleDesc.Count = 1;
+	tex_desc.Usage = D3D11_USAGE_DEFAULT;
+	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	tex_desc.CPUAccessFlags = 0;
+	device->CreateTexture2D(&tex_desc, 0, &panel->texture);
+	
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = tex_desc.Format;
+	srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MipLevels = 1;
+	srv_desc.Texture2D.MostDetailedMip = 0;
+	device->CreateShaderResourceView(panel->texture, &srv_desc, &panel->src_srv);
+	
+	// Vertices are rewritten every time the view changes; the indices never change.
+	CoolVertex* vertices = (CoolVertex*)calloc(MAX_TILE_QUADS * 4, sizeof(CoolVertex)); // @malloc
+	unsigned int* indices = (unsigned int*)malloc(MAX_TILE_QUADS * 6 * sizeof(unsigned int)); // @malloc
+	for (unsigned int i = 0; i < MAX_TILE_QUADS; ++i)
+	{
+		unsigned int quad[6] = {0, 1, 2, 2, 3, 0};
+		for (int j = 0; j < 6; ++j) indices[i * 6 + j] = i * 4 + quad[j];
+	}
+	panel->tile_vertex_buffer = CreateVertexBuffer(device, ctx, vertices, MAX_TILE_QUADS * 4);
+	panel->tile_index_buffer = CreateIndexBuffer(device, ctx, indices, MAX_TILE_QUADS * 6);
+	free(vertices);
+	free(indices);
+}
+
+// Makes the tiles covering the current view resident, uploading at most TILE_UPLOADS_PER_FRAME of
+// them, and rebuilds the quad list. Missing tiles are drawn from coarser levels in the meantime.
+// Returns true if some tiles are still missing, so the panel should be redrawn next frame.
+bool UpdateImagePanelTiles(ID3D11DeviceContext* ctx, ImagePanel* panel)
+{
+	assert(panel && panel->tiled);
+	TiledImage* tiled = panel->tiled;
+	BeginTileFrame(tiled);
+	
+	static u8 tile_pixels[TILE_SIZE * TILE_SIZE * 4];
+	int uploads = 0;
+	
+	// The single tile at the coarsest level is always resident, so there is always something to draw.
+	int root_tile = tiled->levels[tiled->level_count - 1].first_tile;
+	if (TouchTile(tiled, root_tile) < 0)
+	{
+		int slot = MakeTileResident(tiled, root_tile, true);
+		CopyTilePixels(tiled, root_tile, panel->source_data, panel->source_layout, panel->mips, tile_pixels);
+		D3D11_BOX box = {(UINT)((slot % TILE_ATLAS_SLOTS_PER_ROW) * TILE_SIZE), (UINT)((slot / TILE_ATLAS_SLOTS_PER_ROW) * TILE_SIZE), 0, 0, 0, 1};
+		box.right = box.left + TILE_SIZE;
+		box.bottom = box.top + TILE_SIZE;
+		ctx->UpdateSubresource(panel->texture, 0, &box, tile_pixels, TILE_SIZE * 4, 0);
+		++uploads;
+	}
+	
+	TileView view = {};
+	view.canvas_width = panel->last_image_size.x;
+	view.canvas_height = panel->last_image_size.y;
+	view.offset_x = panel->image_offset.x;
+	view.offset_y = panel->image_offset.y;
+	view.size_x = panel->image_size.x;
+	view.size_y = panel->image_size.y;
+	
+	static int visible[MAX_TILE_QUADS];
+	int level = GetTileLevelForView(tiled, view);
+	int visible_count = GetVisibleTiles(tiled, view, level, visible, MAX_TILE_QUADS);
+	
+	// Touch everything already resident first, so uploads below can't evict tiles we're about to draw.
+	for (int i = 0; i < visible_count; ++i) TouchTile(tiled, visible[i]);
+	
+	bool is_missing_tiles = false;
+	for (int i = 0; i < visible_count; ++i)
+	{
+		int tile = visible[i];
+		if (tiled->page_table[tile] >= 0) continue;
+		
+		int slot = (uploads < TILE_UPLOADS_PER_FRAME) ? MakeTileResident(tiled, tile) : -1;
+		if (slot < 0)
+		{
+			is_missing_tiles = true;
+			continue;
+		}
+		
+		CopyTilePixels(tiled, tile, panel->source_data, panel->source_layout, panel->mips, tile_pixels);
+		D3D11_BOX box = {(UINT)((slot % TILE_ATLAS_SLOTS_PER_ROW) * TILE_SIZE), (UINT)((slot / TILE_ATLAS_SLOTS_PER_ROW) * TILE_SIZE), 0, 0, 0, 1};
+		box.right = box.left + TILE_SIZE;
+		box.bottom = box.top + TILE_SIZE;
+		ctx->UpdateSubresource(panel->texture, 0, &box, tile_pixels, TILE_SIZE * 4, 0);
+		++uploads;
+	}
+	
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (ctx->Map(panel->tile_vertex_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) != S_OK)
+	{
+		assert(false);
+		return false;
+	}
+	CoolVertex* vertices = (CoolVertex*)mapped.pData;
+	int quad_count = 0;
+	for (int i = 0; i < visible_count; ++i)
+	{
+		TileQuad quad;
+		if (!GetTileQuad(tiled, visible[i], &quad)) continue;
+		
+		// Same convention as the single texture quad: positions span [-1, 1] across the whole image.
+		float x0 = quad.image_min[0] * 2.0f - 1.0f, x1 = quad.image_max[0] * 2.0f - 1.0f;
+		float y0 = quad.image_min[1] * 2.0f - 1.0f, y1 = quad.image_max[1] * 2.0f - 1.0f;
+		CoolVertex* v = &vertices[quad_count * 4];
+		v[0] = {{x0, y0}, {quad.atlas_min[0], quad.atlas_min[1]}, {255, 255, 255, 255}};
+		v[1] = {{x1, y0}, {quad.atlas_max[0], quad.atlas_min[1]}, {255, 255, 255, 255}};
+		v[2] = {{x1, y1}, {quad.atlas_max[0], quad.atlas_max[1]}, {255, 255, 255, 255}};
+		v[3] = {{x0, y1}, {quad.atlas_min[0], quad.atlas_max[1]}, {255, 255, 255, 255}};
+		++quad_count;
+	}
+	ctx->Unmap(panel->tile_vertex_buffer, 0);
+	panel->tile_quad_count = quad_count;
+	
+	return is_missing_tiles;
+}
+
+// Borrows the stored image's pixels and texture. A panel that was already showing an image of the same
+// size (one it stepped away from) keeps its view and selection.
+static void ShowStoredImage(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel)
+{
+	StoredImage* stored = panel->stored;
+	DecodedImage image = stored->pixels->image;
+	
+	// Whatever stood in for the image until now, a preview or a partial texture.
+	if (panel->texture) panel->texture->Release();
+	if (panel->src_srv) panel->src_srv->Release();
+	panel->texture = 0;
+	panel->src_srv = 0;
+	panel->is_evicted = false;
+	panel->preview_bytes = 0;
+	panel->texture_version = stored->texture_version;
+	
+	if (image.width != panel->source_width || image.height != panel->source_height)
+	{
+		panel->image_size = Vec2((float)image.width, (float)image.height);
+		panel->image_offset = {};
+		panel->selection_start = {-1, -1};
+		panel->selection_end = {-1, -1};
+	}
+	panel->source_buffer = RetainPixelBuffer(stored->pixels);
+	panel->source_data = (unsigned char*)image.pixels;
+	panel->source_width = image.width;
+	panel->source_height = image.height;
+	panel->source_layout = image.layout;
+	
+	if (stored->texture)
+	{
+		panel->texture = stored->texture;
+		panel->src_srv = stored->srv;
+		panel->texture->AddRef();
+		panel->src_srv->AddRef();
+	}
+	else
+	{
+		// Tiles are cut from the CPU mip chain on demand, into an atlas each panel has for itself since it
+		// only holds what that panel's view needs.
+		panel->mips = stored->mips;
+		panel->tiled = CreateTiledImage(image.width, image.height);
+		CreateImagePanelTileAtlas(device, ctx, panel);
+	}
+}
+
+// Shows as much of a progressively decoding image as has been uploaded, with the same quad the whole
+// image will be drawn with. An evicted panel keeps its preview, which is already as good.
+static void ShowPartialStoredImage(ImagePanel* panel)
+{
+	StoredImage* stored = panel->stored;
+	if (panel->is_evicted || !stored->partial_texture || panel->texture_version == stored->texture_version) return;
+	if (panel->texture != stored->partial_texture)
+	{
+		if (panel->texture) panel->texture->Release();
+		if (panel->src_srv) panel->src_srv->Release();
+		panel->texture = stored->partial_texture;
+		panel->src_srv = stored->partial_srv;
+		panel->texture->AddRef();
+		panel->src_srv->AddRef();
+	}
+	if (stored->partial_width != panel->source_width || stored->partial_height != panel->source_height)
+	{
+		panel->image_size = Vec2((float)stored->partial_width, (float)stored->partial_height);
+		panel->image_offset = {};
+		panel->selection_start = {-1, -1};
+		panel->selection_end = {-1, -1};
+		panel->source_width = stored->partial_width;
+		panel->source_height = stored->partial_height;
+	}
+	panel->texture_version = stored->texture_version;
+	panel->should_redraw = true;
+}
+
+// Picks up the panel's image once it has been decoded and uploaded (by this panel or any other). Returns
+// true if the panel changed state this call; showing more of a partly decoded or uploaded image doesn't
+// count.
+bool UpdateImagePanelLoad(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel)
+{
+	assert(panel);
+	if (!panel->stored || panel->load_failed) return false;
+	if (panel->source_buffer)
+	{
+		// Sharper levels of the texture are still going up.
+		if (panel->texture_version == panel->stored->texture_version) return false;
+		panel->texture_version = panel->stored->texture_version;
+		panel->should_redraw = true;
+		return false;
+	}
+	
+	StoredImageState state = UpdateStoredImage(device, panel->stored);
+	if (state == StoredImageState::Loading)
+	{
+		ShowPartialStoredImage(panel);
+		return false;
+	}
+	
+	if (state == StoredImageState::Ready) ShowStoredImage(device, ctx, panel);
+	else panel->load_failed = true;
+	panel->should_redraw = true;
+	return true;
+}
+
+// Frees everything that belongs to the image being shown rather than to the panel, leaving the panel
+// as it was before its first load finished. The source size is kept, to compare the next image against.
+static void ReleaseImagePanelImage(ImagePanel* panel)
+{
+	ReleaseStoredImage(panel->stored);
+	if (panel->texture) panel->texture->Release();
+	if (panel->src_srv) panel->src_srv->Release();
+	if (panel->tile_vertex_buffer) panel->tile_vertex_buffer->Release();
+	if (panel->tile_index_buffer) panel->tile_index_buffer->Release();
+	DestroyTiledImage(panel->tiled);
+	ReleaseImageStatsJob(panel->stats_cache);
+	free(panel->stats);
+	ReleaseSummedAreaJob(panel->summed_area);
+	ClearImagePanelDiff(panel);
+	ReleasePixelBuffer(panel->source_buffer); // Any queued exports keep the pixels alive until they finish.
+	
+	panel->stored = 0;
+	panel->load_failed = false;
+	panel->is_evicted = false;
+	panel->preview_bytes = 0;
+	panel->texture_version = 0;
+	panel->is_awaiting_prefetch = false;
+	panel->texture = 0;
+	panel->src_srv = 0;
+	panel->tile_vertex_buffer = 0;
+	panel->tile_index_buffer = 0;
+	panel->tile_quad_count = 0;
+	panel->tiled = 0;
+	panel->mips = 0;
+	panel->stats_cache = 0;
+	panel->stats = 0;
+	panel->summed_area = 0;
+	panel->source_buffer = 0;
+	panel->source_data = 0;
+}
+
 void ReleaseImagePanel(ImagePanel image)
 {
-	image.texture->Release();
-	image.render_target->Release();
-	image.src_srv->Release();
-	image.dst_srv->Release();
-	image.rtv->Release();
+	ReleaseImagePanelImage(&image);
+	ReleaseRenderTarget(&image.canvas);
 	image.vertex_buffer->Release();
 	image.index_buffer->Release();
 	image.constant_buffer->Release();
 	
 	free(image.file_path);
 	free(image.window_label);
-    
-    stbi_image_free(image.source_data);
+	for (int i = 0; i < image.sequence_count; ++i) free(image.sequence_paths[i]);
+	free(image.sequence_paths);
+}
+
+// Copies the mip levels from the first one no bigger than PANEL_PREVIEW_SIZE on down into a texture of
+// their own: on the GPU for images that have a whole texture, and from the CPU chain for tiled ones. A
+// texture that is still uploading already has these, since PANEL_PREVIEW_SIZE is no bigger than
+// UPLOAD_CHUNK_SIZE.
+static void CreateImagePanelPreview(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel, ID3D11Texture2D** texture, ID3D11ShaderResourceView** srv)
+{
+	int width = panel->source_width;
+	int height = panel->source_height;
+	int level_count = GetMipLevelCount(width, height);
+	if (level_count > MAX_MIP_LEVELS) level_count = MAX_MIP_LEVELS;
+	int first_level = 0;
+	while (first_level < level_count - 1 && (GetMipLevelSize(width, first_level) > PANEL_PREVIEW_SIZE || GetMipLevelSize(height, first_level) > PANEL_PREVIEW_SIZE)) ++first_level;
+	
+	D3D11_TEXTURE2D_DESC tex_desc = {};
+	tex_desc.Width = GetMipLevelSize(width, first_level);
+	tex_desc.Height = GetMipLevelSize(height, first_level);
+	tex_desc.MipLevels = level_count - first_level;
+	tex_desc.ArraySize = 1;
+	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	tex_desc.SampleDesc.Count = 1;
+	tex_desc.Usage = D3D11_USAGE_DEFAULT;
+	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	tex_desc.CPUAccessFlags = 0;
+	
+	panel->preview_bytes = 0;
+	D3D11_SUBRESOURCE_DATA sr_data[MAX_MIP_LEVELS] = {};
+	for (int level = first_level; level < level_count; ++level)
+	{
+		int level_width = GetMipLevelSize(width, level);
+		panel->preview_bytes += (u64)level_width * GetMipLevelSize(height, level) * 4;
+		if (panel->tiled)
+		{
+			// Tiled images are far bigger than a preview, so level 0 is never needed.
+			sr_data[level - first_level].pSysMem = panel->mips->levels[level].pixels;
+			sr_data[level - first_level].SysMemPitch = level_width * 4;
+		}
+	}
+	device->CreateTexture2D(&tex_desc, panel->tiled ? sr_data : 0, texture);
+	if (!panel->tiled)
+	{
+		for (int level = first_level; level < level_count; ++level)
+		{
+			ctx->CopySubresourceRegion(*texture, level - first_level, 0, 0, 0, panel->texture, level, 0);
+		}
+	}
+	
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = tex_desc.Format;
+	srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MipLevels = tex_desc.MipLevels;
+	srv_desc.Texture2D.MostDetailedMip = 0;
+	device->CreateShaderResourceView(*texture, &srv_desc, srv);
+}
+
+bool EvictImagePanel(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel)
+{
+	assert(panel);
+	if (!panel->source_buffer || panel->is_evicted) return false;
+	
+	// The preview is drawn with the same quad as the full texture, so the view doesn't move; it's just
+	// blurrier. The source size is kept, which keeps the selection valid too.
+	ID3D11Texture2D* preview = 0;
+	ID3D11ShaderResourceView* preview_srv = 0;
+	CreateImagePanelPreview(device, ctx, panel, &preview, &preview_srv);
+	u64 preview_bytes = panel->preview_bytes;
+	ReleaseImagePanelImage(panel);
+	panel->texture = preview;
+	panel->src_srv = preview_srv;
+	panel->preview_bytes = preview_bytes;
+	panel->is_evicted = true;
+	panel->should_redraw = true;
+	return true;
+}
+
+void RestoreImagePanel(ImagePanel* panel)
+{
+	assert(panel);
+	if (!panel->is_evicted || panel->stored) return;
+	panel->stored = AcquireStoredImage(panel->file_path);
+}
+
+// Lists the panel's folder and finds the panel's file in it. The listing is kept, so new files only show
+// up in a panel opened after they were added.
+static bool ListImagePanelSequence(ImagePanel* panel)
+{
+	if (panel->sequence_paths) return true;
+	
+	// The folder is everything up to the file name, separator included, so paths are built by appending.
+	size_t folder_length = panel->file_name - panel->file_path;
+	char* folder_path = (char*)malloc(folder_length + 2); // @malloc
+	memcpy(folder_path, panel->file_path, folder_length);
+	folder_path[folder_length] = 0;
+	if (!folder_length) strcpy(folder_path, ".");
+	
+	int count = 0;
+	char** names = ListImageFileNames(folder_path, &count);
+	free(folder_path);
+	if (!names) return false;
+	
+	int index = -1;
+	for (int i = 0; i < count; ++i)
+	{
+		if (index < 0 && !strcmp(names[i], panel->file_name)) index = i;
+		size_t name_size = strlen(names[i]) + 1;
+		char* path = (char*)malloc(folder_length + name_size); // @malloc
+		memcpy(path, panel->file_path, folder_length);
+		memcpy(path + folder_length, names[i], name_size);
+		free(names[i]);
+		names[i] = path;
+	}
+	if (index < 0)
+	{
+		// Not an extension the listing recognizes, so there's no place in the folder to step from.
+		for (int i = 0; i < count; ++i) free(names[i]);
+		free(names);
+		return false;
+	}
+	panel->sequence_paths = names;
+	panel->sequence_count = count;
+	panel->sequence_index = index;
+	return true;
+}
+
+void PrefetchImagePanelNeighbours(ImagePanel* panel, ImagePrefetcher* prefetcher)
+{
+	assert(panel && prefetcher);
+	if (!ListImagePanelSequence(panel)) return;
+	PrefetchImageSequence(prefetcher, panel->sequence_paths, panel->sequence_count, panel->sequence_index, 0);
+}
+
+bool StepImagePanel(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel, int step, ImagePrefetcher* prefetcher)
+{
+	assert(panel && prefetcher);
+	if (!ListImagePanelSequence(panel) || panel->sequence_count < 2 || !step) return false;
+	
+	int count = panel->sequence_count;
+	int index = ((panel->sequence_index + step) % count + count) % count;
+	panel->sequence_index = index;
+	PrefetchImageSequence(prefetcher, panel->sequence_paths, count, index, step);
+	
+	ReleaseImagePanelImage(panel);
+	size_t path_size = strlen(panel->sequence_paths[index]) + 1;
+	char* image_path = (char*)malloc(path_size); // @malloc
+	memcpy(image_path, panel->sequence_paths[index], path_size);
+	SetImagePanelPath(panel, image_path);
+	panel->should_redraw = true;
+	
+	PixelBuffer* pixels;
+	MipChain* mips;
+	PrefetchState state = GetPrefetchedImage(prefetcher, image_path, &pixels, &mips);
+	if (state == PrefetchState::Ready)
+	{
+		++prefetcher->hit_count;
+		panel->stored = AcquireStoredImage(image_path, pixels, mips);
+		UpdateImagePanelLoad(device, ctx, panel);
+		return true;
+	}
+	++prefetcher->miss_count;
+	if (state == PrefetchState::Pending) panel->is_awaiting_prefetch = true;
+	else panel->stored = AcquireStoredImage(image_path); // Failures get one more try, which reports the error.
+	return true;
+}
+
+bool UpdateImagePanelPrefetch(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel, ImagePrefetcher* prefetcher)
+{
+	assert(panel && prefetcher);
+	if (!panel->is_awaiting_prefetch) return false;
+	
+	PixelBuffer* pixels;
+	MipChain* mips;
+	PrefetchState state = GetPrefetchedImage(prefetcher, panel->file_path, &pixels, &mips);
+	if (state == PrefetchState::Pending) return false;
+	
+	// The prefetcher may have moved on to another panel's folder and dropped the decode, in which case
+	// the panel loads the image itself.
+	panel->is_awaiting_prefetch = false;
+	panel->should_redraw = true;
+	if (state == PrefetchState::Failed)
+	{
+		panel->load_failed = true;
+		return true;
+	}
+	panel->stored = AcquireStoredImage(panel->file_path, pixels, mips);
+	UpdateImagePanelLoad(device, ctx, panel);
+	return true;
 }
 
 static Vec2 CanvasPosToImagePos(ImagePanel* panel, Vec2 canvas_pos)
@@ -143,41 +558,40 @@ static Vec2 ImagePosToCanvasPos(ImagePanel* panel, Vec2 image_pos)
     return (image_pos / src_image_size) * (src_br - src_tl) + src_tl;
 }
 
-void ResizeImagePanelCanvas(ID3D11Device* device, ImagePanel* image, int width, int height)
+// Makes sure the canvas can hold width x height, returning true if it had to be swapped for a different
+// target (whose contents are undefined). While the panel is being resized the canvas only ever grows, with
+// some headroom, so a drag just draws into a different part of the same target; once the size has
+// settled, a canvas that is far too big is traded for a smaller one.
+bool ResizeImagePanelCanvas(ID3D11Device* device, ImagePanel* image, int width, int height, bool is_resizing)
 {
 	assert(image);
-	if (image->render_target) image->render_target->Release();
-	if (image->rtv) image->rtv->Release();
-	if (image->dst_srv) image->dst_srv->Release();
-	
-	D3D11_TEXTURE2D_DESC render_target_desc = {};
-	render_target_desc.Width = width;
-	render_target_desc.Height = height;
-	render_target_desc.MipLevels = render_target_desc.ArraySize = 1;
-	render_target_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	render_target_desc.SampleDesc.Count = 1;
-	render_target_desc.Usage = D3D11_USAGE_DEFAULT;
-	render_target_desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	render_target_desc.CPUAccessFlags = 0;
-	render_target_desc.MiscFlags = 0;
-	
-	device->CreateTexture2D( &render_target_desc, 0, &image->render_target);
-	
-	D3D11_RENDER_TARGET_VIEW_DESC rtv_desc = {};
-	rtv_desc.Format = render_target_desc.Format;
-	rtv_desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	rtv_desc.Texture2D.MipSlice = 0;
-	
-	device->CreateRenderTargetView(image->render_target, &rtv_desc, &image->rtv);
-	
-	D3D11_SHADER_RESOURCE_VIEW_DESC dst_srv_desc = {};
-	dst_srv_desc.Format = rtv_desc.Format;
-	dst_srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	dst_srv_desc.Texture2D.MipLevels = 1;
-	dst_srv_desc.Texture2D.MostDetailedMip = 0;
-	device->CreateShaderResourceView(image->render_target, &dst_srv_desc, &image->dst_srv);
+	RenderTarget* canvas = &image->canvas;
+	bool fits = (canvas->texture && canvas->width >= width && canvas->height >= height);
+	if (fits)
+	{
+		if (is_resizing) return false;
+		
+		s64 needed_area = (s64)GetRenderTargetBucketSize(width) * GetRenderTargetBucketSize(height);
+		if ((s64)canvas->width * canvas->height <= needed_area * 4) return false;
+		
+		ReleaseRenderTarget(canvas);
+		*canvas = AcquireRenderTarget(device, width, height);
+		return true;
+	}
+	
+	if (is_resizing)
+	{
+		width += width / 4;
+		height += height / 4;
+	}
+	ReleaseRenderTarget(canvas);
+	*canvas = AcquireRenderTarget(device, width, height);
+	return true;
 }
 
+// Frames without a size change before a resize counts as finished.
+#define CANVAS_SETTLE_FRAMES 30
+
 // Returns true if the image panel has focus.
 bool DrawImagePanel(ImagePanel* panel, ImGuiID dockspace_id, bool force_focus)
 {
@@ -189,24 +603,52 @@ bool DrawImagePanel(ImagePanel* panel, ImGuiID dockspace_id, bool force_focus)
 	if (dockspace_id) ImGui::SetNextWindowDockID(dockspace_id, ImGuiCond_Appearing);
 	if (force_focus) ImGui::SetNextWindowFocus();
     ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
-	if (ImGui::Begin(panel->window_label, &panel->is_visible))
+	panel->is_shown = ImGui::Begin(panel->window_label, &panel->is_visible);
+	if (panel->is_shown)
 	{
 		
 		Vec2 current_image_size = ImGui::GetContentRegionAvail();
 		if (current_image_size.x < 1.0f) current_image_size.x = 1.0f;
 		if (current_image_size.y < 1.0f) current_image_size.y = 1.0f;
 		
+		int canvas_width = (int)current_image_size.x;
+		int canvas_height = (int)current_image_size.y;
 		if (panel->last_image_size != current_image_size)
 		{
 			panel->should_redraw = true;
 			panel->last_image_size = current_image_size;
-			ResizeImagePanelCanvas(g_pd3dDevice, panel, (int)current_image_size.x, (int)current_image_size.y);
+			panel->canvas_settle_frames = CANVAS_SETTLE_FRAMES;
+			ResizeImagePanelCanvas(g_pd3dDevice, panel, canvas_width, canvas_height, true);
+		}
+		else if (panel->canvas_settle_frames > 0 && --panel->canvas_settle_frames == 0)
+		{
+			if (ResizeImagePanelCanvas(g_pd3dDevice, panel, canvas_width, canvas_height, false)) panel->should_redraw = true;
+		}
+		
+		// Stepping through the folder works while an image is still loading, so keys can be held down.
+		if (ImGui::IsWindowFocused() && !io.WantTextInput)
+		{
+			if (ImGui::IsKeyPressed(VK_RIGHT) || ImGui::IsKeyPressed(VK_NEXT)) panel->navigation_step = 1;
+			if (ImGui::IsKeyPressed(VK_LEFT) || ImGui::IsKeyPressed(VK_PRIOR)) panel->navigation_step = -1;
 		}
+		
+		// Nothing to interact with until the decode has finished.
+		if (!panel->texture)
+		{
+			if (panel->load_failed) ImGui::TextDisabled("Unable to load %s", panel->file_path);
+			else ImGui::TextDisabled("Loading %s...", panel->file_name);
+			window_has_focus = ImGui::IsWindowFocused();
+			ImGui::End();
+			ImGui::PopStyleVar(1);
+			return window_has_focus;
+		}
+		
 		Vec2 cursor_pos = ImGui::GetCursorScreenPos();
 		Vec2 mouse_pos = ImGui::GetMousePos();
 		Vec2 relative_mouse_pos = mouse_pos - cursor_pos;
-		ImTextureID tex_id = (ImTextureID)panel->dst_srv;
-		ImGui::Image(tex_id, current_image_size, Vec2(0, 0), Vec2(1, 1));
+		ImTextureID tex_id = (ImTextureID)panel->canvas.srv;
+		Vec2 canvas_uv = Vec2((float)canvas_width / panel->canvas.width, (float)canvas_height / panel->canvas.height);
+		ImGui::Image(tex_id, current_image_size, Vec2(0, 0), canvas_uv);
 		
 		if (ImGui::IsMouseClicked(ImGuiMouseButton_Right) && ImGui::IsItemHovered()) panel->is_dragging_rmb = true;
 		if (ImGui::IsMouseReleased(ImGuiMouseButton_Right)) panel->is_dragging_rmb = false;
@@ -298,6 +740,13 @@ bool DrawImagePanel(ImagePanel* panel, ImGuiID dockspace_id, bool force_focus)
             }
         }
         
+        if (panel->diff_overlay_srv && panel->show_diff_overlay)
+        {
+            Vec2 tl = cursor_pos + ImagePosToCanvasPos(panel, Vec2(0.0f, 0.0f));
+            Vec2 br = cursor_pos + ImagePosToCanvasPos(panel, Vec2((float)panel->source_width, (float)panel->source_height));
+            dl->AddImage((ImTextureID)panel->diff_overlay_srv, tl, br);
+        }
+        
 		window_has_focus = ImGui::IsWindowFocused();
 	}
 	ImGui::End();
@@ -305,23 +754,40 @@ bool DrawImagePanel(ImagePanel* panel, ImGuiID dockspace_id, bool force_focus)
 	return window_has_focus;
 }
 
+// Clamped, inclusive-exclusive bounds of the panel's selection. Returns false if nothing is selected.
+static bool GetImagePanelSelection(ImagePanel* panel, IVec2* top_left, IVec2* bottom_right)
+{
+    if (panel->selection_start.x < 0 || panel->selection_start.y < 0 || panel->selection_end.x < 0 || panel->selection_end.y < 0) return false;
+    
+    IVec2 int_tl = IVec2(Min(panel->selection_start.x, panel->selection_end.x), Min(panel->selection_start.y, panel->selection_end.y));
+    IVec2 int_br = IVec2(Max(panel->selection_start.x, panel->selection_end.x), Max(panel->selection_start.y, panel->selection_end.y)) + IVec2::One;
+    
+    top_left->x = Clamp(int_tl.x, 0, panel->source_width - 1);
+    top_left->y = Clamp(int_tl.y, 0, panel->source_height - 1);
+    bottom_right->x = Clamp(int_br.x, 0, panel->source_width);
+    bottom_right->y = Clamp(int_br.y, 0, panel->source_height);
+    return true;
+}
+
+// Out of range corners fall back to the edges of the image.
+static void ClampImagePanelRect(ImagePanel* panel, IVec2* top_left, IVec2* bottom_right)
+{
+    IVec2 full_size = IVec2(panel->source_width, panel->source_height);
+    if (bottom_right->x < 0 || bottom_right->x > full_size.x) bottom_right->x = full_size.x;
+    if (bottom_right->y < 0 || bottom_right->y > full_size.y) bottom_right->y = full_size.y;
+    if (top_left->x < 0 || top_left->x >= full_size.x) top_left->x = 0;
+    if (top_left->y < 0 || top_left->y >= full_size.y) top_left->y = 0;
+    if (bottom_right->x <= top_left->x) bottom_right->x = full_size.x;
+    if (bottom_right->y <= top_left->y) bottom_right->y = full_size.y;
+}
+
 bool SaveSelectedImagePanelRegion(ImagePanel* panel, const char* file_path, ImageExportParams params)
 {
-    bool result = false;
-    if (panel->selection_start.x >= 0 && panel->selection_start.y >= 0 && panel->selection_end.x >= 0 && panel->selection_end.y >= 0)
-    {
-        IVec2 int_tl = IVec2(Min(panel->selection_start.x, panel->selection_end.x), Min(panel->selection_start.y, panel->selection_end.y));
-        IVec2 int_br = IVec2(Max(panel->selection_start.x, panel->selection_end.x), Max(panel->selection_start.y, panel->selection_end.y)) + IVec2::One;
-        
-        int_tl.x = Clamp(int_tl.x, 0, panel->source_width - 1);
-        int_tl.y = Clamp(int_tl.y, 0, panel->source_height - 1);
-        int_br.x = Clamp(int_br.x, 0, panel->source_width);
-        int_br.y = Clamp(int_br.y, 0, panel->source_height);
-        
-        result = (SaveImagePanelRect(panel, int_tl, int_br, file_path, params) != 0);
-    }
-    return result;
+    IVec2 int_tl, int_br;
+    if (!GetImagePanelSelection(panel, &int_tl, &int_br)) return false;
+    return SaveImagePanelRect(panel, int_tl, int_br, file_path, params);
 }
+
 bool SaveImagePanel(ImagePanel* panel, const char* file_path, ImageExportParams params)
 {
     IVec2 full_size = IVec2(panel->source_width, panel->source_height);
@@ -331,28 +797,172 @@ bool SaveImagePanel(ImagePanel* panel, const char* file_path, ImageExportParams
 bool SaveImagePanelRect(ImagePanel* panel, IVec2 top_left, IVec2 bottom_right, const char* file_path, ImageExportParams params)
 {
     Assert(panel && file_path && file_path[0]);
-    bool result = false;
+    if (!panel->source_buffer) return false;
     
-    IVec2 full_size = IVec2(panel->source_width, panel->source_height);
-    if (bottom_right.x < 0 || bottom_right.x > full_size.x) bottom_right.x = full_size.x;
-    if (bottom_right.y < 0 || bottom_right.y > full_size.x) bottom_right.y = full_size.x;
-    if (top_left.x < 0 || top_left.x >= full_size.x) top_left.x = 0;
-    if (top_left.y < 0 || top_left.y >= full_size.y) top_left.y = 0;
-    if (bottom_right.x <= top_left.x) bottom_right.x = full_size.x;
-    if (bottom_right.y <= top_left.y) bottom_right.y = full_size.y;
+    ClampImagePanelRect(panel, &top_left, &bottom_right);
+    IVec2 size = bottom_right - top_left;
+    return ExportImageRegion(&panel->source_buffer->image, top_left.x, top_left.y, size.x, size.y, file_path, params);
+}
+
+ExportJob* QueueSelectedImagePanelRegionExport(ImagePanel* panel, const char* file_path, ImageExportParams params)
+{
+    Assert(panel && file_path && file_path[0]);
+    IVec2 top_left, bottom_right;
+    if (!panel->source_buffer || !GetImagePanelSelection(panel, &top_left, &bottom_right)) return 0;
     
-    size_t start_offset = top_left.y * 4 * full_size.x + top_left.x * 4;
-    unsigned char* start_ptr = panel->source_data + start_offset;
-    int stride = full_size.x * 4;
+    ClampImagePanelRect(panel, &top_left, &bottom_right);
+    IVec2 size = bottom_right - top_left;
+    return QueueImageExport(panel->source_buffer, top_left.x, top_left.y, size.x, size.y, file_path, params);
+}
+
+const ImageStats* GetImagePanelStats(ImagePanel* panel, IVec2* top_left, IVec2* bottom_right)
+{
+    Assert(panel && top_left && bottom_right);
+    if (!panel->source_buffer) return 0;
     
-    switch(params.type)
+    IVec2 int_tl, int_br;
+    if (!GetImagePanelSelection(panel, &int_tl, &int_br))
     {
-        case ImageExportParams::FileType::PNG:
+        int_tl = IVec2::Zero;
+        int_br = IVec2(panel->source_width, panel->source_height);
+    }
+    ClampImagePanelRect(panel, &int_tl, &int_br);
+    *top_left = int_tl;
+    *bottom_right = int_br;
+    
+    if (!panel->stats_cache) panel->stats_cache = QueueImageStatsCacheBuild(panel->source_buffer);
+    const ImageStatsCache* cache = GetImageStatsCache(panel->stats_cache);
+    if (!cache) return 0;
+    if (panel->stats && int_tl == panel->stats_top_left && int_br == panel->stats_bottom_right) return panel->stats;
+    
+    if (!panel->stats) panel->stats = (ImageStats*)malloc(sizeof(ImageStats)); // @malloc
+    IVec2 size = int_br - int_tl;
+    GetImageStats(cache, int_tl.x, int_tl.y, size.x, size.y, panel->stats);
+    panel->stats_top_left = int_tl;
+    panel->stats_bottom_right = int_br;
+    return panel->stats;
+}
+
+bool GetImagePanelSelectionSums(ImagePanel* panel, double* sums, double* means)
+{
+    Assert(panel && sums && means);
+    IVec2 top_left, bottom_right;
+    if (!panel->source_buffer || !GetImagePanelSelection(panel, &top_left, &bottom_right)) return false;
+    if (!panel->summed_area) panel->summed_area = QueueSummedAreaTableBuild(panel->source_buffer);
+    
+    const SummedAreaTable* table = GetSummedAreaTable(panel->summed_area);
+    if (!table) return false;
+    
+    ClampImagePanelRect(panel, &top_left, &bottom_right);
+    IVec2 size = bottom_right - top_left;
+    GetSummedAreaSums(table, top_left.x, top_left.y, size.x, size.y, sums);
+    double pixel_count = (double)size.x * (double)size.y;
+    for (int c = 0; c < table->channel_count; ++c) means[c] = sums[c] / pixel_count;
+    return true;
+}
+
+// Largest side of the mismatch overlay texture. Big images get a shrunk mask, which still shows every
+// mismatch at the cost of exaggerating it.
+#define DIFF_OVERLAY_MAX_SIZE 4096
+
+bool DiffImagePanels(ImagePanel* panel, ImagePanel* other, double threshold, bool with_ssim)
+{
+    Assert(panel && other);
+    ClearImagePanelDiff(panel);
+    if (!panel->source_buffer || !other->source_buffer) return false;
+    const DecodedImage* image = &panel->source_buffer->image;
+    const DecodedImage* other_image = &other->source_buffer->image;
+    if (image->width != other_image->width || image->height != other_image->height) return false;
+    
+    static const u8 overlay_color[4] = {255, 0, 255, 160};
+    ImageDiffParams params = {};
+    params.threshold = threshold;
+    params.keep_mask = true;
+    panel->diff_job = QueueImageDiff(panel->source_buffer, other->source_buffer, params, DIFF_OVERLAY_MAX_SIZE, overlay_color);
+    
+    if (with_ssim) panel->ssim_job = QueueSsim(panel->source_buffer, other->source_buffer);
+    panel->diff_panel_id = other->panel_id;
+    return true;
+}
+
+bool UpdateImagePanelDiff(ID3D11Device* device, ImagePanel* panel)
+{
+    Assert(panel);
+    bool is_changed = false;
+    
+    // Images too small for the SSIM window still get the rest of the comparison.
+    if (panel->ssim_job && GetSsimState(panel->ssim_job) != SsimState::Running)
+    {
+        const SsimResult* result = GetSsimResult(panel->ssim_job);
+        if (result)
+        {
+            panel->ssim = (SsimResult*)malloc(sizeof(SsimResult)); // @malloc
+            *panel->ssim = *result;
+        }
+        ReleaseSsimJob(panel->ssim_job);
+        panel->ssim_job = 0;
+        is_changed = true;
+    }
+    if (!panel->diff_job || GetDiffState(panel->diff_job) == DiffState::Running) return is_changed;
+    
+    if (GetDiffState(panel->diff_job) == DiffState::Ready)
+    {
+        u8* overlay;
+        int overlay_width, overlay_height;
+        panel->diff = (ImageDiff*)malloc(sizeof(ImageDiff)); // @malloc
+        *panel->diff = TakeImageDiff(panel->diff_job, &overlay, &overlay_width, &overlay_height);
+        
+        D3D11_TEXTURE2D_DESC tex_desc = {};
+        tex_desc.Width = overlay_width;
+        tex_desc.Height = overlay_height;
+        tex_desc.MipLevels = 1;
+        tex_desc.ArraySize = 1;
+        tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        tex_desc.SampleDesc.Count = 1;
+        tex_desc.Usage = D3D11_USAGE_IMMUTABLE;
+        tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        
+        D3D11_SUBRESOURCE_DATA sr_data = {};
+        sr_data.pSysMem = overlay;
+        sr_data.SysMemPitch = overlay_width * 4;
+        ID3D11Texture2D* texture = 0;
+        if (SUCCEEDED(device->CreateTexture2D(&tex_desc, &sr_data, &texture)))
         {
-            result = (stbi_write_png(file_path, bottom_right.x - top_left.x, bottom_right.y - top_left.y, 4, start_ptr, stride) != 0); 
+            device->CreateShaderResourceView(texture, 0, &panel->diff_overlay_srv);
+            texture->Release(); // The view keeps it alive.
         }
-        break;
-        default: break;
+        free(overlay);
+        panel->show_diff_overlay = true;
+    }
+    else
+    {
+        ReleaseSsimJob(panel->ssim_job);
+        panel->ssim_job = 0;
+        panel->diff_panel_id = 0;
     }
-    return result;
-}
\ No newline at end of file
+    
+    ReleaseDiffJob(panel->diff_job);
+    panel->diff_job = 0;
+    return true;
+}
+
+void ClearImagePanelDiff(ImagePanel* panel)
+{
+    Assert(panel);
+    if (panel->diff)
+    {
+        FreeImageDiff(panel->diff);
+        free(panel->diff);
+    }
+    ReleaseDiffJob(panel->diff_job);
+    ReleaseSsimJob(panel->ssim_job);
+    if (panel->diff_overlay_srv) panel->diff_overlay_srv->Release();
+    free(panel->ssim);
+    panel->diff = 0;
+    panel->diff_job = 0;
+    panel->ssim_job = 0;
+    panel->ssim = 0;
+    panel->diff_panel_id = 0;
+    panel->diff_overlay_srv = 0;
+    panel->show_diff_overlay = false;
+}
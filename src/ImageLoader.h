@@ -4,15 +4,26 @@
 #define _IMAGE_LOADER_H
 
 #include <d3d11.h>
+#include "ImageDecode.h"
+#include "ThumbnailDecode.h"
+#include "TiledImage.h"
+#include "RenderTargetPool.h"
+#include "ImageExport.h"
+#include "ImageStats.h"
+#include "SummedAreaTable.h"
+#include "ImageDiff.h"
+#include "ImageSsim.h"
+#include "ImagePrefetch.h"
+#include "ImageStore.h"
+
+#define PANEL_PREVIEW_SIZE 512 // Most an evicted panel keeps of its image, on the longer side. No bigger than UPLOAD_CHUNK_SIZE.
 
 struct ImagePanel
 {
-	ID3D11Texture2D* texture; // TODO(Matt): Free me.
-	ID3D11Texture2D* render_target;
+	ID3D11Texture2D* texture; // Null until the decode finishes, or shows some of it. Shared with the stored image, or the panel's own tile atlas for tiled images.
+	RenderTarget canvas; // Pooled, and often bigger than the panel; only the top-left last_image_size is drawn.
 	
 	ID3D11ShaderResourceView* src_srv;
-	ID3D11ShaderResourceView* dst_srv;
-	ID3D11RenderTargetView* rtv;
 	
 	ID3D11Buffer* vertex_buffer;
 	ID3D11Buffer* index_buffer;
@@ -21,11 +32,40 @@ struct ImagePanel
 	Vec2 image_size;
 	Vec2 image_offset;
 	Vec2 last_image_size;
+	int canvas_settle_frames; // Counts down after a resize; the canvas may shrink once it reaches zero.
 	
-    unsigned char* source_data;
+    unsigned char* source_data; // Pixels in source_layout, exactly as decoded.
+	PixelBuffer* source_buffer; // Owns source_data. Exports hold references to it rather than copies.
 	int source_width;
 	int source_height;
-	int source_channel_count; // Number of channels in the source image.
+	PixelLayout source_layout; // Native channel count and bit depth of the source image.
+	
+	StoredImage* stored; // Shared by every panel showing the file. Null while waiting on the prefetcher, or evicted.
+	bool load_failed;
+	bool is_evicted; // Only a preview is left in texture, until the image is shown again.
+	u64 preview_bytes; // Size of the preview texture, if the panel has one of its own.
+	int texture_version; // Of the stored image's textures as of the last redraw, or 0.
+	bool is_awaiting_prefetch; // Stepped to an image the prefetcher is still decoding.
+	
+	TiledImage* tiled; // Set for images too big for one texture; these are drawn tile by tile from the atlas.
+	MipChain* mips; // CPU copies of the lower levels that tiles are cut from. Belongs to the stored image.
+	ID3D11Buffer* tile_vertex_buffer;
+	ID3D11Buffer* tile_index_buffer;
+	int tile_quad_count; // Number of quads in tile_vertex_buffer as of the last UpdateImagePanelTiles.
+	
+	ImageStatsJob* stats_cache; // Per-tile stats, queued the first time stats are asked for.
+	ImageStats* stats; // Stats for stats_top_left to stats_bottom_right, reused until the selection changes.
+	IVec2 stats_top_left;
+	IVec2 stats_bottom_right;
+	SummedAreaJob* summed_area; // Queued the first time the selection's sums are asked for.
+	
+	ImageDiff* diff; // Result of the last comparison with another panel, without the full-size mask.
+	DiffJob* diff_job; // The comparison in flight, until UpdateImagePanelDiff picks up its result.
+	SsimResult* ssim; // Structural similarity from the same comparison, if it was asked for.
+	SsimJob* ssim_job; // Runs alongside diff_job, and is picked up by UpdateImagePanelDiff the same way.
+	int diff_panel_id; // The panel it was compared with.
+	ID3D11ShaderResourceView* diff_overlay_srv; // Mismatch mask, shrunk to fit a texture.
+	bool show_diff_overlay;
 	
 	int panel_id; // Unique ID of the panel (per app instance). Starts at 1 and increments for every new panel.
 	
@@ -33,10 +73,16 @@ struct ImagePanel
 	char* file_name; // Pointer to the start of the name within file path.
 	char* window_label; // Pointer to an imgui label string, concatenation of file name and panel ID.
 	
+	char** sequence_paths; // Every image in the file's folder, listed the first time it's needed.
+	int sequence_count;
+	int sequence_index; // Of file_path in sequence_paths.
+	int navigation_step; // Set by DrawImagePanel when a next/previous key is pressed, for the caller to act on.
+	
 	bool is_dragging_rmb; // True if a right-click drag is happening that started in this panel.
     bool is_dragging_lmb; // True if a left-click drag is happening that started in this panel.
     
 	bool is_visible; // True if the panel is open. Panel will be deleted if this is false.
+	bool is_shown; // False while the panel is a tab hidden behind another one.
 	
 	bool should_redraw; // True if the image has changed state and needs to be re-drawn to the canvas.
 	bool show_r;
@@ -48,48 +94,47 @@ struct ImagePanel
     IVec2 selection_end;
 };
 
-struct ImageExportParams
-{
-    // TODO(Matt): Extension
-    // TODO(Matt): Channel count
-    // TODO(Matt): I dunno, like compression amount or something (this really depends on format, maybe this should be a union).
-    
-    // TODO(Matt): Gif support? I guess we can't handle animated ones anyway (should we? Nah).
-    enum class FileType : u8
-    {
-        None = 0,
-        PNG,
-        BMP,
-        TGA,
-        JPG,
-        HDR,
-        DDS
-    };
-    
-    FileType type;
-    
-    union
-    {
-        struct
-        {
-            int channel_count;
-            int compress_level;
-            
-        } PNG;
-        
-        struct
-        {
-            int dummy;
-        } BMP;
-    };
-};
-
 bool SaveImagePanel(ImagePanel* panel, const char* file_path, ImageExportParams params);
 bool SaveSelectedImagePanelRegion(ImagePanel* panel, const char* file_path, ImageExportParams params);
 bool SaveImagePanelRect(ImagePanel* panel, IVec2 top_left, IVec2 bottom_right, const char* file_path, ImageExportParams params);
+// Same as SaveSelectedImagePanelRegion, but encodes on a worker. Returns null if nothing is selected.
+ExportJob* QueueSelectedImagePanelRegionExport(ImagePanel* panel, const char* file_path, ImageExportParams params);
+// Histograms and stats for the selection, or the whole image if nothing is selected, recomputed only when
+// the selection changes. The per-tile cache they come from is built in the background the first time,
+// and this returns null until it's ready (or while the image is still loading). The covered rect is
+// returned in top_left and bottom_right (inclusive-exclusive).
+const ImageStats* GetImagePanelStats(ImagePanel* panel, IVec2* top_left, IVec2* bottom_right);
+// Per-channel sums and means over the selection, in constant time, so they can follow a drag. They come
+// from a summed-area table that is built in the background the first time there is a selection; until
+// it's ready (or if nothing is selected) this returns false. sums and means must hold source channel count
+// values.
+bool GetImagePanelSelectionSums(ImagePanel* panel, double* sums, double* means);
+// Starts comparing the panel's pixels with another panel's on a worker, plus SSIM and MS-SSIM if with_ssim
+// is set. Returns false if either image isn't loaded or their sizes differ. The result, along with an
+// overlay of the mismatched pixels, is kept on the panel once UpdateImagePanelDiff has picked it up.
+bool DiffImagePanels(ImagePanel* panel, ImagePanel* other, double threshold, bool with_ssim);
+// Call once per frame. Returns true when a comparison, or its SSIM, has just finished.
+bool UpdateImagePanelDiff(ID3D11Device* device, ImagePanel* panel);
+void ClearImagePanelDiff(ImagePanel* panel);
 ImagePanel LoadImageFromFile(ID3D11Device* device, ID3D11DeviceContext* ctx, char* image_path, int panel_id, Vec2 viewport_size);
-void ResizeImagePanelCanvas(ID3D11Device* device, ImagePanel* image, int width, int height);
+bool UpdateImagePanelLoad(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel);
+bool UpdateImagePanelTiles(ID3D11DeviceContext* ctx, ImagePanel* panel);
+bool ResizeImagePanelCanvas(ID3D11Device* device, ImagePanel* image, int width, int height, bool is_resizing);
 void ReleaseImagePanel(ImagePanel image);
+// Drops the panel's full-resolution pixels and texture and everything derived from them, keeping just the
+// mip levels no bigger than PANEL_PREVIEW_SIZE to draw from. Returns false if the panel has nothing to
+// evict (it's still loading, or already evicted).
+bool EvictImagePanel(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel);
+// Starts loading an evicted panel's image again; the preview is swapped for it once it's ready.
+void RestoreImagePanel(ImagePanel* panel);
+// Queues decodes of the images around the panel's in its folder, so stepping to them is quick.
+void PrefetchImagePanelNeighbours(ImagePanel* panel, ImagePrefetcher* prefetcher);
+// Switches the panel to the image step places along in its folder, wrapping around at either end. The
+// view is kept if the new image is the same size. Prefetched images are shown straight away; anything
+// else loads the same way a newly opened one does. Returns false if the folder has nowhere to step to.
+bool StepImagePanel(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel, int step, ImagePrefetcher* prefetcher);
+// Picks up the image a step is waiting on once the prefetcher has it. Returns true if the panel changed state.
+bool UpdateImagePanelPrefetch(ID3D11Device* device, ID3D11DeviceContext* ctx, ImagePanel* panel, ImagePrefetcher* prefetcher);
 
 bool DrawImagePanel(ImagePanel* panel, ImGuiID dockspace_id, bool force_focus);
 #endif //_IMAGE_LOADER_H
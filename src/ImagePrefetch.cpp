@@ -0,0 +1,167 @@
+#include "ImagePrefetch.h"
+
+ImagePrefetcher* CreateImagePrefetcher(u64 budget)
+{
+	ImagePrefetcher* prefetcher = (ImagePrefetcher*)calloc(1, sizeof(ImagePrefetcher)); // @malloc
+	prefetcher->budget = budget;
+	return prefetcher;
+}
+
+static void FreePrefetchEntry(ImagePrefetcher* prefetcher, PrefetchEntry* entry)
+{
+	ReleaseImageLoad(entry->job);
+	ReleasePixelBuffer(entry->pixels); // Panels showing the image keep their own reference.
+	if (entry->mips)
+	{
+		FreeMipChain(entry->mips);
+		free(entry->mips);
+	}
+	prefetcher->used_bytes -= entry->byte_size;
+	free(entry->file_path);
+}
+
+void DestroyImagePrefetcher(ImagePrefetcher* prefetcher)
+{
+	if (!prefetcher) return;
+	for (int i = 0; i < arrlen(prefetcher->entries); ++i) FreePrefetchEntry(prefetcher, &prefetcher->entries[i]);
+	arrfree(prefetcher->entries);
+	free(prefetcher);
+}
+
+// A handful of entries at most (whatever the budget holds), so a linear search is plenty.
+static PrefetchEntry* FindPrefetchEntry(ImagePrefetcher* prefetcher, const char* file_path)
+{
+	for (int i = 0; i < arrlen(prefetcher->entries); ++i)
+	{
+		if (!strcmp(prefetcher->entries[i].file_path, file_path)) return &prefetcher->entries[i];
+	}
+	return 0;
+}
+
+void PrefetchImageSequence(ImagePrefetcher* prefetcher, char** paths, int count, int index, int step)
+{
+	assert(prefetcher && paths && index >= 0 && index < count);
+	prefetcher->wanted_at = ++prefetcher->clock;
+
+	// Nearest first, alternating sides while both have images left to fetch.
+	int direction = (step < 0) ? -1 : 1;
+	int wanted[1 + PREFETCH_AHEAD + PREFETCH_BEHIND];
+	int wanted_count = 0;
+	u64 wanted_size = 0;
+	for (int distance = 0; distance <= PREFETCH_AHEAD || distance <= PREFETCH_BEHIND; ++distance)
+	{
+		for (int side = 0; side < 2; ++side)
+		{
+			if ((distance == 0 && side == 1) || distance > (side ? PREFETCH_BEHIND : PREFETCH_AHEAD)) continue;
+			int i = index + (side ? -distance : distance) * direction;
+			i = ((i % count) + count) % count;
+
+			bool is_duplicate = false; // Short folders wrap around onto images already in the list.
+			for (int j = 0; j < wanted_count; ++j) is_duplicate |= (wanted[j] == i);
+			if (is_duplicate) continue;
+
+			// Until something has been decoded there's nothing to go on, and everything is asked for.
+			if (wanted_count > 0 && wanted_size + prefetcher->estimated_size > prefetcher->budget) continue;
+			wanted_size += prefetcher->estimated_size;
+			wanted[wanted_count++] = i;
+		}
+	}
+
+	// Touched farthest first, so the nearest images are the last to be evicted.
+	for (int i = wanted_count - 1; i >= 0; --i)
+	{
+		const char* file_path = paths[wanted[i]];
+		PrefetchEntry* entry = FindPrefetchEntry(prefetcher, file_path);
+		if (!entry)
+		{
+			PrefetchEntry new_entry = {};
+			size_t path_size = strlen(file_path) + 1;
+			new_entry.file_path = (char*)malloc(path_size); // @malloc
+			memcpy(new_entry.file_path, file_path, path_size);
+			new_entry.job = QueueImageLoad(file_path);
+			arrput(prefetcher->entries, new_entry);
+			entry = &arrlast(prefetcher->entries);
+		}
+		entry->last_used = ++prefetcher->clock;
+		entry->wanted_at = prefetcher->wanted_at;
+	}
+
+	// Decodes that have fallen out of range are cancelled, and failures forgotten so they can be retried
+	// next time round. Finished images stay until the budget pushes them out.
+	for (int i = (int)arrlen(prefetcher->entries) - 1; i >= 0; --i)
+	{
+		PrefetchEntry* entry = &prefetcher->entries[i];
+		if (entry->wanted_at == prefetcher->wanted_at || entry->pixels) continue;
+		FreePrefetchEntry(prefetcher, entry);
+		arrdelswap(prefetcher->entries, i);
+	}
+}
+
+bool UpdateImagePrefetcher(ImagePrefetcher* prefetcher)
+{
+	assert(prefetcher);
+	bool has_changed = false;
+	for (int i = 0; i < arrlen(prefetcher->entries); ++i)
+	{
+		PrefetchEntry* entry = &prefetcher->entries[i];
+		if (!entry->job) continue;
+		ImageLoadState state = GetImageLoadState(entry->job);
+		if (state == ImageLoadState::Queued || state == ImageLoadState::Decoding) continue;
+
+		if (state == ImageLoadState::Ready)
+		{
+			DecodedImage image = TakeDecodedImage(entry->job);
+			entry->byte_size = (u64)image.width * image.height * GetPixelSize(image.layout);
+			entry->pixels = CreatePixelBuffer(&image);
+			entry->mips = TakeMipChain(entry->job);
+			if (entry->mips) entry->byte_size += GetMipChainSize(entry->mips);
+			prefetcher->used_bytes += entry->byte_size;
+			prefetcher->estimated_size = entry->byte_size;
+		}
+		else
+		{
+			entry->has_failed = true;
+		}
+		ReleaseImageLoad(entry->job);
+		entry->job = 0;
+		has_changed = true;
+	}
+
+	// Least recently used first, but never the most recent image, which is the one being looked at.
+	while (prefetcher->used_bytes > prefetcher->budget)
+	{
+		int oldest = -1;
+		int newest = -1;
+		for (int i = 0; i < arrlen(prefetcher->entries); ++i)
+		{
+			PrefetchEntry* entry = &prefetcher->entries[i];
+			if (!entry->pixels) continue;
+			if (oldest < 0 || entry->last_used < prefetcher->entries[oldest].last_used) oldest = i;
+			if (newest < 0 || entry->last_used > prefetcher->entries[newest].last_used) newest = i;
+		}
+		if (oldest == newest) break;
+		FreePrefetchEntry(prefetcher, &prefetcher->entries[oldest]);
+		arrdelswap(prefetcher->entries, oldest);
+	}
+	return has_changed;
+}
+
+PrefetchState GetPrefetchedImage(ImagePrefetcher* prefetcher, const char* file_path, PixelBuffer** pixels, MipChain** mips)
+{
+	assert(prefetcher && file_path && pixels && mips);
+	*pixels = 0;
+	*mips = 0;
+	PrefetchEntry* entry = FindPrefetchEntry(prefetcher, file_path);
+	if (!entry) return PrefetchState::Missing;
+	if (entry->has_failed) return PrefetchState::Failed;
+	if (!entry->pixels) return PrefetchState::Pending;
+
+	entry->last_used = ++prefetcher->clock;
+	*pixels = RetainPixelBuffer(entry->pixels);
+	if (entry->mips)
+	{
+		*mips = (MipChain*)malloc(sizeof(MipChain)); // @malloc
+		CopyMipChain(entry->mips, *mips);
+	}
+	return PrefetchState::Ready;
+}
@@ -0,0 +1,67 @@
+#ifndef _IMAGE_PREFETCH_H
+#define _IMAGE_PREFETCH_H
+
+#include "ImageDecode.h"
+#include "MipChain.h"
+
+// Decodes the images around the one being looked at, so stepping to the next or previous image in a
+// folder only costs a texture upload. Finished decodes (pixels and mip chain, exactly what a panel would
+// get from its own ImageLoadJob) are kept in memory up to a byte budget, and the least recently used ones
+// are dropped first. Images that are still wanted after a step are never decoded twice.
+
+#define PREFETCH_AHEAD 4 // Images decoded past the current one, in the direction of travel.
+#define PREFETCH_BEHIND 2
+#define PREFETCH_DEFAULT_BUDGET ((u64)1 << 30)
+
+enum class PrefetchState : u8
+{
+	Missing = 0, // Not asked for, or already dropped.
+	Pending,
+	Ready,
+	Failed
+};
+
+struct PrefetchEntry
+{
+	char* file_path;
+	ImageLoadJob* job; // Null once the decode has been collected.
+	PixelBuffer* pixels; // Set once Ready.
+	MipChain* mips;
+	u64 byte_size; // Of pixels and mips together.
+	u64 last_used; // Prefetcher clock, for the LRU.
+	u64 wanted_at; // Clock of the last PrefetchImageSequence that asked for it.
+	bool has_failed;
+};
+
+struct ImagePrefetcher
+{
+	PrefetchEntry* entries; // stb_ds array.
+	u64 budget;
+	u64 used_bytes; // Held by Ready entries.
+	u64 clock;
+	u64 wanted_at; // Clock of the last PrefetchImageSequence.
+	u64 estimated_size; // Size of the last image collected, to guess how many neighbours fit.
+
+	// Counted by whoever steps through the images.
+	u64 hit_count;
+	u64 miss_count;
+};
+
+ImagePrefetcher* CreateImagePrefetcher(u64 budget = PREFETCH_DEFAULT_BUDGET);
+void DestroyImagePrefetcher(ImagePrefetcher* prefetcher);
+
+// Makes paths[index] the current image, and queues decodes for it and the images around it: nearest
+// first, up to PREFETCH_AHEAD in the direction of travel (step, which may be zero) and PREFETCH_BEHIND the
+// other way, wrapping around, and no more than the budget holds. Decodes that haven't started and are no
+// longer wanted are cancelled.
+void PrefetchImageSequence(ImagePrefetcher* prefetcher, char** paths, int count, int index, int step);
+
+// Collects finished decodes and drops the least recently used images while over budget. Returns true if
+// anything finished.
+bool UpdateImagePrefetcher(ImagePrefetcher* prefetcher);
+
+// On Ready, pixels gets a new reference to the decoded pixels and mips a copy of the chain; the caller
+// releases the one and frees the other (FreeMipChain, then free()).
+PrefetchState GetPrefetchedImage(ImagePrefetcher* prefetcher, const char* file_path, PixelBuffer** pixels, MipChain** mips);
+
+#endif //_IMAGE_PREFETCH_H
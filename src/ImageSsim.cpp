@@ -0,0 +1,508 @@
+#include "ImageSsim.h"
+#include "Core/CpuFeatures.h"
+#include "Core/JobSystem.h"
+#include "Core/FrameScheduler.h"
+#include <math.h>
+
+#define SSIM_WINDOW 11
+#define SSIM_SIGMA 1.5
+#define SSIM_C1 (0.01f * 0.01f)
+#define SSIM_C2 (0.03f * 0.03f)
+
+// Output rows per ParallelFor index. Every band has to filter SSIM_WINDOW - 1 extra input rows to get
+// going, so bands shouldn't be much smaller than this.
+#define SSIM_BAND_ROWS 64
+
+// The five moments filtered for every pixel: both means, both second moments and the cross moment.
+#define SSIM_MOMENTS 5
+
+static const double ms_ssim_weights[SSIM_SCALES] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+
+static void GetSsimWindowWeights(float* weights)
+{
+	double sum = 0.0;
+	double raw[SSIM_WINDOW];
+	for (int i = 0; i < SSIM_WINDOW; ++i)
+	{
+		double offset = i - SSIM_WINDOW / 2;
+		raw[i] = exp(-offset * offset / (2.0 * SSIM_SIGMA * SSIM_SIGMA));
+		sum += raw[i];
+	}
+	for (int i = 0; i < SSIM_WINDOW; ++i) weights[i] = (float)(raw[i] / sum);
+}
+
+// The window is symmetric, so both passes add the pair of samples either side of the centre before
+// weighting them, which takes six multiplies per moment instead of eleven. The window is "valid" only:
+// a row of width w filters down to w - SSIM_WINDOW + 1 values.
+#define SSIM_HALF_WINDOW (SSIM_WINDOW / 2)
+
+// Horizontal pass: filters all five moments (mean a, mean b, a^2, b^2, ab) of one row pair into
+// moments, which holds SSIM_MOMENTS rows of out_width values, forming the products on the fly. This is
+// the scalar reference, starting at first_x.
+static void FilterSsimMomentsScalar(const float* a, const float* b, const float* weights, int first_x, int out_width, float* moments)
+{
+	for (int x = first_x; x < out_width; ++x)
+	{
+		float center_a = a[x + SSIM_HALF_WINDOW];
+		float center_b = b[x + SSIM_HALF_WINDOW];
+		float weight = weights[SSIM_HALF_WINDOW];
+		float sum_a = weight * center_a;
+		float sum_b = weight * center_b;
+		float sum_aa = weight * center_a * center_a;
+		float sum_bb = weight * center_b * center_b;
+		float sum_ab = weight * center_a * center_b;
+		for (int k = 0; k < SSIM_HALF_WINDOW; ++k)
+		{
+			float left_a = a[x + k], right_a = a[x + SSIM_WINDOW - 1 - k];
+			float left_b = b[x + k], right_b = b[x + SSIM_WINDOW - 1 - k];
+			sum_a += weights[k] * (left_a + right_a);
+			sum_b += weights[k] * (left_b + right_b);
+			sum_aa += weights[k] * (left_a * left_a + right_a * right_a);
+			sum_bb += weights[k] * (left_b * left_b + right_b * right_b);
+			sum_ab += weights[k] * (left_a * left_b + right_a * right_b);
+		}
+		moments[x] = sum_a;
+		moments[out_width + x] = sum_b;
+		moments[out_width * 2 + x] = sum_aa;
+		moments[out_width * 3 + x] = sum_bb;
+		moments[out_width * 4 + x] = sum_ab;
+	}
+}
+
+static float FilterSsimColumnScalar(const float* const* rows, const float* weights, size_t offset)
+{
+	float sum = weights[SSIM_HALF_WINDOW] * rows[SSIM_HALF_WINDOW][offset];
+	for (int k = 0; k < SSIM_HALF_WINDOW; ++k) sum += weights[k] * (rows[k][offset] + rows[SSIM_WINDOW - 1 - k][offset]);
+	return sum;
+}
+
+// Vertical pass: rows holds the SSIM_WINDOW horizontally filtered moment rows in order, each laid out as
+// FilterSsimMoments leaves them. Filters them down and adds the SSIM and contrast-structure terms of
+// every output pixel to the sums.
+static void SumSsimRowScalar(const float* const* rows, const float* weights, int first_x, int width, double* ssim_sum, double* cs_sum)
+{
+	for (int x = first_x; x < width; ++x)
+	{
+		float mean_a = FilterSsimColumnScalar(rows, weights, x);
+		float mean_b = FilterSsimColumnScalar(rows, weights, (size_t)width + x);
+		float variance_a = FilterSsimColumnScalar(rows, weights, (size_t)width * 2 + x) - mean_a * mean_a;
+		float variance_b = FilterSsimColumnScalar(rows, weights, (size_t)width * 3 + x) - mean_b * mean_b;
+		float covariance = FilterSsimColumnScalar(rows, weights, (size_t)width * 4 + x) - mean_a * mean_b;
+
+		float luminance = (2.0f * mean_a * mean_b + SSIM_C1) / (mean_a * mean_a + mean_b * mean_b + SSIM_C1);
+		float contrast_structure = (2.0f * covariance + SSIM_C2) / (variance_a + variance_b + SSIM_C2);
+		*ssim_sum += luminance * contrast_structure;
+		*cs_sum += contrast_structure;
+	}
+}
+
+#ifdef CORE_SIMD_X86
+// Eight outputs per iteration, from overlapping unaligned loads.
+SIMD_TARGET_AVX2 static void FilterSsimMomentsAVX2(const float* a, const float* b, const float* weights, int out_width, float* moments)
+{
+	__m256 taps[SSIM_HALF_WINDOW + 1];
+	for (int k = 0; k <= SSIM_HALF_WINDOW; ++k) taps[k] = _mm256_set1_ps(weights[k]);
+
+	int x = 0;
+	for (; x + 8 <= out_width; x += 8)
+	{
+		__m256 center_a = _mm256_loadu_ps(a + x + SSIM_HALF_WINDOW);
+		__m256 center_b = _mm256_loadu_ps(b + x + SSIM_HALF_WINDOW);
+		__m256 sum_a = _mm256_mul_ps(taps[SSIM_HALF_WINDOW], center_a);
+		__m256 sum_b = _mm256_mul_ps(taps[SSIM_HALF_WINDOW], center_b);
+		__m256 sum_aa = _mm256_mul_ps(taps[SSIM_HALF_WINDOW], _mm256_mul_ps(center_a, center_a));
+		__m256 sum_bb = _mm256_mul_ps(taps[SSIM_HALF_WINDOW], _mm256_mul_ps(center_b, center_b));
+		__m256 sum_ab = _mm256_mul_ps(taps[SSIM_HALF_WINDOW], _mm256_mul_ps(center_a, center_b));
+		for (int k = 0; k < SSIM_HALF_WINDOW; ++k)
+		{
+			__m256 left_a = _mm256_loadu_ps(a + x + k), right_a = _mm256_loadu_ps(a + x + SSIM_WINDOW - 1 - k);
+			__m256 left_b = _mm256_loadu_ps(b + x + k), right_b = _mm256_loadu_ps(b + x + SSIM_WINDOW - 1 - k);
+			sum_a = _mm256_add_ps(sum_a, _mm256_mul_ps(taps[k], _mm256_add_ps(left_a, right_a)));
+			sum_b = _mm256_add_ps(sum_b, _mm256_mul_ps(taps[k], _mm256_add_ps(left_b, right_b)));
+			sum_aa = _mm256_add_ps(sum_aa, _mm256_mul_ps(taps[k], _mm256_add_ps(_mm256_mul_ps(left_a, left_a), _mm256_mul_ps(right_a, right_a))));
+			sum_bb = _mm256_add_ps(sum_bb, _mm256_mul_ps(taps[k], _mm256_add_ps(_mm256_mul_ps(left_b, left_b), _mm256_mul_ps(right_b, right_b))));
+			sum_ab = _mm256_add_ps(sum_ab, _mm256_mul_ps(taps[k], _mm256_add_ps(_mm256_mul_ps(left_a, left_b), _mm256_mul_ps(right_a, right_b))));
+		}
+		_mm256_storeu_ps(moments + x, sum_a);
+		_mm256_storeu_ps(moments + out_width + x, sum_b);
+		_mm256_storeu_ps(moments + out_width * 2 + x, sum_aa);
+		_mm256_storeu_ps(moments + out_width * 3 + x, sum_bb);
+		_mm256_storeu_ps(moments + out_width * 4 + x, sum_ab);
+	}
+	FilterSsimMomentsScalar(a, b, weights, x, out_width, moments);
+}
+
+SIMD_TARGET_AVX2 static inline __m256 FilterSsimColumnAVX2(const float* const* rows, const __m256* taps, size_t offset)
+{
+	__m256 sum = _mm256_mul_ps(taps[SSIM_HALF_WINDOW], _mm256_loadu_ps(rows[SSIM_HALF_WINDOW] + offset));
+	for (int k = 0; k < SSIM_HALF_WINDOW; ++k)
+	{
+		__m256 pair = _mm256_add_ps(_mm256_loadu_ps(rows[k] + offset), _mm256_loadu_ps(rows[SSIM_WINDOW - 1 - k] + offset));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(taps[k], pair));
+	}
+	return sum;
+}
+
+// Sums go into float lanes for the row and into double once per row, which is plenty for rows of any
+// realistic width.
+SIMD_TARGET_AVX2 static void SumSsimRowAVX2(const float* const* rows, const float* weights, int width, double* ssim_sum, double* cs_sum)
+{
+	__m256 taps[SSIM_HALF_WINDOW + 1];
+	for (int k = 0; k <= SSIM_HALF_WINDOW; ++k) taps[k] = _mm256_set1_ps(weights[k]);
+	const __m256 c1 = _mm256_set1_ps(SSIM_C1);
+	const __m256 c2 = _mm256_set1_ps(SSIM_C2);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	__m256 ssim_lanes = _mm256_setzero_ps();
+	__m256 cs_lanes = _mm256_setzero_ps();
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256 mean_a = FilterSsimColumnAVX2(rows, taps, x);
+		__m256 mean_b = FilterSsimColumnAVX2(rows, taps, (size_t)width + x);
+		__m256 moment_sum = _mm256_add_ps(FilterSsimColumnAVX2(rows, taps, (size_t)width * 2 + x), FilterSsimColumnAVX2(rows, taps, (size_t)width * 3 + x));
+		__m256 moment_ab = FilterSsimColumnAVX2(rows, taps, (size_t)width * 4 + x);
+
+		__m256 mean_square_sum = _mm256_add_ps(_mm256_mul_ps(mean_a, mean_a), _mm256_mul_ps(mean_b, mean_b));
+		__m256 mean_ab = _mm256_mul_ps(mean_a, mean_b);
+		__m256 variance_sum = _mm256_sub_ps(moment_sum, mean_square_sum);
+		__m256 covariance = _mm256_sub_ps(moment_ab, mean_ab);
+
+		__m256 luminance = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(two, mean_ab), c1), _mm256_add_ps(mean_square_sum, c1));
+		__m256 contrast_structure = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(two, covariance), c2), _mm256_add_ps(variance_sum, c2));
+		ssim_lanes = _mm256_add_ps(ssim_lanes, _mm256_mul_ps(luminance, contrast_structure));
+		cs_lanes = _mm256_add_ps(cs_lanes, contrast_structure);
+	}
+
+	alignas(32) float ssim_values[8];
+	alignas(32) float cs_values[8];
+	_mm256_store_ps(ssim_values, ssim_lanes);
+	_mm256_store_ps(cs_values, cs_lanes);
+	for (int k = 0; k < 8; ++k)
+	{
+		*ssim_sum += ssim_values[k];
+		*cs_sum += cs_values[k];
+	}
+	SumSsimRowScalar(rows, weights, x, width, ssim_sum, cs_sum);
+}
+#endif
+
+static void FilterSsimMoments(const float* a, const float* b, const float* weights, int out_width, float* moments, bool is_avx2)
+{
+#ifdef CORE_SIMD_X86
+	if (is_avx2)
+	{
+		FilterSsimMomentsAVX2(a, b, weights, out_width, moments);
+		return;
+	}
+#endif
+	FilterSsimMomentsScalar(a, b, weights, 0, out_width, moments);
+}
+
+static void SumSsimRow(const float* const* rows, const float* weights, int width, double* ssim_sum, double* cs_sum, bool is_avx2)
+{
+#ifdef CORE_SIMD_X86
+	if (is_avx2)
+	{
+		SumSsimRowAVX2(rows, weights, width, ssim_sum, cs_sum);
+		return;
+	}
+#endif
+	SumSsimRowScalar(rows, weights, 0, width, ssim_sum, cs_sum);
+}
+
+struct SsimPass
+{
+	const float* a;
+	const float* b;
+	int width;
+	int height;
+	float weights[SSIM_WINDOW];
+	bool is_avx2;
+	double* ssim_sums; // One per band.
+	double* cs_sums;
+};
+
+// ParallelFor callback: sums SSIM over bands [begin, end) of output rows. Each band slides down the
+// image keeping the last SSIM_WINDOW horizontally filtered rows of moments in a ring, so each input row
+// is filtered across once and the ring is filtered down for each output row.
+static void SumSsimBands(int begin, int end, void* data)
+{
+	SsimPass* pass = (SsimPass*)data;
+	int width = pass->width;
+	int out_width = width - SSIM_WINDOW + 1;
+	int out_height = pass->height - SSIM_WINDOW + 1;
+	size_t slot_size = (size_t)SSIM_MOMENTS * out_width;
+	float* ring = (float*)malloc(sizeof(float) * slot_size * SSIM_WINDOW); // @malloc
+
+	for (int band = begin; band < end; ++band)
+	{
+		int first_row = band * SSIM_BAND_ROWS;
+		int end_row = (first_row + SSIM_BAND_ROWS < out_height) ? first_row + SSIM_BAND_ROWS : out_height;
+		double ssim_sum = 0.0;
+		double cs_sum = 0.0;
+
+		for (int y = first_row; y < end_row + SSIM_WINDOW - 1; ++y)
+		{
+			const float* row_a = pass->a + (size_t)y * width;
+			const float* row_b = pass->b + (size_t)y * width;
+			FilterSsimMoments(row_a, row_b, pass->weights, out_width, ring + (size_t)(y % SSIM_WINDOW) * slot_size, pass->is_avx2);
+
+			int out_y = y - (SSIM_WINDOW - 1);
+			if (out_y < first_row) continue;
+
+			const float* window_rows[SSIM_WINDOW];
+			for (int k = 0; k < SSIM_WINDOW; ++k) window_rows[k] = ring + (size_t)((out_y + k) % SSIM_WINDOW) * slot_size;
+			SumSsimRow(window_rows, pass->weights, out_width, &ssim_sum, &cs_sum, pass->is_avx2);
+		}
+		pass->ssim_sums[band] = ssim_sum;
+		pass->cs_sums[band] = cs_sum;
+	}
+	free(ring);
+}
+
+// Mean SSIM and contrast-structure over every window position of one scale.
+static void ComputeSsimScale(const float* a, const float* b, int width, int height, bool is_avx2, double* ssim, double* cs)
+{
+	int out_height = height - SSIM_WINDOW + 1;
+	int band_count = (out_height + SSIM_BAND_ROWS - 1) / SSIM_BAND_ROWS;
+
+	SsimPass pass = {};
+	pass.a = a;
+	pass.b = b;
+	pass.width = width;
+	pass.height = height;
+	GetSsimWindowWeights(pass.weights);
+	pass.is_avx2 = is_avx2;
+	pass.ssim_sums = (double*)malloc(sizeof(double) * band_count * 2); // @malloc
+	pass.cs_sums = pass.ssim_sums + band_count;
+	ParallelFor(band_count, 1, SumSsimBands, &pass);
+
+	double ssim_sum = 0.0;
+	double cs_sum = 0.0;
+	for (int band = 0; band < band_count; ++band)
+	{
+		ssim_sum += pass.ssim_sums[band];
+		cs_sum += pass.cs_sums[band];
+	}
+	free(pass.ssim_sums);
+
+	double window_count = (double)(width - SSIM_WINDOW + 1) * (double)out_height;
+	*ssim = ssim_sum / window_count;
+	*cs = cs_sum / window_count;
+}
+
+struct SsimDownsample
+{
+	const float* src;
+	int src_width;
+	float* dst;
+	int dst_width;
+};
+
+// ParallelFor callback: 2x2 box filters rows [begin, end) of the next scale down.
+static void DownsampleSsimRows(int begin, int end, void* data)
+{
+	SsimDownsample* build = (SsimDownsample*)data;
+	for (int y = begin; y < end; ++y)
+	{
+		const float* row0 = build->src + (size_t)(y * 2) * build->src_width;
+		const float* row1 = row0 + build->src_width;
+		float* dst = build->dst + (size_t)y * build->dst_width;
+		for (int x = 0; x < build->dst_width; ++x)
+		{
+			dst[x] = (row0[x * 2] + row0[x * 2 + 1] + row1[x * 2] + row1[x * 2 + 1]) * 0.25f;
+		}
+	}
+}
+
+static float* DownsampleSsimPlane(const float* src, int width, int height)
+{
+	SsimDownsample build = {src, width, 0, width / 2};
+	build.dst = (float*)malloc(sizeof(float) * (size_t)(width / 2) * (height / 2)); // @malloc
+	ParallelFor(height / 2, 16, DownsampleSsimRows, &build);
+	return build.dst;
+}
+
+bool ComputeSsimOfPlanes(const float* a, const float* b, int width, int height, SsimResult* result, SsimKernel kernel)
+{
+	assert(a && b && result);
+	*result = {};
+	bool is_avx2 = (kernel != SsimKernel::Scalar) && CpuHasAVX2();
+
+	// Each scale halves the planes; the ones below full size are owned here.
+	const float* scale_a = a;
+	const float* scale_b = b;
+	for (int scale = 0; scale < SSIM_SCALES; ++scale)
+	{
+		if (width < SSIM_WINDOW || height < SSIM_WINDOW) break;
+		ComputeSsimScale(scale_a, scale_b, width, height, is_avx2, &result->scale_ssim[scale], &result->scale_cs[scale]);
+		++result->scale_count;
+
+		if (scale + 1 < SSIM_SCALES && width / 2 >= SSIM_WINDOW && height / 2 >= SSIM_WINDOW)
+		{
+			float* next_a = DownsampleSsimPlane(scale_a, width, height);
+			float* next_b = DownsampleSsimPlane(scale_b, width, height);
+			if (scale_a != a) free((void*)scale_a);
+			if (scale_b != b) free((void*)scale_b);
+			scale_a = next_a;
+			scale_b = next_b;
+		}
+		width /= 2;
+		height /= 2;
+	}
+	if (scale_a != a) free((void*)scale_a);
+	if (scale_b != b) free((void*)scale_b);
+	if (!result->scale_count) return false;
+
+	// Contrast-structure from every scale but the coarsest, which contributes full SSIM. Negative terms
+	// (anti-correlated images) are clamped, since they can't be raised to fractional powers.
+	int last = result->scale_count - 1;
+	double weight_sum = 0.0;
+	for (int scale = 0; scale <= last; ++scale) weight_sum += ms_ssim_weights[scale];
+
+	double ms_ssim = 1.0;
+	for (int scale = 0; scale <= last; ++scale)
+	{
+		double term = (scale == last) ? result->scale_ssim[scale] : result->scale_cs[scale];
+		ms_ssim *= pow((term > 0.0) ? term : 0.0, ms_ssim_weights[scale] / weight_sum);
+	}
+	result->ssim = result->scale_ssim[0];
+	result->ms_ssim = ms_ssim;
+	return true;
+}
+
+// The channel count is a template parameter so the stride is a constant the compiler can vectorize
+// around, and scale is folded into the weights.
+template <typename T, int C>
+static void GetLumaRowOf(const T* src, int width, float scale, float* dst)
+{
+	if (C < 3)
+	{
+		for (int x = 0; x < width; ++x, src += C) dst[x] = (float)src[0] * scale;
+	}
+	else
+	{
+		float r = 0.299f * scale, g = 0.587f * scale, b = 0.114f * scale;
+		for (int x = 0; x < width; ++x, src += C) dst[x] = r * (float)src[0] + g * (float)src[1] + b * (float)src[2];
+	}
+}
+
+template <typename T>
+static void GetLumaRow(const T* src, int channel_count, int width, float scale, float* dst)
+{
+	switch (channel_count)
+	{
+		case 1: GetLumaRowOf<T, 1>(src, width, scale, dst); break;
+		case 2: GetLumaRowOf<T, 2>(src, width, scale, dst); break;
+		case 3: GetLumaRowOf<T, 3>(src, width, scale, dst); break;
+		case 4: GetLumaRowOf<T, 4>(src, width, scale, dst); break;
+	}
+}
+
+struct SsimLumaBuild
+{
+	const DecodedImage* image;
+	float* plane;
+};
+
+// ParallelFor callback: converts rows [begin, end) of an image to luma.
+static void BuildSsimLumaRows(int begin, int end, void* data)
+{
+	SsimLumaBuild* build = (SsimLumaBuild*)data;
+	const DecodedImage* image = build->image;
+	PixelLayout layout = image->layout;
+	size_t stride = (size_t)image->width * GetPixelSize(layout);
+	u8* scratch = (layout.type == PixelType::F32) ? (u8*)malloc((size_t)image->width * layout.channel_count) : 0; // @malloc
+
+	for (int y = begin; y < end; ++y)
+	{
+		const u8* row = (const u8*)image->pixels + (size_t)y * stride;
+		float* dst = build->plane + (size_t)y * image->width;
+		switch (layout.type)
+		{
+			case PixelType::U8: GetLumaRow(row, layout.channel_count, image->width, 1.0f / 255.0f, dst); break;
+			case PixelType::U16: GetLumaRow((const u16*)row, layout.channel_count, image->width, 1.0f / 65535.0f, dst); break;
+			case PixelType::F32:
+			ConvertPixelsToU8(row, layout, image->width, scratch);
+			GetLumaRow(scratch, layout.channel_count, image->width, 1.0f / 255.0f, dst);
+			break;
+		}
+	}
+	free(scratch);
+}
+
+static float* BuildSsimLumaPlane(const DecodedImage* image)
+{
+	SsimLumaBuild build = {image, 0};
+	build.plane = (float*)malloc(sizeof(float) * (size_t)image->width * image->height); // @malloc
+	ParallelFor(image->height, 16, BuildSsimLumaRows, &build);
+	return build.plane;
+}
+
+bool ComputeSsim(const DecodedImage* a, const DecodedImage* b, SsimResult* result, SsimKernel kernel)
+{
+	assert(a && b && a->pixels && b->pixels && result);
+	*result = {};
+	if (a->width != b->width || a->height != b->height) return false;
+	if (a->width < SSIM_WINDOW || a->height < SSIM_WINDOW) return false;
+
+	float* plane_a = BuildSsimLumaPlane(a);
+	float* plane_b = BuildSsimLumaPlane(b);
+	bool success = ComputeSsimOfPlanes(plane_a, plane_b, a->width, a->height, result, kernel);
+	free(plane_a);
+	free(plane_b);
+	return success;
+}
+
+static void DestroySsimJob(void* data)
+{
+	SsimJob* job = (SsimJob*)data;
+	ReleasePixelBuffer(job->a);
+	ReleasePixelBuffer(job->b);
+	delete job;
+}
+
+static void RunSsimJob(void* data)
+{
+	SsimJob* job = (SsimJob*)data;
+	bool success = ComputeSsim(&job->a->image, &job->b->image, &job->result);
+
+	ReleasePixelBuffer(job->a);
+	ReleasePixelBuffer(job->b);
+	job->a = job->b = 0;
+
+	job->state.store(success ? SsimState::Ready : SsimState::Failed);
+	WakeFrameScheduler();
+}
+
+SsimJob* QueueSsim(PixelBuffer* a, PixelBuffer* b)
+{
+	assert(a && b);
+	SsimJob* job = new SsimJob();
+	job->a = RetainPixelBuffer(a);
+	job->b = RetainPixelBuffer(b);
+	job->result = {};
+	job->state.store(SsimState::Running);
+	PushSharedJob(&job->shared, RunSsimJob, DestroySsimJob, job);
+	return job;
+}
+
+SsimState GetSsimState(SsimJob* job)
+{
+	assert(job);
+	return job->state.load();
+}
+
+const SsimResult* GetSsimResult(SsimJob* job)
+{
+	assert(job);
+	return (job->state.load() == SsimState::Ready) ? &job->result : 0;
+}
+
+void ReleaseSsimJob(SsimJob* job)
+{
+	if (!job) return;
+	CancelSharedJob(&job->shared);
+	ReleaseSharedJob(&job->shared);
+}
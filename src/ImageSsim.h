@@ -0,0 +1,69 @@
+#ifndef _IMAGE_SSIM_H
+#define _IMAGE_SSIM_H
+
+#include "ImageDecode.h"
+
+// Structural similarity (SSIM) and its multi-scale version (MS-SSIM), with the parameters of Wang et al.:
+// an 11x11 Gaussian window with a sigma of 1.5, K1 = 0.01, K2 = 0.03, and five scales for MS-SSIM.
+// Images are compared on luma, and only where the window fits entirely inside them. Like ImageDiff,
+// this doesn't touch the renderer.
+
+#define SSIM_SCALES 5
+
+struct SsimResult
+{
+	double ssim; // Mean SSIM at full resolution, 1 for identical images.
+	double ms_ssim;
+	int scale_count; // Scales MS-SSIM used. Images too small for all five use fewer, with the weights rescaled.
+	double scale_ssim[SSIM_SCALES]; // Mean SSIM at each scale.
+	double scale_cs[SSIM_SCALES]; // Mean contrast-structure term at each scale.
+};
+
+// Which filter kernels the comparison runs. Anything but Best is only for benchmarks and tests; AVX2 falls
+// back to scalar where the CPU doesn't have it.
+enum class SsimKernel : u8
+{
+	Best = 0,
+	Scalar,
+	AVX2
+};
+
+// Both planes are width x height floats in [0, 1], tightly packed. Returns false if the window doesn't
+// fit in them.
+bool ComputeSsimOfPlanes(const float* a, const float* b, int width, int height, SsimResult* result, SsimKernel kernel = SsimKernel::Best);
+
+// Converts both images to luma (BT.601 weights on the stored values, alpha ignored, float sources mapped
+// to 8 bits the way they're displayed) and compares those. Returns false if the sizes differ or the
+// window doesn't fit.
+bool ComputeSsim(const DecodedImage* a, const DecodedImage* b, SsimResult* result, SsimKernel kernel = SsimKernel::Best);
+
+enum class SsimState : u32
+{
+	Running = 0,
+	Ready,
+	Failed
+};
+
+// ComputeSsim running in the background.
+struct SsimJob
+{
+	SharedJob shared;
+	PixelBuffer* a; // References, dropped as soon as the comparison is done.
+	PixelBuffer* b;
+	SsimResult result;
+
+	std::atomic<SsimState> state;
+};
+
+// Queues ComputeSsim and returns immediately. The caller owns one reference and must eventually hand it
+// back with ReleaseSsimJob.
+SsimJob* QueueSsim(PixelBuffer* a, PixelBuffer* b);
+SsimState GetSsimState(SsimJob* job);
+
+// Null until the job is Ready. The result belongs to the job.
+const SsimResult* GetSsimResult(SsimJob* job);
+
+// Drops the caller's reference. If the comparison hasn't started yet, it is skipped.
+void ReleaseSsimJob(SsimJob* job);
+
+#endif //_IMAGE_SSIM_H
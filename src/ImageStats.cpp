@@ -0,0 +1,538 @@
+#include "ImageStats.h"
+#include "Core/CpuFeatures.h"
+#include "Core/JobSystem.h"
+#include "Core/FrameScheduler.h"
+#include <float.h>
+#include <math.h>
+
+// Regions are handed to the job system in bands of whole rows holding at least this many pixels.
+#define STATS_BAND_PIXELS (1 << 16)
+
+struct StatsAccumulator
+{
+	u32 histogram[4][STATS_HISTOGRAM_BINS];
+
+	// Unused for 8-bit sources: their histogram is exact, so these are worked out from it at the end.
+	double min[4];
+	double max[4];
+	double sum[4];
+	double sum_squares[4];
+};
+
+static void ResetStatsAccumulator(StatsAccumulator* accumulator)
+{
+	memset(accumulator->histogram, 0, sizeof(accumulator->histogram));
+	for (int c = 0; c < 4; ++c)
+	{
+		accumulator->min[c] = DBL_MAX;
+		accumulator->max[c] = -DBL_MAX;
+		accumulator->sum[c] = 0.0;
+		accumulator->sum_squares[c] = 0.0;
+	}
+}
+
+static void AccumulateRowU8(const u8* row, int channel_count, int width, StatsAccumulator* accumulator)
+{
+	switch (channel_count)
+	{
+		case 1:
+		for (int x = 0; x < width; ++x) ++accumulator->histogram[0][row[x]];
+		break;
+		case 2:
+		for (int x = 0; x < width; ++x, row += 2)
+		{
+			++accumulator->histogram[0][row[0]];
+			++accumulator->histogram[1][row[1]];
+		}
+		break;
+		case 3:
+		for (int x = 0; x < width; ++x, row += 3)
+		{
+			++accumulator->histogram[0][row[0]];
+			++accumulator->histogram[1][row[1]];
+			++accumulator->histogram[2][row[2]];
+		}
+		break;
+		case 4:
+		for (int x = 0; x < width; ++x, row += 4)
+		{
+			++accumulator->histogram[0][row[0]];
+			++accumulator->histogram[1][row[1]];
+			++accumulator->histogram[2][row[2]];
+			++accumulator->histogram[3][row[3]];
+		}
+		break;
+		default: assert(false); break;
+	}
+}
+
+// Scalar reference for 16-bit and float rows, starting at pixel first_x. NaNs are binned at zero and
+// otherwise left out of min and max.
+template <typename T>
+static void AccumulateRowScalar(const T* row, int channel_count, int first_x, int width, float bin_scale, StatsAccumulator* accumulator)
+{
+	for (int x = first_x; x < width; ++x)
+	{
+		const T* pixel = row + (size_t)x * channel_count;
+		for (int c = 0; c < channel_count; ++c)
+		{
+			float value = (float)pixel[c];
+			float scaled = value * bin_scale;
+			int bin = (scaled > 0.0f) ? ((scaled < (float)(STATS_HISTOGRAM_BINS - 1)) ? (int)scaled : STATS_HISTOGRAM_BINS - 1) : 0;
+			++accumulator->histogram[c][bin];
+
+			if (value < accumulator->min[c]) accumulator->min[c] = value;
+			if (value > accumulator->max[c]) accumulator->max[c] = value;
+			accumulator->sum[c] += value;
+			accumulator->sum_squares[c] += (double)value * value;
+		}
+	}
+}
+
+#ifdef CORE_SIMD_X86
+SIMD_TARGET_AVX2 static inline __m256 LoadValuesAVX2(const u16* values)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)values)));
+}
+
+SIMD_TARGET_AVX2 static inline __m256 LoadValuesAVX2(const float* values)
+{
+	return _mm256_loadu_ps(values);
+}
+
+// Eight pixels per iteration, as channel_count vectors of eight values. Lane k of vector j always holds
+// channel (8j + k) % channel_count, so each vector keeps its own min, max and sums and they're sorted
+// out by channel once at the end of the row. The bin indices are computed eight at a time too, with the
+// channel's histogram offset added in, but the increments themselves have to be scalar.
+template <typename T, int channel_count>
+SIMD_TARGET_AVX2 static void AccumulateRowAVX2(const T* row, int width, float bin_scale, StatsAccumulator* accumulator)
+{
+	__m256 mins[channel_count];
+	__m256 maxs[channel_count];
+	__m256d sums[channel_count][2];
+	__m256d sum_squares[channel_count][2];
+	__m256i bin_offsets[channel_count];
+	for (int j = 0; j < channel_count; ++j)
+	{
+		mins[j] = _mm256_set1_ps(FLT_MAX);
+		maxs[j] = _mm256_set1_ps(-FLT_MAX);
+		sums[j][0] = sums[j][1] = _mm256_setzero_pd();
+		sum_squares[j][0] = sum_squares[j][1] = _mm256_setzero_pd();
+
+		alignas(32) int offsets[8];
+		for (int k = 0; k < 8; ++k) offsets[k] = ((j * 8 + k) % channel_count) * STATS_HISTOGRAM_BINS;
+		bin_offsets[j] = _mm256_load_si256((const __m256i*)offsets);
+	}
+
+	const __m256 scale = _mm256_set1_ps(bin_scale);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 last_bin = _mm256_set1_ps((float)(STATS_HISTOGRAM_BINS - 1));
+	u32* histogram = &accumulator->histogram[0][0];
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		const T* values = row + (size_t)x * channel_count;
+		for (int j = 0; j < channel_count; ++j)
+		{
+			__m256 v = LoadValuesAVX2(values + j * 8);
+
+			// With a NaN in either operand, min/max return the second one, so NaNs never get in.
+			mins[j] = _mm256_min_ps(v, mins[j]);
+			maxs[j] = _mm256_max_ps(v, maxs[j]);
+
+			__m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+			__m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+			sums[j][0] = _mm256_add_pd(sums[j][0], low);
+			sums[j][1] = _mm256_add_pd(sums[j][1], high);
+			sum_squares[j][0] = _mm256_add_pd(sum_squares[j][0], _mm256_mul_pd(low, low));
+			sum_squares[j][1] = _mm256_add_pd(sum_squares[j][1], _mm256_mul_pd(high, high));
+
+			// Clamped before the conversion, which also sends NaNs to bin 0 like the scalar path.
+			__m256 scaled = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(v, scale), zero), last_bin);
+			__m256i bins = _mm256_add_epi32(_mm256_cvttps_epi32(scaled), bin_offsets[j]);
+			alignas(32) u32 indices[8];
+			_mm256_store_si256((__m256i*)indices, bins);
+			for (int k = 0; k < 8; ++k) ++histogram[indices[k]];
+		}
+	}
+
+	for (int j = 0; j < channel_count; ++j)
+	{
+		alignas(32) float lane_mins[8];
+		alignas(32) float lane_maxs[8];
+		alignas(32) double lane_sums[8];
+		alignas(32) double lane_squares[8];
+		_mm256_store_ps(lane_mins, mins[j]);
+		_mm256_store_ps(lane_maxs, maxs[j]);
+		_mm256_store_pd(lane_sums, sums[j][0]);
+		_mm256_store_pd(lane_sums + 4, sums[j][1]);
+		_mm256_store_pd(lane_squares, sum_squares[j][0]);
+		_mm256_store_pd(lane_squares + 4, sum_squares[j][1]);
+		for (int k = 0; k < 8; ++k)
+		{
+			int c = (j * 8 + k) % channel_count;
+			if (lane_mins[k] < accumulator->min[c]) accumulator->min[c] = lane_mins[k];
+			if (lane_maxs[k] > accumulator->max[c]) accumulator->max[c] = lane_maxs[k];
+			accumulator->sum[c] += lane_sums[k];
+			accumulator->sum_squares[c] += lane_squares[k];
+		}
+	}
+	AccumulateRowScalar(row, channel_count, x, width, bin_scale, accumulator);
+}
+
+template <typename T>
+static void AccumulateRowDispatchAVX2(const T* row, int channel_count, int width, float bin_scale, StatsAccumulator* accumulator)
+{
+	switch (channel_count)
+	{
+		case 1: AccumulateRowAVX2<T, 1>(row, width, bin_scale, accumulator); break;
+		case 2: AccumulateRowAVX2<T, 2>(row, width, bin_scale, accumulator); break;
+		case 3: AccumulateRowAVX2<T, 3>(row, width, bin_scale, accumulator); break;
+		case 4: AccumulateRowAVX2<T, 4>(row, width, bin_scale, accumulator); break;
+		default: assert(false); break;
+	}
+}
+#endif
+
+static void AccumulateRow(const void* row, PixelLayout layout, int width, StatsAccumulator* accumulator)
+{
+	int channel_count = layout.channel_count;
+	if (layout.type == PixelType::U8)
+	{
+		AccumulateRowU8((const u8*)row, channel_count, width, accumulator);
+		return;
+	}
+
+	// 16-bit values go in by their top byte, floats by where they fall in [0, 1].
+	float bin_scale = (layout.type == PixelType::U16) ? 1.0f / 256.0f : (float)STATS_HISTOGRAM_BINS;
+#ifdef CORE_SIMD_X86
+	if (CpuHasAVX2())
+	{
+		if (layout.type == PixelType::U16) AccumulateRowDispatchAVX2((const u16*)row, channel_count, width, bin_scale, accumulator);
+		else AccumulateRowDispatchAVX2((const float*)row, channel_count, width, bin_scale, accumulator);
+		return;
+	}
+#endif
+	if (layout.type == PixelType::U16) AccumulateRowScalar((const u16*)row, channel_count, 0, width, bin_scale, accumulator);
+	else AccumulateRowScalar((const float*)row, channel_count, 0, width, bin_scale, accumulator);
+}
+
+static void AccumulateRect(const void* pixels, PixelLayout layout, int image_width, int x, int y, int width, int height, StatsAccumulator* accumulator)
+{
+	size_t pixel_size = GetPixelSize(layout);
+	size_t stride = (size_t)image_width * pixel_size;
+	const u8* start = (const u8*)pixels + (size_t)y * stride + (size_t)x * pixel_size;
+	for (int row = 0; row < height; ++row)
+	{
+		AccumulateRow(start + (size_t)row * stride, layout, width, accumulator);
+	}
+}
+
+// Running totals for one query. The histogram counts go straight into the ImageStats, which can hold
+// more than a tile's worth.
+struct StatsTotals
+{
+	double min[4];
+	double max[4];
+	double sum[4];
+	double sum_squares[4];
+};
+
+static void BeginImageStats(ImageStats* stats, StatsTotals* totals, int channel_count)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->channel_count = channel_count;
+	for (int c = 0; c < 4; ++c)
+	{
+		totals->min[c] = DBL_MAX;
+		totals->max[c] = -DBL_MAX;
+		totals->sum[c] = 0.0;
+		totals->sum_squares[c] = 0.0;
+	}
+}
+
+static void AddStatsAccumulator(ImageStats* stats, StatsTotals* totals, const StatsAccumulator* accumulator)
+{
+	for (int c = 0; c < stats->channel_count; ++c)
+	{
+		for (int bin = 0; bin < STATS_HISTOGRAM_BINS; ++bin) stats->histogram[c][bin] += accumulator->histogram[c][bin];
+		if (accumulator->min[c] < totals->min[c]) totals->min[c] = accumulator->min[c];
+		if (accumulator->max[c] > totals->max[c]) totals->max[c] = accumulator->max[c];
+		totals->sum[c] += accumulator->sum[c];
+		totals->sum_squares[c] += accumulator->sum_squares[c];
+	}
+}
+
+static void FinishImageStats(ImageStats* stats, StatsTotals* totals, PixelLayout layout)
+{
+	for (int bin = 0; bin < STATS_HISTOGRAM_BINS; ++bin) stats->pixel_count += stats->histogram[0][bin];
+	if (!stats->pixel_count) return;
+
+	for (int c = 0; c < stats->channel_count; ++c)
+	{
+		if (layout.type == PixelType::U8)
+		{
+			for (int bin = 0; bin < STATS_HISTOGRAM_BINS; ++bin)
+			{
+				u64 count = stats->histogram[c][bin];
+				if (!count) continue;
+				if (totals->min[c] > bin) totals->min[c] = bin;
+				totals->max[c] = bin;
+				totals->sum[c] += (double)bin * count;
+				totals->sum_squares[c] += (double)bin * bin * count;
+			}
+		}
+
+		ChannelStats* channel = &stats->channels[c];
+		double mean = totals->sum[c] / (double)stats->pixel_count;
+		double variance = totals->sum_squares[c] / (double)stats->pixel_count - mean * mean;
+		channel->min = totals->min[c];
+		channel->max = totals->max[c];
+		channel->mean = mean;
+		channel->stddev = (variance > 0.0) ? sqrt(variance) : 0.0;
+	}
+}
+
+struct StatsBand
+{
+	int x;
+	int y;
+	int width;
+	int row_count;
+};
+
+struct StatsBandPass
+{
+	const void* pixels;
+	PixelLayout layout;
+	int image_width;
+	const StatsBand* bands;
+	StatsAccumulator* results; // One per band.
+};
+
+// ParallelFor callback: accumulates bands [begin, end), each into its own result.
+static void AccumulateStatsBands(int begin, int end, void* data)
+{
+	StatsBandPass* pass = (StatsBandPass*)data;
+	for (int i = begin; i < end; ++i)
+	{
+		const StatsBand* band = &pass->bands[i];
+		ResetStatsAccumulator(&pass->results[i]);
+		AccumulateRect(pass->pixels, pass->layout, pass->image_width, band->x, band->y, band->width, band->row_count, &pass->results[i]);
+	}
+}
+
+static int GetStatsBandRows(int width)
+{
+	int rows = STATS_BAND_PIXELS / width;
+	return (rows > 0) ? rows : 1;
+}
+
+// Adds up to four rectangles (x, y, width, height) worth of pixels into the stats. Every rectangle is
+// cut into bands of rows and all the bands go to the job system together.
+static void AddStatsRects(const void* pixels, PixelLayout layout, int image_width, const int (*rects)[4], int rect_count, ImageStats* stats, StatsTotals* totals)
+{
+	int band_count = 0;
+	for (int i = 0; i < rect_count; ++i)
+	{
+		int band_rows = GetStatsBandRows(rects[i][2]);
+		band_count += (rects[i][3] + band_rows - 1) / band_rows;
+	}
+	if (!band_count) return;
+
+	StatsBand* bands = (StatsBand*)malloc(sizeof(StatsBand) * band_count); // @malloc
+	StatsAccumulator* results = (StatsAccumulator*)malloc(sizeof(StatsAccumulator) * band_count); // @malloc
+	int band_index = 0;
+	for (int i = 0; i < rect_count; ++i)
+	{
+		int band_rows = GetStatsBandRows(rects[i][2]);
+		for (int row = 0; row < rects[i][3]; row += band_rows)
+		{
+			StatsBand* band = &bands[band_index++];
+			band->x = rects[i][0];
+			band->y = rects[i][1] + row;
+			band->width = rects[i][2];
+			band->row_count = (rects[i][3] - row < band_rows) ? rects[i][3] - row : band_rows;
+		}
+	}
+
+	StatsBandPass pass = {pixels, layout, image_width, bands, results};
+	ParallelFor(band_count, 1, AccumulateStatsBands, &pass);
+	for (int i = 0; i < band_count; ++i) AddStatsAccumulator(stats, totals, &results[i]);
+
+	free(bands);
+	free(results);
+}
+
+// Same, all on the calling thread. Waiting for the job system means helping it, and the UI thread would
+// then run whatever happened to be queued (a whole decode or export) in the middle of a frame.
+static void AddStatsRectsSerial(const void* pixels, PixelLayout layout, int image_width, const int (*rects)[4], int rect_count, ImageStats* stats, StatsTotals* totals)
+{
+	StatsAccumulator accumulator;
+	for (int i = 0; i < rect_count; ++i)
+	{
+		ResetStatsAccumulator(&accumulator);
+		AccumulateRect(pixels, layout, image_width, rects[i][0], rects[i][1], rects[i][2], rects[i][3], &accumulator);
+		AddStatsAccumulator(stats, totals, &accumulator);
+	}
+}
+
+void ComputeImageStats(const void* pixels, PixelLayout layout, int image_width, int x, int y, int width, int height, ImageStats* stats)
+{
+	assert(pixels && stats);
+	assert(x >= 0 && y >= 0 && x + width <= image_width);
+
+	StatsTotals totals;
+	BeginImageStats(stats, &totals, layout.channel_count);
+	if (width > 0 && height > 0)
+	{
+		int rect[1][4] = {{x, y, width, height}};
+		AddStatsRects(pixels, layout, image_width, rect, 1, stats, &totals);
+	}
+	FinishImageStats(stats, &totals, layout);
+}
+
+// ParallelFor callback: accumulates tiles [begin, end) of the cache.
+static void BuildStatsTiles(int begin, int end, void* data)
+{
+	ImageStatsCache* cache = (ImageStatsCache*)data;
+	for (int i = begin; i < end; ++i)
+	{
+		int tile_x = (i % cache->tile_columns) * STATS_TILE_SIZE;
+		int tile_y = (i / cache->tile_columns) * STATS_TILE_SIZE;
+		int width = (cache->width - tile_x < STATS_TILE_SIZE) ? cache->width - tile_x : STATS_TILE_SIZE;
+		int height = (cache->height - tile_y < STATS_TILE_SIZE) ? cache->height - tile_y : STATS_TILE_SIZE;
+
+		StatsAccumulator* tile = &cache->tiles[i];
+		ResetStatsAccumulator(tile);
+		AccumulateRect(cache->pixels, cache->layout, cache->width, tile_x, tile_y, width, height, tile);
+	}
+}
+
+void BuildImageStatsCache(ImageStatsCache* cache, const void* pixels, PixelLayout layout, int width, int height)
+{
+	assert(cache && pixels && width > 0 && height > 0);
+	*cache = {};
+	cache->pixels = pixels;
+	cache->layout = layout;
+	cache->width = width;
+	cache->height = height;
+	cache->tile_columns = (width + STATS_TILE_SIZE - 1) / STATS_TILE_SIZE;
+	cache->tile_rows = (height + STATS_TILE_SIZE - 1) / STATS_TILE_SIZE;
+
+	int tile_count = cache->tile_columns * cache->tile_rows;
+	cache->tiles = (StatsAccumulator*)malloc(sizeof(StatsAccumulator) * tile_count); // @malloc
+	ParallelFor(tile_count, 1, BuildStatsTiles, cache);
+}
+
+void FreeImageStatsCache(ImageStatsCache* cache)
+{
+	if (!cache) return;
+	free(cache->tiles);
+	*cache = {};
+}
+
+void GetImageStats(const ImageStatsCache* cache, int x, int y, int width, int height, ImageStats* stats)
+{
+	assert(cache && cache->tiles && stats);
+	assert(x >= 0 && y >= 0 && x + width <= cache->width && y + height <= cache->height);
+
+	StatsTotals totals;
+	BeginImageStats(stats, &totals, cache->layout.channel_count);
+	if (width <= 0 || height <= 0)
+	{
+		FinishImageStats(stats, &totals, cache->layout);
+		return;
+	}
+
+	// Tiles the region covers completely. Tiles on the right and bottom of the image are clipped to it,
+	// so a region reaching the image edge covers those too.
+	int x1 = x + width;
+	int y1 = y + height;
+	int first_column = (x + STATS_TILE_SIZE - 1) / STATS_TILE_SIZE;
+	int first_row = (y + STATS_TILE_SIZE - 1) / STATS_TILE_SIZE;
+	int end_column = (x1 == cache->width) ? cache->tile_columns : x1 / STATS_TILE_SIZE;
+	int end_row = (y1 == cache->height) ? cache->tile_rows : y1 / STATS_TILE_SIZE;
+
+	if (first_column >= end_column || first_row >= end_row)
+	{
+		int rect[1][4] = {{x, y, width, height}};
+		AddStatsRectsSerial(cache->pixels, cache->layout, cache->width, rect, 1, stats, &totals);
+		FinishImageStats(stats, &totals, cache->layout);
+		return;
+	}
+
+	for (int row = first_row; row < end_row; ++row)
+	{
+		for (int column = first_column; column < end_column; ++column)
+		{
+			AddStatsAccumulator(stats, &totals, &cache->tiles[row * cache->tile_columns + column]);
+		}
+	}
+
+	// Whatever is left is a frame around the covered tiles: full-width strips above and below, and
+	// strips on either side between them.
+	int inner_x0 = first_column * STATS_TILE_SIZE;
+	int inner_y0 = first_row * STATS_TILE_SIZE;
+	int inner_x1 = (end_column * STATS_TILE_SIZE < cache->width) ? end_column * STATS_TILE_SIZE : cache->width;
+	int inner_y1 = (end_row * STATS_TILE_SIZE < cache->height) ? end_row * STATS_TILE_SIZE : cache->height;
+
+	int rects[4][4];
+	int rect_count = 0;
+	int edges[4][4] =
+	{
+		{x, y, width, inner_y0 - y},
+		{x, inner_y1, width, y1 - inner_y1},
+		{x, inner_y0, inner_x0 - x, inner_y1 - inner_y0},
+		{inner_x1, inner_y0, x1 - inner_x1, inner_y1 - inner_y0},
+	};
+	for (int i = 0; i < 4; ++i)
+	{
+		if (edges[i][2] <= 0 || edges[i][3] <= 0) continue;
+		memcpy(rects[rect_count++], edges[i], sizeof(edges[i]));
+	}
+	AddStatsRectsSerial(cache->pixels, cache->layout, cache->width, rects, rect_count, stats, &totals);
+	FinishImageStats(stats, &totals, cache->layout);
+}
+
+static void DestroyImageStatsJob(void* data)
+{
+	ImageStatsJob* job = (ImageStatsJob*)data;
+	FreeImageStatsCache(&job->cache);
+	ReleasePixelBuffer(job->pixels);
+	delete job;
+}
+
+static void RunImageStatsJob(void* data)
+{
+	ImageStatsJob* job = (ImageStatsJob*)data;
+	const DecodedImage* image = &job->pixels->image;
+	BuildImageStatsCache(&job->cache, image->pixels, image->layout, image->width, image->height);
+	job->state.store(ImageStatsState::Ready);
+	WakeFrameScheduler();
+}
+
+ImageStatsJob* QueueImageStatsCacheBuild(PixelBuffer* pixels)
+{
+	assert(pixels);
+	ImageStatsJob* job = new ImageStatsJob();
+	job->pixels = RetainPixelBuffer(pixels);
+	job->cache = {};
+	job->state.store(ImageStatsState::Building);
+	PushSharedJob(&job->shared, RunImageStatsJob, DestroyImageStatsJob, job);
+	return job;
+}
+
+const ImageStatsCache* GetImageStatsCache(ImageStatsJob* job)
+{
+	assert(job);
+	return (job->state.load() == ImageStatsState::Ready) ? &job->cache : 0;
+}
+
+void ReleaseImageStatsJob(ImageStatsJob* job)
+{
+	if (!job) return;
+	CancelSharedJob(&job->shared);
+	ReleaseSharedJob(&job->shared);
+}
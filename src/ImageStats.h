@@ -0,0 +1,85 @@
+#ifndef _IMAGE_STATS_H
+#define _IMAGE_STATS_H
+
+#include "ImageDecode.h"
+
+// Per-channel histograms and summary statistics over rectangles of an image. 8-bit channels are binned
+// exactly, 16-bit channels by their top 8 bits, and float channels over [0, 1] with anything outside
+// landing in the end bins. Min, max, mean and stddev are in the source's own units either way.
+
+#define STATS_HISTOGRAM_BINS 256
+#define STATS_TILE_SIZE 256
+
+struct ChannelStats
+{
+	double min;
+	double max;
+	double mean;
+	double stddev;
+};
+
+struct ImageStats
+{
+	int channel_count;
+	u64 pixel_count;
+	u64 histogram[4][STATS_HISTOGRAM_BINS];
+	ChannelStats channels[4];
+};
+
+struct StatsAccumulator;
+
+// Partial results for every STATS_TILE_SIZE square tile of an image. Stats for a rectangle are put
+// together from the tiles it covers completely plus one pass over its ragged edges, so dragging a
+// selection around costs time in proportion to its perimeter rather than its area.
+struct ImageStatsCache
+{
+	const void* pixels; // Not owned, and must outlive the cache.
+	PixelLayout layout;
+	int width;
+	int height;
+	int tile_columns;
+	int tile_rows;
+	StatsAccumulator* tiles;
+};
+
+// Computes stats for the width x height region at (x, y) from scratch, with rows split across the job
+// system. image_width is the width of the whole image, for the row stride.
+void ComputeImageStats(const void* pixels, PixelLayout layout, int image_width, int x, int y, int width, int height, ImageStats* stats);
+
+// Scans the whole image once, in parallel over tiles.
+void BuildImageStatsCache(ImageStatsCache* cache, const void* pixels, PixelLayout layout, int width, int height);
+void FreeImageStatsCache(ImageStatsCache* cache);
+
+// Same result as ComputeImageStats, but only the parts of the region not covered by whole tiles are read.
+// Those are never more than a tile deep, so they're read on the calling thread alone, and this never
+// waits on (or runs) anything from the job system.
+void GetImageStats(const ImageStatsCache* cache, int x, int y, int width, int height, ImageStats* stats);
+
+enum class ImageStatsState : u32
+{
+	Building = 0,
+	Ready
+};
+
+// A cache being built in the background, so the first look at a big image's stats doesn't stall the UI.
+// It keeps its reference to the pixels for as long as it lives, since the cache reads them.
+struct ImageStatsJob
+{
+	SharedJob shared;
+	PixelBuffer* pixels;
+	ImageStatsCache cache;
+
+	std::atomic<ImageStatsState> state;
+};
+
+// Queues a build and returns immediately. The caller owns one reference and must eventually hand it back
+// with ReleaseImageStatsJob.
+ImageStatsJob* QueueImageStatsCacheBuild(PixelBuffer* pixels);
+
+// Null until the job is Ready. The cache belongs to the job.
+const ImageStatsCache* GetImageStatsCache(ImageStatsJob* job);
+
+// Drops the caller's reference. If the build hasn't started yet, it is skipped.
+void ReleaseImageStatsJob(ImageStatsJob* job);
+
+#endif //_IMAGE_STATS_H
@@ -0,0 +1,400 @@
+#include "ImageStore.h"
+#include "TiledImage.h"
+#include "ProgressiveDecode.h"
+#include "UploadScheduler.h"
+#include "Platform/Platform.h"
+
+static StoredImage** g_stored_images = 0; // stb_ds array. One per file open in any panel, so a short list.
+static UploadScheduler* g_upload_scheduler = 0;
+static ID3D11Texture2D* g_staging_textures[UPLOAD_RING_SIZE]; // Created as the ring first comes round to them.
+
+StoredImage* AcquireStoredImage(const char* file_path, PixelBuffer* pixels, MipChain* mips)
+{
+	assert(file_path);
+	u64 file_size = 0;
+	u64 modified_time = 0;
+	char* canonical_path = Platform::GetCanonicalPath(file_path);
+	if (canonical_path) Platform::GetFileInfo(canonical_path, &file_size, &modified_time);
+	
+	for (int i = 0; i < arrlen(g_stored_images); ++i)
+	{
+		StoredImage* image = g_stored_images[i];
+		if (!canonical_path || image->has_failed || strcmp(image->canonical_path, canonical_path)) continue;
+		if (image->file_size != file_size || image->modified_time != modified_time) continue;
+		
+		free(canonical_path);
+		ReleasePixelBuffer(pixels);
+		if (mips)
+		{
+			FreeMipChain(mips);
+			free(mips);
+		}
+		++image->ref_count;
+		return image;
+	}
+	
+	// Missing files still get an image of their own, which fails to decode like any other bad file.
+	StoredImage* image = (StoredImage*)calloc(1, sizeof(StoredImage)); // @malloc
+	if (!canonical_path)
+	{
+		size_t path_size = strlen(file_path) + 1;
+		canonical_path = (char*)malloc(path_size); // @malloc
+		memcpy(canonical_path, file_path, path_size);
+	}
+	image->canonical_path = canonical_path;
+	image->file_size = file_size;
+	image->modified_time = modified_time;
+	image->ref_count = 1;
+	if (pixels)
+	{
+		image->pixels = pixels;
+		image->mips = mips;
+	}
+	else
+	{
+		image->job = QueueImageLoad(file_path, file_size >= PROGRESSIVE_DECODE_MIN_SIZE);
+	}
+	arrput(g_stored_images, image);
+	return image;
+}
+
+static void ReleasePartialTexture(StoredImage* image)
+{
+	if (image->partial_srv) image->partial_srv->Release();
+	if (image->partial_texture) image->partial_texture->Release();
+	image->partial_texture = 0;
+	image->partial_srv = 0;
+	image->partial_bytes = 0;
+}
+
+static void FreeStoredImage(StoredImage* image)
+{
+	if (g_upload_scheduler) CancelUploads(g_upload_scheduler, image);
+	ReleasePartialTexture(image);
+	ReleaseImageLoad(image->job);
+	ReleasePixelBuffer(image->pixels); // Panels and exports that still use the pixels hold their own references.
+	if (image->mips)
+	{
+		FreeMipChain(image->mips);
+		free(image->mips);
+	}
+	if (image->srv) image->srv->Release();
+	if (image->texture) image->texture->Release();
+	free(image->canonical_path);
+	free(image);
+}
+
+void ReleaseStoredImage(StoredImage* image)
+{
+	if (!image || --image->ref_count > 0) return;
+	for (int i = 0; i < arrlen(g_stored_images); ++i)
+	{
+		if (g_stored_images[i] != image) continue;
+		arrdelswap(g_stored_images, i);
+		break;
+	}
+	FreeStoredImage(image);
+}
+
+// Display textures are always RGBA8 with a full mip chain: the canvas they're drawn into is RGBA8 anyway,
+// and the CPU-built mips are RGBA8. The texture is created empty and its levels are scheduled for upload,
+// smallest first; level 0 is converted from the decoded pixels a chunk at a time as it goes up.
+static void CreateStoredImageTexture(ID3D11Device* device, StoredImage* image)
+{
+	MipChain* mips = image->mips;
+	DecodedImage source = image->pixels->image;
+	assert(mips && mips->level_count >= 1);
+	
+	D3D11_TEXTURE2D_DESC tex_desc = {};
+	tex_desc.Width = source.width;
+	tex_desc.Height = source.height;
+	tex_desc.MipLevels = mips->level_count;
+	tex_desc.ArraySize = 1;
+	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	tex_desc.SampleDesc.Count = 1;
+	tex_desc.Usage = D3D11_USAGE_DEFAULT;
+	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	tex_desc.CPUAccessFlags = 0;
+	device->CreateTexture2D(&tex_desc, 0, &image->texture);
+	
+	D3D11_SHADER_RESOURCE_VIEW_DESC src_srv_desc = {};
+	src_srv_desc.Format = tex_desc.Format;
+	src_srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	src_srv_desc.Texture2D.MipLevels = tex_desc.MipLevels;
+	src_srv_desc.Texture2D.MostDetailedMip = 0;
+	device->CreateShaderResourceView(image->texture, &src_srv_desc, &image->srv);
+	
+	if (!g_upload_scheduler) g_upload_scheduler = CreateUploadScheduler();
+	image->texture_min_level = MAX_MIP_LEVELS;
+	for (int level = mips->level_count - 1; level >= 0; --level)
+	{
+		ScheduleUpload(g_upload_scheduler, image, level, GetMipLevelSize(source.width, level), GetMipLevelSize(source.height, level));
+	}
+}
+
+StoredImageState UpdateStoredImage(ID3D11Device* device, StoredImage* image)
+{
+	assert(image);
+	if (image->has_failed) return StoredImageState::Failed;
+	if (image->job)
+	{
+		ImageLoadState state = GetImageLoadState(image->job);
+		if (state == ImageLoadState::Queued || state == ImageLoadState::Decoding) return StoredImageState::Loading;
+		if (state == ImageLoadState::Ready)
+		{
+			DecodedImage decoded = TakeDecodedImage(image->job);
+			image->pixels = CreatePixelBuffer(&decoded);
+			image->mips = TakeMipChain(image->job);
+		}
+		else
+		{
+			image->has_failed = true;
+		}
+		ReleaseImageLoad(image->job);
+		image->job = 0;
+		if (image->has_failed)
+		{
+			ReleasePartialTexture(image); // Panels showing it hold their own references until they switch.
+			return StoredImageState::Failed;
+		}
+	}
+	
+	// Tiled images are uploaded a tile at a time by each panel. Everything else goes up through the upload
+	// scheduler, and then the chain only lives on the GPU. Panels wait for the levels that fit in a single
+	// chunk, which take a frame, so small images never show up blurry and previews can be copied from them.
+	DecodedImage source = image->pixels->image;
+	if (!image->texture && !ShouldTileImage(source.width, source.height)) CreateStoredImageTexture(device, image);
+	if (image->texture)
+	{
+		int tail_level = 0;
+		while (GetMipLevelSize(source.width, tail_level) > UPLOAD_CHUNK_SIZE || GetMipLevelSize(source.height, tail_level) > UPLOAD_CHUNK_SIZE) ++tail_level;
+		if (image->texture_min_level > tail_level) return StoredImageState::Loading;
+	}
+	ReleasePartialTexture(image);
+	return StoredImageState::Ready;
+}
+
+// The image itself, point sampled down by a power of two if it's big enough to be tiled, or the preview.
+// Rows that haven't been uploaded yet are whatever the driver cleared the texture to, transparent black.
+static void CreatePartialTexture(ID3D11Device* device, StoredImage* image, const DecodeProgress* progress)
+{
+	int scale = 0;
+	int width = progress->preview.width;
+	int height = progress->preview.height;
+	if (progress->has_image.load())
+	{
+		scale = 1;
+		while (ShouldTileImage((progress->width + scale - 1) / scale, (progress->height + scale - 1) / scale)) scale *= 2;
+		width = (progress->width + scale - 1) / scale;
+		height = (progress->height + scale - 1) / scale;
+	}
+	else if (!progress->has_preview.load()) return;
+	
+	D3D11_TEXTURE2D_DESC tex_desc = {};
+	tex_desc.Width = width;
+	tex_desc.Height = height;
+	tex_desc.MipLevels = 1;
+	tex_desc.ArraySize = 1;
+	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	tex_desc.SampleDesc.Count = 1;
+	tex_desc.Usage = D3D11_USAGE_DEFAULT;
+	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	tex_desc.CPUAccessFlags = 0;
+	
+	D3D11_SUBRESOURCE_DATA sr_data = {};
+	sr_data.pSysMem = progress->preview.pixels;
+	sr_data.SysMemPitch = width * 4;
+	device->CreateTexture2D(&tex_desc, scale ? 0 : &sr_data, &image->partial_texture);
+	
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = tex_desc.Format;
+	srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MipLevels = 1;
+	srv_desc.Texture2D.MostDetailedMip = 0;
+	device->CreateShaderResourceView(image->partial_texture, &srv_desc, &image->partial_srv);
+	
+	image->partial_bytes = (u64)width * height * 4;
+	image->partial_width = progress->width;
+	image->partial_height = progress->height;
+	image->partial_scale = scale;
+	image->partial_passes = 0;
+	image->partial_rows = 0;
+	++image->texture_version;
+}
+
+// Fills a staging texture with a chunk of one level and copies it into the image's texture. Level 0 is
+// converted to RGBA8 on the way. Returns false, having copied nothing, if there's no staging texture or it
+// can't be mapped.
+static bool CopyUploadChunk(ID3D11DeviceContext* ctx, StoredImage* image, const UploadChunk* chunk, ID3D11Texture2D* staging)
+{
+	// Slots are only reused once the GPU has finished with them, so this doesn't wait.
+	D3D11_MAPPED_SUBRESOURCE mapped_resource;
+	if (!staging || ctx->Map(staging, 0, D3D11_MAP_WRITE, 0, &mapped_resource) != S_OK) return false;
+	if (chunk->level == 0)
+	{
+		DecodedImage source = image->pixels->image;
+		PixelLayout layout = source.layout;
+		PixelLayout u8_layout = {layout.channel_count, PixelType::U8};
+		size_t pixel_size = GetPixelSize(layout);
+		u8 converted[UPLOAD_CHUNK_SIZE * 4];
+		for (int y = 0; y < chunk->height; ++y)
+		{
+			const u8* src = (const u8*)source.pixels + ((size_t)(chunk->y + y) * source.width + chunk->x) * pixel_size;
+			u8* dst = (u8*)mapped_resource.pData + (size_t)y * mapped_resource.RowPitch;
+			if (layout.channel_count == 4 && layout.type == PixelType::U8)
+			{
+				memcpy(dst, src, (size_t)chunk->width * 4);
+			}
+			else if (layout.type != PixelType::U8)
+			{
+				ConvertPixelsToU8(src, layout, chunk->width, converted);
+				ExpandPixelsToRGBA(converted, u8_layout, chunk->width, dst);
+			}
+			else
+			{
+				ExpandPixelsToRGBA(src, u8_layout, chunk->width, dst);
+			}
+		}
+	}
+	else
+	{
+		MipLevel* level = &image->mips->levels[chunk->level];
+		for (int y = 0; y < chunk->height; ++y)
+		{
+			const u8* src = level->pixels + ((size_t)(chunk->y + y) * level->width + chunk->x) * 4;
+			memcpy((u8*)mapped_resource.pData + (size_t)y * mapped_resource.RowPitch, src, (size_t)chunk->width * 4);
+		}
+	}
+	ctx->Unmap(staging, 0);
+	
+	D3D11_BOX box = {0, 0, 0, (UINT)chunk->width, (UINT)chunk->height, 1};
+	ctx->CopySubresourceRegion(image->texture, chunk->level, chunk->x, chunk->y, 0, staging, 0, &box);
+	return true;
+}
+
+static ID3D11Texture2D* GetStagingTexture(ID3D11Device* device, int slot)
+{
+	if (g_staging_textures[slot]) return g_staging_textures[slot];
+	
+	D3D11_TEXTURE2D_DESC tex_desc = {};
+	tex_desc.Width = UPLOAD_CHUNK_SIZE;
+	tex_desc.Height = UPLOAD_CHUNK_SIZE;
+	tex_desc.MipLevels = 1;
+	tex_desc.ArraySize = 1;
+	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	tex_desc.SampleDesc.Count = 1;
+	tex_desc.Usage = D3D11_USAGE_STAGING;
+	tex_desc.BindFlags = 0;
+	tex_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	device->CreateTexture2D(&tex_desc, 0, &g_staging_textures[slot]);
+	return g_staging_textures[slot];
+}
+
+bool UpdateImageStoreUploads(ID3D11Device* device, ID3D11DeviceContext* ctx)
+{
+	u64 budget = PROGRESSIVE_UPLOAD_BYTES;
+	bool has_pending = false;
+	for (int i = 0; i < arrlen(g_stored_images); ++i)
+	{
+		StoredImage* image = g_stored_images[i];
+		if (!image->job || !image->job->progress || image->job->state.load() != ImageLoadState::Decoding) continue;
+		DecodeProgress* progress = image->job->progress;
+		if (!image->partial_texture) CreatePartialTexture(device, image, progress);
+		if (!image->partial_texture || !image->partial_scale) continue; // A preview is uploaded whole.
+		
+		// Interlaced images are uploaded top to bottom again at every new level of detail; the most recent
+		// one wins if several passes finish in the time one takes to go up.
+		int ready_rows = progress->height;
+		if (progress->pass_count > 1)
+		{
+			int ready_passes = progress->ready_passes.load();
+			if (ready_passes == 0) continue;
+			if (ready_passes > image->partial_passes)
+			{
+				image->partial_passes = ready_passes;
+				image->partial_rows = 0;
+			}
+		}
+		else
+		{
+			image->partial_passes = 1;
+			ready_rows = progress->ready_rows.load();
+		}
+		
+		// Texture rows, each of which needs the source row scale times further down to be ready.
+		int scale = image->partial_scale;
+		int width = (progress->width + scale - 1) / scale;
+		int ready_texture_rows = (ready_rows + scale - 1) / scale;
+		if (image->partial_rows >= ready_texture_rows) continue;
+		
+		u64 row_bytes = (u64)width * 4;
+		int row_count = ready_texture_rows - image->partial_rows;
+		if ((u64)row_count * row_bytes > budget) row_count = (int)(budget / row_bytes);
+		if (row_count < ready_texture_rows - image->partial_rows) has_pending = true;
+		if (row_count == 0) continue;
+		
+		u8* pixels = (u8*)malloc(row_count * row_bytes); // @malloc
+		if (scale == 1)
+		{
+			ConvertProgressiveRowsToRGBA8(progress, image->partial_passes, image->partial_rows, row_count, pixels);
+		}
+		else
+		{
+			u32* source_row = (u32*)malloc((u64)progress->width * 4); // @malloc
+			for (int row = 0; row < row_count; ++row)
+			{
+				ConvertProgressiveRowsToRGBA8(progress, image->partial_passes, (image->partial_rows + row) * scale, 1, (u8*)source_row);
+				u32* dst = (u32*)pixels + (u64)row * width;
+				for (int x = 0; x < width; ++x) dst[x] = source_row[x * scale];
+			}
+			free(source_row);
+		}
+		D3D11_BOX box = {0, (UINT)image->partial_rows, 0, (UINT)width, (UINT)(image->partial_rows + row_count), 1};
+		ctx->UpdateSubresource(image->partial_texture, 0, &box, pixels, (UINT)row_bytes, 0);
+		free(pixels);
+		
+		image->partial_rows += row_count;
+		++image->texture_version;
+		budget -= row_count * row_bytes;
+	}
+	if (!g_upload_scheduler) return has_pending;
+	
+	// Each finished level lifts the clamp on sampling by one, so panels can draw what's in.
+	BeginUploadFrame(g_upload_scheduler);
+	UploadChunk chunk;
+	while (NextUploadChunk(g_upload_scheduler, &chunk))
+	{
+		StoredImage* image = (StoredImage*)chunk.owner;
+		if (!CopyUploadChunk(ctx, image, &chunk, GetStagingTexture(device, chunk.slot)))
+		{
+			// Out of memory for staging, or a device in trouble; the chunk goes first again next frame.
+			ReturnUploadChunk(g_upload_scheduler, &chunk);
+			return true;
+		}
+		if (!chunk.is_level_done) continue;
+		
+		image->texture_min_level = chunk.level;
+		ctx->SetResourceMinLOD(image->texture, (float)chunk.level);
+		++image->texture_version;
+		if (chunk.level == 0)
+		{
+			FreeMipChain(image->mips);
+			free(image->mips);
+			image->mips = 0;
+		}
+	}
+	return has_pending || HasPendingUploads(g_upload_scheduler);
+}
+
+void DestroyImageStore()
+{
+	for (int i = 0; i < arrlen(g_stored_images); ++i) FreeStoredImage(g_stored_images[i]);
+	arrfree(g_stored_images);
+	for (int slot = 0; slot < UPLOAD_RING_SIZE; ++slot)
+	{
+		if (g_staging_textures[slot]) g_staging_textures[slot]->Release();
+		g_staging_textures[slot] = 0;
+	}
+	DestroyUploadScheduler(g_upload_scheduler);
+	g_upload_scheduler = 0;
+}
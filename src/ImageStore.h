@@ -0,0 +1,76 @@
+#ifndef _IMAGE_STORE_H
+#define _IMAGE_STORE_H
+
+#include <d3d11.h>
+#include "ImageDecode.h"
+#include "MipChain.h"
+
+// Decoded images shared by every panel showing the same file, so opening a file twice (to compare two
+// crops of it, say) decodes it once and keeps one copy of its pixels and one texture. Images are keyed by
+// canonical path, size and write time: any spelling of the path finds the same image, while a file that
+// has changed on disk since is decoded afresh. Panels borrow the pixels and texture, and an image is
+// freed when the last panel lets go of it. Only used from the main thread.
+//
+// Big files are decoded progressively (see ProgressiveDecode.h), and what has been decoded so far goes
+// into a partial texture that panels show until the image is ready.
+
+#define PROGRESSIVE_DECODE_MIN_SIZE ((u64)1 << 20) // Files smaller than this decode quickly enough to just wait for.
+#define PROGRESSIVE_UPLOAD_BYTES (16 << 20) // Most partial texture data uploaded per frame, over all images.
+
+enum class StoredImageState : u8
+{
+	Loading = 0,
+	Ready,
+	Failed
+};
+
+struct StoredImage
+{
+	char* canonical_path; // Or the path as given, if the file couldn't be found.
+	u64 file_size;
+	u64 modified_time;
+	int ref_count;
+
+	ImageLoadJob* job; // Pending decode, null once it has been collected.
+	PixelBuffer* pixels; // Set once decoded.
+	MipChain* mips; // Kept for tiled images, which have tiles cut from it on demand, and until the texture is uploaded.
+	ID3D11Texture2D* texture; // The whole image with its mips, for images that aren't tiled.
+	ID3D11ShaderResourceView* srv;
+	int texture_min_level; // Most detailed level of texture uploaded so far, or MAX_MIP_LEVELS before the first.
+	int texture_version; // Bumped whenever what the textures show changes, so panels know to redraw.
+	bool has_failed;
+
+	// While a progressive decode runs, what it has published so far: a single level texture of the image,
+	// scaled down if it will be tiled, or of its preview. Dropped once the image is ready.
+	ID3D11Texture2D* partial_texture;
+	ID3D11ShaderResourceView* partial_srv;
+	u64 partial_bytes;
+	int partial_width; // Of the whole image the texture stands in for.
+	int partial_height;
+	int partial_scale; // Image pixels per texel along each side, or 0 for a preview.
+	int partial_passes; // Detail the rows uploaded so far were converted at, for interlaced images.
+	int partial_rows; // Rows uploaded at that detail.
+};
+
+// Finds the image for a file, or adds it and starts decoding it, and adds a reference. pixels and mips,
+// if given, are an already decoded copy of the file (from the prefetcher) that the store takes over
+// instead of decoding; they're released straight away if the store already has the image.
+StoredImage* AcquireStoredImage(const char* file_path, PixelBuffer* pixels = 0, MipChain* mips = 0);
+void ReleaseStoredImage(StoredImage* image);
+
+// Collects a finished decode and creates its texture, the first time it's called after the decode is
+// done. The image is only ready once every level of the texture no bigger than UPLOAD_CHUNK_SIZE has been
+// uploaded.
+StoredImageState UpdateStoredImage(ID3D11Device* device, StoredImage* image);
+
+// Called once per frame. Uploads rows progressive decodes have published since last frame to their partial
+// textures, batched into one update per image and no more than PROGRESSIVE_UPLOAD_BYTES in all, and
+// continues the staged uploads of finished textures (see UploadScheduler.h). Those go up smallest level
+// first, and sampling is clamped to the levels that are in, so an image starts out blurry and sharpens
+// over a few frames instead of stalling one. Returns true if anything is left for the next frame.
+bool UpdateImageStoreUploads(ID3D11Device* device, ID3D11DeviceContext* ctx);
+
+// Frees every image. Panels have to release theirs first.
+void DestroyImageStore();
+
+#endif //_IMAGE_STORE_H
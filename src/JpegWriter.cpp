@@ -0,0 +1,519 @@
+#include "JpegWriter.h"
+#include "Core/JobSystem.h"
+
+#define JPEG_OUTPUT_BUFFER_SIZE (64 * 1024)
+#define JPEG_MCU_ROWS_PER_WORKER 2
+
+// Natural (row-major) index of each coefficient in zigzag order.
+static const u8 jpeg_zigzag[64] =
+{
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Quantization tables from Annex K of the spec, for quality 50, in natural order.
+static const u8 jpeg_luma_quant[64] =
+{
+	16, 11, 10, 16, 24, 40, 51, 61,
+	12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56,
+	14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77,
+	24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103, 99
+};
+
+static const u8 jpeg_chroma_quant[64] =
+{
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// Standard Huffman tables from Annex K: the number of codes of each length from 1 to 16, then the symbols.
+static const u8 jpeg_dc_luma_counts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const u8 jpeg_dc_chroma_counts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const u8 jpeg_dc_symbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const u8 jpeg_ac_luma_counts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D};
+static const u8 jpeg_ac_luma_symbols[162] =
+{
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+	0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+	0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+	0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+	0xF9, 0xFA
+};
+
+static const u8 jpeg_ac_chroma_counts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const u8 jpeg_ac_chroma_symbols[162] =
+{
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+	0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+	0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+	0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+	0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+	0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+	0xF9, 0xFA
+};
+
+struct JpegHuffmanCodes
+{
+	u16 codes[256];
+	u8 sizes[256];
+};
+
+// DC and AC codes for luma (index 0) and chroma (index 1).
+struct JpegHuffmanTables
+{
+	JpegHuffmanCodes dc[2];
+	JpegHuffmanCodes ac[2];
+};
+
+static void BuildJpegHuffmanCodes(const u8* counts, const u8* symbols, JpegHuffmanCodes* out)
+{
+	*out = {};
+	u32 code = 0;
+	int k = 0;
+	for (int length = 1; length <= 16; ++length)
+	{
+		for (int i = 0; i < counts[length - 1]; ++i, ++k)
+		{
+			out->codes[symbols[k]] = (u16)code++;
+			out->sizes[symbols[k]] = (u8)length;
+		}
+		code <<= 1;
+	}
+}
+
+static JpegHuffmanTables CreateJpegHuffmanTables()
+{
+	JpegHuffmanTables tables;
+	BuildJpegHuffmanCodes(jpeg_dc_luma_counts, jpeg_dc_symbols, &tables.dc[0]);
+	BuildJpegHuffmanCodes(jpeg_dc_chroma_counts, jpeg_dc_symbols, &tables.dc[1]);
+	BuildJpegHuffmanCodes(jpeg_ac_luma_counts, jpeg_ac_luma_symbols, &tables.ac[0]);
+	BuildJpegHuffmanCodes(jpeg_ac_chroma_counts, jpeg_ac_chroma_symbols, &tables.ac[1]);
+	return tables;
+}
+
+static const JpegHuffmanTables* GetJpegHuffmanTables()
+{
+	// Built once, thread-safely, on first use.
+	static const JpegHuffmanTables tables = CreateJpegHuffmanTables();
+	return &tables;
+}
+
+// One pass of the AAN float DCT over 8 values, step apart. The outputs come out scaled by the AAN
+// factors, which are undone as part of quantization.
+static void ForwardDct8(float* d, int step)
+{
+	float tmp0 = d[0] + d[7 * step];
+	float tmp7 = d[0] - d[7 * step];
+	float tmp1 = d[step] + d[6 * step];
+	float tmp6 = d[step] - d[6 * step];
+	float tmp2 = d[2 * step] + d[5 * step];
+	float tmp5 = d[2 * step] - d[5 * step];
+	float tmp3 = d[3 * step] + d[4 * step];
+	float tmp4 = d[3 * step] - d[4 * step];
+
+	// Even part.
+	float tmp10 = tmp0 + tmp3;
+	float tmp13 = tmp0 - tmp3;
+	float tmp11 = tmp1 + tmp2;
+	float tmp12 = tmp1 - tmp2;
+	d[0] = tmp10 + tmp11;
+	d[4 * step] = tmp10 - tmp11;
+	float z1 = (tmp12 + tmp13) * 0.707106781f;
+	d[2 * step] = tmp13 + z1;
+	d[6 * step] = tmp13 - z1;
+
+	// Odd part.
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+	float z5 = (tmp10 - tmp12) * 0.382683433f;
+	float z2 = 0.541196100f * tmp10 + z5;
+	float z4 = 1.306562965f * tmp12 + z5;
+	float z3 = tmp11 * 0.707106781f;
+	float z11 = tmp7 + z3;
+	float z13 = tmp7 - z3;
+	d[5 * step] = z13 + z2;
+	d[3 * step] = z13 - z2;
+	d[step] = z11 + z4;
+	d[7 * step] = z11 - z4;
+}
+
+// Transforms and quantizes one block of level shifted samples into zigzag order.
+static void QuantizeJpegBlock(float* block, const float* scales, s16* dst)
+{
+	for (int i = 0; i < 8; ++i) ForwardDct8(block + i * 8, 1);
+	for (int i = 0; i < 8; ++i) ForwardDct8(block + i, 8);
+	for (int k = 0; k < 64; ++k)
+	{
+		int n = jpeg_zigzag[k];
+		float value = block[n] * scales[n];
+		int q = (int)((value < 0.0f) ? value - 0.5f : value + 0.5f);
+		// The standard AC tables only cover magnitudes up to 10 bits.
+		dst[k] = (s16)((q < -1023) ? -1023 : ((q > 1023) ? 1023 : q));
+	}
+}
+
+struct JpegTransformJob
+{
+	JpegWriter* writer;
+	int row_count; // Valid rows in the band; the rest repeat the last one.
+};
+
+// ParallelFor callback: converts, transforms and quantizes MCU rows [begin, end) of the pending band.
+static void TransformJpegMcuRows(int begin, int end, void* data)
+{
+	JpegTransformJob* job = (JpegTransformJob*)data;
+	JpegWriter* writer = job->writer;
+	int channel_count = writer->channel_count;
+	int mcu_size = writer->mcu_size;
+	size_t stride = (size_t)writer->width * channel_count;
+
+	// Y, Cb and Cr for one MCU, level shifted.
+	float planes[3][16 * 16];
+	float block[64];
+	for (int r = begin; r < end; ++r)
+	{
+		for (int m = 0; m < writer->mcu_columns; ++m)
+		{
+			for (int y = 0; y < mcu_size; ++y)
+			{
+				int source_y = r * mcu_size + y;
+				if (source_y >= job->row_count) source_y = job->row_count - 1;
+				const u8* row = writer->pending + (size_t)source_y * stride;
+				for (int x = 0; x < mcu_size; ++x)
+				{
+					int source_x = m * mcu_size + x;
+					if (source_x >= writer->width) source_x = writer->width - 1;
+					const u8* pixel = row + (size_t)source_x * channel_count;
+					int i = y * mcu_size + x;
+					if (channel_count == 1)
+					{
+						planes[0][i] = pixel[0] - 128.0f;
+						continue;
+					}
+					float red = pixel[0], green = pixel[1], blue = pixel[2];
+					planes[0][i] = 0.299f * red + 0.587f * green + 0.114f * blue - 128.0f;
+					planes[1][i] = -0.168736f * red - 0.331264f * green + 0.5f * blue;
+					planes[2][i] = 0.5f * red - 0.418688f * green - 0.081312f * blue;
+				}
+			}
+
+			s16* dst = writer->coefficients + ((size_t)r * writer->mcu_columns + m) * writer->blocks_per_mcu * 64;
+			int luma_blocks = writer->is_subsampled ? 4 : 1;
+			for (int b = 0; b < luma_blocks; ++b)
+			{
+				int x0 = (b & 1) * 8;
+				int y0 = (b >> 1) * 8;
+				for (int i = 0; i < 64; ++i) block[i] = planes[0][(y0 + i / 8) * mcu_size + x0 + i % 8];
+				QuantizeJpegBlock(block, writer->quant_scales[0], dst);
+				dst += 64;
+			}
+			for (int c = 1; c < channel_count; ++c)
+			{
+				for (int i = 0; i < 64; ++i)
+				{
+					int x = i % 8;
+					int y = i / 8;
+					if (writer->is_subsampled)
+					{
+						const float* p = planes[c] + (y * 2) * mcu_size + x * 2;
+						block[i] = (p[0] + p[1] + p[mcu_size] + p[mcu_size + 1]) * 0.25f;
+					}
+					else
+					{
+						block[i] = planes[c][y * mcu_size + x];
+					}
+				}
+				QuantizeJpegBlock(block, writer->quant_scales[1], dst);
+				dst += 64;
+			}
+		}
+	}
+}
+
+static void PutJpegByte(JpegWriter* writer, u8 value)
+{
+	if (writer->output_size == writer->output_capacity)
+	{
+		WriteEncoderFile(&writer->file, writer->output, writer->output_size);
+		writer->output_size = 0;
+	}
+	writer->output[writer->output_size++] = value;
+}
+
+static void PutJpegBits(JpegWriter* writer, u32 bits, int count)
+{
+	writer->bit_buffer = (writer->bit_buffer << count) | (bits & ((1u << count) - 1));
+	writer->bit_count += count;
+	while (writer->bit_count >= 8)
+	{
+		u8 value = (u8)(writer->bit_buffer >> (writer->bit_count - 8));
+		PutJpegByte(writer, value);
+		if (value == 0xFF) PutJpegByte(writer, 0); // Byte stuffing, so it can't be mistaken for a marker.
+		writer->bit_count -= 8;
+	}
+}
+
+static void PutJpegMarker(JpegWriter* writer, u8 marker, u32 length)
+{
+	PutJpegByte(writer, 0xFF);
+	PutJpegByte(writer, marker);
+	if (length)
+	{
+		PutJpegByte(writer, (u8)(length >> 8));
+		PutJpegByte(writer, (u8)length);
+	}
+}
+
+static int GetJpegCategory(int value)
+{
+	int magnitude = (value < 0) ? -value : value;
+	int category = 0;
+	while (magnitude)
+	{
+		++category;
+		magnitude >>= 1;
+	}
+	return category;
+}
+
+static void EncodeJpegBlock(JpegWriter* writer, const s16* block, int component)
+{
+	const JpegHuffmanTables* tables = GetJpegHuffmanTables();
+	const JpegHuffmanCodes* dc = &tables->dc[component ? 1 : 0];
+	const JpegHuffmanCodes* ac = &tables->ac[component ? 1 : 0];
+
+	// Values are sent as their category's Huffman code followed by that many low bits, with negative
+	// values stored as one less (so their leading bit is zero).
+	int diff = block[0] - writer->dc_predictions[component];
+	writer->dc_predictions[component] = block[0];
+	int category = GetJpegCategory(diff);
+	PutJpegBits(writer, dc->codes[category], dc->sizes[category]);
+	if (category) PutJpegBits(writer, (diff < 0) ? diff - 1 : diff, category);
+
+	int run = 0;
+	for (int k = 1; k < 64; ++k)
+	{
+		int value = block[k];
+		if (!value)
+		{
+			++run;
+			continue;
+		}
+		while (run >= 16)
+		{
+			PutJpegBits(writer, ac->codes[0xF0], ac->sizes[0xF0]); // 16 zeros.
+			run -= 16;
+		}
+		category = GetJpegCategory(value);
+		int symbol = (run << 4) | category;
+		PutJpegBits(writer, ac->codes[symbol], ac->sizes[symbol]);
+		PutJpegBits(writer, (value < 0) ? value - 1 : value, category);
+		run = 0;
+	}
+	if (run) PutJpegBits(writer, ac->codes[0x00], ac->sizes[0x00]); // End of block.
+}
+
+static void FlushJpegBand(JpegWriter* writer)
+{
+	if (!writer->pending_rows) return;
+
+	int mcu_rows = (writer->pending_rows + writer->mcu_size - 1) / writer->mcu_size;
+	JpegTransformJob job = {writer, writer->pending_rows};
+	ParallelFor(mcu_rows, 1, TransformJpegMcuRows, &job);
+
+	const s16* block = writer->coefficients;
+	int mcu_count = mcu_rows * writer->mcu_columns;
+	int luma_blocks = writer->is_subsampled ? 4 : 1;
+	for (int m = 0; m < mcu_count; ++m)
+	{
+		if (writer->restart_interval && writer->mcus_coded && writer->mcus_coded % writer->restart_interval == 0)
+		{
+			// Byte aligned, and coded as if the image started over.
+			if (writer->bit_count) PutJpegBits(writer, 0x7F, 8 - writer->bit_count); // Pad with ones.
+			int restart_number = (writer->mcus_coded / writer->restart_interval - 1) & 7;
+			PutJpegMarker(writer, (u8)(0xD0 + restart_number), 0);
+			memset(writer->dc_predictions, 0, sizeof(writer->dc_predictions));
+		}
+		++writer->mcus_coded;
+		for (int b = 0; b < writer->blocks_per_mcu; ++b, block += 64)
+		{
+			EncodeJpegBlock(writer, block, (b < luma_blocks) ? 0 : b - luma_blocks + 1);
+		}
+	}
+	writer->pending_rows = 0;
+}
+
+static void PutJpegHuffmanTable(JpegWriter* writer, u8 table_id, const u8* counts, const u8* symbols)
+{
+	int symbol_count = 0;
+	for (int i = 0; i < 16; ++i) symbol_count += counts[i];
+	PutJpegByte(writer, table_id);
+	for (int i = 0; i < 16; ++i) PutJpegByte(writer, counts[i]);
+	for (int i = 0; i < symbol_count; ++i) PutJpegByte(writer, symbols[i]);
+}
+
+bool BeginJpegWrite(JpegWriter* writer, const char* file_path, int width, int height, int channel_count, int quality, bool is_subsampled, int restart_interval)
+{
+	assert(writer && file_path);
+	*writer = {};
+	if (width <= 0 || height <= 0 || width > U16_MAX || height > U16_MAX) return false;
+	if (channel_count != 1 && channel_count != 3) return false;
+	if (restart_interval < 0 || restart_interval > U16_MAX) return false;
+
+	if (!OpenEncoderFile(&writer->file, file_path)) return false;
+	writer->width = width;
+	writer->height = height;
+	writer->channel_count = channel_count;
+	writer->restart_interval = restart_interval;
+	writer->is_subsampled = (is_subsampled && channel_count == 3);
+	writer->mcu_size = writer->is_subsampled ? 16 : 8;
+	writer->mcu_columns = (width + writer->mcu_size - 1) / writer->mcu_size;
+	writer->blocks_per_mcu = writer->is_subsampled ? 6 : channel_count;
+
+	int mcu_rows = (height + writer->mcu_size - 1) / writer->mcu_size;
+	int band_mcu_rows = (GetJobWorkerCount() + 1) * JPEG_MCU_ROWS_PER_WORKER;
+	if (band_mcu_rows > mcu_rows) band_mcu_rows = mcu_rows;
+	writer->band_rows = band_mcu_rows * writer->mcu_size;
+	writer->pending = (u8*)malloc((size_t)width * channel_count * writer->band_rows); // @malloc
+	writer->coefficients = (s16*)malloc(sizeof(s16) * 64 * writer->blocks_per_mcu * writer->mcu_columns * (size_t)band_mcu_rows); // @malloc
+	writer->output_capacity = JPEG_OUTPUT_BUFFER_SIZE;
+	writer->output = (u8*)malloc(writer->output_capacity); // @malloc
+
+	// Quality scaling as in the IJG library, so quality numbers mean what people expect.
+	if (quality <= 0) quality = JPEG_DEFAULT_QUALITY;
+	if (quality > 100) quality = 100;
+	int scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+	static const float aan_scales[8] = {1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f};
+	u8 quant_tables[2][64]; // Zigzag order, as stored in the file.
+	for (int t = 0; t < 2; ++t)
+	{
+		const u8* base = t ? jpeg_chroma_quant : jpeg_luma_quant;
+		for (int k = 0; k < 64; ++k)
+		{
+			int n = jpeg_zigzag[k];
+			int q = (base[n] * scale + 50) / 100;
+			q = (q < 1) ? 1 : ((q > 255) ? 255 : q);
+			quant_tables[t][k] = (u8)q;
+			writer->quant_scales[t][n] = 1.0f / (q * aan_scales[n / 8] * aan_scales[n % 8] * 8.0f);
+		}
+	}
+
+	int table_count = (channel_count == 3) ? 2 : 1;
+	PutJpegMarker(writer, 0xD8, 0); // Start of image.
+
+	static const u8 jfif[14] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0}; // Version 1.1, 1:1 aspect, no thumbnail.
+	PutJpegMarker(writer, 0xE0, 2 + sizeof(jfif));
+	for (int i = 0; i < (int)sizeof(jfif); ++i) PutJpegByte(writer, jfif[i]);
+
+	PutJpegMarker(writer, 0xDB, 2 + 65 * table_count);
+	for (int t = 0; t < table_count; ++t)
+	{
+		PutJpegByte(writer, (u8)t);
+		for (int k = 0; k < 64; ++k) PutJpegByte(writer, quant_tables[t][k]);
+	}
+
+	PutJpegMarker(writer, 0xC0, 8 + 3 * channel_count); // Baseline frame.
+	PutJpegByte(writer, 8);
+	PutJpegByte(writer, (u8)(height >> 8));
+	PutJpegByte(writer, (u8)height);
+	PutJpegByte(writer, (u8)(width >> 8));
+	PutJpegByte(writer, (u8)width);
+	PutJpegByte(writer, (u8)channel_count);
+	for (int c = 0; c < channel_count; ++c)
+	{
+		PutJpegByte(writer, (u8)(c + 1));
+		PutJpegByte(writer, (c == 0 && writer->is_subsampled) ? 0x22 : 0x11);
+		PutJpegByte(writer, c ? 1 : 0);
+	}
+
+	// Each table is its ID, 16 code counts and the symbols: 12 for DC, 162 for AC.
+	int huffman_size = 2 + (17 + 12) + (17 + 162);
+	if (channel_count == 3) huffman_size += (17 + 12) + (17 + 162);
+	PutJpegMarker(writer, 0xC4, huffman_size);
+	PutJpegHuffmanTable(writer, 0x00, jpeg_dc_luma_counts, jpeg_dc_symbols);
+	PutJpegHuffmanTable(writer, 0x10, jpeg_ac_luma_counts, jpeg_ac_luma_symbols);
+	if (channel_count == 3)
+	{
+		PutJpegHuffmanTable(writer, 0x01, jpeg_dc_chroma_counts, jpeg_dc_symbols);
+		PutJpegHuffmanTable(writer, 0x11, jpeg_ac_chroma_counts, jpeg_ac_chroma_symbols);
+	}
+
+	if (restart_interval)
+	{
+		PutJpegMarker(writer, 0xDD, 4); // Restart interval.
+		PutJpegByte(writer, (u8)(restart_interval >> 8));
+		PutJpegByte(writer, (u8)restart_interval);
+	}
+
+	PutJpegMarker(writer, 0xDA, 6 + 2 * channel_count); // Start of scan.
+	PutJpegByte(writer, (u8)channel_count);
+	for (int c = 0; c < channel_count; ++c)
+	{
+		PutJpegByte(writer, (u8)(c + 1));
+		PutJpegByte(writer, c ? 0x11 : 0x00);
+	}
+	PutJpegByte(writer, 0); // Spectral selection covers all 64 coefficients.
+	PutJpegByte(writer, 63);
+	PutJpegByte(writer, 0);
+	return !writer->file.has_error;
+}
+
+bool WriteJpegRows(JpegWriter* writer, const u8* rows, int row_count, size_t stride)
+{
+	assert(writer && rows);
+	if (!writer->file.file || writer->file.has_error) return false;
+	if (row_count > writer->height - writer->rows_written) row_count = writer->height - writer->rows_written;
+
+	size_t row_size = (size_t)writer->width * writer->channel_count;
+	for (int y = 0; y < row_count; ++y)
+	{
+		memcpy(writer->pending + (size_t)writer->pending_rows * row_size, rows + (size_t)y * stride, row_size);
+		++writer->pending_rows;
+		if (writer->pending_rows == writer->band_rows) FlushJpegBand(writer);
+	}
+	writer->rows_written += row_count;
+	return !writer->file.has_error;
+}
+
+bool EndJpegWrite(JpegWriter* writer)
+{
+	assert(writer);
+	bool is_complete = (writer->file.file && writer->rows_written == writer->height);
+	if (is_complete)
+	{
+		FlushJpegBand(writer);
+		if (writer->bit_count) PutJpegBits(writer, 0x7F, 8 - writer->bit_count); // Pad with ones.
+		PutJpegMarker(writer, 0xD9, 0); // End of image.
+		WriteEncoderFile(&writer->file, writer->output, writer->output_size);
+	}
+	bool success = CloseEncoderFile(&writer->file, is_complete);
+	free(writer->pending);
+	free(writer->coefficients);
+	free(writer->output);
+	*writer = {};
+	return success;
+}
@@ -0,0 +1,48 @@
+#ifndef _JPEG_WRITER_H
+#define _JPEG_WRITER_H
+
+#include "EncoderFile.h"
+
+// Baseline JPEG (JFIF) encoder with the standard Huffman tables. Rows are collected into bands of whole
+// MCU rows; the color conversion, DCT and quantization for a band run on the job system, and the
+// entropy coding (which has to be sequential) follows on the calling thread.
+
+#define JPEG_DEFAULT_QUALITY 90
+
+struct JpegWriter
+{
+	EncoderFile file;
+	int width;
+	int height;
+	int channel_count; // 1 (gray) or 3 (RGB, stored as YCbCr).
+	bool is_subsampled; // 4:2:0 chroma, so MCUs are 16x16 instead of 8x8.
+	int mcu_size;
+	int mcu_columns;
+	int blocks_per_mcu;
+	int rows_written;
+	int restart_interval; // MCUs between RSTn markers, or 0 for none.
+	int mcus_coded;
+
+	float quant_scales[2][64]; // Reciprocals of the quantizer steps with the DCT scale factors folded in.
+
+	u8* pending; // Rows waiting for a band to fill up, tightly packed.
+	int pending_rows;
+	int band_rows; // A multiple of mcu_size.
+	s16* coefficients; // Quantized blocks of one band in zigzag order, in the order they're coded.
+
+	int dc_predictions[3];
+	u32 bit_buffer;
+	int bit_count;
+	u8* output; // Entropy coded bytes waiting to be written.
+	size_t output_size;
+	size_t output_capacity;
+};
+
+// channel_count is 1 or 3. quality is 1 to 100; 0 picks JPEG_DEFAULT_QUALITY. Images are limited to
+// 65535 pixels on a side by the format. restart_interval (up to 65535 MCUs) puts a restart marker
+// between every so many MCUs, which lets decoders resynchronize after damaged data.
+bool BeginJpegWrite(JpegWriter* writer, const char* file_path, int width, int height, int channel_count, int quality, bool is_subsampled, int restart_interval = 0);
+bool WriteJpegRows(JpegWriter* writer, const u8* rows, int row_count, size_t stride);
+bool EndJpegWrite(JpegWriter* writer);
+
+#endif //_JPEG_WRITER_H
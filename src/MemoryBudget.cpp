@@ -0,0 +1,102 @@
+#include "MemoryBudget.h"
+
+static void AddStoredImageUsage(const StoredImage* image, MemoryUsage* usage)
+{
+	if (image->pixels)
+	{
+		DecodedImage pixels = image->pixels->image;
+		usage->cpu_bytes += (u64)pixels.width * pixels.height * GetPixelSize(pixels.layout);
+		if (image->texture)
+		{
+			int level_count = GetMipLevelCount(pixels.width, pixels.height);
+			for (int level = 0; level < level_count && level < MAX_MIP_LEVELS; ++level)
+			{
+				usage->gpu_bytes += (u64)GetMipLevelSize(pixels.width, level) * GetMipLevelSize(pixels.height, level) * 4;
+			}
+		}
+	}
+	if (image->mips) usage->cpu_bytes += GetMipChainSize(image->mips);
+	usage->gpu_bytes += image->partial_bytes;
+}
+
+// Everything but the stored image.
+static void AddImagePanelUsage(const ImagePanel* panel, MemoryUsage* usage)
+{
+	if (panel->summed_area)
+	{
+		const SummedAreaTable* table = GetSummedAreaTable(panel->summed_area);
+		if (table)
+		{
+			int sum_size = (table->type == SummedAreaType::U32) ? 4 : 8;
+			usage->cpu_bytes += (u64)(table->width + 1) * (table->height + 1) * table->channel_count * sum_size;
+		}
+	}
+	if (panel->canvas.texture) usage->gpu_bytes += (u64)panel->canvas.width * panel->canvas.height * 4;
+	if (panel->tiled) usage->gpu_bytes += (u64)TILE_ATLAS_SIZE * TILE_ATLAS_SIZE * 4;
+	usage->gpu_bytes += panel->preview_bytes;
+}
+
+MemoryUsage GetImagePanelMemoryUsage(const ImagePanel* panel)
+{
+	assert(panel);
+	MemoryUsage usage = {};
+	AddImagePanelUsage(panel, &usage);
+	if (panel->stored) AddStoredImageUsage(panel->stored, &usage);
+	return usage;
+}
+
+MemoryUsage GetTotalMemoryUsage(const ImagePanel* panels, int panel_count)
+{
+	MemoryUsage usage = {};
+	for (int i = 0; i < panel_count; ++i)
+	{
+		AddImagePanelUsage(&panels[i], &usage);
+
+		// Panels sharing an image are rare and few, so looking back for an earlier one is cheap enough.
+		const StoredImage* stored = panels[i].stored;
+		bool is_counted = !stored;
+		for (int j = 0; j < i && !is_counted; ++j) is_counted = (panels[j].stored == stored);
+		if (!is_counted) AddStoredImageUsage(stored, &usage);
+	}
+	return usage;
+}
+
+bool EnforceMemoryBudget(ID3D11Device* device, ID3D11DeviceContext* ctx, MemoryBudget* budget, ImagePanel* panels, int panel_count, const int* focus_order, int focus_count)
+{
+	assert(budget && (panels || !panel_count) && (focus_order || !focus_count));
+	bool has_evicted = false;
+	budget->usage = GetTotalMemoryUsage(panels, panel_count);
+	while (budget->usage.cpu_bytes > budget->cpu_budget || budget->usage.gpu_bytes > budget->gpu_budget)
+	{
+		// Hidden tabs rank below everything on screen, and within each group the least recently focused
+		// goes first.
+		int victim = -1;
+		int victim_rank = 0;
+		for (int i = 0; i < panel_count; ++i)
+		{
+			ImagePanel* panel = &panels[i];
+			if (!panel->source_buffer || panel->is_evicted) continue;
+			int focus_index = -1;
+			for (int j = 0; j < focus_count; ++j)
+			{
+				if (focus_order[j] == panel->panel_id) focus_index = j;
+			}
+			if (focus_count > 0 && focus_index == focus_count - 1) continue;
+
+			int rank = focus_index + 1 + (panel->is_shown ? focus_count + 1 : 0);
+			if (victim < 0 || rank < victim_rank)
+			{
+				victim = i;
+				victim_rank = rank;
+			}
+		}
+		if (victim < 0) break;
+		EvictImagePanel(device, ctx, &panels[victim]);
+		budget->usage = GetTotalMemoryUsage(panels, panel_count);
+		has_evicted = true;
+	}
+
+	budget->evicted_count = 0;
+	for (int i = 0; i < panel_count; ++i) budget->evicted_count += panels[i].is_evicted;
+	return has_evicted;
+}
@@ -0,0 +1,41 @@
+#ifndef _MEMORY_BUDGET_H
+#define _MEMORY_BUDGET_H
+
+#include "ImageLoader.h"
+
+// Keeps what the open panels hold under a budget. Panels are charged for their decoded pixels, CPU mip
+// chains and summed-area tables, and on the GPU for their textures, tile atlases and canvases; an image
+// shared by several panels counts once. Over budget, panels are evicted down to a preview (see
+// EvictImagePanel), least recently focused first, and tabs hidden behind other tabs before panels that
+// are on screen. The focused panel is never evicted, and an evicted panel is decoded again when it gets
+// focus back.
+
+#define MEMORY_BUDGET_DEFAULT_CPU ((u64)2 << 30)
+#define MEMORY_BUDGET_DEFAULT_GPU ((u64)1 << 30)
+
+struct MemoryUsage
+{
+	u64 cpu_bytes;
+	u64 gpu_bytes;
+};
+
+struct MemoryBudget
+{
+	u64 cpu_budget;
+	u64 gpu_budget;
+	MemoryUsage usage; // As of the last EnforceMemoryBudget.
+	int evicted_count; // Panels only holding a preview, as of the same.
+};
+
+// What one panel holds, counting its image in full even if other panels share it.
+MemoryUsage GetImagePanelMemoryUsage(const ImagePanel* panel);
+
+// What all the panels hold between them, counting each shared image once.
+MemoryUsage GetTotalMemoryUsage(const ImagePanel* panels, int panel_count);
+
+// Evicts panels until the usage fits the budget or only the focused panel is left. focus_order holds
+// panel IDs, least recently focused first, so the last one is the focused panel; panels missing from it
+// count as older than any in it. Returns true if any panel was evicted.
+bool EnforceMemoryBudget(ID3D11Device* device, ID3D11DeviceContext* ctx, MemoryBudget* budget, ImagePanel* panels, int panel_count, const int* focus_order, int focus_count);
+
+#endif //_MEMORY_BUDGET_H
@@ -0,0 +1,280 @@
+#include "MipChain.h"
+#include "Core/CpuFeatures.h"
+
+// Levels are filtered in linear light. Rows are converted to 14-bit linear values as they are read, so
+// the sum of a 2x2 block still fits in 16 bits and the box filter can run on plain u16 lanes, and each
+// output row is converted back to sRGB8 for storage. Every level is read from the stored level before it,
+// so nothing bigger than a few rows is ever kept in linear form.
+#define LINEAR_MAX 16383
+
+struct SrgbTables
+{
+	u16 to_linear[256]; // sRGB8 -> linear14, for color channels.
+	u16 alpha_to_linear[256]; // Alpha is already linear; just rescaled.
+	u8 to_srgb[LINEAR_MAX + 1]; // linear14 -> sRGB8.
+	u8 alpha_to_srgb[LINEAR_MAX + 1];
+};
+
+static SrgbTables CreateSrgbTables()
+{
+	SrgbTables result;
+	for (int i = 0; i < 256; ++i)
+	{
+		float c = i / 255.0f;
+		float linear = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		result.to_linear[i] = (u16)(linear * LINEAR_MAX + 0.5f);
+		result.alpha_to_linear[i] = (u16)((i * LINEAR_MAX + 127) / 255);
+	}
+	for (int i = 0; i <= LINEAR_MAX; ++i)
+	{
+		float linear = (float)i / LINEAR_MAX;
+		float c = (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+		result.to_srgb[i] = (u8)(c * 255.0f + 0.5f);
+		result.alpha_to_srgb[i] = (u8)((i * 255 + LINEAR_MAX / 2) / LINEAR_MAX);
+	}
+	return result;
+}
+
+static const SrgbTables* GetSrgbTables()
+{
+	static const SrgbTables tables = CreateSrgbTables(); // Thread-safe static init; chains build on workers.
+	return &tables;
+}
+
+int GetMipLevelCount(int width, int height)
+{
+	int size = (width > height) ? width : height;
+	int result = 1;
+	while (size > 1)
+	{
+		size >>= 1;
+		++result;
+	}
+	return result;
+}
+
+int GetMipLevelSize(int size, int level)
+{
+	int result = size >> level;
+	return (result > 0) ? result : 1;
+}
+
+// Returns a pointer to row y of the source as RGBA8, converting into out if the layout needs it.
+static const u8* GetSourceRowRGBA8(const void* source, PixelLayout layout, int width, int y, u8* scratch, u8* out)
+{
+	size_t stride = (size_t)width * GetPixelSize(layout);
+	const u8* row = (const u8*)source + (size_t)y * stride;
+	if (layout.type == PixelType::U8 && layout.channel_count == 4) return row;
+
+	PixelLayout u8_layout = {layout.channel_count, PixelType::U8};
+	if (layout.type != PixelType::U8)
+	{
+		ConvertPixelsToU8(row, layout, width, scratch);
+		row = scratch;
+	}
+	ExpandPixelsToRGBA(row, u8_layout, width, out);
+	return out;
+}
+
+static void SrgbRowToLinear(const SrgbTables* tables, const u8* src, int width, u16* dst)
+{
+	for (int x = 0; x < width; ++x, src += 4, dst += 4)
+	{
+		dst[0] = tables->to_linear[src[0]];
+		dst[1] = tables->to_linear[src[1]];
+		dst[2] = tables->to_linear[src[2]];
+		dst[3] = tables->alpha_to_linear[src[3]];
+	}
+}
+
+static void LinearRowToSrgb(const SrgbTables* tables, const u16* src, int width, u8* dst)
+{
+	for (int x = 0; x < width; ++x, src += 4, dst += 4)
+	{
+		dst[0] = tables->to_srgb[src[0]];
+		dst[1] = tables->to_srgb[src[1]];
+		dst[2] = tables->to_srgb[src[2]];
+		dst[3] = tables->alpha_to_srgb[src[3]];
+	}
+}
+
+// Scalar reference for the 2x2 box filter, starting at output column first_x. Odd trailing columns are
+// clamped to the last source column.
+static void DownsampleRowPairScalar(const u16* row0, const u16* row1, int src_width, u16* dst, int first_x, int dst_width)
+{
+	for (int x = first_x; x < dst_width; ++x)
+	{
+		int x0 = x * 2;
+		int x1 = (x0 + 1 < src_width) ? x0 + 1 : x0;
+		for (int c = 0; c < 4; ++c)
+		{
+			int sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+			dst[x * 4 + c] = (u16)((sum + 2) >> 2);
+		}
+	}
+}
+
+#ifdef CORE_SIMD_X86
+// Two output pixels per iteration. Each 128-bit load holds two RGBA16 pixels.
+static void DownsampleRowPairSSE2(const u16* row0, const u16* row1, int src_width, u16* dst, int dst_width)
+{
+	const __m128i rounding = _mm_set1_epi16(2);
+	int x = 0;
+	for (; x + 2 <= dst_width && x * 2 + 4 <= src_width; x += 2)
+	{
+		__m128i a = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(row0 + x * 8)), _mm_loadu_si128((const __m128i*)(row1 + x * 8)));
+		__m128i b = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(row0 + x * 8 + 8)), _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 8)));
+
+		// a = [p0, p1], b = [p2, p3] (column sums). Pair up horizontal neighbors: [p0 + p1, p2 + p3].
+		__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+		_mm_storeu_si128((__m128i*)(dst + x * 4), sum);
+	}
+	DownsampleRowPairScalar(row0, row1, src_width, dst, x, dst_width);
+}
+
+// Four output pixels per iteration; same idea as the SSE2 version, but unpack works within 128-bit
+// lanes, so the results come out as [o0, o2 | o1, o3] and need one cross-lane permute.
+SIMD_TARGET_AVX2 static void DownsampleRowPairAVX2(const u16* row0, const u16* row1, int src_width, u16* dst, int dst_width)
+{
+	const __m256i rounding = _mm256_set1_epi16(2);
+	int x = 0;
+	for (; x + 4 <= dst_width && x * 2 + 8 <= src_width; x += 4)
+	{
+		__m256i a = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(row0 + x * 8)), _mm256_loadu_si256((const __m256i*)(row1 + x * 8)));
+		__m256i b = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(row0 + x * 8 + 16)), _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + 16)));
+
+		__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+		sum = _mm256_srli_epi16(_mm256_add_epi16(sum, rounding), 2);
+		sum = _mm256_permute4x64_epi64(sum, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i*)(dst + x * 4), sum);
+	}
+	DownsampleRowPairScalar(row0, row1, src_width, dst, x, dst_width);
+}
+#endif
+
+static void DownsampleRowPair(MipKernel kernel, const u16* row0, const u16* row1, int src_width, u16* dst, int dst_width)
+{
+#ifdef CORE_SIMD_X86
+	if (kernel == MipKernel::Best) kernel = CpuHasAVX2() ? MipKernel::AVX2 : MipKernel::SSE2;
+	if (kernel == MipKernel::AVX2 && CpuHasAVX2()) DownsampleRowPairAVX2(row0, row1, src_width, dst, dst_width);
+	else if (kernel != MipKernel::Scalar) DownsampleRowPairSSE2(row0, row1, src_width, dst, dst_width);
+	else DownsampleRowPairScalar(row0, row1, src_width, dst, 0, dst_width);
+#else
+	(void)kernel;
+	DownsampleRowPairScalar(row0, row1, src_width, dst, 0, dst_width);
+#endif
+}
+
+struct MipLevelBuild
+{
+	const SrgbTables* tables;
+	MipKernel kernel;
+
+	// The original image for level 1, or the stored level before this one (RGBA8).
+	const void* source;
+	PixelLayout source_layout;
+	int src_width;
+	int src_height;
+
+	MipLevel* dst;
+};
+
+// ParallelFor callback: computes output rows [begin, end) of one level.
+static void BuildMipLevelRows(int begin, int end, void* data)
+{
+	MipLevelBuild* build = (MipLevelBuild*)data;
+	int src_width = build->src_width;
+	int dst_width = build->dst->width;
+
+	// Per-batch scratch: two linear source rows, one linear output row, and RGBA8 conversion space for
+	// sources in other layouts.
+	size_t src_row_size = (size_t)src_width * 4;
+	u16* scratch_linear = (u16*)malloc(src_row_size * 2 * sizeof(u16) + (size_t)dst_width * 4 * sizeof(u16)); // @malloc
+	u16* row0 = scratch_linear;
+	u16* row1 = scratch_linear + src_row_size;
+	u16* out_row = scratch_linear + src_row_size * 2;
+	bool is_rgba8 = (build->source_layout.type == PixelType::U8 && build->source_layout.channel_count == 4);
+	u8* scratch_rgba = is_rgba8 ? 0 : (u8*)malloc(src_row_size * 4); // @malloc
+
+	for (int y = begin; y < end; ++y)
+	{
+		int y0 = y * 2;
+		int y1 = (y0 + 1 < build->src_height) ? y0 + 1 : y0;
+
+		const u8* rgba0 = GetSourceRowRGBA8(build->source, build->source_layout, src_width, y0, scratch_rgba, scratch_rgba + src_row_size);
+		SrgbRowToLinear(build->tables, rgba0, src_width, row0);
+		const u8* rgba1 = GetSourceRowRGBA8(build->source, build->source_layout, src_width, y1, scratch_rgba + src_row_size * 2, scratch_rgba + src_row_size * 3);
+		SrgbRowToLinear(build->tables, rgba1, src_width, row1);
+
+		DownsampleRowPair(build->kernel, row0, row1, src_width, out_row, dst_width);
+		LinearRowToSrgb(build->tables, out_row, dst_width, build->dst->pixels + (size_t)y * dst_width * 4);
+	}
+
+	free(scratch_linear);
+	free(scratch_rgba);
+}
+
+void BuildMipChain(const void* source, PixelLayout layout, int width, int height, MipChain* chain, MipKernel kernel)
+{
+	assert(source && chain);
+	*chain = {};
+	chain->level_count = GetMipLevelCount(width, height);
+	if (chain->level_count > MAX_MIP_LEVELS) chain->level_count = MAX_MIP_LEVELS;
+	if (chain->level_count < 2) return;
+
+	const SrgbTables* tables = GetSrgbTables();
+	PixelLayout rgba8_layout = {4, PixelType::U8};
+	for (int level = 1; level < chain->level_count; ++level)
+	{
+		MipLevel* dst = &chain->levels[level];
+		dst->width = GetMipLevelSize(width, level);
+		dst->height = GetMipLevelSize(height, level);
+		dst->pixels = (u8*)malloc((size_t)dst->width * dst->height * 4); // @malloc
+
+		MipLevelBuild build = {};
+		build.tables = tables;
+		build.kernel = kernel;
+		build.source = (level == 1) ? source : chain->levels[level - 1].pixels;
+		build.source_layout = (level == 1) ? layout : rgba8_layout;
+		build.src_width = GetMipLevelSize(width, level - 1);
+		build.src_height = GetMipLevelSize(height, level - 1);
+		build.dst = dst;
+
+		// Rows are independent, so each level is split across the job system. Small levels aren't
+		// worth the overhead and run inline.
+		ParallelFor(dst->height, 16, BuildMipLevelRows, &build);
+	}
+}
+
+void FreeMipChain(MipChain* chain)
+{
+	assert(chain);
+	for (int i = 0; i < MAX_MIP_LEVELS; ++i) free(chain->levels[i].pixels);
+	*chain = {};
+}
+
+void CopyMipChain(const MipChain* source, MipChain* copy)
+{
+	assert(source && copy);
+	*copy = *source;
+	for (int i = 0; i < MAX_MIP_LEVELS; ++i)
+	{
+		const MipLevel* level = &source->levels[i];
+		if (!level->pixels) continue;
+		size_t size = (size_t)level->width * level->height * 4;
+		copy->levels[i].pixels = (u8*)malloc(size); // @malloc
+		memcpy(copy->levels[i].pixels, level->pixels, size);
+	}
+}
+
+u64 GetMipChainSize(const MipChain* chain)
+{
+	assert(chain);
+	u64 size = 0;
+	for (int i = 0; i < MAX_MIP_LEVELS; ++i)
+	{
+		if (chain->levels[i].pixels) size += (u64)chain->levels[i].width * chain->levels[i].height * 4;
+	}
+	return size;
+}
@@ -0,0 +1,53 @@
+#ifndef _MIP_CHAIN_H
+#define _MIP_CHAIN_H
+
+#include "ImageDecode.h"
+
+#define MAX_MIP_LEVELS 32
+
+// One downsampled level, always RGBA8 with tightly packed rows.
+struct MipLevel
+{
+	u8* pixels;
+	int width;
+	int height;
+};
+
+// Downsampled copies of an image, each half the size of the one before, down to 1x1. Level 0 is the
+// source image itself and is never stored here (levels[0] stays empty).
+struct MipChain
+{
+	MipLevel levels[MAX_MIP_LEVELS];
+	int level_count; // Including level 0.
+};
+
+// Number of levels in a full chain for an image of this size, including level 0.
+int GetMipLevelCount(int width, int height);
+
+// Size of a level, never less than 1x1.
+int GetMipLevelSize(int size, int level);
+
+// Which box filter BuildMipChain runs. Anything but Best is only for benchmarks; kernels the CPU doesn't
+// have fall back to SSE2.
+enum class MipKernel : u8
+{
+	Best = 0,
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+// Builds every level below the source with a gamma-correct 2x2 box filter (SSE2, or AVX2 where the CPU
+// has it), splitting the rows of each level across the job system. The source can be in any layout; it
+// is converted to RGBA8 as it is read, and RGB is treated as sRGB. Each level is filtered from the one
+// before it as stored, so the only memory used besides the chain itself is a few rows per worker.
+void BuildMipChain(const void* source, PixelLayout layout, int width, int height, MipChain* chain, MipKernel kernel = MipKernel::Best);
+void FreeMipChain(MipChain* chain);
+
+// Deep copy, freed with FreeMipChain like any other.
+void CopyMipChain(const MipChain* source, MipChain* copy);
+
+// Bytes held by the stored levels.
+u64 GetMipChainSize(const MipChain* chain);
+
+#endif //_MIP_CHAIN_H
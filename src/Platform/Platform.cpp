@@ -17,6 +17,10 @@
 // Needed for file dialogs.
 #include <shobjidl_core.h>
 
+// Process memory counters, for benchmarks.
+#include <psapi.h>
+#pragma comment(lib, "Psapi.lib")
+
 // File I/O and open/new/save dialogs.
 #include "Platform/Win32/Win32File.cpp"
 
@@ -26,4 +30,30 @@
 // Entry point and window message handler.
 #include "Platform/Win32/Win32Main.cpp"
 
+#else
+
+// POSIX platform layer. Only the pieces that don't need a window system exist so far.
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// File I/O.
+#include "Platform/Posix/PosixFile.cpp"
+
+// Batched reads of many whole files (io_uring on Linux).
+#include "Platform/Posix/PosixAsyncRead.cpp"
+
+// Stream I/O, and the error/assert reporting that the Win32 layer does with dialogs.
+#include "Platform/Posix/PosixLogger.cpp"
+
 #endif
\ No newline at end of file
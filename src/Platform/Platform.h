@@ -17,6 +17,41 @@ namespace Platform
 		DarkYellow, Yellow,
 	};
 	
+	// Read-only view of a whole file. The data pointer stays valid until UnmapFile.
+	struct MappedFile
+	{
+		void* data;
+		u64 size;
+		void* handle; // Platform specific mapping handle.
+	};
+	
+	// Advisory lock on a file, from TryLockFile. It doesn't stop anyone reading or writing the file; it
+	// only makes other TryLockFile calls on it fail until it's unlocked.
+	struct FileLock
+	{
+		void* handle; // Platform specific. Null while nothing is locked.
+	};
+	
+	// One range of a file for ReadFileRanges.
+	struct FileRange
+	{
+		u64 offset;
+		u64 size;
+		void* buffer; // Must hold size bytes.
+		u64 bytes_read; // Filled in by ReadFileRanges. Short only where the range runs past the end of the file.
+	};
+	
+	// One piece of a gathered write.
+	struct FileBuffer
+	{
+		const void* data;
+		u64 size;
+	};
+	
+	// Called by ReadFilesAsync as each file finishes, on the thread that called it. data is a malloc'd copy
+	// of the whole file that the callback takes ownership of, or null if the file couldn't be read.
+	typedef void (*FileReadCallback)(int index, void* data, u64 size, void* user_data);
+	
 	struct OpenFileResult
 	{
 		// NOTE(Matt): Both the array and each individual string it contains are heap allocated, so you
@@ -34,13 +69,51 @@ namespace Platform
 	// NOTE(Matt): Because 0 is a valid file size, this function will return -1 if the file can't be opened
 	// for whatever reason.
 	s64 GetFileSize(const char* file_path); // TODO(Matt): I don't think this supports unicode paths.
-    //void ReadFileToBuffer(const char* file_path, u8** buffer, u32* size);
-	bool ReadFileToBuffer(const char* file_path, void* buffer, u32 buffer_size);
+	// Size and last write time of a file, without opening it. The time is in platform units and is only
+	// good for telling whether a file has changed.
+	bool GetFileInfo(const char* file_path, u64* size, u64* modified_time);
+	// Absolute path with links and . and .. resolved, so different spellings of one file compare equal.
+	// Returns a malloc'd path, or null if the file doesn't exist.
+	char* GetCanonicalPath(const char* file_path);
+	// Reads the whole file into buffer. Fails if the file is bigger than buffer_size.
+	bool ReadFileToBuffer(const char* file_path, void* buffer, u64 buffer_size);
+	// Fetches several ranges of one file with positional reads, opening it once. Returns false if the file
+	// can't be opened or any read fails.
+	bool ReadFileRanges(const char* file_path, FileRange* ranges, int range_count);
+	// Creates or truncates the file, or with append adds to the end of it (creating it if need be).
 	bool WriteBufferToFile(u8* buffer, u64 size, const char* file_path, bool append);
+	// Same, but writes several buffers one after another, as if they were one.
+	bool WriteBuffersToFile(const FileBuffer* buffers, int buffer_count, const char* file_path, bool append);
+	// Reads whole files with up to queue_depth of them in flight, batching the opens, size queries, reads
+	// and closes of all of them into a few system calls. Only Linux has a backend for this (io_uring).
+	// Elsewhere, or if the kernel won't set up a ring, it returns false before calling back at all, and
+	// the caller has to read the files itself (BulkFileRead does this on the job system).
+	bool ReadFilesAsync(const char* const* file_paths, int file_count, int queue_depth, FileReadCallback callback, void* user_data);
+	// Asks the OS to drop its cached pages of a file, so the next read comes from the disk. For benchmarks;
+	// returns false where that isn't supported.
+	bool DropFileCache(const char* file_path);
+	// Most memory the process has had resident at once so far, in bytes. For benchmarks; returns 0 where
+	// that isn't supported.
+	u64 GetPeakMemoryUsage();
+	// Maps the file into memory without copying it. Returns false for missing or empty files.
+	bool MapFileForRead(const char* file_path, MappedFile* mapped_file);
+	// Maps a file for reading and writing, creating it if need be and growing it to at least size bytes (it
+	// is never shrunk, and the whole file is mapped). Writes go back to the file; UnmapFile as usual.
+	bool MapFileForWrite(const char* file_path, u64 size, MappedFile* mapped_file);
+	void UnmapFile(MappedFile* mapped_file);
+	// Takes an exclusive advisory lock on a file, creating the file if need be, without waiting. Returns
+	// false if the lock is already held, whether by another process or another FileLock in this one.
+	bool TryLockFile(const char* file_path, FileLock* lock);
+	void UnlockFile(FileLock* lock);
     //Str GetFullExecutablePath();
     //Str NormalizePath(const char* path);
 	
 	char** ShowOpenFileDialog(int* count);
+	// Folder picker. Returns a malloc'd path, or null if it was cancelled.
+	char* ShowOpenFolderDialog();
+	// Names (not paths) of the files directly inside a directory, in no particular order; subdirectories
+	// are skipped. Returns null if the directory can't be read. The caller frees each name and the array.
+	char** ListDirectory(const char* directory_path, int* count);
 	//Str ShowBasicFileDialog(int type = 0, int resource_type = -1);
 };
 #endif //_PLATFORM_H
@@ -0,0 +1,347 @@
+// Bulk whole-file reads. On Linux these go through io_uring, driven with the raw system calls so there
+// is no liburing to vendor: every file in flight goes openat + statx, then read, then close, and the
+// steps of all of them are submitted together, so a batch of small files costs a handful of
+// io_uring_enter calls instead of four system calls each.
+
+bool Platform::DropFileCache(const char* file_path)
+{
+#ifdef POSIX_FADV_DONTNEED
+	int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	bool result = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(fd);
+	return result;
+#else
+	return false;
+#endif
+}
+
+u64 Platform::GetPeakMemoryUsage()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return (u64)usage.ru_maxrss;
+#else
+	return (u64)usage.ru_maxrss * 1024; // Kilobytes everywhere else.
+#endif
+}
+
+#ifdef __linux__
+
+#define URING_MAX_QUEUE_DEPTH 256
+
+// Largest single read. Linux won't move much more than 2 GB per call anyway.
+#define URING_READ_CHUNK ((u64)1 << 30)
+
+enum class UringOp : u8
+{
+	Open = 0,
+	Statx,
+	Read,
+	Close
+};
+
+// One file in flight. Slots are reused once the file's close has completed.
+struct UringSlot
+{
+	int index; // Into the caller's paths, or -1 if the slot is free.
+	int fd;
+	int pending; // Operations submitted but not yet completed.
+	bool failed;
+	bool is_reported; // The callback has had the file, and all that's left is closing it.
+	struct statx file_stat;
+	u8* data;
+	u64 size;
+	u64 done;
+};
+
+struct Uring
+{
+	int fd;
+	u32* sq_head;
+	u32* sq_tail;
+	u32* sq_mask;
+	u32* sq_array;
+	u32* cq_head;
+	u32* cq_tail;
+	u32* cq_mask;
+	io_uring_sqe* sqes;
+	io_uring_cqe* cqes;
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	u32 sq_entries;
+	u32 unsubmitted;
+};
+
+static void CloseUring(Uring* ring)
+{
+	if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->fd >= 0) close(ring->fd);
+	*ring = {};
+	ring->fd = -1;
+}
+
+// Fails (leaving nothing to clean up) if the kernel is too old for any of the operations used here, or if
+// io_uring is disabled, which containers and hardened kernels often do.
+static bool OpenUring(Uring* ring, u32 entries)
+{
+	*ring = {};
+	io_uring_params params = {};
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) return false;
+
+	const u8 required_ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE};
+	size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+	io_uring_probe* probe = (io_uring_probe*)calloc(1, probe_size); // @malloc
+	bool is_supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+	for (int i = 0; is_supported && i < (int)ARRAYCOUNT(required_ops); ++i)
+	{
+		is_supported = required_ops[i] <= probe->last_op && (probe->ops[required_ops[i]].flags & IO_URING_OP_SUPPORTED);
+	}
+	free(probe);
+
+	// Older kernels map the two rings separately.
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool is_single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (is_single_map && ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+
+	if (is_supported)
+	{
+		ring->sq_ring = mmap(0, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+		if (ring->sq_ring == MAP_FAILED) ring->sq_ring = 0;
+	}
+	if (ring->sq_ring)
+	{
+		ring->cq_ring = is_single_map ? ring->sq_ring : mmap(0, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) ring->cq_ring = 0;
+	}
+	if (ring->cq_ring)
+	{
+		ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		ring->sqes = (io_uring_sqe*)mmap(0, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+		if (ring->sqes == MAP_FAILED) ring->sqes = 0;
+	}
+	if (!ring->sqes)
+	{
+		CloseUring(ring);
+		return false;
+	}
+
+	u8* sq = (u8*)ring->sq_ring;
+	u8* cq = (u8*)ring->cq_ring;
+	ring->sq_head = (u32*)(sq + params.sq_off.head);
+	ring->sq_tail = (u32*)(sq + params.sq_off.tail);
+	ring->sq_mask = (u32*)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (u32*)(sq + params.sq_off.array);
+	ring->cq_head = (u32*)(cq + params.cq_off.head);
+	ring->cq_tail = (u32*)(cq + params.cq_off.tail);
+	ring->cq_mask = (u32*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+	ring->sq_entries = params.sq_entries;
+	return true;
+}
+
+// The ring has two entries per slot and a slot never has more than two operations outstanding, so
+// there is always room.
+static io_uring_sqe* PushUringOp(Uring* ring, int slot_index, UringOp op)
+{
+	u32 tail = *ring->sq_tail;
+	Assert(tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) < ring->sq_entries);
+	u32 position = tail & *ring->sq_mask;
+
+	io_uring_sqe* sqe = &ring->sqes[position];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = ((u64)slot_index << 8) | (u64)op;
+	ring->sq_array[position] = position;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	++ring->unsubmitted;
+	return sqe;
+}
+
+static void PushUringRead(Uring* ring, int slot_index, UringSlot* slot)
+{
+	u64 size = slot->size - slot->done;
+	io_uring_sqe* sqe = PushUringOp(ring, slot_index, UringOp::Read);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = slot->fd;
+	sqe->addr = (u64)(uintptr_t)(slot->data + slot->done);
+	sqe->len = (u32)((size < URING_READ_CHUNK) ? size : URING_READ_CHUNK);
+	sqe->off = slot->done;
+	++slot->pending;
+}
+
+static void StartUringFile(Uring* ring, int slot_index, UringSlot* slot, int file_index, const char* file_path)
+{
+	*slot = {};
+	slot->index = file_index;
+	slot->fd = -1;
+
+	// Open and size the file at the same time; the read has to wait for both.
+	io_uring_sqe* open_sqe = PushUringOp(ring, slot_index, UringOp::Open);
+	open_sqe->opcode = IORING_OP_OPENAT;
+	open_sqe->fd = AT_FDCWD;
+	open_sqe->addr = (u64)(uintptr_t)file_path;
+	open_sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+	io_uring_sqe* statx_sqe = PushUringOp(ring, slot_index, UringOp::Statx);
+	statx_sqe->opcode = IORING_OP_STATX;
+	statx_sqe->fd = AT_FDCWD;
+	statx_sqe->addr = (u64)(uintptr_t)file_path;
+	statx_sqe->len = STATX_SIZE;
+	statx_sqe->off = (u64)(uintptr_t)&slot->file_stat;
+	slot->pending = 2;
+}
+
+// Moves a slot on to its next step. Returns true once the slot is free again.
+static bool CompleteUringOp(Uring* ring, int slot_index, UringSlot* slot, UringOp op, int result, Platform::FileReadCallback callback, void* user_data)
+{
+	--slot->pending;
+	switch (op)
+	{
+		case UringOp::Open:
+		if (result < 0) slot->failed = true;
+		else slot->fd = result;
+		break;
+
+		case UringOp::Statx:
+		if (result < 0) slot->failed = true;
+		else slot->size = slot->file_stat.stx_size;
+		break;
+
+		case UringOp::Read:
+		if (result == -EINTR || result == -EAGAIN)
+		{
+			PushUringRead(ring, slot_index, slot);
+			return false;
+		}
+		if (result < 0) slot->failed = true;
+		else if (result == 0) slot->size = slot->done; // The file shrank since it was sized.
+		else slot->done += (u64)result;
+		break;
+
+		case UringOp::Close:
+		slot->index = -1;
+		return true;
+	}
+	if (slot->pending) return false;
+
+	if (!slot->failed && op != UringOp::Read)
+	{
+		slot->data = (u8*)malloc(slot->size ? slot->size : 1); // @malloc
+		if (!slot->data) slot->failed = true;
+	}
+	if (!slot->failed && slot->done < slot->size)
+	{
+		PushUringRead(ring, slot_index, slot);
+		return false;
+	}
+
+	// Finished, one way or the other. The buffer goes to the callback before the close is even
+	// submitted, so whatever consumes it can start right away.
+	if (slot->failed)
+	{
+		free(slot->data);
+		callback(slot->index, 0, 0, user_data);
+	}
+	else
+	{
+		callback(slot->index, slot->data, slot->size, user_data);
+	}
+	slot->data = 0;
+	slot->is_reported = true;
+
+	if (slot->fd < 0)
+	{
+		slot->index = -1;
+		return true;
+	}
+	io_uring_sqe* sqe = PushUringOp(ring, slot_index, UringOp::Close);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = slot->fd;
+	slot->pending = 1;
+	return false;
+}
+
+bool Platform::ReadFilesAsync(const char* const* file_paths, int file_count, int queue_depth, FileReadCallback callback, void* user_data)
+{
+	Assert(file_paths && callback);
+	if (queue_depth < 1) queue_depth = 1;
+	if (queue_depth > URING_MAX_QUEUE_DEPTH) queue_depth = URING_MAX_QUEUE_DEPTH;
+	if (queue_depth > file_count) queue_depth = (file_count > 0) ? file_count : 1;
+
+	Uring ring;
+	if (!OpenUring(&ring, (u32)queue_depth * 2)) return false;
+
+	UringSlot* slots = (UringSlot*)malloc(sizeof(UringSlot) * queue_depth); // @malloc
+	for (int i = 0; i < queue_depth; ++i) slots[i].index = -1;
+
+	int next_file = 0;
+	int active_count = 0;
+	bool is_broken = false;
+	for (;;)
+	{
+		for (int i = 0; i < queue_depth && next_file < file_count; ++i)
+		{
+			if (slots[i].index >= 0) continue;
+			StartUringFile(&ring, i, &slots[i], next_file, file_paths[next_file]);
+			++next_file;
+			++active_count;
+		}
+		if (!active_count) break;
+
+		// Submit everything queued and wait for at least one completion, in one call.
+		int submitted = (int)syscall(__NR_io_uring_enter, ring.fd, ring.unsubmitted, 1, IORING_ENTER_GETEVENTS, 0, 0);
+		if (submitted < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+			is_broken = true;
+			break;
+		}
+		ring.unsubmitted -= (u32)submitted;
+
+		u32 head = *ring.cq_head;
+		u32 tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head)
+		{
+			io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+			int slot_index = (int)(cqe->user_data >> 8);
+			UringOp op = (UringOp)(cqe->user_data & 0xff);
+			if (CompleteUringOp(&ring, slot_index, &slots[slot_index], op, cqe->res, callback, user_data)) --active_count;
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	if (is_broken)
+	{
+		// The kernel may still write into buffers of the files in flight, so those are abandoned rather
+		// than freed. Everything not finished, whether it was still being opened, sized or read, is reported
+		// as failed.
+		for (int i = 0; i < queue_depth; ++i)
+		{
+			if (slots[i].index >= 0 && !slots[i].is_reported) callback(slots[i].index, 0, 0, user_data);
+		}
+		for (; next_file < file_count; ++next_file) callback(next_file, 0, 0, user_data);
+	}
+	else
+	{
+		free(slots);
+	}
+	CloseUring(&ring);
+	return true;
+}
+
+#else
+
+bool Platform::ReadFilesAsync(const char* const*, int, int, FileReadCallback, void*)
+{
+	return false;
+}
+
+#endif
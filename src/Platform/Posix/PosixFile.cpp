@@ -0,0 +1,307 @@
+// Linux moves at most about 2 GB per read or write call, however much is asked for, so big transfers
+// are split into chunks of this size.
+#define POSIX_IO_CHUNK_SIZE ((u64)1 << 30)
+
+// Chunks handed to one writev call.
+#define POSIX_WRITE_BATCH 64
+
+// preads until size bytes are in or the file ends. Returns the number of bytes read, or -1 on error.
+static s64 PosixReadAt(int fd, void* buffer, u64 size, u64 offset)
+{
+	u64 total = 0;
+	while (total < size)
+	{
+		u64 chunk = (size - total < POSIX_IO_CHUNK_SIZE) ? size - total : POSIX_IO_CHUNK_SIZE;
+		ssize_t count = pread(fd, (u8*)buffer + total, (size_t)chunk, (off_t)(offset + total));
+		if (count < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (count == 0) break;
+		total += (u64)count;
+	}
+	return (s64)total;
+}
+
+s64 Platform::GetFileSize(const char* file_path)
+{
+	struct stat file_stat;
+	if (stat(file_path, &file_stat) != 0) return -1;
+	return (s64)file_stat.st_size;
+}
+
+bool Platform::GetFileInfo(const char* file_path, u64* size, u64* modified_time)
+{
+	Assert(file_path && size && modified_time);
+	struct stat file_stat;
+	if (stat(file_path, &file_stat) != 0) return false;
+	*size = (u64)file_stat.st_size;
+#ifdef __APPLE__
+	*modified_time = (u64)file_stat.st_mtimespec.tv_sec * 1000000000ull + (u64)file_stat.st_mtimespec.tv_nsec;
+#else
+	*modified_time = (u64)file_stat.st_mtim.tv_sec * 1000000000ull + (u64)file_stat.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+char* Platform::GetCanonicalPath(const char* file_path)
+{
+	Assert(file_path);
+	return realpath(file_path, 0);
+}
+
+bool Platform::ReadFileToBuffer(const char* file_path, void* buffer, u64 buffer_size)
+{
+	Assert(buffer && buffer_size && file_path);
+	
+	int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	
+	bool result = false;
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) == 0 && (u64)file_stat.st_size <= buffer_size)
+	{
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+		result = PosixReadAt(fd, buffer, (u64)file_stat.st_size, 0) == (s64)file_stat.st_size;
+	}
+	close(fd);
+	return result;
+}
+
+bool Platform::ReadFileRanges(const char* file_path, FileRange* ranges, int range_count)
+{
+	Assert(file_path && (ranges || !range_count));
+	
+	int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	
+	// Announce every range before blocking on the first, so the kernel can have them all in flight at
+	// once rather than one after another.
+#ifdef POSIX_FADV_WILLNEED
+	for (int i = 0; i < range_count; ++i) posix_fadvise(fd, (off_t)ranges[i].offset, (off_t)ranges[i].size, POSIX_FADV_WILLNEED);
+#endif
+	
+	bool result = true;
+	for (int i = 0; i < range_count; ++i)
+	{
+		s64 count = PosixReadAt(fd, ranges[i].buffer, ranges[i].size, ranges[i].offset);
+		ranges[i].bytes_read = (count > 0) ? (u64)count : 0;
+		if (count < 0) result = false;
+	}
+	close(fd);
+	return result;
+}
+
+bool Platform::WriteBufferToFile(u8* buffer, u64 size, const char* file_path, bool append)
+{
+	FileBuffer file_buffer = {buffer, size};
+	return WriteBuffersToFile(&file_buffer, 1, file_path, append);
+}
+
+// Gathers up to POSIX_WRITE_BATCH chunks into each writev call, and picks up where a short write left
+// off, which can land in the middle of a buffer.
+bool Platform::WriteBuffersToFile(const FileBuffer* buffers, int buffer_count, const char* file_path, bool append)
+{
+	Assert(file_path && (buffers || !buffer_count));
+	
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+	int fd = open(file_path, flags, 0644);
+	if (fd < 0) return false;
+	
+	bool success = true;
+	int index = 0; // Next byte to write is at offset in buffers[index].
+	u64 offset = 0;
+	for (;;)
+	{
+		while (index < buffer_count && offset == buffers[index].size)
+		{
+			++index;
+			offset = 0;
+		}
+		if (index == buffer_count) break;
+		
+		struct iovec chunks[POSIX_WRITE_BATCH];
+		int chunk_count = 0;
+		u64 batch_size = 0;
+		int chunk_index = index;
+		u64 chunk_offset = offset;
+		while (chunk_index < buffer_count && chunk_count < POSIX_WRITE_BATCH && batch_size < POSIX_IO_CHUNK_SIZE)
+		{
+			u64 size = buffers[chunk_index].size - chunk_offset;
+			if (size > POSIX_IO_CHUNK_SIZE - batch_size) size = POSIX_IO_CHUNK_SIZE - batch_size;
+			if (size)
+			{
+				chunks[chunk_count].iov_base = (void*)((const u8*)buffers[chunk_index].data + chunk_offset);
+				chunks[chunk_count].iov_len = (size_t)size;
+				++chunk_count;
+				batch_size += size;
+			}
+			chunk_offset += size;
+			if (chunk_offset == buffers[chunk_index].size)
+			{
+				++chunk_index;
+				chunk_offset = 0;
+			}
+		}
+		
+		ssize_t written = writev(fd, chunks, chunk_count);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			success = false;
+			break;
+		}
+		
+		for (u64 remaining = (u64)written; remaining;)
+		{
+			u64 left = buffers[index].size - offset;
+			if (remaining < left)
+			{
+				offset += remaining;
+				remaining = 0;
+			}
+			else
+			{
+				remaining -= left;
+				++index;
+				offset = 0;
+			}
+		}
+	}
+	
+	if (close(fd) != 0) success = false;
+	return success;
+}
+
+bool Platform::MapFileForRead(const char* file_path, MappedFile* mapped_file)
+{
+	Assert(file_path && mapped_file);
+	*mapped_file = {};
+
+	int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	// The mapping holds its own reference to the file, so the descriptor can go right away.
+	void* view = mmap(0, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) return false;
+
+	// Decoders read front to back, so let the kernel read ahead aggressively.
+	madvise(view, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+
+	mapped_file->data = view;
+	mapped_file->size = (u64)file_stat.st_size;
+	return true;
+}
+
+bool Platform::MapFileForWrite(const char* file_path, u64 size, MappedFile* mapped_file)
+{
+	Assert(file_path && mapped_file && size > 0);
+	*mapped_file = {};
+
+	int fd = open(file_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) return false;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	// Growing with ftruncate leaves a hole, so the new space costs nothing on disk until it's written.
+	if ((u64)file_stat.st_size < size)
+	{
+		if (ftruncate(fd, (off_t)size) != 0)
+		{
+			close(fd);
+			return false;
+		}
+	}
+	else
+	{
+		size = (u64)file_stat.st_size;
+	}
+
+	void* view = mmap(0, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) return false;
+
+	mapped_file->data = view;
+	mapped_file->size = size;
+	return true;
+}
+
+void Platform::UnmapFile(MappedFile* mapped_file)
+{
+	Assert(mapped_file);
+	if (mapped_file->data) munmap(mapped_file->data, (size_t)mapped_file->size);
+	*mapped_file = {};
+}
+
+// flock locks belong to the open file, so the descriptor is kept open (as fd + 1, keeping null for no lock)
+// until UnlockFile, and a second open of the same file in this process conflicts like any other.
+bool Platform::TryLockFile(const char* file_path, FileLock* lock)
+{
+	Assert(file_path && lock);
+	*lock = {};
+	int fd = open(file_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) return false;
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	lock->handle = (void*)(intptr_t)(fd + 1);
+	return true;
+}
+
+void Platform::UnlockFile(FileLock* lock)
+{
+	Assert(lock);
+	if (lock->handle) close((int)(intptr_t)lock->handle - 1); // Closing drops the lock.
+	*lock = {};
+}
+
+char** Platform::ListDirectory(const char* directory_path, int* count)
+{
+	Assert(directory_path && count);
+	*count = 0;
+	DIR* directory = opendir(directory_path);
+	if (!directory) return 0;
+	
+	int capacity = 64;
+	char** result = (char**)malloc(sizeof(char*) * capacity); // @malloc
+	while (struct dirent* entry = readdir(directory))
+	{
+		// Not every file system fills in d_type.
+		bool is_file = (entry->d_type == DT_REG);
+		if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+		{
+			struct stat file_stat;
+			is_file = fstatat(dirfd(directory), entry->d_name, &file_stat, 0) == 0 && S_ISREG(file_stat.st_mode);
+		}
+		if (!is_file) continue;
+		
+		if (*count == capacity)
+		{
+			capacity *= 2;
+			result = (char**)realloc(result, sizeof(char*) * capacity);
+		}
+		size_t name_size = strlen(entry->d_name) + 1;
+		result[*count] = (char*)malloc(name_size); // @malloc
+		memcpy(result[*count], entry->d_name, name_size);
+		++*count;
+	}
+	closedir(directory);
+	return result;
+}
@@ -0,0 +1,109 @@
+// Standard stream output for POSIX. There are no dialogs without a window system, so the dialog calls
+// report on stderr instead.
+
+// ANSI escape number for a console color, as a foreground color; backgrounds are 10 higher.
+static int PosixGetColorCode(Platform::ConsoleColor color)
+{
+	switch (color)
+	{
+		case Platform::ConsoleColor::Black: return 30;
+		case Platform::ConsoleColor::White: return 97;
+		case Platform::ConsoleColor::DarkGrey: return 90;
+		case Platform::ConsoleColor::Grey: return 37;
+		case Platform::ConsoleColor::DarkRed: return 31;
+		case Platform::ConsoleColor::Red: return 91;
+		case Platform::ConsoleColor::DarkGreen: return 32;
+		case Platform::ConsoleColor::Green: return 92;
+		case Platform::ConsoleColor::DarkBlue: return 34;
+		case Platform::ConsoleColor::Blue: return 94;
+		case Platform::ConsoleColor::DarkCyan: return 36;
+		case Platform::ConsoleColor::Cyan: return 96;
+		case Platform::ConsoleColor::DarkPurple: return 35;
+		case Platform::ConsoleColor::Purple: return 95;
+		case Platform::ConsoleColor::DarkYellow: return 33;
+		case Platform::ConsoleColor::Yellow: return 93;
+		default: return 39;
+	}
+}
+
+// Colors only go to terminals, so redirected output stays plain text. Grey on black is treated as the
+// terminal's own default rather than forced on it.
+static void PosixPrintToStream(const char* message, FILE* stream, Platform::ConsoleColor text_color, Platform::ConsoleColor background_color)
+{
+	bool is_default = (text_color == Platform::ConsoleColor::Grey && background_color == Platform::ConsoleColor::Black);
+	if (is_default || !isatty(fileno(stream)))
+	{
+		fputs(message, stream);
+		return;
+	}
+
+	if (background_color == Platform::ConsoleColor::Black) fprintf(stream, "\x1b[%dm%s\x1b[0m", PosixGetColorCode(text_color), message);
+	else fprintf(stream, "\x1b[%d;%dm%s\x1b[0m", PosixGetColorCode(text_color), PosixGetColorCode(background_color) + 10, message);
+}
+
+// Linux reports a tracer in /proc; anywhere that doesn't, asserts just abort.
+static bool PosixIsDebuggerPresent()
+{
+	FILE* status = fopen("/proc/self/status", "r");
+	if (!status) return false;
+
+	bool is_traced = false;
+	char line[256];
+	while (fgets(line, sizeof(line), status))
+	{
+		if (strncmp(line, "TracerPid:", 10) == 0)
+		{
+			is_traced = atoi(line + 10) != 0;
+			break;
+		}
+	}
+	fclose(status);
+	return is_traced;
+}
+
+void Platform::PrintMessage(const char* message, Platform::ConsoleColor text_color, Platform::ConsoleColor background_color)
+{
+	PosixPrintToStream(message, stdout, text_color, background_color);
+}
+
+void Platform::PrintError(const char* message, Platform::ConsoleColor text_color, Platform::ConsoleColor background_color)
+{
+	PosixPrintToStream(message, stderr, text_color, background_color);
+}
+
+void Platform::FatalError(const char* message, ...)
+{
+	const size_t output_buffer_size = 4096;
+	char output_buffer[output_buffer_size];
+	va_list args;
+	va_start(args, message);
+	vsnprintf(output_buffer, output_buffer_size, message, args);
+	va_end(args);
+	Platform::ShowErrorDialog(output_buffer);
+	exit(-1);
+}
+
+// Breaks into the debugger if there is one, the way Retry does on Windows, and aborts otherwise.
+bool Platform::ShowAssertDialog(const char* message, const char* file, u32 line)
+{
+	const size_t output_buffer_size = 4096;
+	char buf[output_buffer_size];
+	snprintf(buf, output_buffer_size,
+			 "Assertion Failed!\n"
+			 "    File: %s\n"
+			 "    Line: %u\n"
+			 "    Statement: ASSERT(%s)\n",
+			 file, line, message);
+	PrintError(buf);
+	fflush(stderr);
+
+	if (PosixIsDebuggerPresent()) return true;
+	abort();
+}
+
+void Platform::ShowErrorDialog(const char* message)
+{
+	PrintError("Error: ");
+	PrintError(message);
+	PrintError("\n");
+}
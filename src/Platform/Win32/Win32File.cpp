@@ -1,23 +1,66 @@
+// ReadFile and WriteFile take DWORD sizes, so big transfers are split into chunks of this size.
+#define WIN32_IO_CHUNK_SIZE ((u64)1 << 30)
 
-bool Platform::ReadFileToBuffer(const char* file_path, void* buffer, u32 buffer_size)
+// Reads until size bytes are in or the file ends, at offset if one is given and from the file pointer
+// otherwise. Returns the number of bytes read, or -1 on error.
+static s64 Win32ReadFile(HANDLE handle, void* buffer, u64 size, const u64* offset)
+{
+	u64 total = 0;
+	while (total < size)
+	{
+		DWORD chunk = (DWORD)((size - total < WIN32_IO_CHUNK_SIZE) ? size - total : WIN32_IO_CHUNK_SIZE);
+		OVERLAPPED position = {};
+		if (offset)
+		{
+			// On a synchronous handle, the offset in an OVERLAPPED just makes this a positional read.
+			u64 at = *offset + total;
+			position.Offset = (DWORD)at;
+			position.OffsetHigh = (DWORD)(at >> 32);
+		}
+		DWORD count = 0;
+		if (!ReadFile(handle, (u8*)buffer + total, chunk, &count, offset ? &position : 0))
+		{
+			if (GetLastError() == ERROR_HANDLE_EOF) break;
+			return -1;
+		}
+		if (count == 0) break;
+		total += count;
+	}
+	return (s64)total;
+}
+
+bool Platform::ReadFileToBuffer(const char* file_path, void* buffer, u64 buffer_size)
 {
 	Assert(buffer && buffer_size && file_path);
 	
+    HANDLE handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	
 	bool result = false;
+	LARGE_INTEGER file_size;
+	if (GetFileSizeEx(handle, &file_size) && (u64)file_size.QuadPart <= buffer_size)
+	{
+		result = Win32ReadFile(handle, buffer, (u64)file_size.QuadPart, 0) == file_size.QuadPart;
+	}
+	CloseHandle(handle);
+	return result;
+}
+
+bool Platform::ReadFileRanges(const char* file_path, FileRange* ranges, int range_count)
+{
+	Assert(file_path && (ranges || !range_count));
 	
-    HANDLE handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	HANDLE handle = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, 0);
+	if (handle == INVALID_HANDLE_VALUE) return false;
 	
-    if (handle != INVALID_HANDLE_VALUE)
+	bool result = true;
+	for (int i = 0; i < range_count; ++i)
 	{
-		LARGE_INTEGER file_size;
-		if (GetFileSizeEx(handle, &file_size))
-		{
-			Assert(buffer_size >= file_size.QuadPart);
-			DWORD dummy;
-			result = ReadFile(handle, buffer, buffer_size, &dummy, 0);
-			CloseHandle(handle);
-		}
+		s64 count = Win32ReadFile(handle, ranges[i].buffer, ranges[i].size, &ranges[i].offset);
+		ranges[i].bytes_read = (count > 0) ? (u64)count : 0;
+		if (count < 0) result = false;
 	}
+	CloseHandle(handle);
 	return result;
 }
 
@@ -38,39 +81,203 @@ s64 Platform::GetFileSize(const char* file_path)
 	return result;
 }
 
+bool Platform::GetFileInfo(const char* file_path, u64* size, u64* modified_time)
+{
+	Assert(file_path && size && modified_time);
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(file_path, GetFileExInfoStandard, &attributes)) return false;
+	*size = ((u64)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	*modified_time = ((u64)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+char* Platform::GetCanonicalPath(const char* file_path)
+{
+	Assert(file_path);
+	// The handle's final path has links resolved and the case each name has on disk, which the path it
+	// was opened by might not.
+	HANDLE handle = CreateFileA(file_path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (handle == INVALID_HANDLE_VALUE) return 0;
+	char* result = 0;
+	DWORD length = GetFinalPathNameByHandleA(handle, 0, 0, FILE_NAME_NORMALIZED);
+	if (length)
+	{
+		result = (char*)malloc(length); // @malloc
+		if (GetFinalPathNameByHandleA(handle, result, length, FILE_NAME_NORMALIZED) >= length)
+		{
+			free(result);
+			result = 0;
+		}
+	}
+	CloseHandle(handle);
+	return result;
+}
+
 bool Platform::WriteBufferToFile(u8* buffer, u64 size, const char* file_path, bool append)
 {
+	FileBuffer file_buffer = {buffer, size};
+	return WriteBuffersToFile(&file_buffer, 1, file_path, append);
+}
+
+bool Platform::WriteBuffersToFile(const FileBuffer* buffers, int buffer_count, const char* file_path, bool append)
+{
+	Assert(file_path && (buffers || !buffer_count));
+	
+	// Appending opens whatever is there (or creates it) and writes from the end; otherwise the file starts
+	// over.
 	u32 open_mode = GENERIC_WRITE;
-	u32 share_mode = 0;
-	u32 create_mode = (append) ? CREATE_ALWAYS : OPEN_ALWAYS;
+	u32 create_mode = (append) ? OPEN_ALWAYS : CREATE_ALWAYS;
 	u32 flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
-	void* handle = CreateFileA(file_path, open_mode, 0, 0, create_mode, flags, 0);
+	HANDLE handle = CreateFileA(file_path, open_mode, 0, 0, create_mode, flags, 0);
+	if (handle == INVALID_HANDLE_VALUE) return false;
 	
-	bool success = (handle != INVALID_HANDLE_VALUE);
-    
-	if (success)
+	bool success = true;
+	if (append)
 	{
-		DWORD dummy; // Unused, but Win32 says we have to pass this to WriteFile.
-		
-		u32 count = (u32)(size / U32_MAX);
-		u32 mod = size % U32_MAX;
-		
-		for (u32 i = 0; i < count; ++i)
+		LARGE_INTEGER zero = {};
+		success = SetFilePointerEx(handle, zero, 0, FILE_END) != 0;
+	}
+	
+	for (int i = 0; success && i < buffer_count; ++i)
+	{
+		const u8* data = (const u8*)buffers[i].data;
+		for (u64 offset = 0; success && offset < buffers[i].size;)
 		{
-			if (!WriteFile(handle, buffer + (u64)(i * U32_MAX), U32_MAX, &dummy, 0))
-			{
-				success = false;
-				break;
-			}
+			DWORD chunk = (DWORD)((buffers[i].size - offset < WIN32_IO_CHUNK_SIZE) ? buffers[i].size - offset : WIN32_IO_CHUNK_SIZE);
+			DWORD written = 0;
+			success = WriteFile(handle, data + offset, chunk, &written, 0) && written == chunk;
+			offset += chunk;
 		}
-		
-		if (success && !WriteFile(handle, buffer + (u64)(U32_MAX * count), mod, &dummy, 0)) success = false;
-		CloseHandle(handle);
 	}
 	
+	CloseHandle(handle);
 	return success;
 }
 
+// No IOCP backend, by design. What io_uring saves on Linux is the system calls around each read, and with
+// overlapped I/O the opens, size queries and closes would still be one call per file, so it would do
+// little more than BulkFileRead already does by reading on several job system threads. Returning false
+// sends it down that path.
+bool Platform::ReadFilesAsync(const char* const*, int, int, FileReadCallback, void*)
+{
+	return false;
+}
+
+bool Platform::DropFileCache(const char*)
+{
+	return false;
+}
+
+u64 Platform::GetPeakMemoryUsage()
+{
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return (u64)counters.PeakWorkingSetSize;
+}
+
+bool Platform::MapFileForRead(const char* file_path, MappedFile* mapped_file)
+{
+	Assert(file_path && mapped_file);
+	*mapped_file = {};
+
+	HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	// The mapping object keeps its own reference to the file, so the file handle can go right away.
+	HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	CloseHandle(file);
+	if (!mapping) return false;
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	mapped_file->data = view;
+	mapped_file->size = (u64)file_size.QuadPart;
+	mapped_file->handle = mapping;
+	return true;
+}
+
+bool Platform::MapFileForWrite(const char* file_path, u64 size, MappedFile* mapped_file)
+{
+	Assert(file_path && mapped_file && size > 0);
+	*mapped_file = {};
+
+	HANDLE file = CreateFileA(file_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	if ((u64)file_size.QuadPart > size) size = (u64)file_size.QuadPart;
+
+	// Creating the mapping bigger than the file grows the file to match.
+	HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), 0);
+	CloseHandle(file);
+	if (!mapping) return false;
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	mapped_file->data = view;
+	mapped_file->size = size;
+	mapped_file->handle = mapping;
+	return true;
+}
+
+void Platform::UnmapFile(MappedFile* mapped_file)
+{
+	Assert(mapped_file);
+	if (mapped_file->data) UnmapViewOfFile(mapped_file->data);
+	if (mapped_file->handle) CloseHandle((HANDLE)mapped_file->handle);
+	*mapped_file = {};
+}
+
+// Byte range locks on Windows are enforced on reads and writes, so the lock is taken on a byte far past the
+// end of the file, where it gets in the way of nothing but other locks. The handle only reads, and shares
+// writing, so MapFileForWrite can still open the file while it's held.
+bool Platform::TryLockFile(const char* file_path, FileLock* lock)
+{
+	Assert(file_path && lock);
+	*lock = {};
+	HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = 0xFFFFFFFE;
+	overlapped.OffsetHigh = 0x7FFFFFFF;
+	if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	lock->handle = file;
+	return true;
+}
+
+void Platform::UnlockFile(FileLock* lock)
+{
+	Assert(lock);
+	if (lock->handle) CloseHandle((HANDLE)lock->handle); // Closing drops the lock.
+	*lock = {};
+}
+
 #if 0
 Str Platform::GetFullExecutablePath()
 {
@@ -262,6 +469,80 @@ char** Platform::ShowOpenFileDialog(int* count)
 	}
 	return result;
 }
+
+char* Platform::ShowOpenFolderDialog()
+{
+	char* result = 0;
+	
+	int success = CoInitializeEx(0, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+	if (success >= 0)
+	{
+		IFileOpenDialog *open_dialog;
+		success = CoCreateInstance(CLSID_FileOpenDialog, 0, CLSCTX_ALL, IID_IFileOpenDialog, (void**)&open_dialog);
+		if (success >= 0)
+		{
+			FILEOPENDIALOGOPTIONS flags = 0;
+			success = open_dialog->GetOptions(&flags);
+			if (success >= 0) success = open_dialog->SetOptions(flags | FOS_FORCEFILESYSTEM | FOS_PICKFOLDERS);
+			if (success >= 0) success = open_dialog->Show(NULL);
+			
+			IShellItem* item = 0;
+			if (success >= 0) success = open_dialog->GetResult(&item);
+			if (success >= 0)
+			{
+				wchar_t* wide_path;
+				success = item->GetDisplayName(SIGDN_FILESYSPATH, &wide_path);
+				if (success >= 0)
+				{
+					int size = WideCharToMultiByte(CP_UTF8, 0, wide_path, -1, 0, 0, 0, 0);
+					result = (char*)malloc(size + 1); // @malloc
+					WideCharToMultiByte(CP_UTF8, 0, wide_path, -1, result, size, 0, 0);
+					result[size] = 0;
+					CoTaskMemFree(wide_path);
+				}
+				item->Release();
+			}
+			open_dialog->Release();
+		}
+		
+		CoUninitialize();
+	}
+	return result;
+}
+
+char** Platform::ListDirectory(const char* directory_path, int* count)
+{
+	Assert(directory_path && count);
+	*count = 0;
+	
+	char pattern[MAX_PATH];
+	size_t length = strlen(directory_path);
+	bool has_separator = length && (directory_path[length - 1] == '\\' || directory_path[length - 1] == '/');
+	if (snprintf(pattern, sizeof(pattern), "%s%s*", directory_path, has_separator ? "" : "\\") >= (int)sizeof(pattern)) return 0;
+	
+	WIN32_FIND_DATAA find_data;
+	HANDLE find = FindFirstFileExA(pattern, FindExInfoBasic, &find_data, FindExSearchNameMatch, 0, FIND_FIRST_EX_LARGE_FETCH);
+	if (find == INVALID_HANDLE_VALUE) return 0;
+	
+	int capacity = 64;
+	char** result = (char**)malloc(sizeof(char*) * capacity); // @malloc
+	do
+	{
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+		if (*count == capacity)
+		{
+			capacity *= 2;
+			result = (char**)realloc(result, sizeof(char*) * capacity);
+		}
+		size_t name_size = strlen(find_data.cFileName) + 1;
+		result[*count] = (char*)malloc(name_size); // @malloc
+		memcpy(result[*count], find_data.cFileName, name_size);
+		++*count;
+	}
+	while (FindNextFileA(find, &find_data));
+	FindClose(find);
+	return result;
+}
 /*
 bool Win32ShowBasicFileDialog()
 {
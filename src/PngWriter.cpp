@@ -0,0 +1,405 @@
+#include "PngWriter.h"
+#include "Core/CpuFeatures.h"
+#include "Core/JobSystem.h"
+
+enum class PngFilter : u8
+{
+	None = 0,
+	Sub,
+	Up,
+	Average,
+	Paeth,
+	Count
+};
+
+static void PutU32BigEndian(u8* dst, u32 value)
+{
+	dst[0] = (u8)(value >> 24);
+	dst[1] = (u8)(value >> 16);
+	dst[2] = (u8)(value >> 8);
+	dst[3] = (u8)value;
+}
+
+static bool WritePngChunk(EncoderFile* file, const char* type, const u8* data, u32 size, u32 crc)
+{
+	u8 header[8];
+	PutU32BigEndian(header, size);
+	memcpy(header + 4, type, 4);
+	u8 footer[4];
+	PutU32BigEndian(footer, crc);
+	WriteEncoderFile(file, header, 8);
+	WriteEncoderFile(file, data, size);
+	return WriteEncoderFile(file, footer, 4);
+}
+
+static u32 GetPngChunkCrc(const char* type, const u8* data, size_t size)
+{
+	return ComputeCrc32(ComputeCrc32(0, (const u8*)type, 4), data, size);
+}
+
+static u8 PredictPaeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return (u8)a;
+	return (u8)((pb <= pc) ? b : c);
+}
+
+// Filter residuals are scored as signed bytes, so 0xFF counts as 1, not 255.
+static u32 GetSignedByteMagnitude(u8 value)
+{
+	return (value < 128) ? value : 256 - value;
+}
+
+// Computes the four predictive filters for bytes [begin, end) of the row and adds up their scores
+// (and the score of the unfiltered row) into sums.
+static void FilterPngRowScalar(const u8* raw, const u8* prior, int bpp, size_t begin, size_t end, u8** filtered, u64* sums)
+{
+	for (size_t x = begin; x < end; ++x)
+	{
+		int a = (x >= (size_t)bpp) ? raw[x - bpp] : 0;
+		int b = prior[x];
+		int c = (x >= (size_t)bpp) ? prior[x - bpp] : 0;
+		u8 sub = (u8)(raw[x] - a);
+		u8 up = (u8)(raw[x] - b);
+		u8 average = (u8)(raw[x] - ((a + b) >> 1));
+		u8 paeth = (u8)(raw[x] - PredictPaeth(a, b, c));
+		filtered[0][x] = sub;
+		filtered[1][x] = up;
+		filtered[2][x] = average;
+		filtered[3][x] = paeth;
+		sums[(int)PngFilter::None] += GetSignedByteMagnitude(raw[x]);
+		sums[(int)PngFilter::Sub] += GetSignedByteMagnitude(sub);
+		sums[(int)PngFilter::Up] += GetSignedByteMagnitude(up);
+		sums[(int)PngFilter::Average] += GetSignedByteMagnitude(average);
+		sums[(int)PngFilter::Paeth] += GetSignedByteMagnitude(paeth);
+	}
+}
+
+#ifdef CORE_SIMD_X86
+static __m128i GetSignedByteMagnitudesSSE2(__m128i value)
+{
+	return _mm_min_epu8(value, _mm_sub_epi8(_mm_setzero_si128(), value));
+}
+
+// Paeth predictor for eight 16-bit lanes. With p = a + b - c, |p - a| = |b - c|, |p - b| = |a - c| and
+// |p - c| = |(b - c) + (a - c)|, so nothing needs more than 16 bits.
+static __m128i PredictPaethSSE2(__m128i a, __m128i b, __m128i c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i dist_b = _mm_sub_epi16(b, c);
+	__m128i dist_a = _mm_sub_epi16(a, c);
+	__m128i pc = _mm_add_epi16(dist_b, dist_a);
+	__m128i pa = _mm_max_epi16(dist_b, _mm_sub_epi16(zero, dist_b));
+	__m128i pb = _mm_max_epi16(dist_a, _mm_sub_epi16(zero, dist_a));
+	pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+	__m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+	__m128i use_c = _mm_cmpgt_epi16(pb, pc);
+	__m128i b_or_c = _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, b));
+	return _mm_or_si128(_mm_and_si128(not_a, b_or_c), _mm_andnot_si128(not_a, a));
+}
+
+// Sixteen bytes at a time from x = bpp on. Every filter reads only unfiltered bytes, so there is no
+// dependency between iterations: the left neighbors are just another unaligned load. Returns where the
+// scalar code has to take over.
+static size_t FilterPngRowSSE2(const u8* raw, const u8* prior, int bpp, size_t size, u8** filtered, u64* sums)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i totals[(int)PngFilter::Count];
+	for (int i = 0; i < (int)PngFilter::Count; ++i) totals[i] = zero;
+
+	size_t x = bpp;
+	for (; x + 16 <= size; x += 16)
+	{
+		__m128i r = _mm_loadu_si128((const __m128i*)(raw + x));
+		__m128i a = _mm_loadu_si128((const __m128i*)(raw + x - bpp));
+		__m128i b = _mm_loadu_si128((const __m128i*)(prior + x));
+		__m128i c = _mm_loadu_si128((const __m128i*)(prior + x - bpp));
+
+		__m128i sub = _mm_sub_epi8(r, a);
+		__m128i up = _mm_sub_epi8(r, b);
+		// _mm_avg_epu8 rounds up; PNG's average rounds down.
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		average = _mm_sub_epi8(r, average);
+		__m128i paeth_lo = PredictPaethSSE2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+		__m128i paeth_hi = PredictPaethSSE2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+		__m128i paeth = _mm_sub_epi8(r, _mm_packus_epi16(paeth_lo, paeth_hi));
+
+		_mm_storeu_si128((__m128i*)(filtered[0] + x), sub);
+		_mm_storeu_si128((__m128i*)(filtered[1] + x), up);
+		_mm_storeu_si128((__m128i*)(filtered[2] + x), average);
+		_mm_storeu_si128((__m128i*)(filtered[3] + x), paeth);
+
+		totals[(int)PngFilter::None] = _mm_add_epi64(totals[(int)PngFilter::None], _mm_sad_epu8(GetSignedByteMagnitudesSSE2(r), zero));
+		totals[(int)PngFilter::Sub] = _mm_add_epi64(totals[(int)PngFilter::Sub], _mm_sad_epu8(GetSignedByteMagnitudesSSE2(sub), zero));
+		totals[(int)PngFilter::Up] = _mm_add_epi64(totals[(int)PngFilter::Up], _mm_sad_epu8(GetSignedByteMagnitudesSSE2(up), zero));
+		totals[(int)PngFilter::Average] = _mm_add_epi64(totals[(int)PngFilter::Average], _mm_sad_epu8(GetSignedByteMagnitudesSSE2(average), zero));
+		totals[(int)PngFilter::Paeth] = _mm_add_epi64(totals[(int)PngFilter::Paeth], _mm_sad_epu8(GetSignedByteMagnitudesSSE2(paeth), zero));
+	}
+
+	for (int i = 0; i < (int)PngFilter::Count; ++i)
+	{
+		u64 halves[2];
+		_mm_storeu_si128((__m128i*)halves, totals[i]);
+		sums[i] += halves[0] + halves[1];
+	}
+	return x;
+}
+#endif
+
+// Writes the filter type byte and the filtered row to dst, using whichever filter scores lowest.
+// scratch needs room for four rows.
+static void FilterPngRow(const u8* raw, const u8* prior, size_t size, int bpp, u8* scratch, u8* dst)
+{
+	u8* filtered[4] = {scratch, scratch + size, scratch + size * 2, scratch + size * 3};
+	u64 sums[(int)PngFilter::Count] = {};
+
+	size_t first = ((size_t)bpp < size) ? bpp : size;
+	FilterPngRowScalar(raw, prior, bpp, 0, first, filtered, sums);
+#ifdef CORE_SIMD_X86
+	size_t x = FilterPngRowSSE2(raw, prior, bpp, size, filtered, sums);
+	if (x < first) x = first;
+#else
+	size_t x = first;
+#endif
+	FilterPngRowScalar(raw, prior, bpp, x, size, filtered, sums);
+
+	int best = 0;
+	for (int i = 1; i < (int)PngFilter::Count; ++i)
+	{
+		if (sums[i] < sums[best]) best = i;
+	}
+	dst[0] = (u8)best;
+	memcpy(dst + 1, (best == (int)PngFilter::None) ? raw : filtered[best - 1], size);
+}
+
+static void SwapBytes16(const u8* src, size_t size, u8* dst)
+{
+	for (size_t i = 0; i + 1 < size; i += 2)
+	{
+		dst[i] = src[i + 1];
+		dst[i + 1] = src[i];
+	}
+}
+
+struct PngFilterJob
+{
+	PngWriter* writer;
+	const u8* rows;
+	size_t stride;
+	u8* dst;
+};
+
+// ParallelFor callback: filters rows [begin, end) of one WritePngRows call.
+static void FilterPngRows(int begin, int end, void* data)
+{
+	PngFilterJob* job = (PngFilterJob*)data;
+	PngWriter* writer = job->writer;
+	size_t size = writer->row_size;
+	int bpp = writer->channel_count * writer->bit_depth / 8;
+	bool is_16_bit = (writer->bit_depth == 16);
+
+	u8* scratch = (u8*)malloc(size * (is_16_bit ? 6 : 4)); // @malloc
+	u8* swapped_raw = scratch + size * 4;
+	u8* swapped_prior = scratch + size * 5;
+	for (int y = begin; y < end; ++y)
+	{
+		const u8* raw = job->rows + (size_t)y * job->stride;
+		const u8* prior = (y == 0) ? writer->previous_row : job->rows + (size_t)(y - 1) * job->stride;
+		if (is_16_bit)
+		{
+			// PNG samples are big endian. previous_row is stored swapped already.
+			SwapBytes16(raw, size, swapped_raw);
+			if (y > 0) SwapBytes16(prior, size, swapped_prior);
+			raw = swapped_raw;
+			if (y > 0) prior = swapped_prior;
+		}
+		FilterPngRow(raw, prior, size, bpp, scratch, job->dst + (size_t)y * (size + 1));
+	}
+	free(scratch);
+}
+
+struct PngCompressJob
+{
+	PngWriter* writer;
+	size_t data_size; // Filtered bytes in this band.
+};
+
+// ParallelFor callback: deflates chunks [begin, end) of the pending band.
+static void CompressPngChunks(int begin, int end, void* data)
+{
+	PngCompressJob* job = (PngCompressJob*)data;
+	PngWriter* writer = job->writer;
+	const u8* band = writer->filtered + writer->dict_size;
+	for (int i = begin; i < end; ++i)
+	{
+		size_t start = (size_t)i * PNG_CHUNK_SIZE;
+		size_t size = job->data_size - start;
+		if (size > PNG_CHUNK_SIZE) size = PNG_CHUNK_SIZE;
+		size_t dict_size = writer->dict_size + start;
+		if (dict_size > DEFLATE_WINDOW_SIZE) dict_size = DEFLATE_WINDOW_SIZE;
+
+		DeflateOutput* out = &writer->chunk_outputs[i];
+		out->size = 0;
+		if (i == 0 && !writer->is_stream_started)
+		{
+			// zlib header: deflate with a 32K window, no preset dictionary, level hint in FLG.
+			int level = writer->compress_level;
+			u8 flags = (level <= 1) ? 0x01 : ((level <= 5) ? 0x5E : ((level == 6) ? 0x9C : 0xDA));
+			const u8 header[2] = {0x78, flags};
+			AppendDeflateOutput(out, header, 2);
+		}
+		DeflateChunk(band + start, dict_size, size, writer->compress_level, out);
+		writer->chunk_crcs[i] = GetPngChunkCrc("IDAT", out->data, out->size);
+		writer->chunk_adlers[i] = ComputeAdler32(1, band + start, size);
+	}
+}
+
+// Compresses and writes every pending row, then keeps the tail of the data as the next dictionary.
+static void FlushPngBand(PngWriter* writer)
+{
+	size_t data_size = (size_t)writer->pending_rows * (writer->row_size + 1);
+	if (!data_size) return;
+
+	int chunk_count = (int)((data_size + PNG_CHUNK_SIZE - 1) / PNG_CHUNK_SIZE);
+	if (chunk_count > writer->chunk_capacity)
+	{
+		writer->chunk_outputs = (DeflateOutput*)realloc(writer->chunk_outputs, sizeof(DeflateOutput) * chunk_count); // @malloc
+		writer->chunk_crcs = (u32*)realloc(writer->chunk_crcs, sizeof(u32) * chunk_count); // @malloc
+		writer->chunk_adlers = (u32*)realloc(writer->chunk_adlers, sizeof(u32) * chunk_count); // @malloc
+		for (int i = writer->chunk_capacity; i < chunk_count; ++i) writer->chunk_outputs[i] = {};
+		writer->chunk_capacity = chunk_count;
+	}
+
+	PngCompressJob job = {writer, data_size};
+	ParallelFor(chunk_count, 1, CompressPngChunks, &job);
+	writer->is_stream_started = true;
+
+	for (int i = 0; i < chunk_count; ++i)
+	{
+		DeflateOutput* out = &writer->chunk_outputs[i];
+		WritePngChunk(&writer->file, "IDAT", out->data, (u32)out->size, writer->chunk_crcs[i]);
+		size_t size = (i == chunk_count - 1) ? data_size - (size_t)i * PNG_CHUNK_SIZE : PNG_CHUNK_SIZE;
+		writer->adler = CombineAdler32(writer->adler, writer->chunk_adlers[i], size);
+	}
+
+	size_t total = writer->dict_size + data_size;
+	size_t dict_size = (total < DEFLATE_WINDOW_SIZE) ? total : DEFLATE_WINDOW_SIZE;
+	memmove(writer->filtered, writer->filtered + total - dict_size, dict_size);
+	writer->dict_size = dict_size;
+	writer->pending_rows = 0;
+}
+
+bool BeginPngWrite(PngWriter* writer, const char* file_path, int width, int height, int channel_count, int bit_depth, int compress_level)
+{
+	assert(writer && file_path);
+	*writer = {};
+	if (width <= 0 || height <= 0 || channel_count < 1 || channel_count > 4 || (bit_depth != 8 && bit_depth != 16)) return false;
+
+	if (!OpenEncoderFile(&writer->file, file_path)) return false;
+
+	writer->width = width;
+	writer->height = height;
+	writer->channel_count = channel_count;
+	writer->bit_depth = bit_depth;
+	writer->compress_level = (compress_level >= 1 && compress_level <= DEFLATE_MAX_LEVEL) ? compress_level : PNG_DEFAULT_COMPRESS_LEVEL;
+	writer->row_size = (size_t)width * channel_count * (bit_depth / 8);
+	writer->adler = 1;
+
+	// Enough rows per band to give every thread a few chunks to work on.
+	size_t band_size = (size_t)PNG_CHUNK_SIZE * (GetJobWorkerCount() + 1) * 4;
+	size_t rows = band_size / (writer->row_size + 1);
+	writer->band_rows = (rows > 0) ? (int)((rows < (size_t)height) ? rows : height) : 1;
+	writer->previous_row = (u8*)calloc(1, writer->row_size); // @malloc
+	writer->filtered = (u8*)malloc(DEFLATE_WINDOW_SIZE + (size_t)writer->band_rows * (writer->row_size + 1)); // @malloc
+
+	static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	static const u8 color_types[4] = {0, 4, 2, 6}; // Gray, gray + alpha, RGB, RGBA.
+	u8 header[13];
+	PutU32BigEndian(header, width);
+	PutU32BigEndian(header + 4, height);
+	header[8] = (u8)bit_depth;
+	header[9] = color_types[channel_count - 1];
+	header[10] = 0; // Deflate.
+	header[11] = 0; // Adaptive filtering.
+	header[12] = 0; // Not interlaced.
+	WriteEncoderFile(&writer->file, signature, 8);
+	return WritePngChunk(&writer->file, "IHDR", header, 13, GetPngChunkCrc("IHDR", header, 13));
+}
+
+bool WritePngRows(PngWriter* writer, const void* rows, int row_count, size_t stride)
+{
+	assert(writer && rows);
+	if (!writer->file.file || writer->file.has_error) return false;
+	if (row_count > writer->height - writer->rows_written) row_count = writer->height - writer->rows_written;
+
+	const u8* src = (const u8*)rows;
+	while (row_count > 0)
+	{
+		int count = writer->band_rows - writer->pending_rows;
+		if (count > row_count) count = row_count;
+
+		PngFilterJob job = {writer, src, stride, writer->filtered + writer->dict_size + (size_t)writer->pending_rows * (writer->row_size + 1)};
+		ParallelFor(count, 4, FilterPngRows, &job);
+
+		const u8* last_row = src + (size_t)(count - 1) * stride;
+		if (writer->bit_depth == 16) SwapBytes16(last_row, writer->row_size, writer->previous_row);
+		else memcpy(writer->previous_row, last_row, writer->row_size);
+
+		writer->pending_rows += count;
+		writer->rows_written += count;
+		if (writer->pending_rows == writer->band_rows) FlushPngBand(writer);
+
+		src += (size_t)count * stride;
+		row_count -= count;
+	}
+	return !writer->file.has_error;
+}
+
+bool EndPngWrite(PngWriter* writer)
+{
+	assert(writer);
+	if (!writer->file.file) return false;
+
+	bool is_complete = (!writer->file.has_error && writer->rows_written == writer->height);
+	if (is_complete)
+	{
+		FlushPngBand(writer);
+
+		// The stream ends with an empty final block and the Adler-32 of everything that was compressed.
+		DeflateOutput tail = {};
+		DeflateFinish(&tail);
+		u8 adler[4];
+		PutU32BigEndian(adler, writer->adler);
+		AppendDeflateOutput(&tail, adler, 4);
+		WritePngChunk(&writer->file, "IDAT", tail.data, (u32)tail.size, GetPngChunkCrc("IDAT", tail.data, tail.size));
+		FreeDeflateOutput(&tail);
+		WritePngChunk(&writer->file, "IEND", 0, 0, GetPngChunkCrc("IEND", 0, 0));
+	}
+	bool success = CloseEncoderFile(&writer->file, is_complete);
+
+	for (int i = 0; i < writer->chunk_capacity; ++i) FreeDeflateOutput(&writer->chunk_outputs[i]);
+	free(writer->chunk_outputs);
+	free(writer->chunk_crcs);
+	free(writer->chunk_adlers);
+	free(writer->previous_row);
+	free(writer->filtered);
+	*writer = {};
+	return success;
+}
+
+bool WritePng(const char* file_path, const void* pixels, int width, int height, int channel_count, int bit_depth, size_t stride, int compress_level)
+{
+	PngWriter writer;
+	if (!BeginPngWrite(&writer, file_path, width, height, channel_count, bit_depth, compress_level))
+	{
+		EndPngWrite(&writer);
+		return false;
+	}
+	WritePngRows(&writer, pixels, height, stride);
+	return EndPngWrite(&writer);
+}
@@ -0,0 +1,57 @@
+#ifndef _PNG_WRITER_H
+#define _PNG_WRITER_H
+
+#include "Deflate.h"
+#include "EncoderFile.h"
+
+// Multi-threaded PNG encoder. Rows are filtered in parallel (the filter for each row is picked with
+// SSE2 using the usual minimum-sum-of-absolute-differences heuristic), and the filtered data is cut
+// into PNG_CHUNK_SIZE pieces that are deflated on separate workers and written as one IDAT each.
+// Rows can be fed in any number of calls, so the image never has to be in memory all at once.
+
+#define PNG_CHUNK_SIZE (256 * 1024) // Filtered bytes per deflate chunk.
+
+// Photographic images gain very little from searching harder than this (level 6 is about 8% smaller but
+// takes 7x as long on noisy photos), so it's what an unset compress level gets.
+#define PNG_DEFAULT_COMPRESS_LEVEL 4
+
+struct PngWriter
+{
+	EncoderFile file;
+	int width;
+	int height;
+	int channel_count;
+	int bit_depth; // 8 or 16.
+	int compress_level;
+	size_t row_size; // Bytes per row, not counting the filter type byte.
+	int rows_written;
+
+	u8* previous_row; // Last row passed in (big endian for 16-bit images), or zeros before the first.
+	u8* filtered; // Up to DEFLATE_WINDOW_SIZE bytes of already compressed data, then pending rows.
+	size_t dict_size;
+	int pending_rows;
+	int band_rows; // Pending rows are compressed once there are this many.
+
+	DeflateOutput* chunk_outputs; // One per chunk in a band, reused from band to band.
+	u32* chunk_crcs;
+	u32* chunk_adlers;
+	int chunk_capacity;
+
+	u32 adler;
+	bool is_stream_started; // The zlib header goes in front of the first chunk.
+};
+
+// Opens the file and writes the PNG header. channel_count is 1 to 4 (gray, gray + alpha, RGB, RGBA).
+// compress_level is 1 to 9; 0 picks PNG_DEFAULT_COMPRESS_LEVEL.
+bool BeginPngWrite(PngWriter* writer, const char* file_path, int width, int height, int channel_count, int bit_depth, int compress_level);
+
+// Adds the next row_count rows, stride bytes apart. 16-bit samples are in native byte order.
+bool WritePngRows(PngWriter* writer, const void* rows, int row_count, size_t stride);
+
+// Compresses whatever is left and closes the file. If not every row was written (or anything failed),
+// the file is deleted and false is returned, so this also serves to cancel a write.
+bool EndPngWrite(PngWriter* writer);
+
+bool WritePng(const char* file_path, const void* pixels, int width, int height, int channel_count, int bit_depth, size_t stride, int compress_level);
+
+#endif //_PNG_WRITER_H
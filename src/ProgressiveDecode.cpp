@@ -0,0 +1,758 @@
+#include "ProgressiveDecode.h"
+#include "ThumbnailDecode.h"
+#include "Platform/Platform.h"
+#include "Core/FrameScheduler.h"
+
+// Bits looked up at once when decoding Huffman codes. Longer codes, which are rare, take a slower path.
+#define INFLATE_FAST_BITS 9
+#define INFLATE_FAST_MASK ((1 << INFLATE_FAST_BITS) - 1)
+
+// Inflated bytes wait in a ring until a whole window's worth has built up, and are then handed to the row
+// decoder, so the ring holds that plus the window behind it that matches can still copy from.
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_RING_SIZE (2 * INFLATE_WINDOW_SIZE)
+#define INFLATE_RING_MASK (INFLATE_RING_SIZE - 1)
+
+#define PROGRESSIVE_WAKE_BYTES (4 << 20) // Decoded between wakeups of the main loop.
+#define PNG_MAX_DIMENSION (1 << 24) // Same limits as stb_image, so nothing decodes here that it would refuse.
+#define PNG_MAX_PIXEL_BYTES (1 << 30)
+
+// Origin and spacing of each Adam7 pass.
+static const int adam7_x0[ADAM7_PASS_COUNT] = {0, 4, 0, 2, 0, 1, 0};
+static const int adam7_y0[ADAM7_PASS_COUNT] = {0, 0, 4, 0, 2, 0, 1};
+static const int adam7_dx[ADAM7_PASS_COUNT] = {8, 8, 4, 4, 2, 2, 1};
+static const int adam7_dy[ADAM7_PASS_COUNT] = {8, 8, 8, 4, 4, 2, 2};
+
+// Block each decoded pixel stands for once the first n passes are in, at index n - 1. The top left pixel
+// of every such block belongs to one of those passes.
+static const int adam7_block_width[ADAM7_PASS_COUNT] = {8, 4, 4, 2, 2, 1, 1};
+static const int adam7_block_height[ADAM7_PASS_COUNT] = {8, 8, 4, 4, 2, 2, 1};
+
+static const u16 inflate_length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const u8 inflate_length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const u16 inflate_distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const u8 inflate_distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const u8 inflate_code_length_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// stb_image's scale from low bit depth gray to 8 bits, indexed by depth.
+static const u8 png_depth_scale[9] = {0, 0xFF, 0x55, 0, 0x11, 0, 0, 0, 0x01};
+
+struct InflateHuffman
+{
+	u16 fast[1 << INFLATE_FAST_BITS]; // (length << 9) | symbol, indexed by the next bits, or 0 if the code is longer.
+	u16 counts[16]; // Number of codes of each length.
+	u16 symbols[288]; // In code order.
+};
+
+struct PngStreamDecoder
+{
+	// Input: the zlib stream, split over however many IDAT chunks the encoder felt like.
+	const u8* file_end;
+	const u8* next_chunk; // Header of the chunk after the current one, or null past the last IDAT.
+	const u8* in;
+	const u8* in_end;
+	u64 bits; // Valid bits are the low bit_count, next bit lowest.
+	int bit_count;
+	int padding; // Zero bytes fed in past the end of the data.
+
+	InflateHuffman literals;
+	InflateHuffman distances;
+	u8 ring[INFLATE_RING_SIZE];
+	u64 out_position; // Bytes inflated so far.
+	u64 consumed; // Bytes handed to the row decoder so far.
+
+	// Image format, in stb_image's terms: img_n channels in the file, out_n in the result.
+	int width;
+	int height;
+	int depth;
+	int color_type;
+	int img_n;
+	int out_n;
+	u8 palette[256 * 4];
+	bool has_transparency;
+	u16 transparent[3];
+
+	// Rows of the pass being decoded. Rows are filtered against the previous row of the same pass.
+	DecodeProgress* progress;
+	const std::atomic<bool>* is_cancelled;
+	int pass; // Always 0 for images that aren't interlaced.
+	int pass_width;
+	int pass_height;
+	int pass_row;
+	int row_size; // Bytes per filtered row, without the filter type.
+	int row_filled; // Bytes of the current row gathered, filter type included.
+	int filter_bytes; // Bytes per pixel, at least 1.
+	u8* filtered; // Filter type, then the row as inflated.
+	u8* current; // Unfiltered.
+	u8* prior;
+	u64 unannounced_bytes; // Published since the main loop was last woken.
+	bool is_done;
+	bool has_failed;
+};
+
+static u32 ReadPngU32(const u8* p)
+{
+	return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+static bool IsPngChunk(const u8* header, const char* type)
+{
+	return memcmp(header + 4, type, 4) == 0;
+}
+
+static bool IsDecodeCancelled(const std::atomic<bool>* is_cancelled)
+{
+	return is_cancelled && is_cancelled->load(std::memory_order_relaxed);
+}
+
+// The next byte of IDAT data, stepping over chunk boundaries (and anything between IDATs) as needed.
+static u8 ReadPngStreamByte(PngStreamDecoder* decoder)
+{
+	while (decoder->in == decoder->in_end)
+	{
+		const u8* header = decoder->next_chunk;
+		if (!header || decoder->file_end - header < 12 || (u64)(decoder->file_end - header - 12) < ReadPngU32(header) || IsPngChunk(header, "IEND"))
+		{
+			decoder->next_chunk = 0;
+			++decoder->padding;
+			return 0;
+		}
+		u32 length = ReadPngU32(header);
+		decoder->next_chunk = header + 12 + length;
+		if (IsPngChunk(header, "IDAT"))
+		{
+			decoder->in = header + 8;
+			decoder->in_end = header + 8 + length;
+		}
+	}
+	return *decoder->in++;
+}
+
+static void FillPngStreamBits(PngStreamDecoder* decoder)
+{
+	while (decoder->bit_count <= 56)
+	{
+		decoder->bits |= (u64)ReadPngStreamByte(decoder) << decoder->bit_count;
+		decoder->bit_count += 8;
+	}
+}
+
+static u32 TakePngStreamBits(PngStreamDecoder* decoder, int count)
+{
+	if (decoder->bit_count < count) FillPngStreamBits(decoder);
+	u32 result = (u32)(decoder->bits & ((1ull << count) - 1));
+	decoder->bits >>= count;
+	decoder->bit_count -= count;
+	return result;
+}
+
+static bool BuildInflateHuffman(const u8* lengths, int count, InflateHuffman* table)
+{
+	memset(table, 0, sizeof(*table));
+	for (int i = 0; i < count; ++i) ++table->counts[lengths[i]];
+	table->counts[0] = 0;
+
+	int left = 1;
+	for (int length = 1; length <= 15; ++length)
+	{
+		left = (left << 1) - table->counts[length];
+		if (left < 0) return false; // Over-subscribed. Incomplete codes are allowed, and just never match.
+	}
+
+	u16 offsets[16] = {};
+	int next_code[16] = {};
+	for (int length = 1; length < 15; ++length) offsets[length + 1] = offsets[length] + table->counts[length];
+	for (int length = 1, code = 0; length <= 15; ++length)
+	{
+		code = (code + table->counts[length - 1]) << 1;
+		next_code[length] = code;
+	}
+
+	for (int symbol = 0; symbol < count; ++symbol)
+	{
+		int length = lengths[symbol];
+		if (!length) continue;
+		table->symbols[offsets[length]++] = (u16)symbol;
+		int code = next_code[length]++;
+		if (length > INFLATE_FAST_BITS) continue;
+
+		// Codes are sent starting from their top bit, so they come out of the bit buffer reversed.
+		int reversed = 0;
+		for (int i = 0; i < length; ++i) reversed |= ((code >> i) & 1) << (length - 1 - i);
+		for (int i = reversed; i < (1 << INFLATE_FAST_BITS); i += 1 << length) table->fast[i] = (u16)((length << 9) | symbol);
+	}
+	return true;
+}
+
+// Returns -1 for a code that isn't in the table.
+static int DecodeInflateSymbol(PngStreamDecoder* decoder, const InflateHuffman* table)
+{
+	if (decoder->bit_count < 16) FillPngStreamBits(decoder);
+	u16 fast = table->fast[decoder->bits & INFLATE_FAST_MASK];
+	if (fast)
+	{
+		decoder->bits >>= fast >> 9;
+		decoder->bit_count -= fast >> 9;
+		return fast & 511;
+	}
+
+	// A bit at a time, counting through the canonical codes of each length.
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int length = 1; length <= 15; ++length)
+	{
+		code |= (int)((decoder->bits >> (length - 1)) & 1);
+		int count = table->counts[length];
+		if (code - first < count)
+		{
+			decoder->bits >>= length;
+			decoder->bit_count -= length;
+			return table->symbols[index + code - first];
+		}
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+// Moves on to the next pass that has any pixels in it, publishing the empty ones on the way.
+static void StartPngPass(PngStreamDecoder* decoder)
+{
+	DecodeProgress* progress = decoder->progress;
+	for (; decoder->pass < progress->pass_count; ++decoder->pass)
+	{
+		decoder->pass_width = decoder->width;
+		decoder->pass_height = decoder->height;
+		if (progress->pass_count > 1)
+		{
+			int pass = decoder->pass;
+			decoder->pass_width = (decoder->width - adam7_x0[pass] + adam7_dx[pass] - 1) / adam7_dx[pass];
+			decoder->pass_height = (decoder->height - adam7_y0[pass] + adam7_dy[pass] - 1) / adam7_dy[pass];
+		}
+		if (decoder->pass_width > 0 && decoder->pass_height > 0) break;
+		progress->ready_passes.store(decoder->pass + 1);
+	}
+	if (decoder->pass == progress->pass_count)
+	{
+		decoder->is_done = true;
+		return;
+	}
+
+	decoder->row_size = (int)(((u64)decoder->img_n * decoder->pass_width * decoder->depth + 7) >> 3);
+	decoder->pass_row = 0;
+	decoder->row_filled = 0;
+	memset(decoder->prior, 0, decoder->row_size);
+}
+
+static u8 PaethPredict(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return (u8)a;
+	return (u8)((pb <= pc) ? b : c);
+}
+
+// Expands an unfiltered row to stb_image's output layout, writing every step pixels along dst.
+static void WritePngPixels(const PngStreamDecoder* decoder, const u8* src, int count, u8* dst, int step)
+{
+	int img_n = decoder->img_n;
+	int out_n = decoder->out_n;
+	if (decoder->depth == 16)
+	{
+		for (int i = 0; i < count; ++i, src += img_n * 2, dst += step)
+		{
+			u16* pixel = (u16*)dst;
+			bool is_transparent = decoder->has_transparency;
+			for (int c = 0; c < img_n; ++c)
+			{
+				pixel[c] = (u16)((src[c * 2] << 8) | src[c * 2 + 1]);
+				is_transparent &= (pixel[c] == decoder->transparent[c]);
+			}
+			if (out_n > img_n) pixel[img_n] = is_transparent ? 0 : 0xFFFF;
+		}
+		return;
+	}
+
+	int depth = decoder->depth;
+	if (depth == 8 && decoder->color_type != 3 && out_n == img_n && step == img_n)
+	{
+		memcpy(dst, src, (size_t)count * img_n);
+		return;
+	}
+
+	int mask = (1 << depth) - 1;
+	u8 scale = (decoder->color_type == 0) ? png_depth_scale[depth] : 1;
+	for (int i = 0; i < count; ++i, dst += step)
+	{
+		u8 samples[4];
+		for (int c = 0; c < img_n; ++c)
+		{
+			// Below 8 bits there's only ever one channel, packed from the top bit of each byte down.
+			int bit = (i * img_n + c) * depth;
+			samples[c] = (depth == 8) ? src[bit >> 3] : (u8)(scale * ((src[bit >> 3] >> (8 - depth - (bit & 7))) & mask));
+		}
+		if (decoder->color_type == 3)
+		{
+			memcpy(dst, &decoder->palette[samples[0] * 4], out_n);
+			continue;
+		}
+		bool is_transparent = decoder->has_transparency;
+		for (int c = 0; c < img_n; ++c)
+		{
+			dst[c] = samples[c];
+			is_transparent &= (samples[c] == decoder->transparent[c]);
+		}
+		if (out_n > img_n) dst[img_n] = is_transparent ? 0 : 0xFF;
+	}
+}
+
+// Unfilters the row just gathered, writes its pixels to their place in the image, and publishes it.
+static void FinishPngRow(PngStreamDecoder* decoder)
+{
+	const u8* raw = decoder->filtered + 1;
+	u8* current = decoder->current;
+	const u8* prior = decoder->prior;
+	int size = decoder->row_size;
+	int bpp = decoder->filter_bytes;
+	switch (decoder->filtered[0])
+	{
+		case 0: memcpy(current, raw, size); break;
+		case 1:
+		{
+			for (int k = 0; k < bpp && k < size; ++k) current[k] = raw[k];
+			for (int k = bpp; k < size; ++k) current[k] = (u8)(raw[k] + current[k - bpp]);
+		}
+		break;
+		case 2:
+		{
+			for (int k = 0; k < size; ++k) current[k] = (u8)(raw[k] + prior[k]);
+		}
+		break;
+		case 3:
+		{
+			for (int k = 0; k < bpp && k < size; ++k) current[k] = (u8)(raw[k] + (prior[k] >> 1));
+			for (int k = bpp; k < size; ++k) current[k] = (u8)(raw[k] + ((prior[k] + current[k - bpp]) >> 1));
+		}
+		break;
+		case 4:
+		{
+			for (int k = 0; k < bpp && k < size; ++k) current[k] = (u8)(raw[k] + prior[k]);
+			for (int k = bpp; k < size; ++k) current[k] = (u8)(raw[k] + PaethPredict(current[k - bpp], prior[k], prior[k - bpp]));
+		}
+		break;
+		default:
+		{
+			decoder->has_failed = true;
+			return;
+		}
+	}
+
+	DecodeProgress* progress = decoder->progress;
+	DecodedImage* image = &progress->image;
+	int pixel_size = GetPixelSize(image->layout);
+	int pass = decoder->pass;
+	bool is_interlaced = (progress->pass_count > 1);
+	int x = is_interlaced ? adam7_x0[pass] : 0;
+	int y = is_interlaced ? adam7_y0[pass] + decoder->pass_row * adam7_dy[pass] : decoder->pass_row;
+	int step = (is_interlaced ? adam7_dx[pass] : 1) * pixel_size;
+	u8* dst = (u8*)image->pixels + ((size_t)y * image->width + x) * pixel_size;
+	WritePngPixels(decoder, current, decoder->pass_width, dst, step);
+
+	u8* swap = decoder->prior;
+	decoder->prior = decoder->current;
+	decoder->current = swap;
+	decoder->row_filled = 0;
+	decoder->unannounced_bytes += (u64)decoder->pass_width * pixel_size;
+	if (!is_interlaced) progress->ready_rows.store(y + 1);
+
+	if (++decoder->pass_row == decoder->pass_height)
+	{
+		progress->ready_passes.store(++decoder->pass);
+		StartPngPass(decoder);
+		if (decoder->is_done) progress->ready_rows.store(image->height);
+		WakeFrameScheduler();
+		decoder->unannounced_bytes = 0;
+	}
+	else if (decoder->unannounced_bytes >= PROGRESSIVE_WAKE_BYTES)
+	{
+		WakeFrameScheduler();
+		decoder->unannounced_bytes = 0;
+	}
+	if (IsDecodeCancelled(decoder->is_cancelled)) decoder->has_failed = true;
+}
+
+// Hands everything inflated so far to the row decoder. Once the image is complete (or has gone wrong),
+// anything further is thrown away.
+static void ConsumePngStreamOutput(PngStreamDecoder* decoder)
+{
+	while (decoder->consumed < decoder->out_position && !decoder->is_done && !decoder->has_failed)
+	{
+		int start = (int)(decoder->consumed & INFLATE_RING_MASK);
+		u64 span = decoder->out_position - decoder->consumed;
+		if (span > (u64)(INFLATE_RING_SIZE - start)) span = INFLATE_RING_SIZE - start;
+		if (span > (u64)(decoder->row_size + 1 - decoder->row_filled)) span = decoder->row_size + 1 - decoder->row_filled;
+		memcpy(decoder->filtered + decoder->row_filled, decoder->ring + start, (size_t)span);
+		decoder->row_filled += (int)span;
+		decoder->consumed += span;
+		if (decoder->row_filled == decoder->row_size + 1) FinishPngRow(decoder);
+	}
+	decoder->consumed = decoder->out_position;
+}
+
+static void PutInflatedByte(PngStreamDecoder* decoder, u8 byte)
+{
+	decoder->ring[decoder->out_position++ & INFLATE_RING_MASK] = byte;
+	if (decoder->out_position - decoder->consumed == INFLATE_WINDOW_SIZE) ConsumePngStreamOutput(decoder);
+}
+
+static bool IsPngStreamStopped(const PngStreamDecoder* decoder)
+{
+	return decoder->is_done || decoder->has_failed || decoder->padding > 8;
+}
+
+static bool InflateHuffmanBlock(PngStreamDecoder* decoder)
+{
+	while (!IsPngStreamStopped(decoder))
+	{
+		if (decoder->bit_count < 32) FillPngStreamBits(decoder);
+		int symbol = DecodeInflateSymbol(decoder, &decoder->literals);
+		if (symbol < 0) return false;
+		if (symbol < 256)
+		{
+			PutInflatedByte(decoder, (u8)symbol);
+			continue;
+		}
+		if (symbol == 256) return true;
+
+		symbol -= 257;
+		if (symbol >= 29) return false;
+		int length = inflate_length_base[symbol] + (int)TakePngStreamBits(decoder, inflate_length_extra[symbol]);
+		symbol = DecodeInflateSymbol(decoder, &decoder->distances);
+		if (symbol < 0 || symbol >= 30) return false;
+		int distance = inflate_distance_base[symbol] + (int)TakePngStreamBits(decoder, inflate_distance_extra[symbol]);
+		if ((u64)distance > decoder->out_position) return false;
+		for (int i = 0; i < length; ++i) PutInflatedByte(decoder, decoder->ring[(decoder->out_position - distance) & INFLATE_RING_MASK]);
+	}
+	return true;
+}
+
+static bool ReadInflateDynamicTables(PngStreamDecoder* decoder)
+{
+	int literal_count = (int)TakePngStreamBits(decoder, 5) + 257;
+	int distance_count = (int)TakePngStreamBits(decoder, 5) + 1;
+	int code_length_count = (int)TakePngStreamBits(decoder, 4) + 4;
+	if (literal_count > 286 || distance_count > 30) return false;
+
+	u8 code_length_lengths[19] = {};
+	for (int i = 0; i < code_length_count; ++i) code_length_lengths[inflate_code_length_order[i]] = (u8)TakePngStreamBits(decoder, 3);
+	InflateHuffman* code_lengths = &decoder->distances; // Free until the real distance table is built.
+	if (!BuildInflateHuffman(code_length_lengths, 19, code_lengths)) return false;
+
+	u8 lengths[286 + 30];
+	int total = literal_count + distance_count;
+	for (int i = 0; i < total;)
+	{
+		int symbol = DecodeInflateSymbol(decoder, code_lengths);
+		if (symbol < 0) return false;
+		if (symbol < 16)
+		{
+			lengths[i++] = (u8)symbol;
+			continue;
+		}
+		u8 value = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (i == 0) return false;
+			value = lengths[i - 1];
+			repeat = 3 + (int)TakePngStreamBits(decoder, 2);
+		}
+		else if (symbol == 17)
+		{
+			repeat = 3 + (int)TakePngStreamBits(decoder, 3);
+		}
+		else
+		{
+			repeat = 11 + (int)TakePngStreamBits(decoder, 7);
+		}
+		if (i + repeat > total) return false;
+		memset(lengths + i, value, repeat);
+		i += repeat;
+	}
+	if (!lengths[256]) return false; // No end of block code.
+	return BuildInflateHuffman(lengths, literal_count, &decoder->literals) && BuildInflateHuffman(lengths + literal_count, distance_count, &decoder->distances);
+}
+
+// Inflates the zlib stream until every row of the image is out.
+static bool InflatePngStream(PngStreamDecoder* decoder)
+{
+	u32 cmf = TakePngStreamBits(decoder, 8);
+	u32 flg = TakePngStreamBits(decoder, 8);
+	if ((cmf & 15) != 8 || (flg & 32) || ((cmf << 8) | flg) % 31) return false;
+
+	bool is_final = false;
+	while (!is_final && !IsPngStreamStopped(decoder))
+	{
+		is_final = TakePngStreamBits(decoder, 1) != 0;
+		u32 type = TakePngStreamBits(decoder, 2);
+		if (type == 0)
+		{
+			TakePngStreamBits(decoder, decoder->bit_count & 7);
+			u32 length = TakePngStreamBits(decoder, 16);
+			u32 inverse = TakePngStreamBits(decoder, 16);
+			if ((length ^ 0xFFFF) != inverse) return false;
+			for (u32 i = 0; i < length && !IsPngStreamStopped(decoder); ++i) PutInflatedByte(decoder, (u8)TakePngStreamBits(decoder, 8));
+		}
+		else if (type == 1)
+		{
+			u8 lengths[288 + 32];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			memset(lengths + 288, 5, 32);
+			BuildInflateHuffman(lengths, 288, &decoder->literals);
+			BuildInflateHuffman(lengths + 288, 30, &decoder->distances);
+			if (!InflateHuffmanBlock(decoder)) return false;
+		}
+		else if (type == 2)
+		{
+			if (!ReadInflateDynamicTables(decoder) || !InflateHuffmanBlock(decoder)) return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	ConsumePngStreamOutput(decoder);
+
+	// Running out of data means zeros were decoded as if they were the image.
+	return decoder->is_done && !decoder->has_failed && decoder->padding * 8 <= decoder->bit_count;
+}
+
+// Reads the chunks up to the first IDAT and sets up the output. Returns false for anything stb_image
+// would refuse, and for Apple's CgBI PNGs, which aren't zlib streams at all; those go through stb_image.
+static bool ReadPngHeaders(const u8* data, u64 size, PngStreamDecoder* decoder)
+{
+	static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	if (size < 8 || memcmp(data, signature, 8) != 0) return false;
+	const u8* end = data + size;
+	const u8* p = data + 8;
+	bool has_header = false;
+	int palette_size = 0;
+	bool is_interlaced = false;
+	for (;;)
+	{
+		if (end - p < 12) return false;
+		u32 length = ReadPngU32(p);
+		if ((u64)(end - p - 12) < length) return false;
+		const u8* chunk = p + 8;
+
+		if (IsPngChunk(p, "IHDR"))
+		{
+			if (has_header || length != 13) return false;
+			decoder->width = (int)ReadPngU32(chunk);
+			decoder->height = (int)ReadPngU32(chunk + 4);
+			decoder->depth = chunk[8];
+			decoder->color_type = chunk[9];
+			is_interlaced = (chunk[12] == 1);
+			if (ReadPngU32(chunk) > PNG_MAX_DIMENSION || ReadPngU32(chunk + 4) > PNG_MAX_DIMENSION || !decoder->width || !decoder->height) return false;
+			if (decoder->depth != 1 && decoder->depth != 2 && decoder->depth != 4 && decoder->depth != 8 && decoder->depth != 16) return false;
+			if (decoder->color_type > 6 || (decoder->color_type != 3 && (decoder->color_type & 1))) return false;
+			if (decoder->color_type == 3 && decoder->depth == 16) return false;
+			if (chunk[10] || chunk[11] || chunk[12] > 1) return false;
+			decoder->img_n = (decoder->color_type == 3) ? 1 : ((decoder->color_type & 2) ? 3 : 1) + ((decoder->color_type & 4) ? 1 : 0);
+			if (PNG_MAX_PIXEL_BYTES / decoder->width / ((decoder->color_type == 3) ? 4 : decoder->img_n) < decoder->height) return false;
+			has_header = true;
+		}
+		else if (IsPngChunk(p, "PLTE"))
+		{
+			if (!has_header || length > 256 * 3 || length % 3) return false;
+			palette_size = length / 3;
+			for (int i = 0; i < palette_size; ++i)
+			{
+				memcpy(&decoder->palette[i * 4], chunk + i * 3, 3);
+				decoder->palette[i * 4 + 3] = 0xFF;
+			}
+		}
+		else if (IsPngChunk(p, "tRNS"))
+		{
+			if (!has_header) return false;
+			if (decoder->color_type == 3)
+			{
+				if (!palette_size || length > (u32)palette_size) return false;
+				for (u32 i = 0; i < length; ++i) decoder->palette[i * 4 + 3] = chunk[i];
+				decoder->out_n = 4;
+			}
+			else
+			{
+				if (!(decoder->img_n & 1) || length != (u32)decoder->img_n * 2) return false;
+				decoder->has_transparency = true;
+				for (int c = 0; c < decoder->img_n; ++c)
+				{
+					u16 value = (u16)((chunk[c * 2] << 8) | chunk[c * 2 + 1]);
+					decoder->transparent[c] = (decoder->depth == 16) ? value : (u16)((value & 0xFF) * png_depth_scale[decoder->depth]);
+				}
+			}
+		}
+		else if (IsPngChunk(p, "IDAT"))
+		{
+			if (!has_header || (decoder->color_type == 3 && !palette_size)) return false;
+			break;
+		}
+		else if (!(p[4] & 32))
+		{
+			return false; // IEND, CgBI, or a critical chunk nobody knows.
+		}
+		p += 12 + length;
+	}
+
+	decoder->file_end = end;
+	decoder->next_chunk = p;
+	if (decoder->color_type == 3) decoder->out_n = decoder->out_n ? 4 : 3;
+	else decoder->out_n = decoder->img_n + (decoder->has_transparency ? 1 : 0);
+
+	int bytes_per_sample = (decoder->depth == 16) ? 2 : 1;
+	decoder->filter_bytes = (decoder->depth < 8) ? 1 : decoder->img_n * bytes_per_sample;
+	size_t row_bytes = (((size_t)decoder->img_n * decoder->width * decoder->depth + 7) >> 3) + 1;
+	decoder->filtered = (u8*)malloc(row_bytes * 3); // @malloc
+	decoder->current = decoder->filtered + row_bytes;
+	decoder->prior = decoder->current + row_bytes;
+
+	DecodeProgress* progress = decoder->progress;
+	DecodedImage* image = &progress->image;
+	image->width = decoder->width;
+	image->height = decoder->height;
+	image->layout = {decoder->out_n, (decoder->depth == 16) ? PixelType::U16 : PixelType::U8};
+	image->pixels = malloc((size_t)decoder->width * decoder->height * decoder->out_n * bytes_per_sample); // @malloc
+	progress->owns_pixels = true;
+	if (!image->pixels || !decoder->filtered) return false;
+	progress->pass_count = is_interlaced ? ADAM7_PASS_COUNT : 1;
+	progress->width = decoder->width;
+	progress->height = decoder->height;
+	progress->has_image.store(true);
+	return true;
+}
+
+static bool DecodePngStream(const u8* data, u64 size, DecodeProgress* progress, const std::atomic<bool>* is_cancelled)
+{
+	PngStreamDecoder* decoder = (PngStreamDecoder*)calloc(1, sizeof(PngStreamDecoder)); // @malloc
+	decoder->progress = progress;
+	decoder->is_cancelled = is_cancelled;
+	bool success = ReadPngHeaders(data, size, decoder);
+	if (success)
+	{
+		StartPngPass(decoder);
+		success = InflatePngStream(decoder);
+	}
+	free(decoder->filtered);
+	free(decoder);
+	return success;
+}
+
+DecodeProgress* CreateDecodeProgress()
+{
+	DecodeProgress* progress = new DecodeProgress();
+	progress->width = 0;
+	progress->height = 0;
+	progress->image = {};
+	progress->pass_count = 1;
+	progress->owns_pixels = false;
+	progress->preview = {};
+	progress->has_image.store(false);
+	progress->has_preview.store(false);
+	progress->ready_rows.store(0);
+	progress->ready_passes.store(0);
+	return progress;
+}
+
+void FreeDecodeProgress(DecodeProgress* progress)
+{
+	if (!progress) return;
+	if (progress->owns_pixels) FreeDecodedImage(&progress->image);
+	FreeDecodedImage(&progress->preview);
+	delete progress;
+}
+
+bool DecodeImageFileProgressive(const char* file_path, DecodeProgress* progress, DecodedImage* image, const std::atomic<bool>* is_cancelled)
+{
+	assert(file_path && progress && image);
+	*image = {};
+
+	bool success = false;
+	Platform::MappedFile mapped_file = {};
+	if (Platform::MapFileForRead(file_path, &mapped_file))
+	{
+		const u8* data = (const u8*)mapped_file.data;
+		u64 size = mapped_file.size;
+		if (size >= 8 && data[0] == 0x89 && data[1] == 'P')
+		{
+			success = DecodePngStream(data, size, progress, is_cancelled);
+		}
+		else if (size >= 2 && data[0] == 0xFF && data[1] == 0xD8)
+		{
+			if (DecodeJpegPreview(data, size, &progress->preview, &progress->width, &progress->height))
+			{
+				progress->has_preview.store(true);
+				WakeFrameScheduler();
+			}
+		}
+	}
+	Platform::UnmapFile(&mapped_file);
+
+	if (success)
+	{
+		*image = progress->image;
+		progress->owns_pixels = false;
+		return true;
+	}
+
+	// Whatever the streaming decoder couldn't handle, stb_image gets to try; what's already published
+	// stays up until it's done.
+	if (IsDecodeCancelled(is_cancelled)) return false;
+	return DecodeImageFile(file_path, image);
+}
+
+void ConvertProgressiveRowsToRGBA8(const DecodeProgress* progress, int pass_count, int first_row, int row_count, u8* dst)
+{
+	assert(progress && progress->image.pixels && dst);
+	assert(first_row >= 0 && row_count >= 0 && first_row + row_count <= progress->image.height);
+	const DecodedImage* image = &progress->image;
+	int width = image->width;
+	int pixel_size = GetPixelSize(image->layout);
+
+	int block_width = 1;
+	int block_height = 1;
+	if (progress->pass_count > 1)
+	{
+		assert(pass_count >= 1 && pass_count <= ADAM7_PASS_COUNT);
+		block_width = adam7_block_width[pass_count - 1];
+		block_height = adam7_block_height[pass_count - 1];
+	}
+
+	u8* gathered = (block_width > 1) ? (u8*)malloc((size_t)width * pixel_size) : 0; // @malloc
+	u8* converted = (image->layout.type != PixelType::U8) ? (u8*)malloc((size_t)width * image->layout.channel_count) : 0; // @malloc
+	PixelLayout u8_layout = {image->layout.channel_count, PixelType::U8};
+	for (int i = 0; i < row_count; ++i)
+	{
+		int y = (first_row + i) & ~(block_height - 1);
+		const u8* src = (const u8*)image->pixels + (size_t)y * width * pixel_size;
+		if (gathered)
+		{
+			for (int x = 0; x < width; ++x) memcpy(gathered + (size_t)x * pixel_size, src + (size_t)(x & ~(block_width - 1)) * pixel_size, pixel_size);
+			src = gathered;
+		}
+		if (converted)
+		{
+			ConvertPixelsToU8(src, image->layout, width, converted);
+			src = converted;
+		}
+		ExpandPixelsToRGBA(src, u8_layout, width, dst + (size_t)i * width * 4);
+	}
+	free(converted);
+	free(gathered);
+}
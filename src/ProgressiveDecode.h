@@ -0,0 +1,51 @@
+#ifndef _PROGRESSIVE_DECODE_H
+#define _PROGRESSIVE_DECODE_H
+
+#include "ImageDecode.h"
+
+// Decoding that shows its work. A big file takes seconds to decode, and rather than leave its panel empty
+// until then, the decoder publishes what it has as it goes: PNGs are inflated and unfiltered a row at a
+// time straight out of the file (a pass at a time for Adam7 interlaced ones), and JPEGs get a 1/8 scale
+// preview from their DC coefficients before stb_image decodes them in full, which for a progressive JPEG
+// only needs its first scan. Anything else is decoded in one go. Either way the final image is exactly
+// what DecodeImageFile gives.
+
+#define ADAM7_PASS_COUNT 7
+
+// Shared between the worker decoding an image and whoever displays it while it comes in. The worker never
+// touches pixels again once it has published them, so anything published can be read without locking.
+struct DecodeProgress
+{
+	int width; // Of the full image, set along with whichever of has_image or has_preview comes first.
+	int height;
+
+	// The full image, once has_image is set, filled in as ready_rows and ready_passes say. The progress
+	// owns the pixels until the decode succeeds and hands them over as its result.
+	DecodedImage image;
+	int pass_count; // ADAM7_PASS_COUNT for interlaced PNGs, 1 for everything else.
+	bool owns_pixels;
+
+	DecodedImage preview; // Reduced RGBA8 stand-in, once has_preview is set.
+
+	std::atomic<bool> has_image;
+	std::atomic<bool> has_preview;
+	std::atomic<int> ready_rows; // Rows at the top of image that are final.
+	std::atomic<int> ready_passes; // Passes that are complete, for interlaced images.
+};
+
+DecodeProgress* CreateDecodeProgress();
+void FreeDecodeProgress(DecodeProgress* progress);
+
+// Decodes a file the way DecodeImageFile does, publishing to progress along the way. On success image
+// gets the pixels, which progress->image may go on pointing at. Gives up early, returning false, once
+// is_cancelled (optional) is set.
+bool DecodeImageFileProgressive(const char* file_path, DecodeProgress* progress, DecodedImage* image, const std::atomic<bool>* is_cancelled = 0);
+
+// Converts rows [first_row, first_row + row_count) of progress->image to RGBA8 for display, the same way
+// display textures are converted. Interlaced images are shown at the detail of their first pass_count
+// passes, each pixel repeating the nearest one above and to the left of it that those passes decoded, so
+// a partly decoded image looks blocky rather than sparse. While the decode runs, only rows below
+// ready_rows, or passes up to ready_passes, may be read.
+void ConvertProgressiveRowsToRGBA8(const DecodeProgress* progress, int pass_count, int first_row, int row_count, u8* dst);
+
+#endif //_PROGRESSIVE_DECODE_H
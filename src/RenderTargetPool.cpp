@@ -0,0 +1,151 @@
+#include "RenderTargetPool.h"
+#include "Core/FrameScheduler.h"
+
+#include <chrono>
+
+struct PooledRenderTarget
+{
+	RenderTarget target;
+	double released_time; // GetRenderTargetPoolTime when it went back into the pool.
+};
+
+static PooledRenderTarget* g_free_render_targets = 0; // stb_ds array.
+
+static double GetRenderTargetPoolTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int GetRenderTargetBucketSize(int size)
+{
+	if (size < 1) size = 1;
+	return (size + RENDER_TARGET_BUCKET_SIZE - 1) / RENDER_TARGET_BUCKET_SIZE * RENDER_TARGET_BUCKET_SIZE;
+}
+
+static void DestroyRenderTarget(RenderTarget* target)
+{
+	if (target->srv) target->srv->Release();
+	if (target->rtv) target->rtv->Release();
+	if (target->texture) target->texture->Release();
+	*target = {};
+}
+
+static RenderTarget CreateRenderTarget(ID3D11Device* device, int width, int height)
+{
+	RenderTarget result = {};
+	result.width = width;
+	result.height = height;
+
+	D3D11_TEXTURE2D_DESC render_target_desc = {};
+	render_target_desc.Width = width;
+	render_target_desc.Height = height;
+	render_target_desc.MipLevels = render_target_desc.ArraySize = 1;
+	render_target_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	render_target_desc.SampleDesc.Count = 1;
+	render_target_desc.Usage = D3D11_USAGE_DEFAULT;
+	render_target_desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	render_target_desc.CPUAccessFlags = 0;
+	render_target_desc.MiscFlags = 0;
+
+	device->CreateTexture2D( &render_target_desc, 0, &result.texture);
+
+	D3D11_RENDER_TARGET_VIEW_DESC rtv_desc = {};
+	rtv_desc.Format = render_target_desc.Format;
+	rtv_desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+	rtv_desc.Texture2D.MipSlice = 0;
+
+	device->CreateRenderTargetView(result.texture, &rtv_desc, &result.rtv);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = rtv_desc.Format;
+	srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MipLevels = 1;
+	srv_desc.Texture2D.MostDetailedMip = 0;
+	device->CreateShaderResourceView(result.texture, &srv_desc, &result.srv);
+	return result;
+}
+
+RenderTarget AcquireRenderTarget(ID3D11Device* device, int width, int height)
+{
+	int bucket_width = GetRenderTargetBucketSize(width);
+	int bucket_height = GetRenderTargetBucketSize(height);
+
+	// Smallest free target that fits, as long as it's no more than twice the area we'd allocate anyway.
+	s64 max_area = (s64)bucket_width * bucket_height * 2;
+	int best = -1;
+	s64 best_area = 0;
+	for (int i = 0; i < arrlen(g_free_render_targets); ++i)
+	{
+		RenderTarget* target = &g_free_render_targets[i].target;
+		if (target->width < width || target->height < height) continue;
+		s64 area = (s64)target->width * target->height;
+		if (area > max_area) continue;
+		if (best < 0 || area < best_area)
+		{
+			best = i;
+			best_area = area;
+		}
+	}
+
+	if (best >= 0)
+	{
+		RenderTarget result = g_free_render_targets[best].target;
+		arrdelswap(g_free_render_targets, best);
+		return result;
+	}
+	return CreateRenderTarget(device, bucket_width, bucket_height);
+}
+
+void ReleaseRenderTarget(RenderTarget* target)
+{
+	assert(target);
+	if (!target->texture)
+	{
+		*target = {};
+		return;
+	}
+
+	PooledRenderTarget pooled = {*target, GetRenderTargetPoolTime()};
+	arrput(g_free_render_targets, pooled);
+	*target = {};
+	RequestFrameIn(RENDER_TARGET_RELEASE_DELAY);
+
+	// Don't let a burst of releases (closing a lot of panels at once) pin a lot of VRAM.
+	while (arrlen(g_free_render_targets) > RENDER_TARGET_POOL_MAX_FREE)
+	{
+		int oldest = 0;
+		for (int i = 1; i < arrlen(g_free_render_targets); ++i)
+		{
+			if (g_free_render_targets[i].released_time < g_free_render_targets[oldest].released_time) oldest = i;
+		}
+		DestroyRenderTarget(&g_free_render_targets[oldest].target);
+		arrdelswap(g_free_render_targets, oldest);
+	}
+}
+
+void UpdateRenderTargetPool()
+{
+	double now = GetRenderTargetPoolTime();
+	double next_release_time = 0.0;
+	for (int i = 0; i < arrlen(g_free_render_targets);)
+	{
+		double release_time = g_free_render_targets[i].released_time + RENDER_TARGET_RELEASE_DELAY;
+		if (now >= release_time)
+		{
+			DestroyRenderTarget(&g_free_render_targets[i].target);
+			arrdelswap(g_free_render_targets, i);
+			continue;
+		}
+		if (next_release_time == 0.0 || release_time < next_release_time) next_release_time = release_time;
+		++i;
+	}
+
+	// Without this an idle viewer would hold on to the rest until something else woke it up.
+	if (next_release_time != 0.0) RequestFrameIn(next_release_time - now);
+}
+
+void DestroyRenderTargetPool()
+{
+	for (int i = 0; i < arrlen(g_free_render_targets); ++i) DestroyRenderTarget(&g_free_render_targets[i].target);
+	arrfree(g_free_render_targets);
+}
@@ -0,0 +1,43 @@
+#ifndef _RENDER_TARGET_POOL_H
+#define _RENDER_TARGET_POOL_H
+
+#include <d3d11.h>
+
+// Panel canvases come from a shared pool instead of being created and destroyed on every resize.
+// Allocations are rounded up to RENDER_TARGET_BUCKET_SIZE, and a released target stays alive in the pool
+// for RENDER_TARGET_RELEASE_DELAY seconds so the next panel (or the same panel, a few frames into a
+// resize) can pick it up again. Panels only draw into the top-left canvas-sized part of a target.
+// Free targets age in wall-clock time rather than frames, because the main loop stops rendering while
+// nothing changes; the pool asks the frame scheduler for a frame when the next one is due to go.
+
+#define RENDER_TARGET_BUCKET_SIZE 128
+#define RENDER_TARGET_RELEASE_DELAY 2.0 // Seconds a free target is kept before it is actually released.
+#define RENDER_TARGET_POOL_MAX_FREE 8
+
+struct RenderTarget
+{
+	ID3D11Texture2D* texture;
+	ID3D11RenderTargetView* rtv;
+	ID3D11ShaderResourceView* srv;
+	int width; // Allocated size, which is usually bigger than what's drawn into it.
+	int height;
+};
+
+// Size actually allocated for a request, rounded up to the bucket size.
+int GetRenderTargetBucketSize(int size);
+
+// Returns a target at least width x height, reusing a free one from the pool when one fits without
+// wasting too much memory.
+RenderTarget AcquireRenderTarget(ID3D11Device* device, int width, int height);
+
+// Hands a target back to the pool and clears *target. Safe to call on an empty target.
+void ReleaseRenderTarget(RenderTarget* target);
+
+// Call once per frame. Frees targets that have sat unused in the pool for too long, and schedules a frame
+// for when the next one will have.
+void UpdateRenderTargetPool();
+
+// Frees everything in the pool. Targets still held by panels have to be released first.
+void DestroyRenderTargetPool();
+
+#endif //_RENDER_TARGET_POOL_H
@@ -0,0 +1,372 @@
+#include "SimpleImageWriters.h"
+#include "Core/JobSystem.h"
+
+#include <math.h>
+
+// BMP
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_V4_HEADER_SIZE 108
+
+bool BeginBmpWrite(BmpWriter* writer, const char* file_path, int width, int height, int channel_count)
+{
+	assert(writer && file_path);
+	*writer = {};
+	if (width <= 0 || height <= 0 || (channel_count != 3 && channel_count != 4)) return false;
+
+	// Every size field in the format is 32 bits.
+	u32 header_size = BMP_FILE_HEADER_SIZE + ((channel_count == 4) ? BMP_V4_HEADER_SIZE : BMP_INFO_HEADER_SIZE);
+	size_t row_size = ((size_t)width * channel_count + 3) & ~(size_t)3;
+	u64 image_size = (u64)row_size * height;
+	if (image_size + header_size > U32_MAX) return false;
+
+	if (!OpenEncoderFile(&writer->file, file_path)) return false;
+	writer->width = width;
+	writer->height = height;
+	writer->channel_count = channel_count;
+	writer->row_size = row_size;
+	writer->row = (u8*)calloc(1, row_size); // @malloc
+
+	u8 header[BMP_FILE_HEADER_SIZE + BMP_V4_HEADER_SIZE] = {};
+	header[0] = 'B';
+	header[1] = 'M';
+	PutU32LittleEndian(header + 2, (u32)(image_size + header_size));
+	PutU32LittleEndian(header + 10, header_size);
+
+	u8* info = header + BMP_FILE_HEADER_SIZE;
+	PutU32LittleEndian(info, header_size - BMP_FILE_HEADER_SIZE);
+	PutU32LittleEndian(info + 4, (u32)width);
+	PutU32LittleEndian(info + 8, (u32)-height); // Negative height means the rows are top-down.
+	PutU16LittleEndian(info + 12, 1); // Planes.
+	PutU16LittleEndian(info + 14, channel_count * 8);
+	PutU32LittleEndian(info + 16, (channel_count == 4) ? 3 : 0); // BI_BITFIELDS or BI_RGB.
+	PutU32LittleEndian(info + 20, (u32)image_size);
+	PutU32LittleEndian(info + 24, 2835); // 72 DPI, in pixels per meter.
+	PutU32LittleEndian(info + 28, 2835);
+	if (channel_count == 4)
+	{
+		PutU32LittleEndian(info + 40, 0x00FF0000);
+		PutU32LittleEndian(info + 44, 0x0000FF00);
+		PutU32LittleEndian(info + 48, 0x000000FF);
+		PutU32LittleEndian(info + 52, 0xFF000000);
+		memcpy(info + 56, "BGRs", 4); // LCS_sRGB, stored little endian.
+	}
+	return WriteEncoderFile(&writer->file, header, header_size);
+}
+
+bool WriteBmpRows(BmpWriter* writer, const void* rows, int row_count, size_t stride)
+{
+	assert(writer && rows);
+	if (!writer->file.file || writer->file.has_error) return false;
+	if (row_count > writer->height - writer->rows_written) row_count = writer->height - writer->rows_written;
+
+	int channel_count = writer->channel_count;
+	for (int y = 0; y < row_count; ++y)
+	{
+		const u8* src = (const u8*)rows + (size_t)y * stride;
+		u8* dst = writer->row;
+		for (int x = 0; x < writer->width; ++x, src += channel_count, dst += channel_count)
+		{
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+			if (channel_count == 4) dst[3] = src[3];
+		}
+		WriteEncoderFile(&writer->file, writer->row, writer->row_size);
+	}
+	writer->rows_written += row_count;
+	return !writer->file.has_error;
+}
+
+bool EndBmpWrite(BmpWriter* writer)
+{
+	assert(writer);
+	bool success = CloseEncoderFile(&writer->file, writer->rows_written == writer->height);
+	free(writer->row);
+	*writer = {};
+	return success;
+}
+
+// TGA
+
+#define TGA_HEADER_SIZE 18
+#define TGA_MAX_PACKET_PIXELS 128
+
+// Number of pixels equal to the one at x, starting with it.
+static int GetTgaRunLength(const u8* src, int x, int width, int pixel_size)
+{
+	const u8* pixel = src + (size_t)x * pixel_size;
+	int run = 1;
+	while (x + run < width && run < TGA_MAX_PACKET_PIXELS && !memcmp(pixel, pixel + (size_t)run * pixel_size, pixel_size)) ++run;
+	return run;
+}
+
+// Run-length encodes one row. Runs are only used when they save at least a byte over staying in a raw
+// packet, which pays for the header of the raw packet after them; that keeps the worst case at one
+// header per TGA_MAX_PACKET_PIXELS pixels plus one.
+static size_t EncodeTgaRow(const u8* src, int width, int pixel_size, u8* dst)
+{
+	int min_run = (pixel_size == 1) ? 3 : 2;
+	u8* out = dst;
+	int x = 0;
+	while (x < width)
+	{
+		int run = GetTgaRunLength(src, x, width, pixel_size);
+		if (run >= min_run)
+		{
+			*out++ = (u8)(0x80 | (run - 1));
+			memcpy(out, src + (size_t)x * pixel_size, pixel_size);
+			out += pixel_size;
+			x += run;
+			continue;
+		}
+
+		// Raw packet up to the start of the next run.
+		int count = run;
+		while (x + count < width && count < TGA_MAX_PACKET_PIXELS && GetTgaRunLength(src, x + count, width, pixel_size) < min_run) ++count;
+		*out++ = (u8)(count - 1);
+		memcpy(out, src + (size_t)x * pixel_size, (size_t)count * pixel_size);
+		out += (size_t)count * pixel_size;
+		x += count;
+	}
+	return out - dst;
+}
+
+bool BeginTgaWrite(TgaWriter* writer, const char* file_path, int width, int height, int channel_count, bool is_rle)
+{
+	assert(writer && file_path);
+	*writer = {};
+	if (width <= 0 || height <= 0 || width > U16_MAX || height > U16_MAX) return false;
+	if (channel_count != 1 && channel_count != 3 && channel_count != 4) return false;
+
+	if (!OpenEncoderFile(&writer->file, file_path)) return false;
+	writer->width = width;
+	writer->height = height;
+	writer->channel_count = channel_count;
+	writer->is_rle = is_rle;
+
+	size_t row_size = (size_t)width * channel_count;
+	writer->row = (u8*)malloc(row_size); // @malloc
+	if (is_rle) writer->packed = (u8*)malloc(row_size + width / TGA_MAX_PACKET_PIXELS + 1); // @malloc
+
+	u8 header[TGA_HEADER_SIZE] = {};
+	u8 image_type = (channel_count == 1) ? 3 : 2; // Gray or true color.
+	header[2] = is_rle ? image_type + 8 : image_type;
+	PutU16LittleEndian(header + 12, width);
+	PutU16LittleEndian(header + 14, height);
+	header[16] = (u8)(channel_count * 8);
+	header[17] = (u8)(0x20 | ((channel_count == 4) ? 8 : 0)); // Top-left origin, alpha bits.
+	return WriteEncoderFile(&writer->file, header, TGA_HEADER_SIZE);
+}
+
+bool WriteTgaRows(TgaWriter* writer, const void* rows, int row_count, size_t stride)
+{
+	assert(writer && rows);
+	if (!writer->file.file || writer->file.has_error) return false;
+	if (row_count > writer->height - writer->rows_written) row_count = writer->height - writer->rows_written;
+
+	int channel_count = writer->channel_count;
+	size_t row_size = (size_t)writer->width * channel_count;
+	for (int y = 0; y < row_count; ++y)
+	{
+		const u8* src = (const u8*)rows + (size_t)y * stride;
+		const u8* row = src;
+		if (channel_count > 1)
+		{
+			u8* dst = writer->row;
+			for (size_t i = 0; i < row_size; i += channel_count)
+			{
+				dst[i] = src[i + 2];
+				dst[i + 1] = src[i + 1];
+				dst[i + 2] = src[i];
+				if (channel_count == 4) dst[i + 3] = src[i + 3];
+			}
+			row = dst;
+		}
+
+		if (writer->is_rle)
+		{
+			size_t size = EncodeTgaRow(row, writer->width, channel_count, writer->packed);
+			WriteEncoderFile(&writer->file, writer->packed, size);
+		}
+		else
+		{
+			WriteEncoderFile(&writer->file, row, row_size);
+		}
+	}
+	writer->rows_written += row_count;
+	return !writer->file.has_error;
+}
+
+bool EndTgaWrite(TgaWriter* writer)
+{
+	assert(writer);
+	bool is_complete = (writer->file.file && writer->rows_written == writer->height);
+	if (is_complete)
+	{
+		// TGA 2.0 footer: no extension area or developer directory.
+		static const u8 footer[26] = {0, 0, 0, 0, 0, 0, 0, 0, 'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O', 'N', '-', 'X', 'F', 'I', 'L', 'E', '.', 0};
+		WriteEncoderFile(&writer->file, footer, sizeof(footer));
+	}
+	bool success = CloseEncoderFile(&writer->file, is_complete);
+	free(writer->row);
+	free(writer->packed);
+	*writer = {};
+	return success;
+}
+
+// HDR
+
+#define HDR_MIN_RLE_WIDTH 8
+#define HDR_MAX_RLE_WIDTH 32767
+#define HDR_MAX_RUN 127
+#define HDR_MAX_LITERALS 128
+
+static void FloatToRgbe(const float* rgb, u8* rgbe)
+{
+	float max = rgb[0];
+	if (rgb[1] > max) max = rgb[1];
+	if (rgb[2] > max) max = rgb[2];
+	if (max < 1e-32f)
+	{
+		rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+		return;
+	}
+
+	int exponent;
+	float scale = frexpf(max, &exponent) * 256.0f / max;
+	for (int i = 0; i < 3; ++i) rgbe[i] = (u8)((rgb[i] > 0.0f) ? rgb[i] * scale : 0.0f);
+	rgbe[3] = (u8)(exponent + 128);
+}
+
+// Run-length encodes one of the four components of a scanline: runs of 4 or more equal bytes become
+// (128 + length, value) pairs, anything in between goes out as (count, bytes...) literals.
+static u8* EncodeHdrComponent(const u8* values, int width, u8* out)
+{
+	int x = 0;
+	while (x < width)
+	{
+		int run_start = x;
+		int run_length = 0;
+		while (run_start < width)
+		{
+			run_length = 1;
+			while (run_start + run_length < width && run_length < HDR_MAX_RUN && values[run_start + run_length] == values[run_start]) ++run_length;
+			if (run_length >= 4) break;
+			run_start += run_length;
+			run_length = 0;
+		}
+
+		while (x < run_start)
+		{
+			int count = (run_start - x < HDR_MAX_LITERALS) ? run_start - x : HDR_MAX_LITERALS;
+			*out++ = (u8)count;
+			memcpy(out, values + x, count);
+			out += count;
+			x += count;
+		}
+		if (run_length)
+		{
+			*out++ = (u8)(128 + run_length);
+			*out++ = values[run_start];
+			x = run_start + run_length;
+		}
+	}
+	return out;
+}
+
+struct HdrEncodeJob
+{
+	HdrWriter* writer;
+	const float* rows;
+	size_t stride;
+};
+
+// ParallelFor callback: converts and encodes rows [begin, end) of one WriteHdrRows call.
+static void EncodeHdrRows(int begin, int end, void* data)
+{
+	HdrEncodeJob* job = (HdrEncodeJob*)data;
+	HdrWriter* writer = job->writer;
+	int width = writer->width;
+	bool is_rle = (width >= HDR_MIN_RLE_WIDTH && width <= HDR_MAX_RLE_WIDTH);
+
+	u8* components = is_rle ? (u8*)malloc((size_t)width * 4) : 0; // @malloc
+	for (int y = begin; y < end; ++y)
+	{
+		const float* src = (const float*)((const u8*)job->rows + (size_t)y * job->stride);
+		u8* dst = writer->encoded + (size_t)y * writer->row_capacity;
+		if (!is_rle)
+		{
+			for (int x = 0; x < width; ++x) FloatToRgbe(src + x * 3, dst + x * 4);
+			writer->encoded_sizes[y] = (size_t)width * 4;
+			continue;
+		}
+
+		// Components are stored planar, so each one gets its own runs.
+		for (int x = 0; x < width; ++x)
+		{
+			u8 rgbe[4];
+			FloatToRgbe(src + x * 3, rgbe);
+			for (int c = 0; c < 4; ++c) components[c * width + x] = rgbe[c];
+		}
+		u8* out = dst;
+		*out++ = 2;
+		*out++ = 2;
+		*out++ = (u8)(width >> 8);
+		*out++ = (u8)width;
+		for (int c = 0; c < 4; ++c) out = EncodeHdrComponent(components + c * width, width, out);
+		writer->encoded_sizes[y] = out - dst;
+	}
+	free(components);
+}
+
+bool BeginHdrWrite(HdrWriter* writer, const char* file_path, int width, int height)
+{
+	assert(writer && file_path);
+	*writer = {};
+	if (width <= 0 || height <= 0) return false;
+
+	if (!OpenEncoderFile(&writer->file, file_path)) return false;
+	writer->width = width;
+	writer->height = height;
+	writer->row_capacity = 4 + 4 * ((size_t)width + (width + HDR_MAX_LITERALS - 1) / HDR_MAX_LITERALS);
+
+	char header[128];
+	int size = snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+	return WriteEncoderFile(&writer->file, header, size);
+}
+
+bool WriteHdrRows(HdrWriter* writer, const float* rows, int row_count, size_t stride)
+{
+	assert(writer && rows);
+	if (!writer->file.file || writer->file.has_error) return false;
+	if (row_count > writer->height - writer->rows_written) row_count = writer->height - writer->rows_written;
+	if (row_count <= 0) return true;
+
+	if (row_count > writer->encoded_row_capacity)
+	{
+		writer->encoded = (u8*)realloc(writer->encoded, writer->row_capacity * row_count); // @malloc
+		writer->encoded_sizes = (size_t*)realloc(writer->encoded_sizes, sizeof(size_t) * row_count); // @malloc
+		writer->encoded_row_capacity = row_count;
+	}
+
+	HdrEncodeJob job = {writer, rows, stride};
+	ParallelFor(row_count, 4, EncodeHdrRows, &job);
+	for (int y = 0; y < row_count; ++y)
+	{
+		WriteEncoderFile(&writer->file, writer->encoded + (size_t)y * writer->row_capacity, writer->encoded_sizes[y]);
+	}
+	writer->rows_written += row_count;
+	return !writer->file.has_error;
+}
+
+bool EndHdrWrite(HdrWriter* writer)
+{
+	assert(writer);
+	bool success = CloseEncoderFile(&writer->file, writer->rows_written == writer->height);
+	free(writer->encoded);
+	free(writer->encoded_sizes);
+	*writer = {};
+	return success;
+}
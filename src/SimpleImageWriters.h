@@ -0,0 +1,62 @@
+#ifndef _SIMPLE_IMAGE_WRITERS_H
+#define _SIMPLE_IMAGE_WRITERS_H
+
+#include "EncoderFile.h"
+
+// Streaming writers for the formats that need little more than a header and some byte shuffling: BMP,
+// TGA and Radiance HDR. Each is used the same way as PngWriter: Begin, any number of WriteRows calls
+// with the rows in order, then End, which deletes the file if it was left incomplete.
+
+// 24-bit BGR or 32-bit BGRA (with a V4 header carrying the alpha mask). Rows are stored top-down, which
+// is what lets them be written as they arrive.
+struct BmpWriter
+{
+	EncoderFile file;
+	int width;
+	int height;
+	int channel_count; // 3 or 4; rows come in as RGB or RGBA.
+	size_t row_size; // Bytes per stored row, padded to a multiple of 4.
+	int rows_written;
+	u8* row;
+};
+
+bool BeginBmpWrite(BmpWriter* writer, const char* file_path, int width, int height, int channel_count);
+bool WriteBmpRows(BmpWriter* writer, const void* rows, int row_count, size_t stride);
+bool EndBmpWrite(BmpWriter* writer);
+
+// Gray, BGR or BGRA with a top-left origin, optionally run-length encoded (packets never cross rows).
+struct TgaWriter
+{
+	EncoderFile file;
+	int width;
+	int height;
+	int channel_count; // 1, 3 or 4; rows come in as gray, RGB or RGBA.
+	bool is_rle;
+	int rows_written;
+	u8* row; // One row in BGR(A) order.
+	u8* packed; // Run-length encoded row, when is_rle.
+};
+
+bool BeginTgaWrite(TgaWriter* writer, const char* file_path, int width, int height, int channel_count, bool is_rle);
+bool WriteTgaRows(TgaWriter* writer, const void* rows, int row_count, size_t stride);
+bool EndTgaWrite(TgaWriter* writer);
+
+// RGBE with the usual per-channel scanline RLE. Rows come in as linear float RGB and are encoded on the
+// job system, one row per task.
+struct HdrWriter
+{
+	EncoderFile file;
+	int width;
+	int height;
+	int rows_written;
+	size_t row_capacity; // Worst case encoded size of one row.
+	u8* encoded; // One slot of row_capacity per row of the current call.
+	size_t* encoded_sizes;
+	int encoded_row_capacity;
+};
+
+bool BeginHdrWrite(HdrWriter* writer, const char* file_path, int width, int height);
+bool WriteHdrRows(HdrWriter* writer, const float* rows, int row_count, size_t stride);
+bool EndHdrWrite(HdrWriter* writer);
+
+#endif //_SIMPLE_IMAGE_WRITERS_H
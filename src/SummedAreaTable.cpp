@@ -0,0 +1,200 @@
+#include "SummedAreaTable.h"
+#include "Core/JobSystem.h"
+#include "Core/FrameScheduler.h"
+
+// Entries per batch in the column pass. Each batch walks down every row, so it should be at least a
+// cache line or two wide.
+#define SUMMED_AREA_COLUMN_BATCH 256
+
+struct SummedAreaBuild
+{
+	const void* pixels;
+	PixelLayout layout;
+	SummedAreaTable* table;
+	size_t row_entries; // (width + 1) * channel_count.
+};
+
+// ParallelFor callback: fills table rows [begin, end) with running sums along each source row. Table
+// row y + 1 holds source row y.
+template <typename S, typename T>
+static void SumSummedAreaRows(int begin, int end, void* data)
+{
+	SummedAreaBuild* build = (SummedAreaBuild*)data;
+	int width = build->table->width;
+	int channel_count = build->table->channel_count;
+	for (int y = begin; y < end; ++y)
+	{
+		const T* src = (const T*)build->pixels + (size_t)y * width * channel_count;
+		S* dst = (S*)build->table->sums + (size_t)(y + 1) * build->row_entries;
+
+		S running[4] = {};
+		for (int c = 0; c < channel_count; ++c) dst[c] = 0;
+		dst += channel_count;
+		for (int x = 0; x < width; ++x, src += channel_count, dst += channel_count)
+		{
+			for (int c = 0; c < channel_count; ++c)
+			{
+				running[c] += (S)src[c];
+				dst[c] = running[c];
+			}
+		}
+	}
+}
+
+// ParallelFor callback: adds each row to the one below it for batches [begin, end) of columns, which
+// turns the row sums into area sums.
+template <typename S>
+static void SumSummedAreaColumns(int begin, int end, void* data)
+{
+	SummedAreaBuild* build = (SummedAreaBuild*)data;
+	size_t first = (size_t)begin * SUMMED_AREA_COLUMN_BATCH;
+	size_t last = (size_t)end * SUMMED_AREA_COLUMN_BATCH;
+	if (last > build->row_entries) last = build->row_entries;
+
+	S* sums = (S*)build->table->sums;
+	for (int y = 2; y <= build->table->height; ++y)
+	{
+		const S* above = sums + (size_t)(y - 1) * build->row_entries;
+		S* row = sums + (size_t)y * build->row_entries;
+		for (size_t i = first; i < last; ++i) row[i] += above[i];
+	}
+}
+
+template <typename S, typename T>
+static void FillSummedAreaTable(SummedAreaBuild* build)
+{
+	memset(build->table->sums, 0, build->row_entries * sizeof(S));
+	ParallelFor(build->table->height, 16, SumSummedAreaRows<S, T>, build);
+
+	int batch_count = (int)((build->row_entries + SUMMED_AREA_COLUMN_BATCH - 1) / SUMMED_AREA_COLUMN_BATCH);
+	ParallelFor(batch_count, 1, SumSummedAreaColumns<S>, build);
+}
+
+static size_t GetSummedAreaEntrySize(SummedAreaType type)
+{
+	return (type == SummedAreaType::U32) ? sizeof(u32) : sizeof(u64);
+}
+
+bool BuildSummedAreaTable(SummedAreaTable* table, const void* pixels, PixelLayout layout, int width, int height)
+{
+	assert(table && pixels && width > 0 && height > 0);
+	*table = {};
+
+	// 32-bit sums are enough when even the whole image can't overflow them, which halves the size of
+	// the table for anything up to about 16 MP at 8 bits.
+	SummedAreaType type = SummedAreaType::F64;
+	if (layout.type != PixelType::F32)
+	{
+		u64 max_value = (layout.type == PixelType::U8) ? U8_MAX : U16_MAX;
+		type = (max_value * (u64)width * (u64)height <= U32_MAX) ? SummedAreaType::U32 : SummedAreaType::U64;
+	}
+
+	SummedAreaBuild build = {};
+	build.pixels = pixels;
+	build.layout = layout;
+	build.table = table;
+	build.row_entries = (size_t)(width + 1) * layout.channel_count;
+
+	table->sums = malloc(build.row_entries * (size_t)(height + 1) * GetSummedAreaEntrySize(type)); // @malloc
+	if (!table->sums) return false;
+	table->width = width;
+	table->height = height;
+	table->channel_count = layout.channel_count;
+	table->type = type;
+
+	if (layout.type == PixelType::F32) FillSummedAreaTable<double, float>(&build);
+	else if (layout.type == PixelType::U16 && type == SummedAreaType::U32) FillSummedAreaTable<u32, u16>(&build);
+	else if (layout.type == PixelType::U16) FillSummedAreaTable<u64, u16>(&build);
+	else if (type == SummedAreaType::U32) FillSummedAreaTable<u32, u8>(&build);
+	else FillSummedAreaTable<u64, u8>(&build);
+	return true;
+}
+
+void FreeSummedAreaTable(SummedAreaTable* table)
+{
+	if (!table) return;
+	free(table->sums);
+	*table = {};
+}
+
+// Four corners per channel. Integer tables are differenced in their own type, which is exact even when
+// intermediate steps wrap around, since the result always fits.
+template <typename S>
+static void GetSummedAreaSumsOfType(const SummedAreaTable* table, int x, int y, int width, int height, double* sums)
+{
+	size_t row_entries = (size_t)(table->width + 1) * table->channel_count;
+	const S* top = (const S*)table->sums + (size_t)y * row_entries;
+	const S* bottom = (const S*)table->sums + (size_t)(y + height) * row_entries;
+	size_t left = (size_t)x * table->channel_count;
+	size_t right = (size_t)(x + width) * table->channel_count;
+	for (int c = 0; c < table->channel_count; ++c)
+	{
+		S sum = bottom[right + c] - bottom[left + c] - top[right + c] + top[left + c];
+		sums[c] = (double)sum;
+	}
+}
+
+void GetSummedAreaSums(const SummedAreaTable* table, int x, int y, int width, int height, double* sums)
+{
+	assert(table && table->sums && sums);
+	assert(x >= 0 && y >= 0 && width >= 0 && height >= 0);
+	assert(x + width <= table->width && y + height <= table->height);
+	switch (table->type)
+	{
+		case SummedAreaType::U32: GetSummedAreaSumsOfType<u32>(table, x, y, width, height, sums); break;
+		case SummedAreaType::U64: GetSummedAreaSumsOfType<u64>(table, x, y, width, height, sums); break;
+		case SummedAreaType::F64: GetSummedAreaSumsOfType<double>(table, x, y, width, height, sums); break;
+	}
+}
+
+static void DestroySummedAreaJob(void* data)
+{
+	SummedAreaJob* job = (SummedAreaJob*)data;
+	ReleasePixelBuffer(job->pixels);
+	FreeSummedAreaTable(&job->table);
+	delete job;
+}
+
+static void RunSummedAreaJob(void* data)
+{
+	SummedAreaJob* job = (SummedAreaJob*)data;
+	const DecodedImage* image = &job->pixels->image;
+	bool success = BuildSummedAreaTable(&job->table, image->pixels, image->layout, image->width, image->height);
+
+	// The table has everything it needs now, so let the pixels go in case the panel is gone.
+	ReleasePixelBuffer(job->pixels);
+	job->pixels = 0;
+
+	job->state.store(success ? SummedAreaState::Ready : SummedAreaState::Failed);
+	WakeFrameScheduler();
+}
+
+SummedAreaJob* QueueSummedAreaTableBuild(PixelBuffer* pixels)
+{
+	assert(pixels);
+	SummedAreaJob* job = new SummedAreaJob();
+	job->pixels = RetainPixelBuffer(pixels);
+	job->table = {};
+	job->state.store(SummedAreaState::Building);
+	PushSharedJob(&job->shared, RunSummedAreaJob, DestroySummedAreaJob, job);
+	return job;
+}
+
+SummedAreaState GetSummedAreaState(SummedAreaJob* job)
+{
+	assert(job);
+	return job->state.load();
+}
+
+const SummedAreaTable* GetSummedAreaTable(SummedAreaJob* job)
+{
+	assert(job);
+	return (job->state.load() == SummedAreaState::Ready) ? &job->table : 0;
+}
+
+void ReleaseSummedAreaJob(SummedAreaJob* job)
+{
+	if (!job) return;
+	CancelSharedJob(&job->shared);
+	ReleaseSharedJob(&job->shared);
+}
@@ -0,0 +1,62 @@
+#ifndef _SUMMED_AREA_TABLE_H
+#define _SUMMED_AREA_TABLE_H
+
+#include "ImageDecode.h"
+
+// Summed-area tables: every entry holds the per-channel sum of all pixels above and to the left of it,
+// so the sum over any rectangle takes four lookups no matter how big it is.
+
+enum class SummedAreaType : u8
+{
+	U32 = 0, // Integer sources small enough that the whole image can't overflow 32 bits.
+	U64,
+	F64 // Float sources.
+};
+
+struct SummedAreaTable
+{
+	int width;
+	int height;
+	int channel_count;
+	SummedAreaType type;
+	void* sums; // (width + 1) x (height + 1) entries of channel_count sums each; the first row and column are zero.
+};
+
+// Returns false (and leaves the table zeroed) if it couldn't be allocated. Rows and then columns are
+// split across the job system.
+bool BuildSummedAreaTable(SummedAreaTable* table, const void* pixels, PixelLayout layout, int width, int height);
+void FreeSummedAreaTable(SummedAreaTable* table);
+
+// Per-channel sums over the width x height region at (x, y), which must lie inside the table. sums must
+// hold channel_count values.
+void GetSummedAreaSums(const SummedAreaTable* table, int x, int y, int width, int height, double* sums);
+
+enum class SummedAreaState : u32
+{
+	Building = 0,
+	Ready,
+	Failed
+};
+
+// A table being built in the background.
+struct SummedAreaJob
+{
+	SharedJob shared;
+	PixelBuffer* pixels; // A reference, dropped as soon as the table is done.
+	SummedAreaTable table;
+
+	std::atomic<SummedAreaState> state;
+};
+
+// Queues a build and returns immediately. The caller owns one reference and must eventually hand it back
+// with ReleaseSummedAreaJob.
+SummedAreaJob* QueueSummedAreaTableBuild(PixelBuffer* pixels);
+SummedAreaState GetSummedAreaState(SummedAreaJob* job);
+
+// Null until the job is Ready. The table belongs to the job.
+const SummedAreaTable* GetSummedAreaTable(SummedAreaJob* job);
+
+// Drops the caller's reference. If the build hasn't started yet, it is skipped.
+void ReleaseSummedAreaJob(SummedAreaJob* job);
+
+#endif //_SUMMED_AREA_TABLE_H
@@ -0,0 +1,53 @@
+// Unity build for the headless tests (Tests/TestMain.cpp). Same sources as CliBuild.cpp, with the tests in
+// place of the command-line entry point, so everything they cover builds and runs without a window.
+#define CORE_HEADLESS
+
+// Core stuff.
+#include "Core/EngineCore.cpp"
+#include "Core/JobSystem.cpp"
+#include "Core/FrameScheduler.cpp"
+
+// Platform stuff.
+#include "Platform/Platform.cpp"
+
+// Decoding, encoding and analysis.
+#include "ImageDecode.cpp"
+#include "ThumbnailDecode.cpp"
+#include "ProgressiveDecode.cpp"
+#include "ThumbnailCache.cpp"
+#include "MipChain.cpp"
+#include "UploadScheduler.cpp"
+#include "Deflate.cpp"
+#include "EncoderFile.cpp"
+#include "PngWriter.cpp"
+#include "SimpleImageWriters.cpp"
+#include "JpegWriter.cpp"
+#include "BlockCompress.cpp"
+#include "DdsWriter.cpp"
+#include "ImageExport.cpp"
+#include "ImageStats.cpp"
+#include "ImageDiff.cpp"
+#include "ImageSsim.cpp"
+#include "BulkFileRead.cpp"
+
+// Viewer bookkeeping that doesn't touch the renderer.
+#include "TiledImage.cpp"
+#include "SummedAreaTable.cpp"
+
+// Tests, then the entry point that runs them.
+#include "Tests/TestMain.h"
+#include "Tests/DecodeTests.cpp"
+#include "Tests/MipChainTests.cpp"
+#include "Tests/TiledImageTests.cpp"
+#include "Tests/WriterTests.cpp"
+#include "Tests/ProgressiveDecodeTests.cpp"
+#include "Tests/UploadSchedulerTests.cpp"
+#include "Tests/ImageStatsTests.cpp"
+#include "Tests/SummedAreaTableTests.cpp"
+#include "Tests/ImageDiffTests.cpp"
+#include "Tests/ImageSsimTests.cpp"
+#include "Tests/ImageLoadTests.cpp"
+#include "Tests/BlockCompressTests.cpp"
+#include "Tests/ThumbnailDecodeTests.cpp"
+#include "Tests/ThumbnailCacheTests.cpp"
+#include "Tests/TestMain.cpp"
@@ -0,0 +1,279 @@
+// Tests of BlockCompress.cpp and DdsWriter.cpp. stb_image can't read DDS, so the blocks are decoded here,
+// straight from the format descriptions rather than from anything the encoders share.
+#include "TestMain.h"
+#include "BlockCompress.h"
+#include "DdsWriter.h"
+
+static u32 GetTestU32(const u8* src)
+{
+	return (u32)src[0] | ((u32)src[1] << 8) | ((u32)src[2] << 16) | ((u32)src[3] << 24);
+}
+
+// BC1 color, or the color half of BC3, which always has four colors whatever order the endpoints are in.
+static void DecodeTestColorBlock(const u8* block, bool is_bc1, u8* rgba)
+{
+	u32 colors[2] = {(u32)block[0] | ((u32)block[1] << 8), (u32)block[2] | ((u32)block[3] << 8)};
+	int palette[4][4];
+	for (int i = 0; i < 2; ++i)
+	{
+		int r = (colors[i] >> 11) & 31, g = (colors[i] >> 5) & 63, b = colors[i] & 31;
+		palette[i][0] = (r << 3) | (r >> 2);
+		palette[i][1] = (g << 2) | (g >> 4);
+		palette[i][2] = (b << 3) | (b >> 2);
+		palette[i][3] = 255;
+	}
+	bool is_four_color = !is_bc1 || colors[0] > colors[1];
+	for (int c = 0; c < 3; ++c)
+	{
+		palette[2][c] = is_four_color ? (2 * palette[0][c] + palette[1][c]) / 3 : (palette[0][c] + palette[1][c]) / 2;
+		palette[3][c] = is_four_color ? (palette[0][c] + 2 * palette[1][c]) / 3 : 0;
+	}
+	palette[2][3] = 255;
+	palette[3][3] = is_four_color ? 255 : 0;
+
+	u32 indices = GetTestU32(block + 4);
+	for (int i = 0; i < 16; ++i)
+	{
+		const int* color = palette[(indices >> (i * 2)) & 3];
+		for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = (u8)color[c];
+	}
+}
+
+static void DecodeTestAlphaBlock(const u8* block, u8* rgba)
+{
+	int palette[8] = {block[0], block[1]};
+	if (block[0] > block[1])
+	{
+		for (int i = 2; i < 8; ++i) palette[i] = ((8 - i) * block[0] + (i - 1) * block[1]) / 7;
+	}
+	else
+	{
+		for (int i = 2; i < 6; ++i) palette[i] = ((6 - i) * block[0] + (i - 1) * block[1]) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	u64 indices = 0;
+	for (int i = 0; i < 6; ++i) indices |= (u64)block[2 + i] << (i * 8);
+	for (int i = 0; i < 16; ++i) rgba[i * 4 + 3] = (u8)palette[(indices >> (i * 3)) & 7];
+}
+
+static u32 ReadTestBlockBits(const u8* block, int* position, int count)
+{
+	u32 value = 0;
+	for (int i = 0; i < count; ++i, ++*position) value |= (u32)((block[*position >> 3] >> (*position & 7)) & 1) << i;
+	return value;
+}
+
+// Mode 6 only, which is all CompressBlockBC7 writes. Anything else decodes as magenta, so it shows up.
+static void DecodeTestBc7Block(const u8* block, u8* rgba)
+{
+	static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+	int position = 0;
+	if (ReadTestBlockBits(block, &position, 7) != (1 << 6))
+	{
+		for (int i = 0; i < 16; ++i) memcpy(rgba + i * 4, "\xFF\x00\xFF\xFF", 4);
+		return;
+	}
+	int endpoints[2][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		endpoints[0][c] = ReadTestBlockBits(block, &position, 7);
+		endpoints[1][c] = ReadTestBlockBits(block, &position, 7);
+	}
+	for (int e = 0; e < 2; ++e)
+	{
+		int p_bit = ReadTestBlockBits(block, &position, 1);
+		for (int c = 0; c < 4; ++c) endpoints[e][c] = (endpoints[e][c] << 1) | p_bit;
+	}
+	for (int i = 0; i < 16; ++i)
+	{
+		int w = weights[ReadTestBlockBits(block, &position, (i == 0) ? 3 : 4)];
+		for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = (u8)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+	}
+}
+
+static void DecodeTestBlock(BlockFormat format, const u8* block, u8* rgba)
+{
+	switch (format)
+	{
+		case BlockFormat::BC1: DecodeTestColorBlock(block, true, rgba); break;
+		case BlockFormat::BC3:
+			DecodeTestColorBlock(block + 8, false, rgba);
+			DecodeTestAlphaBlock(block, rgba);
+			break;
+		case BlockFormat::BC7: DecodeTestBc7Block(block, rgba); break;
+	}
+}
+
+// Decodes width x height pixels' worth of blocks, which are in rows of (width + 3) / 4.
+static u8* DecodeTestBlocks(BlockFormat format, const u8* blocks, int width, int height)
+{
+	u8* pixels = (u8*)malloc((size_t)width * height * 4); // @malloc
+	int block_columns = (width + 3) / 4;
+	for (int by = 0; by < (height + 3) / 4; ++by)
+	{
+		for (int bx = 0; bx < block_columns; ++bx)
+		{
+			u8 block_pixels[16 * 4];
+			DecodeTestBlock(format, blocks + ((size_t)by * block_columns + bx) * GetBlockFormatSize(format), block_pixels);
+			for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+			{
+				for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+				{
+					memcpy(pixels + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, block_pixels + (y * 4 + x) * 4, 4);
+				}
+			}
+		}
+	}
+	return pixels;
+}
+
+// A soft diagonal ramp, the kind of content block compression is built for, with a little variation
+// across it, and alpha crossing 128 so BC1 has transparent pixels to deal with.
+static u8* MakeSmoothTestImage(int width, int height)
+{
+	u8* pixels = (u8*)malloc((size_t)width * height * 4); // @malloc
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			u8* pixel = pixels + ((size_t)y * width + x) * 4;
+			int t = (x * 2 + y) % 160;
+			pixel[0] = (u8)(40 + t);
+			pixel[1] = (u8)(220 - t * 3 / 4 + (y & 3) / 2);
+			pixel[2] = (u8)(90 + t / 3);
+			pixel[3] = (u8)(255 - (x * 6) % 256);
+		}
+	}
+	return pixels;
+}
+
+// Root mean square error of channels [first_channel, end_channel), over the pixels whose source alpha is
+// at least min_alpha.
+static double GetBlockTestError(const u8* a, const u8* b, int pixel_count, int first_channel, int end_channel, int min_alpha)
+{
+	double sum = 0.0;
+	int count = 0;
+	for (int i = 0; i < pixel_count; ++i)
+	{
+		if (a[i * 4 + 3] < min_alpha) continue;
+		for (int c = first_channel; c < end_channel; ++c)
+		{
+			double delta = (double)a[i * 4 + c] - b[i * 4 + c];
+			sum += delta * delta;
+			++count;
+		}
+	}
+	return count ? sqrt(sum / count) : 0.0;
+}
+
+// Each format on smooth content, compressed with CompressBlockRow (at a width and height that leave
+// partial blocks) and decoded back. BC1 alpha has to be exactly the 1-bit version of the source.
+static void TestBlockCompress()
+{
+	const int width = 38;
+	const int height = 22;
+	u8* source = MakeSmoothTestImage(width, height);
+	static const BlockFormat formats[] = {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC7};
+	static const double max_color_errors[] = {2.0, 2.0, 1.0};
+	for (int f = 0; f < (int)ARRAYCOUNT(formats); ++f)
+	{
+		BlockFormat format = formats[f];
+		size_t block_row_size = (size_t)((width + 3) / 4) * GetBlockFormatSize(format);
+		u8* blocks = (u8*)malloc(block_row_size * ((height + 3) / 4)); // @malloc
+		for (int y = 0; y < height; y += 4)
+		{
+			int row_count = (height - y < 4) ? height - y : 4;
+			CompressBlockRow(format, source + (size_t)y * width * 4, (size_t)width * 4, width, row_count, blocks + (y / 4) * block_row_size);
+		}
+		u8* decoded = DecodeTestBlocks(format, blocks, width, height);
+
+		int pixel_count = width * height;
+		if (format == BlockFormat::BC1)
+		{
+			TEST_CHECK(GetBlockTestError(source, decoded, pixel_count, 0, 3, 128) < max_color_errors[f]);
+			bool is_alpha_exact = true;
+			for (int i = 0; i < pixel_count; ++i) is_alpha_exact &= decoded[i * 4 + 3] == ((source[i * 4 + 3] >= 128) ? 255 : 0);
+			TEST_CHECK(is_alpha_exact);
+		}
+		else
+		{
+			TEST_CHECK(GetBlockTestError(source, decoded, pixel_count, 0, 3, 0) < max_color_errors[f]);
+			TEST_CHECK(GetBlockTestError(source, decoded, pixel_count, 3, 4, 0) < 1.0);
+		}
+		free(decoded);
+		free(blocks);
+	}
+	free(source);
+
+	// A flat block comes back flat, and within a step of its color.
+	u8 flat[16 * 4];
+	for (int i = 0; i < 16; ++i) memcpy(flat + i * 4, "\x64\x96\xC8\xFF", 4);
+	for (int f = 0; f < (int)ARRAYCOUNT(formats); ++f)
+	{
+		u8 block[16];
+		u8 decoded[16 * 4];
+		CompressBlockRow(formats[f], flat, 16, 4, 4, block);
+		DecodeTestBlock(formats[f], block, decoded);
+		bool is_flat = true;
+		for (int i = 1; i < 16; ++i) is_flat &= memcmp(decoded, decoded + i * 4, 4) == 0;
+		TEST_CHECK(is_flat);
+		for (int c = 0; c < 4; ++c) TEST_CHECK(abs(decoded[c] - flat[c]) <= 4);
+	}
+}
+
+// Files tall enough for more than two bands, written in uneven batches of rows, with their headers read
+// back field by field and their blocks decoded.
+static void TestDdsRoundTrip()
+{
+	const int width = 37;
+	const int height = (GetJobWorkerCount() + 1) * DDS_BLOCK_ROWS_PER_WORKER * 4 * 2 + 7;
+	const char* file_path = "test_writer.dds";
+	u8* source = MakeSmoothTestImage(width, height);
+	static const BlockFormat formats[] = {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC7};
+	static const char* four_ccs[] = {"DXT1", "DXT5", "DX10"};
+	static const double max_color_errors[] = {2.0, 2.0, 1.0};
+	for (int f = 0; f < (int)ARRAYCOUNT(formats); ++f)
+	{
+		BlockFormat format = formats[f];
+		DdsWriter writer;
+		TEST_CHECK(BeginDdsWrite(&writer, file_path, width, height, format));
+		TEST_CHECK(WriteDdsRows(&writer, source, WRITER_TEST_FIRST_ROWS, (size_t)width * 4));
+		TEST_CHECK(WriteDdsRows(&writer, source + (size_t)WRITER_TEST_FIRST_ROWS * width * 4, height - WRITER_TEST_FIRST_ROWS, (size_t)width * 4));
+		TEST_CHECK(EndDdsWrite(&writer));
+
+		u32 linear_size = (u32)(((width + 3) / 4) * ((height + 3) / 4) * GetBlockFormatSize(format));
+		u32 header_size = 4 + DDS_HEADER_SIZE + ((format == BlockFormat::BC7) ? DDS_DX10_HEADER_SIZE : 0);
+		s64 file_size = Platform::GetFileSize(file_path);
+		TEST_CHECK(file_size == (s64)(header_size + linear_size));
+		if (file_size != (s64)(header_size + linear_size)) continue;
+
+		u8* file = (u8*)malloc((size_t)file_size); // @malloc
+		TEST_CHECK(Platform::ReadFileToBuffer(file_path, file, (u64)file_size));
+		const u8* dds = file + 4;
+		TEST_CHECK(memcmp(file, "DDS ", 4) == 0);
+		TEST_CHECK(GetTestU32(dds) == DDS_HEADER_SIZE);
+		TEST_CHECK(GetTestU32(dds + 4) == (DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE));
+		TEST_CHECK(GetTestU32(dds + 8) == (u32)height && GetTestU32(dds + 12) == (u32)width);
+		TEST_CHECK(GetTestU32(dds + 16) == linear_size);
+		TEST_CHECK(GetTestU32(dds + 24) == 1);
+		TEST_CHECK(GetTestU32(dds + 72) == DDS_PIXEL_FORMAT_SIZE && GetTestU32(dds + 76) == DDPF_FOURCC);
+		TEST_CHECK(memcmp(dds + 80, four_ccs[f], 4) == 0);
+		TEST_CHECK(GetTestU32(dds + 104) == DDSCAPS_TEXTURE);
+		if (format == BlockFormat::BC7)
+		{
+			const u8* dx10 = dds + DDS_HEADER_SIZE;
+			TEST_CHECK(GetTestU32(dx10) == DXGI_FORMAT_BC7_UNORM_VALUE);
+			TEST_CHECK(GetTestU32(dx10 + 4) == D3D10_RESOURCE_DIMENSION_TEXTURE2D_VALUE);
+			TEST_CHECK(GetTestU32(dx10 + 8) == 0 && GetTestU32(dx10 + 12) == 1 && GetTestU32(dx10 + 16) == 0);
+		}
+
+		u8* decoded = DecodeTestBlocks(format, file + header_size, width, height);
+		int min_alpha = (format == BlockFormat::BC1) ? 128 : 0;
+		TEST_CHECK(GetBlockTestError(source, decoded, width * height, 0, 3, min_alpha) < max_color_errors[f]);
+		free(decoded);
+		free(file);
+	}
+	remove(file_path);
+	free(source);
+}
@@ -0,0 +1,57 @@
+// Tests of ImageDecode.cpp.
+#include "TestMain.h"
+#include "ImageDecode.h"
+
+// A w x h RGBA pattern where every pixel differs from its neighbours in every channel.
+static u8* MakeTestPattern(int width, int height)
+{
+	u8* pixels = (u8*)malloc((size_t)width * height * 4); // @malloc
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			u8* pixel = pixels + ((size_t)y * width + x) * 4;
+			pixel[0] = (u8)(x * 7 + y * 3);
+			pixel[1] = (u8)(x * 5 + y * 11);
+			pixel[2] = (u8)(x * 13 + y);
+			pixel[3] = (u8)(255 - x - y);
+		}
+	}
+	return pixels;
+}
+
+// True if image holds the first channel_count channels of the RGBA pixels.
+static bool IsDecodedPattern(const DecodedImage* image, const u8* rgba, int width, int height, int channel_count)
+{
+	if (image->width != width || image->height != height) return false;
+	if (image->layout.channel_count != channel_count || image->layout.type != PixelType::U8) return false;
+	const u8* pixels = (const u8*)image->pixels;
+	for (size_t i = 0; i < (size_t)width * height; ++i)
+	{
+		for (int c = 0; c < channel_count; ++c)
+		{
+			if (pixels[i * channel_count + c] != rgba[i * 4 + c]) return false;
+		}
+	}
+	return true;
+}
+
+// DecodeImageFile decodes from the mapped file, and stb_image used to refuse every BMP without a palette
+// that way, because its check of the pixel data offset only worked for stdio.
+static void TestDecodeBmpFile()
+{
+	const int width = 19;
+	const int height = 7;
+	u8* rgba = MakeTestPattern(width, height);
+	u8 rgb[width * height * 3];
+	for (int i = 0; i < width * height; ++i) memcpy(rgb + i * 3, rgba + i * 4, 3);
+
+	const char* file_path = "test_decode.bmp";
+	TEST_CHECK(stbi_write_bmp(file_path, width, height, 3, rgb));
+	DecodedImage image;
+	TEST_CHECK(DecodeImageFile(file_path, &image));
+	TEST_CHECK(IsDecodedPattern(&image, rgba, width, height, 3));
+	FreeDecodedImage(&image);
+	remove(file_path);
+	free(rgba);
+}
@@ -0,0 +1,310 @@
+// Tests of ImageDiff.cpp. The SSE2 row kernels are checked against DiffRowScalar, and DiffImages and
+// BuildDiffMaskOverlay against the same thing done the slow way.
+#include "TestMain.h"
+#include "ImageDiff.h"
+
+static u32 NextDiffTestRandom(u32* state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static int ClampDiffTestValue(int value, int max)
+{
+	return (value < 0) ? 0 : ((value > max) ? max : value);
+}
+
+// Random values over the type's whole range (floats over [0, 1]), then a copy where most differ by a
+// little and a quarter by anything at all.
+static void FillDiffTestValues(void* a, void* b, PixelType type, size_t count, u32* state)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		u32 r = NextDiffTestRandom(state);
+		bool is_far = (r & 3) == 0;
+		int nudge = (int)((r >> 2) % 5) - 2;
+		if (type == PixelType::U8)
+		{
+			u8 value = (u8)NextDiffTestRandom(state);
+			((u8*)a)[i] = value;
+			((u8*)b)[i] = is_far ? (u8)NextDiffTestRandom(state) : (u8)ClampDiffTestValue(value + nudge, U8_MAX);
+		}
+		else if (type == PixelType::U16)
+		{
+			u16 value = (u16)NextDiffTestRandom(state);
+			((u16*)a)[i] = value;
+			((u16*)b)[i] = is_far ? (u16)NextDiffTestRandom(state) : (u16)ClampDiffTestValue(value + nudge * 300, U16_MAX);
+		}
+		else
+		{
+			float value = (NextDiffTestRandom(state) & 0xFFFF) / 65535.0f;
+			((float*)a)[i] = value;
+			((float*)b)[i] = is_far ? (NextDiffTestRandom(state) & 0xFFFF) / 65535.0f : value + nudge * 0.001f;
+		}
+	}
+}
+
+static double GetDiffTestValue(const void* values, PixelType type, size_t index)
+{
+	if (type == PixelType::U8) return ((const u8*)values)[index];
+	if (type == PixelType::U16) return ((const u16*)values)[index];
+	return ((const float*)values)[index];
+}
+
+static void RunDiffRowScalar(const void* a, const void* b, PixelLayout layout, int width, double threshold, void* difference, u8* mask, DiffTotals* totals)
+{
+	switch (layout.type)
+	{
+		case PixelType::U8: DiffRowScalar((const u8*)a, (const u8*)b, layout.channel_count, 0, width, (u8)threshold, (u8*)difference, mask, totals); break;
+		case PixelType::U16: DiffRowScalar((const u16*)a, (const u16*)b, layout.channel_count, 0, width, (u16)threshold, (u16*)difference, mask, totals); break;
+		case PixelType::F32: DiffRowScalar((const float*)a, (const float*)b, layout.channel_count, 0, width, (float)threshold, (float*)difference, mask, totals); break;
+	}
+}
+
+// Integer squares are added up exactly either way; float ones only in a different order.
+static bool IsSameDiffTotals(const DiffTotals* a, const DiffTotals* b, PixelType type, int channel_count)
+{
+	if (a->mismatch_count != b->mismatch_count) return false;
+	for (int c = 0; c < channel_count; ++c)
+	{
+		if (a->max_error[c] != b->max_error[c]) return false;
+		double tolerance = (type == PixelType::F32) ? 1e-9 * (1.0 + a->squared_error[c]) : 0.0;
+		if (fabs(a->squared_error[c] - b->squared_error[c]) > tolerance) return false;
+	}
+	return true;
+}
+
+// Widths on both sides of every vector size, and thresholds at, just under and either side of the
+// difference of one particular value, so its pixel flips between match and mismatch.
+static void TestDiffKernelsAgree()
+{
+	static const int widths[] = {1, 3, 4, 5, 8, 15, 16, 17, 33, 100};
+	static const PixelType types[] = {PixelType::U8, PixelType::U16, PixelType::F32};
+	const int max_width = 100;
+	u32 state = 1;
+	for (int t = 0; t < (int)ARRAYCOUNT(types); ++t)
+	{
+		for (int channel_count = 1; channel_count <= 4; ++channel_count)
+		{
+			PixelLayout layout = {channel_count, types[t]};
+			size_t row_size = (size_t)max_width * GetPixelSize(layout);
+			u8* buffers = (u8*)malloc(row_size * 4 + max_width * 2); // @malloc
+			u8* a = buffers;
+			u8* b = a + row_size;
+			u8* scalar_difference = b + row_size;
+			u8* difference = scalar_difference + row_size;
+			u8* scalar_mask = difference + row_size;
+			u8* mask = scalar_mask + max_width;
+			FillDiffTestValues(a, b, layout.type, (size_t)max_width * channel_count, &state);
+
+			size_t probe = (size_t)2 * channel_count + channel_count / 2;
+			double probe_difference = fabs(GetDiffTestValue(a, layout.type, probe) - GetDiffTestValue(b, layout.type, probe));
+			double step = (layout.type == PixelType::F32) ? probe_difference * 1e-3 : 1.0;
+			double peak = (layout.type == PixelType::U8) ? 255.0 : ((layout.type == PixelType::U16) ? 65535.0 : 1.0);
+			double thresholds[] = {0.0, probe_difference - step, probe_difference, probe_difference + step, peak};
+			for (int w = 0; w < (int)ARRAYCOUNT(widths); ++w)
+			{
+				for (int i = 0; i < (int)ARRAYCOUNT(thresholds); ++i)
+				{
+					if (thresholds[i] < 0.0) continue;
+					DiffTotals scalar_totals = {};
+					DiffTotals totals = {};
+					RunDiffRowScalar(a, b, layout, widths[w], thresholds[i], scalar_difference, scalar_mask, &scalar_totals);
+					DiffRow(a, b, layout, widths[w], thresholds[i], difference, mask, &totals);
+					size_t compared_size = (size_t)widths[w] * GetPixelSize(layout);
+					TEST_CHECK(memcmp(difference, scalar_difference, compared_size) == 0);
+					TEST_CHECK(memcmp(mask, scalar_mask, widths[w]) == 0);
+					TEST_CHECK(IsSameDiffTotals(&totals, &scalar_totals, layout.type, channel_count));
+					if (widths[w] > 2 && i == 1 && probe_difference > 0.0) TEST_CHECK(mask[2] == 255);
+
+					// Without a mask only the count is kept.
+					DiffTotals count_totals = {};
+					DiffRow(a, b, layout, widths[w], thresholds[i], difference, 0, &count_totals);
+					TEST_CHECK(count_totals.mismatch_count == scalar_totals.mismatch_count);
+				}
+			}
+			free(buffers);
+		}
+	}
+}
+
+// 8-bit squares are added up in 32-bit lanes, which a row this long of the largest possible differences
+// would overflow if they weren't emptied in time.
+static void TestDiffSquaredErrorFlush()
+{
+	const int width = 16 * 70000 + 5;
+	for (int channel_count = 1; channel_count <= 3; channel_count += 2)
+	{
+		size_t value_count = (size_t)width * channel_count;
+		u8* buffers = (u8*)malloc(value_count * 3); // @malloc
+		u8* a = buffers;
+		u8* b = a + value_count;
+		u8* difference = b + value_count;
+		memset(a, 255, value_count);
+		memset(b, 0, value_count);
+		DiffTotals totals = {};
+		DiffRow(a, b, {channel_count, PixelType::U8}, width, 254.0, difference, 0, &totals);
+		TEST_CHECK(totals.mismatch_count == (u64)width);
+		for (int c = 0; c < channel_count; ++c)
+		{
+			TEST_CHECK(totals.squared_error[c] == 255.0 * 255.0 * width);
+			TEST_CHECK(totals.max_error[c] == 255.0);
+		}
+		free(buffers);
+	}
+}
+
+// Whole images, in matching and mixed layouts, against rows brought to the compared layout by hand and
+// diffed with the scalar kernel.
+static void TestDiffImages()
+{
+	static const PixelLayout layouts[][2] = {
+		{{4, PixelType::U8}, {4, PixelType::U8}},
+		{{3, PixelType::U16}, {3, PixelType::U16}},
+		{{1, PixelType::F32}, {1, PixelType::F32}},
+		{{1, PixelType::U8}, {4, PixelType::U8}},
+		{{3, PixelType::U16}, {4, PixelType::U8}},
+		{{2, PixelType::F32}, {3, PixelType::U16}},
+	};
+	const int width = 203;
+	const int height = 67;
+	size_t pixel_count = (size_t)width * height;
+	u8* rgba = MakeTestPattern(width, height);
+	u8* other = (u8*)malloc(pixel_count * 4); // @malloc
+	u8* unused = (u8*)malloc(pixel_count * 4); // @malloc
+	u32 state = 7;
+	FillDiffTestValues(unused, other, PixelType::U8, pixel_count * 4, &state);
+	for (size_t i = 0; i < pixel_count * 4; ++i)
+	{
+		if (other[i] & 1) other[i] = rgba[i];
+		else if (other[i] & 2) other[i] = (u8)ClampDiffTestValue(rgba[i] + (other[i] >> 5) - 3, U8_MAX);
+	}
+	free(unused);
+
+	for (int i = 0; i < (int)ARRAYCOUNT(layouts); ++i)
+	{
+		DecodedImage a = {MakeStatsTestImage(rgba, pixel_count, layouts[i][0]), width, height, layouts[i][0]};
+		DecodedImage b = {MakeStatsTestImage(other, pixel_count, layouts[i][1]), width, height, layouts[i][1]};
+		ImageDiffParams params = {};
+		params.threshold = 0.05;
+		params.keep_mask = true;
+		params.keep_difference = true;
+		ImageDiff diff;
+		TEST_CHECK(DiffImages(&a, &b, params, &diff));
+
+		PixelLayout layout = diff.layout;
+		int channel_count = (layouts[i][0].channel_count > layouts[i][1].channel_count) ? layouts[i][0].channel_count : layouts[i][1].channel_count;
+		TEST_CHECK(layout.channel_count == channel_count);
+		TEST_CHECK(layout.type == ((layouts[i][0].type == layouts[i][1].type) ? layouts[i][0].type : PixelType::U8));
+
+		size_t row_size = (size_t)width * GetPixelSize(layout);
+		u8* scratch = (u8*)malloc(row_size * 5); // @malloc
+		u8* difference = (u8*)malloc(row_size * height); // @malloc
+		u8* mask = (u8*)malloc(pixel_count); // @malloc
+		double threshold = params.threshold * diff.peak;
+		if (layout.type != PixelType::F32) threshold = floor(threshold);
+		DiffTotals totals = {};
+		for (int y = 0; y < height; ++y)
+		{
+			const u8* row_a = GetDiffRow(&a, layout, y, scratch, scratch + row_size);
+			const u8* row_b = GetDiffRow(&b, layout, y, scratch + row_size * 2, scratch + row_size * 3);
+			RunDiffRowScalar(row_a, row_b, layout, width, threshold, difference + row_size * y, mask + (size_t)width * y, &totals);
+		}
+		TEST_CHECK(diff.mismatch_count == totals.mismatch_count && diff.mismatch_count > 0);
+		TEST_CHECK(memcmp(diff.mask, mask, pixel_count) == 0);
+		TEST_CHECK(memcmp(diff.difference, difference, row_size * height) == 0);
+		for (int c = 0; c < channel_count; ++c)
+		{
+			double mse = totals.squared_error[c] / (double)pixel_count;
+			TEST_CHECK(diff.max_error[c] == totals.max_error[c]);
+			TEST_CHECK(fabs(diff.mse[c] - mse) <= 1e-9 * (1.0 + mse));
+		}
+		free(mask);
+		free(difference);
+		free(scratch);
+		FreeImageDiff(&diff);
+		free(a.pixels);
+		free(b.pixels);
+	}
+	free(other);
+	free(rgba);
+}
+
+// One pixel differs by a known amount, so a threshold just below it makes it a mismatch and one just
+// above doesn't.
+static void TestDiffThreshold()
+{
+	static const PixelType types[] = {PixelType::U8, PixelType::U16, PixelType::F32};
+	static const double differences[] = {10.0, 1000.0, 0.25};
+	static const double margins[] = {0.5, 0.5, 0.01};
+	const int width = 19;
+	const int height = 3;
+	for (int t = 0; t < (int)ARRAYCOUNT(types); ++t)
+	{
+		for (int channel_count = 1; channel_count <= 4; ++channel_count)
+		{
+			PixelLayout layout = {channel_count, types[t]};
+			size_t size = (size_t)width * height * GetPixelSize(layout);
+			DecodedImage a = {calloc(1, size), width, height, layout}; // @malloc
+			DecodedImage b = {calloc(1, size), width, height, layout}; // @malloc
+			size_t index = ((size_t)width + 17) * channel_count + channel_count - 1;
+			if (layout.type == PixelType::U8) ((u8*)b.pixels)[index] = (u8)differences[t];
+			else if (layout.type == PixelType::U16) ((u16*)b.pixels)[index] = (u16)differences[t];
+			else ((float*)b.pixels)[index] = (float)differences[t];
+
+			for (int side = -1; side <= 1; side += 2)
+			{
+				ImageDiffParams params = {};
+				params.threshold = (differences[t] + side * margins[t]) / ((t == 0) ? 255.0 : ((t == 1) ? 65535.0 : 1.0));
+				params.keep_mask = true;
+				ImageDiff diff;
+				TEST_CHECK(DiffImages(&a, &b, params, &diff));
+				TEST_CHECK(diff.mismatch_count == ((side < 0) ? 1u : 0u));
+				TEST_CHECK(diff.mask[width + 17] == ((side < 0) ? 255 : 0));
+				TEST_CHECK(diff.max_error[channel_count - 1] == differences[t]);
+				TEST_CHECK(isinf(diff.psnr[0]) == (channel_count > 1));
+				FreeImageDiff(&diff);
+			}
+			free(a.pixels);
+			free(b.pixels);
+		}
+	}
+}
+
+// Every overlay pixel is colored exactly when some mask pixel in its block is set.
+static void TestDiffMaskOverlay()
+{
+	static const int max_sizes[] = {1, 16, 64, 203, 1000};
+	const u8 color[4] = {255, 0, 64, 200};
+	ImageDiff diff = {};
+	diff.width = 203;
+	diff.height = 67;
+	diff.mask = (u8*)malloc((size_t)diff.width * diff.height); // @malloc
+	u32 state = 3;
+	for (int i = 0; i < diff.width * diff.height; ++i) diff.mask[i] = (NextDiffTestRandom(&state) % 97 == 0) ? 255 : 0;
+
+	for (int s = 0; s < (int)ARRAYCOUNT(max_sizes); ++s)
+	{
+		int overlay_width, overlay_height;
+		u8* overlay = BuildDiffMaskOverlay(&diff, max_sizes[s], color, &overlay_width, &overlay_height);
+		int block_size = (diff.width + max_sizes[s] - 1) / max_sizes[s];
+		TEST_CHECK(overlay_width <= max_sizes[s] && overlay_height <= max_sizes[s]);
+		TEST_CHECK(overlay_width == (diff.width + block_size - 1) / block_size);
+		TEST_CHECK(overlay_height == (diff.height + block_size - 1) / block_size);
+		for (int y = 0; y < overlay_height; ++y)
+		{
+			for (int x = 0; x < overlay_width; ++x)
+			{
+				bool is_set = false;
+				for (int my = y * block_size; my < (y + 1) * block_size && my < diff.height; ++my)
+				{
+					for (int mx = x * block_size; mx < (x + 1) * block_size && mx < diff.width; ++mx) is_set |= diff.mask[my * diff.width + mx] != 0;
+				}
+				const u8 clear[4] = {};
+				TEST_CHECK(memcmp(overlay + ((size_t)y * overlay_width + x) * 4, is_set ? color : clear, 4) == 0);
+			}
+		}
+		free(overlay);
+	}
+	FreeImageDiff(&diff);
+}
@@ -0,0 +1,114 @@
+// QueueImageLoad under load: a few hundred decodes in flight at once, plain and progressive, with some of
+// them released before they start and some while they run.
+#include "TestMain.h"
+
+#define IMAGE_LOAD_TEST_FILE_COUNT 6
+#define IMAGE_LOAD_TEST_JOB_COUNT 300
+
+static std::atomic<int> g_destroyed_image_load_count;
+
+// Stands in for the job's own destroy, to count that every job is freed, and only once.
+static void DestroyCountedImageLoadJob(void* data)
+{
+	DestroyImageLoadJob(data);
+	g_destroyed_image_load_count.fetch_add(1);
+}
+
+// The job is still referenced here, so nothing can be calling destroy yet.
+static ImageLoadJob* QueueCountedImageLoad(const char* file_path, bool is_progressive)
+{
+	ImageLoadJob* job = QueueImageLoad(file_path, is_progressive);
+	job->shared.destroy = DestroyCountedImageLoadJob;
+	return job;
+}
+
+static void TestImageLoadStress()
+{
+	static const char* file_paths[IMAGE_LOAD_TEST_FILE_COUNT] = {
+		"test_load_0.png", "test_load_1.png", "test_load_2.png", "test_load_3.bmp", "test_load_4.tga", "test_load_missing.png"
+	};
+	const int width = 320;
+	const int height = 200;
+	u8* rgba = MakeTestPattern(width, height);
+	u8* rgb = PackTestChannels(rgba, (size_t)width * height, 3);
+	u16* wide = (u16*)malloc((size_t)width * height * 4 * sizeof(u16)); // @malloc
+	for (int i = 0; i < width * height * 4; ++i) wide[i] = (u16)(rgba[i] * 257 + (i & 0xFF));
+	TEST_CHECK(WritePng(file_paths[0], rgba, width, height, 4, 8, (size_t)width * 4, 0));
+	TEST_CHECK(WritePng(file_paths[1], wide, width, height, 4, 16, (size_t)width * 8, 0));
+	TEST_CHECK(WriteInterlacedPng(file_paths[2], rgb, width, height, 3, 8));
+	TEST_CHECK(stbi_write_bmp(file_paths[3], width, height, 3, rgb));
+	TEST_CHECK(stbi_write_tga(file_paths[4], width, height, 4, rgba));
+	free(wide);
+	free(rgb);
+	free(rgba);
+
+	DecodedImage expected[IMAGE_LOAD_TEST_FILE_COUNT] = {};
+	for (int f = 0; f < IMAGE_LOAD_TEST_FILE_COUNT - 1; ++f) TEST_CHECK(DecodeImageFile(file_paths[f], &expected[f]));
+
+	// Every third is released straight away, and every fifth of the rest as soon as it's seen decoding.
+	g_destroyed_image_load_count.store(0);
+	ImageLoadJob* jobs[IMAGE_LOAD_TEST_JOB_COUNT];
+	for (int i = 0; i < IMAGE_LOAD_TEST_JOB_COUNT; ++i)
+	{
+		jobs[i] = QueueCountedImageLoad(file_paths[i % IMAGE_LOAD_TEST_FILE_COUNT], (i / IMAGE_LOAD_TEST_FILE_COUNT) % 2 == 1);
+		if (i % 3 == 0)
+		{
+			ReleaseImageLoad(jobs[i]);
+			jobs[i] = 0;
+		}
+	}
+
+	int ready_count = 0;
+	int failed_count = 0;
+	int remaining_count = IMAGE_LOAD_TEST_JOB_COUNT - (IMAGE_LOAD_TEST_JOB_COUNT + 2) / 3;
+	for (int poll = 0; remaining_count && poll < 30000; ++poll)
+	{
+		for (int i = 0; i < IMAGE_LOAD_TEST_JOB_COUNT; ++i)
+		{
+			if (!jobs[i]) continue;
+			ImageLoadState state = GetImageLoadState(jobs[i]);
+			bool is_released = (i % 5 == 0 && state == ImageLoadState::Decoding);
+			if (state == ImageLoadState::Ready)
+			{
+				const DecodedImage* reference = &expected[i % IMAGE_LOAD_TEST_FILE_COUNT];
+				DecodedImage image = TakeDecodedImage(jobs[i]);
+				MipChain* mips = TakeMipChain(jobs[i]);
+				TEST_CHECK(IsSameDecodedImage(&image, reference));
+				TEST_CHECK(mips && mips->level_count == GetMipLevelCount(width, height) && mips->levels[1].width == width / 2);
+				FreeDecodedImage(&image);
+				if (mips) FreeMipChain(mips);
+				free(mips);
+				++ready_count;
+				is_released = true;
+			}
+			else if (state == ImageLoadState::Failed)
+			{
+				TEST_CHECK(i % IMAGE_LOAD_TEST_FILE_COUNT == IMAGE_LOAD_TEST_FILE_COUNT - 1);
+				++failed_count;
+				is_released = true;
+			}
+			if (is_released)
+			{
+				ReleaseImageLoad(jobs[i]);
+				jobs[i] = 0;
+				--remaining_count;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	TEST_CHECK(remaining_count == 0);
+	TEST_CHECK(ready_count > 0 && failed_count > 0);
+
+	// Released jobs the workers haven't got to yet are freed as they come off the queue.
+	for (int wait = 0; g_destroyed_image_load_count.load() < IMAGE_LOAD_TEST_JOB_COUNT && wait < 30000; ++wait)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	TEST_CHECK(g_destroyed_image_load_count.load() == IMAGE_LOAD_TEST_JOB_COUNT);
+
+	for (int f = 0; f < IMAGE_LOAD_TEST_FILE_COUNT; ++f)
+	{
+		FreeDecodedImage(&expected[f]);
+		remove(file_paths[f]);
+	}
+}
@@ -0,0 +1,206 @@
+// Tests of ImageSsim.cpp, against SSIM worked out the slow way: every window position summed in double
+// straight from the definition.
+#include "TestMain.h"
+#include "ImageSsim.h"
+
+// A smooth gradient with some texture on it, and a copy with noise added and its contrast lowered.
+static void MakeSsimTestPlanes(int width, int height, float* a, float* b)
+{
+	u32 state = 5;
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			size_t i = (size_t)y * width + x;
+			float value = 0.2f + 0.5f * x / width + 0.1f * sinf(x * 0.7f) * cosf(y * 0.45f) + 0.1f * y / height;
+			state = state * 1664525u + 1013904223u;
+			float noise = ((state >> 8) & 0xFF) / 255.0f - 0.5f;
+			a[i] = value;
+			b[i] = 0.1f + value * 0.8f + noise * 0.08f;
+		}
+	}
+}
+
+// Mean SSIM and contrast-structure of one scale, from the definition.
+static void ComputeSsimScaleByHand(const float* a, const float* b, int width, int height, double* ssim, double* cs)
+{
+	double weights[SSIM_WINDOW];
+	double weight_sum = 0.0;
+	for (int i = 0; i < SSIM_WINDOW; ++i)
+	{
+		double offset = i - SSIM_WINDOW / 2;
+		weights[i] = exp(-offset * offset / (2.0 * 1.5 * 1.5));
+		weight_sum += weights[i];
+	}
+	const double c1 = 0.01 * 0.01;
+	const double c2 = 0.03 * 0.03;
+	double ssim_sum = 0.0;
+	double cs_sum = 0.0;
+	int out_width = width - SSIM_WINDOW + 1;
+	int out_height = height - SSIM_WINDOW + 1;
+	for (int y = 0; y < out_height; ++y)
+	{
+		for (int x = 0; x < out_width; ++x)
+		{
+			double mean_a = 0.0, mean_b = 0.0, aa = 0.0, bb = 0.0, ab = 0.0;
+			for (int j = 0; j < SSIM_WINDOW; ++j)
+			{
+				for (int i = 0; i < SSIM_WINDOW; ++i)
+				{
+					double weight = weights[i] * weights[j] / (weight_sum * weight_sum);
+					size_t index = (size_t)(y + j) * width + x + i;
+					mean_a += weight * a[index];
+					mean_b += weight * b[index];
+					aa += weight * a[index] * a[index];
+					bb += weight * b[index] * b[index];
+					ab += weight * a[index] * b[index];
+				}
+			}
+			double contrast_structure = (2.0 * (ab - mean_a * mean_b) + c2) / (aa - mean_a * mean_a + bb - mean_b * mean_b + c2);
+			ssim_sum += (2.0 * mean_a * mean_b + c1) / (mean_a * mean_a + mean_b * mean_b + c1) * contrast_structure;
+			cs_sum += contrast_structure;
+		}
+	}
+	*ssim = ssim_sum / ((double)out_width * out_height);
+	*cs = cs_sum / ((double)out_width * out_height);
+}
+
+// MS-SSIM from the definition, halving the planes with a 2x2 box until the window no longer fits or all
+// five scales are done.
+static double ComputeMsSsimByHand(const float* a, const float* b, int width, int height, int* scale_count)
+{
+	static const double weights[SSIM_SCALES] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+	double ssim[SSIM_SCALES], cs[SSIM_SCALES];
+	float* planes = (float*)malloc(sizeof(float) * width * height * 2); // @malloc
+	memcpy(planes, a, sizeof(float) * width * height);
+	memcpy(planes + width * height, b, sizeof(float) * width * height);
+	int count = 0;
+	while (count < SSIM_SCALES && width >= SSIM_WINDOW && height >= SSIM_WINDOW)
+	{
+		ComputeSsimScaleByHand(planes, planes + width * height, width, height, &ssim[count], &cs[count]);
+		++count;
+		int half_width = width / 2, half_height = height / 2;
+		for (int p = 0; p < 2; ++p)
+		{
+			const float* src = planes + p * width * height;
+			float* dst = planes + p * half_width * half_height;
+			for (int y = 0; y < half_height; ++y)
+			{
+				for (int x = 0; x < half_width; ++x)
+				{
+					const float* s = src + (size_t)y * 2 * width + x * 2;
+					dst[y * half_width + x] = (s[0] + s[1] + s[width] + s[width + 1]) * 0.25f;
+				}
+			}
+		}
+		width = half_width;
+		height = half_height;
+	}
+	free(planes);
+
+	double weight_sum = 0.0;
+	for (int i = 0; i < count; ++i) weight_sum += weights[i];
+	double result = 1.0;
+	for (int i = 0; i < count; ++i)
+	{
+		double term = (i == count - 1) ? ssim[i] : cs[i];
+		result *= pow((term > 0.0) ? term : 0.0, weights[i] / weight_sum);
+	}
+	*scale_count = count;
+	return result;
+}
+
+// Identical planes score exactly 1 (within float rounding), and a degraded pair scores what the slow
+// version says, at every pyramid depth from one scale to five.
+static void TestSsimAgainstReference()
+{
+	static const int sizes[][2] = {{SSIM_WINDOW, SSIM_WINDOW}, {37, 23}, {64, 48}, {181, 177}};
+	static const int scale_counts[] = {1, 2, 3, 5};
+	for (int s = 0; s < (int)ARRAYCOUNT(sizes); ++s)
+	{
+		int width = sizes[s][0];
+		int height = sizes[s][1];
+		float* a = (float*)malloc(sizeof(float) * width * height * 2); // @malloc
+		float* b = a + width * height;
+		MakeSsimTestPlanes(width, height, a, b);
+
+		SsimResult result;
+		TEST_CHECK(ComputeSsimOfPlanes(a, a, width, height, &result));
+		TEST_CHECK(fabs(result.ssim - 1.0) < 1e-6 && fabs(result.ms_ssim - 1.0) < 1e-6);
+		TEST_CHECK(result.scale_count == scale_counts[s]);
+
+		int reference_scale_count = 0;
+		double ms_ssim = ComputeMsSsimByHand(a, b, width, height, &reference_scale_count);
+		double ssim, cs;
+		ComputeSsimScaleByHand(a, b, width, height, &ssim, &cs);
+		TEST_CHECK(ComputeSsimOfPlanes(a, b, width, height, &result));
+		TEST_CHECK(result.scale_count == reference_scale_count);
+		TEST_CHECK(fabs(result.ssim - ssim) < 1e-4 && fabs(result.scale_cs[0] - cs) < 1e-4);
+		TEST_CHECK(fabs(result.ms_ssim - ms_ssim) < 1e-4);
+		TEST_CHECK(result.ssim > 0.1 && result.ssim < 0.95); // Degraded, but not unrecognizably.
+
+		// An inverted copy is anti-correlated everywhere, which MS-SSIM clamps to nothing.
+		for (int i = 0; i < width * height; ++i) b[i] = 1.0f - a[i];
+		TEST_CHECK(ComputeSsimOfPlanes(a, b, width, height, &result));
+		TEST_CHECK(result.ssim < 0.0 && result.ms_ssim == 0.0);
+		free(a);
+	}
+}
+
+// The AVX2 filters against the scalar ones, through the whole comparison, including widths that leave a
+// scalar tail at every scale.
+static void TestSsimKernelsAgree()
+{
+	if (!CpuHasAVX2()) return;
+	static const int sizes[][2] = {{SSIM_WINDOW, SSIM_WINDOW}, {SSIM_WINDOW + 7, 40}, {SSIM_WINDOW + 8, 19}, {203, 197}};
+	for (int s = 0; s < (int)ARRAYCOUNT(sizes); ++s)
+	{
+		int width = sizes[s][0];
+		int height = sizes[s][1];
+		float* a = (float*)malloc(sizeof(float) * width * height * 2); // @malloc
+		float* b = a + width * height;
+		MakeSsimTestPlanes(width, height, a, b);
+		SsimResult scalar, avx2;
+		TEST_CHECK(ComputeSsimOfPlanes(a, b, width, height, &scalar, SsimKernel::Scalar));
+		TEST_CHECK(ComputeSsimOfPlanes(a, b, width, height, &avx2, SsimKernel::AVX2));
+		TEST_CHECK(scalar.scale_count == avx2.scale_count);
+		for (int scale = 0; scale < scalar.scale_count; ++scale)
+		{
+			TEST_CHECK(fabs(scalar.scale_ssim[scale] - avx2.scale_ssim[scale]) < 1e-5);
+			TEST_CHECK(fabs(scalar.scale_cs[scale] - avx2.scale_cs[scale]) < 1e-5);
+		}
+		TEST_CHECK(fabs(scalar.ms_ssim - avx2.ms_ssim) < 1e-5);
+		free(a);
+	}
+}
+
+// Images the window doesn't fit, or that differ in size, are refused with the result zeroed, and images
+// too small for every scale of MS-SSIM use the scales they have.
+static void TestSsimSmallImages()
+{
+	const int width = 40;
+	const int height = 30;
+	float* planes = (float*)malloc(sizeof(float) * width * height * 2); // @malloc
+	MakeSsimTestPlanes(width, height, planes, planes + width * height);
+	static const int too_small[][2] = {{SSIM_WINDOW - 1, SSIM_WINDOW}, {SSIM_WINDOW, SSIM_WINDOW - 1}, {1, 1}};
+	for (int i = 0; i < (int)ARRAYCOUNT(too_small); ++i)
+	{
+		SsimResult result;
+		result.ssim = 0.5;
+		TEST_CHECK(!ComputeSsimOfPlanes(planes, planes + width * height, too_small[i][0], too_small[i][1], &result));
+		TEST_CHECK(result.ssim == 0.0 && result.scale_count == 0);
+	}
+	SsimResult result;
+	TEST_CHECK(ComputeSsimOfPlanes(planes, planes + width * height, SSIM_WINDOW * 2 - 1, SSIM_WINDOW * 4, &result));
+	TEST_CHECK(result.scale_count == 1 && result.ms_ssim == result.ssim);
+	free(planes);
+
+	u8* rgba = MakeTestPattern(width, height);
+	DecodedImage a = {rgba, width, height, {4, PixelType::U8}};
+	DecodedImage narrow = {rgba, SSIM_WINDOW - 1, height, {4, PixelType::U8}};
+	DecodedImage other = {rgba, width - 1, height, {4, PixelType::U8}};
+	TEST_CHECK(ComputeSsim(&a, &a, &result) && fabs(result.ssim - 1.0) < 1e-6);
+	TEST_CHECK(!ComputeSsim(&narrow, &narrow, &result));
+	TEST_CHECK(!ComputeSsim(&a, &other, &result));
+	free(rgba);
+}
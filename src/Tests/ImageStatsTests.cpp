@@ -0,0 +1,159 @@
+// Tests of ImageStats.cpp. The tile cache is checked against ComputeImageStats, which is checked against
+// a plain loop over the pixels, and the AVX2 row kernel against the scalar one.
+#include "TestMain.h"
+#include "ImageStats.h"
+
+#define STATS_TEST_WIDTH (STATS_TILE_SIZE * 2 + 101) // Two whole tiles each way, and a ragged one.
+#define STATS_TEST_HEIGHT (STATS_TILE_SIZE * 2 + 29)
+
+// The test pattern in the given layout. Floats run a little past [0, 1] at both ends, so the end bins
+// get used.
+static void* MakeStatsTestImage(const u8* rgba, size_t pixel_count, PixelLayout layout)
+{
+	int channel_count = layout.channel_count;
+	void* pixels = malloc(pixel_count * GetPixelSize(layout)); // @malloc
+	for (size_t i = 0; i < pixel_count; ++i)
+	{
+		for (int c = 0; c < channel_count; ++c)
+		{
+			u8 value = rgba[i * 4 + c];
+			size_t index = i * channel_count + c;
+			if (layout.type == PixelType::U8) ((u8*)pixels)[index] = value;
+			else if (layout.type == PixelType::U16) ((u16*)pixels)[index] = (u16)(value * 257 + (i & 0xFF));
+			else ((float*)pixels)[index] = value / 255.0f * 1.2f - 0.1f + (i & 0xF) / 4096.0f;
+		}
+	}
+	return pixels;
+}
+
+static double GetStatsTestValue(const void* pixels, PixelLayout layout, size_t index)
+{
+	if (layout.type == PixelType::U8) return ((const u8*)pixels)[index];
+	if (layout.type == PixelType::U16) return ((const u16*)pixels)[index];
+	return ((const float*)pixels)[index];
+}
+
+// Histograms, counts, min and max have to match exactly; the sums behind mean and stddev are added up in
+// a different order, so those only have to come close.
+static bool IsSameImageStats(const ImageStats* a, const ImageStats* b)
+{
+	if (a->channel_count != b->channel_count || a->pixel_count != b->pixel_count) return false;
+	if (memcmp(a->histogram, b->histogram, sizeof(a->histogram)) != 0) return false;
+	for (int c = 0; c < a->channel_count; ++c)
+	{
+		const ChannelStats* x = &a->channels[c];
+		const ChannelStats* y = &b->channels[c];
+		double tolerance = 1e-9 * (1.0 + fabs(x->max));
+		if (x->min != y->min || x->max != y->max) return false;
+		if (fabs(x->mean - y->mean) > tolerance || fabs(x->stddev - y->stddev) > tolerance * 1000.0) return false;
+	}
+	return true;
+}
+
+static void TestImageStatsCache()
+{
+	// Whole image, no whole tiles, exactly one tile, and ragged edges on every side.
+	static const int rects[][4] = {
+		{0, 0, STATS_TEST_WIDTH, STATS_TEST_HEIGHT},
+		{1, 1, STATS_TEST_WIDTH - 2, STATS_TEST_HEIGHT - 2},
+		{255, 257, 300, 3},
+		{17, 3, 513, 511},
+		{STATS_TILE_SIZE, STATS_TILE_SIZE, STATS_TILE_SIZE, STATS_TILE_SIZE},
+		{STATS_TEST_WIDTH - 13, 0, 13, STATS_TEST_HEIGHT},
+		{STATS_TILE_SIZE * 2 - 1, 0, 102, STATS_TEST_HEIGHT},
+		{3, 5, 1, 1},
+	};
+	static const PixelType types[] = {PixelType::U8, PixelType::U16, PixelType::F32};
+	u8* rgba = MakeTestPattern(STATS_TEST_WIDTH, STATS_TEST_HEIGHT);
+	for (int t = 0; t < (int)ARRAYCOUNT(types); ++t)
+	{
+		for (int channel_count = 1; channel_count <= 4; ++channel_count)
+		{
+			PixelLayout layout = {channel_count, types[t]};
+			void* pixels = MakeStatsTestImage(rgba, (size_t)STATS_TEST_WIDTH * STATS_TEST_HEIGHT, layout);
+			ImageStatsCache cache;
+			BuildImageStatsCache(&cache, pixels, layout, STATS_TEST_WIDTH, STATS_TEST_HEIGHT);
+			for (int i = 0; i < (int)ARRAYCOUNT(rects); ++i)
+			{
+				int x = rects[i][0], y = rects[i][1], width = rects[i][2], height = rects[i][3];
+				ImageStats expected, stats;
+				ComputeImageStats(pixels, layout, STATS_TEST_WIDTH, x, y, width, height, &expected);
+				GetImageStats(&cache, x, y, width, height, &stats);
+				TEST_CHECK(IsSameImageStats(&stats, &expected));
+
+				TEST_CHECK(expected.pixel_count == (u64)width * height);
+				for (int c = 0; c < channel_count; ++c)
+				{
+					double min = DBL_MAX, max = -DBL_MAX, sum = 0.0;
+					for (int row = y; row < y + height; ++row)
+					{
+						for (int column = x; column < x + width; ++column)
+						{
+							double value = GetStatsTestValue(pixels, layout, ((size_t)row * STATS_TEST_WIDTH + column) * channel_count + c);
+							if (value < min) min = value;
+							if (value > max) max = value;
+							sum += value;
+						}
+					}
+					TEST_CHECK(expected.channels[c].min == min && expected.channels[c].max == max);
+					TEST_CHECK(fabs(expected.channels[c].mean - sum / expected.pixel_count) < 1e-9 * (1.0 + max));
+				}
+			}
+			FreeImageStatsCache(&cache);
+			free(pixels);
+		}
+	}
+	free(rgba);
+}
+
+// Widths on both sides of the eight pixels the AVX2 kernel takes at a time. Where there's no AVX2 there's
+// nothing to compare.
+static void TestImageStatsKernelsAgree()
+{
+#ifdef CORE_SIMD_X86
+	if (!CpuHasAVX2()) return;
+	static const int widths[] = {1, 7, 8, 9, 37, 64};
+	const int max_width = 64;
+	u8* rgba = MakeTestPattern(max_width, 1);
+	for (int is_float = 0; is_float < 2; ++is_float)
+	{
+		for (int channel_count = 1; channel_count <= 4; ++channel_count)
+		{
+			PixelLayout layout = {channel_count, is_float ? PixelType::F32 : PixelType::U16};
+			void* row = MakeStatsTestImage(rgba, max_width, layout);
+			if (is_float) ((float*)row)[channel_count * 5] = NAN; // Binned at zero and left out of min and max.
+			float bin_scale = is_float ? (float)STATS_HISTOGRAM_BINS : 1.0f / 256.0f;
+			for (int i = 0; i < (int)ARRAYCOUNT(widths); ++i)
+			{
+				StatsAccumulator scalar, avx2;
+				ResetStatsAccumulator(&scalar);
+				ResetStatsAccumulator(&avx2);
+				if (is_float)
+				{
+					AccumulateRowScalar((const float*)row, channel_count, 0, widths[i], bin_scale, &scalar);
+					AccumulateRowDispatchAVX2((const float*)row, channel_count, widths[i], bin_scale, &avx2);
+				}
+				else
+				{
+					AccumulateRowScalar((const u16*)row, channel_count, 0, widths[i], bin_scale, &scalar);
+					AccumulateRowDispatchAVX2((const u16*)row, channel_count, widths[i], bin_scale, &avx2);
+				}
+				TEST_CHECK(memcmp(scalar.histogram, avx2.histogram, sizeof(scalar.histogram)) == 0);
+				for (int c = 0; c < channel_count; ++c)
+				{
+					TEST_CHECK(scalar.min[c] == avx2.min[c] && scalar.max[c] == avx2.max[c]);
+					// A NaN poisons the sums on both paths alike.
+					TEST_CHECK(isnan(scalar.sum[c]) == isnan(avx2.sum[c]));
+					if (!isnan(scalar.sum[c]))
+					{
+						TEST_CHECK(fabs(scalar.sum[c] - avx2.sum[c]) <= 1e-9 * fabs(scalar.sum[c]));
+						TEST_CHECK(fabs(scalar.sum_squares[c] - avx2.sum_squares[c]) <= 1e-9 * fabs(scalar.sum_squares[c]));
+					}
+				}
+			}
+			free(row);
+		}
+	}
+	free(rgba);
+#endif
+}
@@ -0,0 +1,43 @@
+// Tests of MipChain.cpp.
+#include "TestMain.h"
+#include "MipChain.h"
+
+// Every kernel builds exactly the same chain, odd sizes included, and a flat image stays flat.
+static void TestMipKernelsAgree()
+{
+	const int width = 203;
+	const int height = 67;
+	u8* rgba = MakeTestPattern(width, height);
+	MipChain scalar;
+	BuildMipChain(rgba, {4, PixelType::U8}, width, height, &scalar, MipKernel::Scalar);
+	TEST_CHECK(scalar.level_count == 8);
+	TEST_CHECK(scalar.levels[7].width == 1 && scalar.levels[7].height == 1);
+
+	MipKernel kernels[] = {MipKernel::SSE2, MipKernel::AVX2, MipKernel::Best};
+	for (int k = 0; k < (int)ARRAYCOUNT(kernels); ++k)
+	{
+		MipChain chain;
+		BuildMipChain(rgba, {4, PixelType::U8}, width, height, &chain, kernels[k]);
+		TEST_CHECK(chain.level_count == scalar.level_count);
+		for (int level = 1; level < chain.level_count; ++level)
+		{
+			const MipLevel* a = &scalar.levels[level];
+			const MipLevel* b = &chain.levels[level];
+			TEST_CHECK(a->width == b->width && a->height == b->height);
+			TEST_CHECK(memcmp(a->pixels, b->pixels, (size_t)a->width * a->height * 4) == 0);
+		}
+		FreeMipChain(&chain);
+	}
+	FreeMipChain(&scalar);
+
+	for (int i = 0; i < width * height; ++i) memcpy(rgba + i * 4, "\x80\x20\xF0\xC0", 4);
+	MipChain flat;
+	BuildMipChain(rgba, {4, PixelType::U8}, width, height, &flat);
+	for (int level = 1; level < flat.level_count; ++level)
+	{
+		const MipLevel* l = &flat.levels[level];
+		for (int i = 0; i < l->width * l->height; ++i) TEST_CHECK(memcmp(l->pixels + i * 4, "\x80\x20\xF0\xC0", 4) == 0);
+	}
+	FreeMipChain(&flat);
+	free(rgba);
+}
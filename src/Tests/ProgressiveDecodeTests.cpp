@@ -0,0 +1,212 @@
+// DecodeImageFileProgressive has its own PNG decoder, so it's checked against DecodeImageFile, which is
+// what it promises to match, on files written for the purpose.
+#include "TestMain.h"
+#include "ProgressiveDecode.h"
+#include "PngWriter.h"
+#include "JpegWriter.h"
+
+#define PROGRESSIVE_TEST_WIDTH 300 // Enough rows for PngWriter to split the data over several IDATs.
+#define PROGRESSIVE_TEST_HEIGHT 240
+#define PROGRESSIVE_TEST_IDAT_SIZE 1000 // What the interlaced files cut their compressed data into.
+
+static bool IsSameDecodedImage(const DecodedImage* a, const DecodedImage* b)
+{
+	if (!a->pixels || !b->pixels || a->width != b->width || a->height != b->height) return false;
+	if (a->layout.channel_count != b->layout.channel_count || a->layout.type != b->layout.type) return false;
+	return memcmp(a->pixels, b->pixels, (size_t)a->width * a->height * GetPixelSize(a->layout)) == 0;
+}
+
+// Decodes a file both ways and checks they agree. is_streamed says the PNG decoder should have done it,
+// rather than the stb_image fallback, and published every row and pass on the way.
+static void CheckProgressiveDecode(const char* file_path, bool is_streamed, int pass_count)
+{
+	DecodedImage expected;
+	TEST_CHECK(DecodeImageFile(file_path, &expected));
+	DecodeProgress* progress = CreateDecodeProgress();
+	DecodedImage image;
+	TEST_CHECK(DecodeImageFileProgressive(file_path, progress, &image));
+	TEST_CHECK(IsSameDecodedImage(&image, &expected));
+	if (is_streamed)
+	{
+		TEST_CHECK(progress->has_image.load() && image.pixels == progress->image.pixels);
+		TEST_CHECK(progress->pass_count == pass_count);
+		TEST_CHECK(progress->ready_rows.load() == image.height && progress->ready_passes.load() == pass_count);
+	}
+	FreeDecodedImage(&image);
+	FreeDecodedImage(&expected);
+	FreeDecodeProgress(progress);
+}
+
+static void AppendPngU32(DeflateOutput* out, u32 value)
+{
+	u8 bytes[4] = {(u8)(value >> 24), (u8)(value >> 16), (u8)(value >> 8), (u8)value};
+	AppendDeflateOutput(out, bytes, 4);
+}
+
+static void AppendPngChunk(DeflateOutput* out, const char* type, const u8* data, u32 size)
+{
+	AppendPngU32(out, size);
+	AppendDeflateOutput(out, type, 4);
+	if (size) AppendDeflateOutput(out, data, size);
+	AppendPngU32(out, ComputeCrc32(ComputeCrc32(0, (const u8*)type, 4), data, size));
+}
+
+// PngWriter doesn't interlace, so this writes an Adam7 file itself, from samples in native byte order.
+// Rows alternate between the Up and Sub filters, and the first row of each pass has an empty row above it.
+static bool WriteInterlacedPng(const char* file_path, const void* pixels, int width, int height, int channel_count, int bit_depth)
+{
+	static const u8 color_types[4] = {0, 4, 2, 6};
+	int sample_size = bit_depth / 8;
+	int pixel_size = channel_count * sample_size;
+	u8* raw = (u8*)malloc((size_t)width * pixel_size * 2); // @malloc
+	u8* prior = raw + (size_t)width * pixel_size;
+	DeflateOutput filtered = {};
+	for (int pass = 0; pass < ADAM7_PASS_COUNT; ++pass)
+	{
+		int pass_width = (width - adam7_x0[pass] + adam7_dx[pass] - 1) / adam7_dx[pass];
+		int pass_height = (height - adam7_y0[pass] + adam7_dy[pass] - 1) / adam7_dy[pass];
+		if (pass_width <= 0 || pass_height <= 0) continue;
+		int row_size = pass_width * pixel_size;
+		memset(prior, 0, row_size);
+		for (int row = 0; row < pass_height; ++row)
+		{
+			int y = adam7_y0[pass] + row * adam7_dy[pass];
+			for (int i = 0; i < pass_width; ++i)
+			{
+				int x = adam7_x0[pass] + i * adam7_dx[pass];
+				const u8* src = (const u8*)pixels + ((size_t)y * width + x) * pixel_size;
+				for (int s = 0; s < pixel_size; s += sample_size)
+				{
+					if (sample_size == 2)
+					{
+						u16 value;
+						memcpy(&value, src + s, 2);
+						raw[i * pixel_size + s] = (u8)(value >> 8);
+						raw[i * pixel_size + s + 1] = (u8)value;
+					}
+					else raw[i * pixel_size + s] = src[s];
+				}
+			}
+			u8 filter = (row & 1) ? 1 : 2;
+			AppendDeflateOutput(&filtered, &filter, 1);
+			for (int i = 0; i < row_size; ++i)
+			{
+				u8 predicted = (filter == 1) ? ((i >= pixel_size) ? raw[i - pixel_size] : 0) : prior[i];
+				u8 byte = (u8)(raw[i] - predicted);
+				AppendDeflateOutput(&filtered, &byte, 1);
+			}
+			memcpy(prior, raw, row_size);
+		}
+	}
+	free(raw);
+
+	DeflateOutput zlib = {};
+	static const u8 zlib_header[2] = {0x78, 0x9C};
+	AppendDeflateOutput(&zlib, zlib_header, 2);
+	DeflateChunk(filtered.data, 0, filtered.size, DEFLATE_DEFAULT_LEVEL, &zlib);
+	DeflateFinish(&zlib);
+	AppendPngU32(&zlib, ComputeAdler32(1, filtered.data, filtered.size));
+	FreeDeflateOutput(&filtered);
+
+	static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	DeflateOutput png = {};
+	AppendDeflateOutput(&png, signature, 8);
+	u8 header[13] = {};
+	header[0] = (u8)(width >> 24); header[1] = (u8)(width >> 16); header[2] = (u8)(width >> 8); header[3] = (u8)width;
+	header[4] = (u8)(height >> 24); header[5] = (u8)(height >> 16); header[6] = (u8)(height >> 8); header[7] = (u8)height;
+	header[8] = (u8)bit_depth;
+	header[9] = color_types[channel_count - 1];
+	header[12] = 1;
+	AppendPngChunk(&png, "IHDR", header, 13);
+	for (size_t offset = 0; offset < zlib.size; offset += PROGRESSIVE_TEST_IDAT_SIZE)
+	{
+		size_t size = (zlib.size - offset < PROGRESSIVE_TEST_IDAT_SIZE) ? zlib.size - offset : PROGRESSIVE_TEST_IDAT_SIZE;
+		AppendPngChunk(&png, "IDAT", zlib.data + offset, (u32)size);
+	}
+	AppendPngChunk(&png, "IEND", 0, 0);
+	FreeDeflateOutput(&zlib);
+
+	bool success = Platform::WriteBufferToFile(png.data, png.size, file_path, false);
+	FreeDeflateOutput(&png);
+	return success;
+}
+
+static void TestProgressivePng()
+{
+	u8* rgba = MakeTestPattern(PROGRESSIVE_TEST_WIDTH, PROGRESSIVE_TEST_HEIGHT);
+	const char* file_path = "test_progressive.png";
+	for (int channel_count = 1; channel_count <= 4; ++channel_count)
+	{
+		u8* pixels = PackTestChannels(rgba, PROGRESSIVE_TEST_WIDTH * PROGRESSIVE_TEST_HEIGHT, channel_count);
+		TEST_CHECK(WritePng(file_path, pixels, PROGRESSIVE_TEST_WIDTH, PROGRESSIVE_TEST_HEIGHT, channel_count, 8, (size_t)PROGRESSIVE_TEST_WIDTH * channel_count, 0));
+		CheckProgressiveDecode(file_path, true, 1);
+		free(pixels);
+	}
+
+	u16* wide = (u16*)malloc((size_t)PROGRESSIVE_TEST_WIDTH * PROGRESSIVE_TEST_HEIGHT * 4 * sizeof(u16)); // @malloc
+	for (int i = 0; i < PROGRESSIVE_TEST_WIDTH * PROGRESSIVE_TEST_HEIGHT * 4; ++i) wide[i] = (u16)(rgba[i] * 257 + (i & 0xFF));
+	TEST_CHECK(WritePng(file_path, wide, PROGRESSIVE_TEST_WIDTH, PROGRESSIVE_TEST_HEIGHT, 4, 16, (size_t)PROGRESSIVE_TEST_WIDTH * 8, 0));
+	CheckProgressiveDecode(file_path, true, 1);
+	free(wide);
+	remove(file_path);
+	free(rgba);
+}
+
+// Includes sizes small enough to leave some of the seven passes empty.
+static void TestProgressiveInterlacedPng()
+{
+	static const int sizes[][2] = {{PROGRESSIVE_TEST_WIDTH, PROGRESSIVE_TEST_HEIGHT}, {37, 21}, {3, 2}, {1, 1}};
+	const char* file_path = "test_progressive_interlaced.png";
+	for (int i = 0; i < (int)ARRAYCOUNT(sizes); ++i)
+	{
+		int width = sizes[i][0];
+		int height = sizes[i][1];
+		u8* rgba = MakeTestPattern(width, height);
+		for (int channel_count = 1; channel_count <= 4; ++channel_count)
+		{
+			u8* pixels = PackTestChannels(rgba, (size_t)width * height, channel_count);
+			TEST_CHECK(WriteInterlacedPng(file_path, pixels, width, height, channel_count, 8));
+			CheckProgressiveDecode(file_path, true, ADAM7_PASS_COUNT);
+			free(pixels);
+		}
+
+		u16* wide = (u16*)malloc((size_t)width * height * 3 * sizeof(u16)); // @malloc
+		for (int p = 0; p < width * height; ++p)
+		{
+			for (int c = 0; c < 3; ++c) wide[p * 3 + c] = (u16)(rgba[p * 4 + c] * 257 + (p & 0xFF));
+		}
+		TEST_CHECK(WriteInterlacedPng(file_path, wide, width, height, 3, 16));
+		CheckProgressiveDecode(file_path, true, ADAM7_PASS_COUNT);
+		free(wide);
+		free(rgba);
+	}
+	remove(file_path);
+}
+
+// JPEGs are decoded in full by stb_image either way, after a DC preview at 1/8 scale.
+static void TestProgressiveJpeg()
+{
+	u8* rgba = MakeTestPattern(PROGRESSIVE_TEST_WIDTH, PROGRESSIVE_TEST_HEIGHT);
+	const char* file_path = "test_progressive.jpg";
+	for (int channel_count = 1; channel_count <= 3; channel_count += 2)
+	{
+		u8* pixels = PackTestChannels(rgba, PROGRESSIVE_TEST_WIDTH * PROGRESSIVE_TEST_HEIGHT, channel_count);
+		JpegWriter writer;
+		TEST_CHECK(BeginJpegWrite(&writer, file_path, PROGRESSIVE_TEST_WIDTH, PROGRESSIVE_TEST_HEIGHT, channel_count, 0, channel_count == 3));
+		TEST_CHECK(WriteJpegRows(&writer, pixels, PROGRESSIVE_TEST_HEIGHT, (size_t)PROGRESSIVE_TEST_WIDTH * channel_count));
+		TEST_CHECK(EndJpegWrite(&writer));
+		CheckProgressiveDecode(file_path, false, 1);
+
+		DecodeProgress* progress = CreateDecodeProgress();
+		DecodedImage image;
+		TEST_CHECK(DecodeImageFileProgressive(file_path, progress, &image));
+		TEST_CHECK(progress->has_preview.load());
+		TEST_CHECK(progress->width == PROGRESSIVE_TEST_WIDTH && progress->height == PROGRESSIVE_TEST_HEIGHT);
+		TEST_CHECK(progress->preview.width == (PROGRESSIVE_TEST_WIDTH + 7) / 8 && progress->preview.height == (PROGRESSIVE_TEST_HEIGHT + 7) / 8);
+		FreeDecodedImage(&image);
+		FreeDecodeProgress(progress);
+		free(pixels);
+	}
+	remove(file_path);
+	free(rgba);
+}
@@ -0,0 +1,76 @@
+// Tests of SummedAreaTable.cpp, against sums added up pixel by pixel.
+#include "TestMain.h"
+#include "SummedAreaTable.h"
+
+// Checks rectangles along every edge of the image as well as inside it, and the whole image.
+static void CheckSummedAreaSums(const void* pixels, PixelLayout layout, int width, int height, SummedAreaType expected_type)
+{
+	SummedAreaTable table;
+	TEST_CHECK(BuildSummedAreaTable(&table, pixels, layout, width, height));
+	TEST_CHECK(table.type == expected_type);
+	TEST_CHECK(table.width == width && table.height == height && table.channel_count == layout.channel_count);
+
+	int rects[][4] = {
+		{0, 0, width, height},
+		{0, 0, 1, 1},
+		{width - 1, height - 1, 1, 1},
+		{0, height - 1, width, 1},
+		{width - 1, 0, 1, height},
+		{width / 3, height / 4, width - width / 3, height - height / 4},
+		{width / 5, 0, width / 2, height / 3},
+		{width / 2, height / 2, 0, height / 2},
+	};
+	for (int i = 0; i < (int)ARRAYCOUNT(rects); ++i)
+	{
+		int x = rects[i][0], y = rects[i][1], rect_width = rects[i][2], rect_height = rects[i][3];
+		double sums[4];
+		GetSummedAreaSums(&table, x, y, rect_width, rect_height, sums);
+		for (int c = 0; c < layout.channel_count; ++c)
+		{
+			double expected = 0.0;
+			for (int row = y; row < y + rect_height; ++row)
+			{
+				for (int column = x; column < x + rect_width; ++column)
+				{
+					expected += GetStatsTestValue(pixels, layout, ((size_t)row * width + column) * layout.channel_count + c);
+				}
+			}
+			// Integer sums are exact; float ones are added up in another order.
+			if (layout.type == PixelType::F32) TEST_CHECK(fabs(sums[c] - expected) <= 1e-9 * (1.0 + fabs(expected)));
+			else TEST_CHECK(sums[c] == expected);
+		}
+	}
+	FreeSummedAreaTable(&table);
+}
+
+static void TestSummedAreaTable()
+{
+	const int width = 203;
+	const int height = 67;
+	u8* rgba = MakeTestPattern(width, height);
+	static const PixelType types[] = {PixelType::U8, PixelType::U16, PixelType::F32};
+	static const SummedAreaType table_types[] = {SummedAreaType::U32, SummedAreaType::U32, SummedAreaType::F64};
+	for (int t = 0; t < (int)ARRAYCOUNT(types); ++t)
+	{
+		for (int channel_count = 1; channel_count <= 4; ++channel_count)
+		{
+			PixelLayout layout = {channel_count, types[t]};
+			void* pixels = MakeStatsTestImage(rgba, (size_t)width * height, layout);
+			CheckSummedAreaSums(pixels, layout, width, height, table_types[t]);
+			free(pixels);
+		}
+	}
+	free(rgba);
+}
+
+// 65537 white 16-bit pixels add up to exactly U32_MAX, so still fit a 32-bit table; one pixel more and
+// the table has to be 64-bit.
+static void TestSummedAreaTableType()
+{
+	const int max_width = 65538;
+	u16* pixels = (u16*)malloc(sizeof(u16) * max_width); // @malloc
+	for (int i = 0; i < max_width; ++i) pixels[i] = U16_MAX;
+	CheckSummedAreaSums(pixels, {1, PixelType::U16}, max_width - 1, 1, SummedAreaType::U32);
+	CheckSummedAreaSums(pixels, {1, PixelType::U16}, max_width / 2, 2, SummedAreaType::U64);
+	free(pixels);
+}
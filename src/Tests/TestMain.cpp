@@ -0,0 +1,88 @@
+// Entry point of imagetests, built by TestBuild.cpp. Runs every test in g_tests, or only those whose name
+// contains one of the arguments, and exits with 1 if any check failed.
+#include "TestMain.h"
+
+static TestCase g_tests[] = {
+	{"DecodeBmpFile", TestDecodeBmpFile},
+	{"MipKernelsAgree", TestMipKernelsAgree},
+	{"TilePageTable", TestTilePageTable},
+	{"TileEviction", TestTileEviction},
+	{"TileQuadFallback", TestTileQuadFallback},
+	{"BmpRoundTrip", TestBmpRoundTrip},
+	{"TgaRoundTrip", TestTgaRoundTrip},
+	{"PngRoundTrip", TestPngRoundTrip},
+	{"HdrRoundTrip", TestHdrRoundTrip},
+	{"JpegRoundTrip", TestJpegRoundTrip},
+	{"ProgressivePng", TestProgressivePng},
+	{"ProgressiveInterlacedPng", TestProgressiveInterlacedPng},
+	{"ProgressiveJpeg", TestProgressiveJpeg},
+	{"UploadBudget", TestUploadBudget},
+	{"UploadSlotReuse", TestUploadSlotReuse},
+	{"CancelUploads", TestCancelUploads},
+	{"ReturnUploadChunk", TestReturnUploadChunk},
+	{"ImageStatsCache", TestImageStatsCache},
+	{"ImageStatsKernelsAgree", TestImageStatsKernelsAgree},
+	{"SummedAreaTable", TestSummedAreaTable},
+	{"SummedAreaTableType", TestSummedAreaTableType},
+	{"DiffKernelsAgree", TestDiffKernelsAgree},
+	{"DiffSquaredErrorFlush", TestDiffSquaredErrorFlush},
+	{"DiffImages", TestDiffImages},
+	{"DiffThreshold", TestDiffThreshold},
+	{"DiffMaskOverlay", TestDiffMaskOverlay},
+	{"SsimAgainstReference", TestSsimAgainstReference},
+	{"SsimKernelsAgree", TestSsimKernelsAgree},
+	{"SsimSmallImages", TestSsimSmallImages},
+	{"ImageLoadStress", TestImageLoadStress},
+	{"BlockCompress", TestBlockCompress},
+	{"DdsRoundTrip", TestDdsRoundTrip},
+	{"ThumbnailScales", TestThumbnailScales},
+	{"ThumbnailRestartIntervals", TestThumbnailRestartIntervals},
+	{"ThumbnailDamagedJpeg", TestThumbnailDamagedJpeg},
+	{"ThumbnailCacheLookup", TestThumbnailCacheLookup},
+	{"ThumbnailCacheEviction", TestThumbnailCacheEviction},
+	{"ThumbnailCacheReopen", TestThumbnailCacheReopen},
+	{"ThumbnailCacheSharedFile", TestThumbnailCacheSharedFile},
+};
+
+static int g_failed_check_count = 0;
+
+void FailTestCheck(const char* condition, const char* file, int line)
+{
+	ErrPrintF("    %s(%d): check failed: %s\n", file, line, condition);
+	++g_failed_check_count;
+}
+
+static bool IsTestSelected(const char* name, int argc, char** argv)
+{
+	if (argc < 2) return true;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strstr(name, argv[i])) return true;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	StartJobSystem();
+	int run_count = 0;
+	int failed_count = 0;
+	for (int i = 0; i < (int)ARRAYCOUNT(g_tests); ++i)
+	{
+		if (!IsTestSelected(g_tests[i].name, argc, argv)) continue;
+		PrintF("%s\n", g_tests[i].name);
+		int previous_failed_check_count = g_failed_check_count;
+		g_tests[i].function();
+		++run_count;
+		if (g_failed_check_count != previous_failed_check_count) ++failed_count;
+	}
+	StopJobSystem();
+
+	if (failed_count)
+	{
+		ErrPrintF("%d of %d tests failed.\n", failed_count, run_count);
+		return 1;
+	}
+	PrintF("All %d tests passed.\n", run_count);
+	return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef _TEST_MAIN_H
+#define _TEST_MAIN_H
+
+#include "Core/EngineCore.h"
+
+// Tiny test harness for TestBuild.cpp. A test is a plain function that checks things with TEST_CHECK, and
+// is listed in g_tests in TestMain.cpp. A failed check is reported and counted, and the test carries on,
+// so one run shows every failure. Tests run one after another on the main thread, with the job system
+// running, in the directory imagetests was started from; files they write there are theirs to delete.
+
+typedef void TestFunction();
+
+struct TestCase
+{
+	const char* name;
+	TestFunction* function;
+};
+
+void FailTestCheck(const char* condition, const char* file, int line);
+
+#define TEST_CHECK(x) do { if (!(x)) FailTestCheck(#x, __FILE__, __LINE__); } while (0)
+
+#endif //_TEST_MAIN_H
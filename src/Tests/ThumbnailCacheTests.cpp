@@ -0,0 +1,183 @@
+// Tests of ThumbnailCache.cpp: lookups, page eviction, reopening, damaged files, and a second viewer
+// opening the cache while the first has it.
+#include "TestMain.h"
+#include "ThumbnailCache.h"
+
+#define THUMBNAIL_CACHE_TEST_PATH "test_thumbnail_cache.bin"
+
+// A thumbnail whose pixels all depend on seed, so one entry can't pass for another.
+static DecodedImage MakeCacheTestThumbnail(int width, int height, u32 seed)
+{
+	DecodedImage thumbnail = {};
+	thumbnail.pixels = malloc((size_t)width * height * 4); // @malloc
+	thumbnail.width = width;
+	thumbnail.height = height;
+	thumbnail.layout = {4, PixelType::U8};
+	u8* pixels = (u8*)thumbnail.pixels;
+	for (size_t i = 0; i < (size_t)width * height * 4; ++i) pixels[i] = (u8)(i * 7 + seed * 31 + (i >> 10));
+	return thumbnail;
+}
+
+static void AddCacheTestThumbnail(ThumbnailCache* cache, u64 key, int width, int height)
+{
+	DecodedImage thumbnail = MakeCacheTestThumbnail(width, height, (u32)key);
+	AddCachedThumbnail(cache, key, &thumbnail, width * 8, height * 8 + 1);
+	FreeDecodedImage(&thumbnail);
+}
+
+// True if the cache holds what AddCacheTestThumbnail put there for key.
+static bool HasCacheTestThumbnail(ThumbnailCache* cache, u64 key, int width, int height)
+{
+	DecodedImage found;
+	int source_width = 0, source_height = 0;
+	if (!FindCachedThumbnail(cache, key, &found, &source_width, &source_height)) return false;
+	DecodedImage expected = MakeCacheTestThumbnail(width, height, (u32)key);
+	bool is_same = found.width == width && found.height == height && found.layout.channel_count == 4 &&
+		found.layout.type == PixelType::U8 && source_width == width * 8 && source_height == height * 8 + 1 &&
+		memcmp(found.pixels, expected.pixels, (size_t)width * height * 4) == 0;
+	FreeDecodedImage(&expected);
+	FreeDecodedImage(&found);
+	return is_same;
+}
+
+static void TestThumbnailCacheLookup()
+{
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+	ThumbnailCache* cache = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH, 0);
+	TEST_CHECK(cache && !cache->is_private);
+	if (!cache) return;
+
+	for (u64 key = 1; key <= 200; ++key) AddCacheTestThumbnail(cache, key * 0x9E3779B97F4A7C15ull, 1 + (int)key % 37, 1 + (int)key % 23);
+	TEST_CHECK(cache->header->entry_count == 200);
+	bool has_all = true;
+	for (u64 key = 1; key <= 200; ++key) has_all &= HasCacheTestThumbnail(cache, key * 0x9E3779B97F4A7C15ull, 1 + (int)key % 37, 1 + (int)key % 23);
+	TEST_CHECK(has_all);
+
+	// A second add of the same key is ignored, and keys that were never added, zero and a null cache miss.
+	AddCacheTestThumbnail(cache, 0x9E3779B97F4A7C15ull, 5, 5);
+	TEST_CHECK(cache->header->entry_count == 200 && HasCacheTestThumbnail(cache, 0x9E3779B97F4A7C15ull, 2, 2));
+	DecodedImage found;
+	TEST_CHECK(!FindCachedThumbnail(cache, 12345, &found) && !found.pixels);
+	TEST_CHECK(!FindCachedThumbnail(cache, 0, &found) && !FindCachedThumbnail(0, 1, &found));
+	AddCacheTestThumbnail(cache, 0, 4, 4);
+	TEST_CHECK(cache->header->entry_count == 200);
+
+	// Keys depend on the thumbnail size as well as the file, and there's none for a missing file.
+	u64 small_key = GetThumbnailCacheKey(THUMBNAIL_CACHE_TEST_PATH, 128);
+	TEST_CHECK(small_key && small_key != GetThumbnailCacheKey(THUMBNAIL_CACHE_TEST_PATH, 256));
+	TEST_CHECK(small_key == GetThumbnailCacheKey(THUMBNAIL_CACHE_TEST_PATH, 128));
+	TEST_CHECK(GetThumbnailCacheKey("test_thumbnail_cache_missing.png", 128) == 0);
+
+	CloseThumbnailCache(cache);
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+}
+
+// With room for three pages, 4 MB thumbnails fill them two at a time. The fourth page's worth has to
+// empty the least recently used page: not the oldest one, which a lookup has just touched, but the next.
+static void TestThumbnailCacheEviction()
+{
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+	ThumbnailCache* cache = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH, THUMBNAIL_CACHE_PAGE_SIZE * 3);
+	TEST_CHECK(cache && cache->header->max_page_count == 3);
+	if (!cache) return;
+
+	const int size = 1024;
+	for (u64 key = 1; key <= 6; ++key) AddCacheTestThumbnail(cache, key, size, size);
+	TEST_CHECK(cache->header->page_count == 3 && cache->header->entry_count == 6);
+	TEST_CHECK(HasCacheTestThumbnail(cache, 1, size, size));
+
+	AddCacheTestThumbnail(cache, 7, size, size);
+	TEST_CHECK(cache->header->page_count == 3 && cache->header->entry_count == 5);
+	TEST_CHECK(cache->header->current_page == 1);
+	TEST_CHECK(!HasCacheTestThumbnail(cache, 3, size, size) && !HasCacheTestThumbnail(cache, 4, size, size));
+	static const u64 kept[] = {1, 2, 5, 6, 7};
+	for (int i = 0; i < (int)ARRAYCOUNT(kept); ++i) TEST_CHECK(HasCacheTestThumbnail(cache, kept[i], size, size));
+
+	// Touching page 0 again leaves page 2 the oldest.
+	TEST_CHECK(HasCacheTestThumbnail(cache, 2, size, size));
+	AddCacheTestThumbnail(cache, 8, size, size);
+	AddCacheTestThumbnail(cache, 9, size, size);
+	TEST_CHECK(cache->header->current_page == 2 && cache->header->entry_count == 5);
+	TEST_CHECK(!HasCacheTestThumbnail(cache, 5, size, size) && !HasCacheTestThumbnail(cache, 6, size, size));
+	TEST_CHECK(HasCacheTestThumbnail(cache, 9, size, size) && HasCacheTestThumbnail(cache, 1, size, size));
+
+	CloseThumbnailCache(cache);
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+}
+
+// Entries survive closing and reopening with the same size limit. Reopening with another limit, or after
+// the header has been damaged or left marked open by a run that died, starts over with a working cache.
+static void TestThumbnailCacheReopen()
+{
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+	const u64 max_size = THUMBNAIL_CACHE_PAGE_SIZE * 4;
+	ThumbnailCache* cache = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH, max_size);
+	TEST_CHECK(cache);
+	if (!cache) return;
+	for (u64 key = 1; key <= 20; ++key) AddCacheTestThumbnail(cache, key, 64 + (int)key, 48);
+	CloseThumbnailCache(cache);
+
+	cache = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH, max_size);
+	TEST_CHECK(cache && cache->header->entry_count == 20 && cache->header->is_open);
+	bool has_all = true;
+	for (u64 key = 1; key <= 20; ++key) has_all &= HasCacheTestThumbnail(cache, key, 64 + (int)key, 48);
+	TEST_CHECK(has_all);
+	CloseThumbnailCache(cache);
+
+	// Damage to each of these has to be noticed: the magic, the page count and the open flag.
+	static const int damaged_fields[] = {0, 5, 9};
+	for (int i = 0; i < (int)ARRAYCOUNT(damaged_fields); ++i)
+	{
+		Platform::MappedFile file;
+		TEST_CHECK(Platform::MapFileForWrite(THUMBNAIL_CACHE_TEST_PATH, sizeof(ThumbnailCacheHeader), &file));
+		u32* fields = (u32*)file.data;
+		fields[damaged_fields[i]] = (damaged_fields[i] == 5) ? 1000 : 1;
+		Platform::UnmapFile(&file);
+
+		cache = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH, max_size);
+		TEST_CHECK(cache && !cache->is_private && cache->header->entry_count == 0 && cache->header->page_count == 0);
+		TEST_CHECK(cache && !HasCacheTestThumbnail(cache, 1, 65, 48));
+		AddCacheTestThumbnail(cache, 1, 65, 48);
+		TEST_CHECK(HasCacheTestThumbnail(cache, 1, 65, 48));
+		CloseThumbnailCache(cache);
+	}
+
+	cache = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH, max_size * 2);
+	TEST_CHECK(cache && cache->header->entry_count == 0 && !HasCacheTestThumbnail(cache, 1, 65, 48));
+	CloseThumbnailCache(cache);
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+}
+
+// A second viewer opening the cache while the first has it must not reset the first one's index, and
+// gets a private cache of its own that neither sees nor touches the shared one.
+static void TestThumbnailCacheSharedFile()
+{
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+	ThumbnailCache* first = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH);
+	TEST_CHECK(first && !first->is_private);
+	if (!first) return;
+	for (u64 key = 1; key <= 10; ++key) AddCacheTestThumbnail(first, key, 32, 32);
+
+	ThumbnailCache* second = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH);
+	TEST_CHECK(second && second->is_private);
+	TEST_CHECK(second && second->header->max_page_count == THUMBNAIL_CACHE_PRIVATE_SIZE / THUMBNAIL_CACHE_PAGE_SIZE);
+	TEST_CHECK(first->header->entry_count == 10 && HasCacheTestThumbnail(first, 3, 32, 32));
+	TEST_CHECK(!HasCacheTestThumbnail(second, 3, 32, 32));
+	for (u64 key = 100; key <= 110; ++key) AddCacheTestThumbnail(second, key, 40, 24);
+	TEST_CHECK(HasCacheTestThumbnail(second, 105, 40, 24) && !HasCacheTestThumbnail(first, 105, 40, 24));
+
+	// A private cache grows in memory like the file would, and evicts within its own limit.
+	for (u64 key = 200; key < 200 + 40; ++key) AddCacheTestThumbnail(second, key, 1024, 1024);
+	TEST_CHECK(second->header->page_count == second->header->max_page_count);
+	TEST_CHECK(HasCacheTestThumbnail(second, 239, 1024, 1024) && !HasCacheTestThumbnail(second, 200, 1024, 1024));
+	CloseThumbnailCache(second);
+
+	// The shared file kept only the first viewer's entries, and is free once that closes.
+	TEST_CHECK(first->header->entry_count == 10 && first->header->is_open);
+	CloseThumbnailCache(first);
+	ThumbnailCache* reopened = OpenThumbnailCache(THUMBNAIL_CACHE_TEST_PATH);
+	TEST_CHECK(reopened && !reopened->is_private && reopened->header->entry_count == 10);
+	TEST_CHECK(reopened && HasCacheTestThumbnail(reopened, 10, 32, 32) && !HasCacheTestThumbnail(reopened, 105, 40, 24));
+	CloseThumbnailCache(reopened);
+	remove(THUMBNAIL_CACHE_TEST_PATH);
+}
@@ -0,0 +1,386 @@
+// Tests of ThumbnailDecode.cpp: the reduced JPEG decodes against full decodes shrunk with a box filter,
+// restart intervals, and damaged files, which have to fall back to stb_image (or fail) cleanly.
+#include "TestMain.h"
+#include "ThumbnailDecode.h"
+#include "JpegWriter.h"
+
+#define THUMBNAIL_TEST_WIDTH 250
+#define THUMBNAIL_TEST_HEIGHT 190
+
+// Smooth enough that shrinking it in the DCT domain and with a box filter come to nearly the same thing.
+static u8* MakeThumbnailTestImage(int width, int height, int channel_count)
+{
+	u8* pixels = (u8*)malloc((size_t)width * height * channel_count); // @malloc
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			float values[3] = {
+				128.0f + 90.0f * sinf(x * 0.05f) * cosf(y * 0.04f),
+				40.0f + 170.0f * (x + y) / (width + height),
+				180.0f - 150.0f * y / height + 20.0f * sinf((x - y) * 0.03f),
+			};
+			u8* pixel = pixels + ((size_t)y * width + x) * channel_count;
+			for (int c = 0; c < channel_count; ++c) pixel[c] = (u8)values[c];
+		}
+	}
+	return pixels;
+}
+
+static void WriteThumbnailTestJpeg(const char* file_path, const u8* pixels, int width, int height, int channel_count, bool is_subsampled, int restart_interval)
+{
+	JpegWriter writer;
+	TEST_CHECK(BeginJpegWrite(&writer, file_path, width, height, channel_count, 95, is_subsampled, restart_interval));
+	TEST_CHECK(WriteJpegRows(&writer, pixels, height, (size_t)width * channel_count));
+	TEST_CHECK(EndJpegWrite(&writer));
+}
+
+// The whole file, or 0 if it can't be read.
+static u8* ReadThumbnailTestFile(const char* file_path, u64* size)
+{
+	s64 file_size = Platform::GetFileSize(file_path);
+	*size = (file_size > 0) ? (u64)file_size : 0;
+	u8* data = *size ? (u8*)malloc((size_t)*size) : 0; // @malloc
+	if (data && !Platform::ReadFileToBuffer(file_path, data, *size))
+	{
+		free(data);
+		data = 0;
+	}
+	return data;
+}
+
+static bool IsSameThumbnail(const DecodedImage* a, const DecodedImage* b)
+{
+	if (a->width != b->width || a->height != b->height || a->layout.channel_count != 4 || b->layout.channel_count != 4) return false;
+	return memcmp(a->pixels, b->pixels, (size_t)a->width * a->height * 4) == 0;
+}
+
+// Where the entropy coded data starts: just past the start of scan segment.
+static u64 FindThumbnailTestScan(const u8* data, u64 size)
+{
+	for (u64 i = 2; i + 3 < size; ++i)
+	{
+		if (data[i] == 0xFF && data[i + 1] == 0xDA) return i + 2 + ((data[i + 2] << 8) | data[i + 3]);
+	}
+	return 0;
+}
+
+// The full decode shrunk by divisor with a box filter over the same divisor x divisor blocks the reduced
+// decode works on. Blocks that hang over the edge repeat the last row and column, as the encoder did.
+static u8* BoxFilterThumbnailTest(const DecodedImage* image, int divisor)
+{
+	int width = (image->width + divisor - 1) / divisor;
+	int height = (image->height + divisor - 1) / divisor;
+	u8* rgba = (u8*)malloc((size_t)image->width * image->height * 4); // @malloc
+	ExpandPixelsToRGBA(image->pixels, image->layout, image->width * image->height, rgba);
+	u8* result = (u8*)malloc((size_t)width * height * 4); // @malloc
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			int sums[4] = {};
+			for (int j = 0; j < divisor; ++j)
+			{
+				int source_y = y * divisor + j;
+				if (source_y >= image->height) source_y = image->height - 1;
+				for (int i = 0; i < divisor; ++i)
+				{
+					int source_x = x * divisor + i;
+					if (source_x >= image->width) source_x = image->width - 1;
+					for (int c = 0; c < 4; ++c) sums[c] += rgba[((size_t)source_y * image->width + source_x) * 4 + c];
+				}
+			}
+			for (int c = 0; c < 4; ++c) result[((size_t)y * width + x) * 4 + c] = (u8)((sums[c] + divisor * divisor / 2) / (divisor * divisor));
+		}
+	}
+	free(rgba);
+	return result;
+}
+
+// Through the reduced decoder alone, then through DecodeThumbnailFromMemory, which has to give the
+// reduced result when there is one, and otherwise whatever a full decode gives, or nothing at all.
+static bool DecodeThumbnailTestCopy(const u8* data, u64 size, int max_size, DecodedImage* thumbnail)
+{
+	// A copy of exactly size bytes, so reading past it is caught under a sanitizer.
+	u8* copy = (u8*)malloc((size_t)size); // @malloc
+	memcpy(copy, data, (size_t)size);
+	DecodedImage reduced = {};
+	bool is_reduced = DecodeJpegThumbnail(copy, size, max_size, &reduced, 0, 0);
+
+	thumbnail->width = -1;
+	bool success = DecodeThumbnailFromMemory(copy, size, max_size, thumbnail);
+	if (is_reduced)
+	{
+		TEST_CHECK(success && IsSameThumbnail(thumbnail, &reduced));
+	}
+	else
+	{
+		DecodedImage image;
+		bool is_decoded = DecodeImageFromMemory(copy, size, &image);
+		TEST_CHECK(success == is_decoded);
+		if (is_decoded)
+		{
+			int width, height;
+			GetThumbnailSize(image.width, image.height, max_size, &width, &height);
+			TEST_CHECK(thumbnail->width == width && thumbnail->height == height && thumbnail->pixels);
+			FreeDecodedImage(&image);
+		}
+	}
+	if (!success) TEST_CHECK(!thumbnail->pixels && thumbnail->width == 0 && thumbnail->height == 0);
+	FreeDecodedImage(&reduced);
+	free(copy);
+	return is_reduced;
+}
+
+// At 1/2, 1/4 and 1/8 scale, for gray, full chroma and subsampled chroma, the reduced decode has to be
+// close to the full decode shrunk with a box filter. max_size is picked so the scaled blocks are exactly
+// the thumbnail's size, with no filtering after.
+static void TestThumbnailScales()
+{
+	const char* file_path = "test_thumbnail.jpg";
+	const int width = THUMBNAIL_TEST_WIDTH;
+	const int height = THUMBNAIL_TEST_HEIGHT;
+	static const int channel_counts[] = {1, 3, 3};
+	static const bool is_subsampled[] = {false, false, true};
+	for (int f = 0; f < (int)ARRAYCOUNT(channel_counts); ++f)
+	{
+		u8* pixels = MakeThumbnailTestImage(width, height, channel_counts[f]);
+		WriteThumbnailTestJpeg(file_path, pixels, width, height, channel_counts[f], is_subsampled[f], 0);
+		free(pixels);
+		DecodedImage image;
+		TEST_CHECK(DecodeImageFile(file_path, &image));
+		u64 size;
+		u8* data = ReadThumbnailTestFile(file_path, &size);
+		TEST_CHECK(data);
+
+		for (int divisor = 2; divisor <= 8; divisor *= 2)
+		{
+			int max_size = (width + divisor - 1) / divisor;
+			int thumbnail_width, thumbnail_height;
+			GetThumbnailSize(width, height, max_size, &thumbnail_width, &thumbnail_height);
+			TEST_CHECK(thumbnail_height == (height + divisor - 1) / divisor);
+
+			DecodedImage thumbnail;
+			int source_width = 0, source_height = 0;
+			TEST_CHECK(DecodeThumbnail(file_path, max_size, &thumbnail, &source_width, &source_height));
+			TEST_CHECK(source_width == width && source_height == height);
+			TEST_CHECK(thumbnail.width == thumbnail_width && thumbnail.height == thumbnail_height);
+			TEST_CHECK(thumbnail.layout.channel_count == 4 && thumbnail.layout.type == PixelType::U8);
+
+			// It has to have been the reduced decode, not the fallback.
+			DecodedImage reduced = {};
+			TEST_CHECK(data && DecodeJpegThumbnail(data, size, max_size, &reduced, 0, 0));
+			TEST_CHECK(IsSameThumbnail(&thumbnail, &reduced));
+			FreeDecodedImage(&reduced);
+
+			size_t pixel_count = (size_t)thumbnail_width * thumbnail_height;
+			u8* expected = BoxFilterThumbnailTest(&image, divisor);
+			// Subsampled chroma is only repeated at reduced scales, where stb_image interpolates it, so
+			// only the luma is held to the same bound there.
+			const u8* actual = (const u8*)thumbnail.pixels;
+			double luma_error_sum = 0.0, error_sum = 0.0;
+			double max_luma_error = 0.0;
+			int max_error = 0;
+			for (size_t i = 0; i < pixel_count; ++i)
+			{
+				const u8* a = actual + i * 4;
+				const u8* b = expected + i * 4;
+				double luma_error = fabs(0.299 * (a[0] - b[0]) + 0.587 * (a[1] - b[1]) + 0.114 * (a[2] - b[2]));
+				luma_error_sum += luma_error;
+				if (luma_error > max_luma_error) max_luma_error = luma_error;
+				for (int c = 0; c < 4; ++c)
+				{
+					int error = abs((int)a[c] - (int)b[c]);
+					error_sum += error;
+					if (error > max_error) max_error = error;
+				}
+			}
+			TEST_CHECK(luma_error_sum / pixel_count < 1.0 && max_luma_error < 3.0);
+			TEST_CHECK(error_sum / (pixel_count * 4) < (is_subsampled[f] ? 4.5 : 1.0));
+			TEST_CHECK(max_error <= (is_subsampled[f] ? 20 : 4));
+			free(expected);
+			FreeDecodedImage(&thumbnail);
+		}
+		free(data);
+		FreeDecodedImage(&image);
+	}
+	remove(file_path);
+}
+
+// The same image written with restart markers every so many MCUs (including intervals that end mid-row
+// and one longer than the whole image) has to decode to exactly the same thumbnails and previews as
+// without them.
+static void TestThumbnailRestartIntervals()
+{
+	const char* file_path = "test_thumbnail.jpg";
+	const int width = THUMBNAIL_TEST_WIDTH;
+	const int height = THUMBNAIL_TEST_HEIGHT;
+	static const int channel_counts[] = {1, 3};
+	static const bool is_subsampled[] = {false, true};
+	for (int f = 0; f < (int)ARRAYCOUNT(channel_counts); ++f)
+	{
+		u8* pixels = MakeThumbnailTestImage(width, height, channel_counts[f]);
+		WriteThumbnailTestJpeg(file_path, pixels, width, height, channel_counts[f], is_subsampled[f], 0);
+		DecodedImage image;
+		TEST_CHECK(DecodeImageFile(file_path, &image));
+		DecodedImage thumbnails[3];
+		DecodedImage preview;
+		for (int s = 0; s < 3; ++s) TEST_CHECK(DecodeThumbnail(file_path, (width + (2 << s) - 1) / (2 << s), &thumbnails[s]));
+		u64 size;
+		u8* data = ReadThumbnailTestFile(file_path, &size);
+		TEST_CHECK(data && DecodeJpegPreview(data, size, &preview));
+		free(data);
+
+		int mcu_size = is_subsampled[f] ? 16 : 8;
+		int mcu_columns = (width + mcu_size - 1) / mcu_size;
+		int mcu_count = mcu_columns * ((height + mcu_size - 1) / mcu_size);
+		int intervals[] = {1, 3, 7, mcu_columns, mcu_count - 1, mcu_count + 5};
+		for (int i = 0; i < (int)ARRAYCOUNT(intervals); ++i)
+		{
+			WriteThumbnailTestJpeg(file_path, pixels, width, height, channel_counts[f], is_subsampled[f], intervals[i]);
+			data = ReadThumbnailTestFile(file_path, &size);
+			TEST_CHECK(data);
+			if (!data) continue;
+
+			// RST0 to RST7 in turn between the intervals, and none after the last.
+			u64 scan = FindThumbnailTestScan(data, size);
+			int restart_count = 0;
+			bool is_in_order = true;
+			for (u64 p = scan; p + 1 < size; ++p)
+			{
+				if (data[p] != 0xFF || data[p + 1] < 0xD0 || data[p + 1] > 0xD7) continue;
+				if (data[p + 1] != 0xD0 + (restart_count & 7)) is_in_order = false;
+				++restart_count;
+			}
+			TEST_CHECK(restart_count == (mcu_count - 1) / intervals[i] && is_in_order);
+
+			DecodedImage restarted;
+			TEST_CHECK(DecodeImageFile(file_path, &restarted) && IsSameDecodedImage(&restarted, &image));
+			FreeDecodedImage(&restarted);
+			for (int s = 0; s < 3; ++s)
+			{
+				TEST_CHECK(DecodeThumbnailTestCopy(data, size, (width + (2 << s) - 1) / (2 << s), &restarted));
+				TEST_CHECK(IsSameThumbnail(&restarted, &thumbnails[s]));
+				FreeDecodedImage(&restarted);
+			}
+			TEST_CHECK(DecodeJpegPreview(data, size, &restarted) && IsSameThumbnail(&restarted, &preview));
+			FreeDecodedImage(&restarted);
+
+			// An interval that runs into the wrong marker means lost data; the reduced decode has to give
+			// up rather than carry on out of step.
+			if (restart_count > 1)
+			{
+				for (u64 p = scan; p + 1 < size; ++p)
+				{
+					if (data[p] == 0xFF && data[p + 1] == 0xD1)
+					{
+						data[p + 1] = 0xD2;
+						break;
+					}
+				}
+				TEST_CHECK(!DecodeThumbnailTestCopy(data, size, width / 8, &restarted));
+				FreeDecodedImage(&restarted);
+				TEST_CHECK(!DecodeJpegPreview(data, size, &restarted) && !restarted.pixels);
+			}
+			free(data);
+		}
+
+		for (int s = 0; s < 3; ++s) FreeDecodedImage(&thumbnails[s]);
+		FreeDecodedImage(&preview);
+		FreeDecodedImage(&image);
+		free(pixels);
+	}
+	remove(file_path);
+}
+
+// Truncated files, bad Huffman codes, a zero-sized frame and random damage to the scan: the reduced
+// decode gives up on what it can tell is broken, and the result is then whatever stb_image makes of it,
+// or nothing, with the thumbnail zeroed.
+static void TestThumbnailDamagedJpeg()
+{
+	const char* file_path = "test_thumbnail.jpg";
+	const int width = 96;
+	const int height = 80;
+	u8* pixels = MakeThumbnailTestImage(width, height, 3);
+	WriteThumbnailTestJpeg(file_path, pixels, width, height, 3, true, 0);
+	free(pixels);
+	u64 size;
+	u8* data = ReadThumbnailTestFile(file_path, &size);
+	remove(file_path);
+	TEST_CHECK(data);
+	if (!data) return;
+	u64 scan = FindThumbnailTestScan(data, size);
+	TEST_CHECK(scan > 0 && scan < size);
+
+	DecodedImage complete;
+	TEST_CHECK(DecodeThumbnailTestCopy(data, size, 12, &complete));
+
+	// Without the end of image marker, every bit of the scan is still there.
+	DecodedImage thumbnail;
+	TEST_CHECK(DecodeThumbnailTestCopy(data, size - 2, 12, &thumbnail) && IsSameThumbnail(&thumbnail, &complete));
+	FreeDecodedImage(&thumbnail);
+
+	// Cut anywhere in the headers, there's nothing to decode at all; cut in the scan, the reduced decode
+	// runs out of data.
+	u64 header_cuts[] = {0, 1, 2, 3, 20, scan / 2, scan - 1};
+	for (int i = 0; i < (int)ARRAYCOUNT(header_cuts); ++i)
+	{
+		TEST_CHECK(!DecodeThumbnailTestCopy(data, header_cuts[i], 12, &thumbnail));
+		TEST_CHECK(!thumbnail.pixels);
+	}
+	u64 scan_cuts[] = {scan, scan + 1, scan + (size - scan) / 3, size - 40, size - 4};
+	for (int i = 0; i < (int)ARRAYCOUNT(scan_cuts); ++i)
+	{
+		TEST_CHECK(!DecodeThumbnailTestCopy(data, scan_cuts[i], 12, &thumbnail));
+		FreeDecodedImage(&thumbnail);
+	}
+
+	u8* damaged = (u8*)malloc((size_t)size); // @malloc
+	// All ones is never a complete code, in any of the standard tables.
+	memcpy(damaged, data, (size_t)size);
+	for (u64 p = scan + 10; p + 1 < scan + 50; p += 2)
+	{
+		damaged[p] = 0xFF;
+		damaged[p + 1] = 0x00;
+	}
+	TEST_CHECK(!DecodeThumbnailTestCopy(damaged, size, 12, &thumbnail));
+	FreeDecodedImage(&thumbnail);
+
+	// A frame with no width.
+	memcpy(damaged, data, (size_t)size);
+	for (u64 p = 2; p + 8 < scan; ++p)
+	{
+		if (damaged[p] == 0xFF && damaged[p + 1] == 0xC0)
+		{
+			damaged[p + 7] = damaged[p + 8] = 0;
+			break;
+		}
+	}
+	TEST_CHECK(!DecodeThumbnailTestCopy(damaged, size, 12, &thumbnail));
+	FreeDecodedImage(&thumbnail);
+	TEST_CHECK(!DecodeJpegPreview(damaged, size, &thumbnail) && !thumbnail.pixels);
+
+	// Random damage to the scan may or may not be noticed, but must never read out of bounds.
+	u32 state = 11;
+	for (int i = 0; i < 200; ++i)
+	{
+		memcpy(damaged, data, (size_t)size);
+		for (int j = 0; j < 1 + i % 4; ++j)
+		{
+			state = state * 1664525u + 1013904223u;
+			u64 p = scan + (state >> 8) % (size - scan);
+			damaged[p] = (u8)(state >> 24);
+		}
+		DecodeThumbnailTestCopy(damaged, size, (i & 1) ? 12 : 40, &thumbnail);
+		FreeDecodedImage(&thumbnail);
+		u8* copy = (u8*)malloc((size_t)size); // @malloc
+		memcpy(copy, damaged, (size_t)size);
+		if (DecodeJpegPreview(copy, size, &thumbnail)) TEST_CHECK(thumbnail.width == width / 8 && thumbnail.height == height / 8);
+		FreeDecodedImage(&thumbnail);
+		free(copy);
+	}
+
+	free(damaged);
+	FreeDecodedImage(&complete);
+	free(data);
+}
@@ -0,0 +1,74 @@
+// Tests of the page table and LRU bookkeeping in TiledImage.cpp.
+#include "TestMain.h"
+#include "TiledImage.h"
+
+// Every tile maps to its coordinates and back, and the levels shrink down to a single tile.
+static void TestTilePageTable()
+{
+	TiledImage* image = CreateTiledImage(20481, 700);
+	TEST_CHECK(image->levels[0].tiles_x == 81 && image->levels[0].tiles_y == 3);
+	TEST_CHECK(image->levels[1].tiles_x == 40 && image->levels[1].tiles_y == 2);
+	const TileLevel* last = &image->levels[image->level_count - 1];
+	TEST_CHECK(last->tiles_x == 1 && last->tiles_y == 1);
+	TEST_CHECK(last->first_tile == image->tile_count - 1);
+	for (int tile = 0; tile < image->tile_count; ++tile)
+	{
+		TEST_CHECK(image->page_table[tile] == -1);
+		int level, tile_x, tile_y;
+		GetTileCoords(image, tile, &level, &tile_x, &tile_y);
+		TEST_CHECK(GetTileIndex(image, level, tile_x, tile_y) == tile);
+	}
+	DestroyTiledImage(image);
+}
+
+// Slots go to the least recently used tile, but never to one touched this frame or to a pinned one.
+static void TestTileEviction()
+{
+	TiledImage* image = CreateTiledImage(20000, 20000);
+	TEST_CHECK(image->tile_count > TILE_ATLAS_SLOT_COUNT + 2);
+
+	BeginTileFrame(image);
+	TEST_CHECK(MakeTileResident(image, 0, true) >= 0);
+	for (int tile = 1; tile < TILE_ATLAS_SLOT_COUNT; ++tile) TEST_CHECK(MakeTileResident(image, tile) >= 0);
+	TEST_CHECK(MakeTileResident(image, TILE_ATLAS_SLOT_COUNT) == -1);
+
+	BeginTileFrame(image);
+	int slot_of_2 = TouchTile(image, 2);
+	TEST_CHECK(slot_of_2 >= 0);
+	int slot = MakeTileResident(image, TILE_ATLAS_SLOT_COUNT);
+	TEST_CHECK(slot >= 0 && slot != slot_of_2);
+	TEST_CHECK(image->page_table[0] >= 0); // Pinned, although it's the oldest.
+	TEST_CHECK(image->page_table[1] == -1);
+	TEST_CHECK(image->page_table[TILE_ATLAS_SLOT_COUNT] == slot);
+	TEST_CHECK(MakeTileResident(image, TILE_ATLAS_SLOT_COUNT + 1) >= 0);
+	TEST_CHECK(image->page_table[2] == slot_of_2); // Touched this frame, so the next oldest went instead.
+	TEST_CHECK(image->page_table[3] == -1);
+	TEST_CHECK(TouchTile(image, 1) == -1);
+	DestroyTiledImage(image);
+}
+
+// A missing tile falls back to the part of its closest resident ancestor, including the last tile of a
+// level whose size is one more than a multiple of the tile size.
+static void TestTileQuadFallback()
+{
+	TiledImage* image = CreateTiledImage(20481, 20481);
+	BeginTileFrame(image);
+	TileQuad quad;
+	int last_tile = image->levels[0].tiles_x * image->levels[0].tiles_y - 1;
+	TEST_CHECK(!GetTileQuad(image, last_tile, &quad));
+
+	int coarsest = image->tile_count - 1;
+	int slot = MakeTileResident(image, coarsest, true);
+	TEST_CHECK(GetTileQuad(image, last_tile, &quad));
+	TEST_CHECK(quad.image_max[0] == 1.0f && quad.image_max[1] == 1.0f);
+	float slot_max_x = (float)((slot % TILE_ATLAS_SLOTS_PER_ROW + 1) * TILE_SIZE) / TILE_ATLAS_SIZE;
+	float slot_max_y = (float)((slot / TILE_ATLAS_SLOTS_PER_ROW + 1) * TILE_SIZE) / TILE_ATLAS_SIZE;
+	TEST_CHECK(quad.atlas_min[0] < quad.atlas_max[0] && quad.atlas_max[0] <= slot_max_x);
+	TEST_CHECK(quad.atlas_min[1] < quad.atlas_max[1] && quad.atlas_max[1] <= slot_max_y);
+
+	// The tile itself wins once it's in.
+	slot = MakeTileResident(image, last_tile);
+	TEST_CHECK(GetTileQuad(image, last_tile, &quad));
+	TEST_CHECK(quad.atlas_min[0] == (float)((slot % TILE_ATLAS_SLOTS_PER_ROW) * TILE_SIZE) / TILE_ATLAS_SIZE);
+	DestroyTiledImage(image);
+}
@@ -0,0 +1,130 @@
+// UploadScheduler is only bookkeeping, so its budget, its ring of staging slots and its queue can all be
+// checked without a device.
+#include "TestMain.h"
+#include "UploadScheduler.h"
+
+#define UPLOAD_TEST_CHUNK_BYTES ((u64)UPLOAD_CHUNK_SIZE * UPLOAD_CHUNK_SIZE * 4)
+
+// Takes every chunk this frame will give, returning how many there were.
+static int TakeUploadChunks(UploadScheduler* scheduler, UploadChunk* last_chunk)
+{
+	int count = 0;
+	UploadChunk chunk = {};
+	while (NextUploadChunk(scheduler, &chunk))
+	{
+		*last_chunk = chunk;
+		++count;
+	}
+	return count;
+}
+
+static void TestUploadBudget()
+{
+	int owner = 0;
+	UploadScheduler* scheduler = CreateUploadScheduler(64, UPLOAD_TEST_CHUNK_BYTES * 2);
+	ScheduleUpload(scheduler, &owner, 0, UPLOAD_CHUNK_SIZE * 2 + 176, UPLOAD_CHUNK_SIZE + 188); // 3x2 chunks.
+
+	BeginUploadFrame(scheduler);
+	UploadChunk chunks[6];
+	for (int i = 0; i < 2; ++i) TEST_CHECK(NextUploadChunk(scheduler, &chunks[i]));
+	TEST_CHECK(!NextUploadChunk(scheduler, &chunks[2]));
+	TEST_CHECK(chunks[0].x == 0 && chunks[0].y == 0 && chunks[0].width == UPLOAD_CHUNK_SIZE && chunks[0].height == UPLOAD_CHUNK_SIZE);
+	TEST_CHECK(chunks[1].x == UPLOAD_CHUNK_SIZE && chunks[1].y == 0 && !chunks[1].is_level_done);
+
+	// The rest are partial chunks, the last column narrower and the last row shorter, and fit in one frame.
+	BeginUploadFrame(scheduler);
+	for (int i = 2; i < 6; ++i) TEST_CHECK(NextUploadChunk(scheduler, &chunks[i]));
+	TEST_CHECK(chunks[2].x == UPLOAD_CHUNK_SIZE * 2 && chunks[2].width == 176 && !chunks[2].is_level_done);
+	TEST_CHECK(chunks[3].x == 0 && chunks[3].y == UPLOAD_CHUNK_SIZE && chunks[3].height == 188);
+	TEST_CHECK(chunks[5].width == 176 && chunks[5].height == 188 && chunks[5].is_level_done);
+	TEST_CHECK(!HasPendingUploads(scheduler));
+	DestroyUploadScheduler(scheduler);
+
+	// A budget smaller than a chunk still lets one through every frame.
+	scheduler = CreateUploadScheduler(64, 100);
+	ScheduleUpload(scheduler, &owner, 1, UPLOAD_CHUNK_SIZE * 2, UPLOAD_CHUNK_SIZE);
+	UploadChunk chunk = {};
+	for (int frame = 0; frame < 2; ++frame)
+	{
+		BeginUploadFrame(scheduler);
+		TEST_CHECK(TakeUploadChunks(scheduler, &chunk) == 1);
+	}
+	TEST_CHECK(chunk.level == 1 && chunk.is_level_done);
+	DestroyUploadScheduler(scheduler);
+}
+
+// Slots go round in order, and one is only handed out again UPLOAD_FRAME_LATENCY frames after it last was.
+static void TestUploadSlotReuse()
+{
+	int owner = 0;
+	UploadScheduler* scheduler = CreateUploadScheduler(2, UPLOAD_TEST_CHUNK_BYTES * 16);
+	ScheduleUpload(scheduler, &owner, 0, UPLOAD_CHUNK_SIZE * 8, UPLOAD_CHUNK_SIZE);
+
+	BeginUploadFrame(scheduler);
+	UploadChunk chunk;
+	TEST_CHECK(NextUploadChunk(scheduler, &chunk) && chunk.slot == 0);
+	TEST_CHECK(NextUploadChunk(scheduler, &chunk) && chunk.slot == 1);
+	TEST_CHECK(!NextUploadChunk(scheduler, &chunk));
+	for (int frame = 1; frame < UPLOAD_FRAME_LATENCY; ++frame)
+	{
+		BeginUploadFrame(scheduler);
+		TEST_CHECK(!NextUploadChunk(scheduler, &chunk));
+	}
+
+	BeginUploadFrame(scheduler);
+	TEST_CHECK(NextUploadChunk(scheduler, &chunk) && chunk.slot == 0 && chunk.x == UPLOAD_CHUNK_SIZE * 2);
+	TEST_CHECK(NextUploadChunk(scheduler, &chunk) && chunk.slot == 1);
+	TEST_CHECK(!NextUploadChunk(scheduler, &chunk));
+	DestroyUploadScheduler(scheduler);
+}
+
+static void TestCancelUploads()
+{
+	int owners[2] = {};
+	UploadScheduler* scheduler = CreateUploadScheduler(64, UPLOAD_TEST_CHUNK_BYTES);
+	ScheduleUpload(scheduler, &owners[0], 1, UPLOAD_CHUNK_SIZE * 2, UPLOAD_CHUNK_SIZE);
+	ScheduleUpload(scheduler, &owners[1], 0, UPLOAD_CHUNK_SIZE, UPLOAD_CHUNK_SIZE);
+	ScheduleUpload(scheduler, &owners[0], 0, UPLOAD_CHUNK_SIZE, UPLOAD_CHUNK_SIZE);
+
+	// Halfway through a level is as good a time to cancel as any.
+	BeginUploadFrame(scheduler);
+	UploadChunk chunk;
+	TEST_CHECK(NextUploadChunk(scheduler, &chunk) && chunk.owner == &owners[0] && !chunk.is_level_done);
+	CancelUploads(scheduler, &owners[0]);
+	TEST_CHECK(!HasPendingUploads(scheduler, &owners[0]));
+	TEST_CHECK(HasPendingUploads(scheduler, &owners[1]) && HasPendingUploads(scheduler));
+
+	BeginUploadFrame(scheduler);
+	TEST_CHECK(TakeUploadChunks(scheduler, &chunk) == 1);
+	TEST_CHECK(chunk.owner == &owners[1] && chunk.is_level_done);
+	TEST_CHECK(!HasPendingUploads(scheduler));
+	CancelUploads(scheduler, &owners[1]);
+	DestroyUploadScheduler(scheduler);
+}
+
+// A chunk that couldn't be copied comes back through the same slot, without costing any budget, whether
+// or not it finished its level.
+static void TestReturnUploadChunk()
+{
+	int owner = 0;
+	UploadScheduler* scheduler = CreateUploadScheduler(4, (u64)UPLOAD_CHUNK_SIZE * 40 * 4); // Exactly the first chunk.
+	ScheduleUpload(scheduler, &owner, 2, UPLOAD_CHUNK_SIZE + 30, 40);
+
+	BeginUploadFrame(scheduler);
+	UploadChunk chunk, again;
+	TEST_CHECK(NextUploadChunk(scheduler, &chunk) && !chunk.is_level_done);
+	ReturnUploadChunk(scheduler, &chunk);
+	TEST_CHECK(NextUploadChunk(scheduler, &again));
+	TEST_CHECK(again.x == chunk.x && again.y == chunk.y && again.width == chunk.width && again.slot == chunk.slot && !again.is_level_done);
+
+	BeginUploadFrame(scheduler);
+	TEST_CHECK(NextUploadChunk(scheduler, &chunk) && chunk.is_level_done && chunk.slot == 1);
+	TEST_CHECK(!HasPendingUploads(scheduler));
+	ReturnUploadChunk(scheduler, &chunk);
+	TEST_CHECK(HasPendingUploads(scheduler, &owner));
+	TEST_CHECK(NextUploadChunk(scheduler, &again));
+	TEST_CHECK(again.level == 2 && again.x == UPLOAD_CHUNK_SIZE && again.width == 30 && again.height == 40);
+	TEST_CHECK(again.slot == 1 && again.is_level_done);
+	TEST_CHECK(!HasPendingUploads(scheduler));
+	DestroyUploadScheduler(scheduler);
+}
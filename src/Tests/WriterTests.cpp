@@ -0,0 +1,196 @@
+// Round trips through the encoders and back through DecodeImageFile, which is what the viewer and the
+// CLI read their output with.
+#include "TestMain.h"
+#include "PngWriter.h"
+#include "SimpleImageWriters.h"
+#include "JpegWriter.h"
+
+#define WRITER_TEST_WIDTH 37
+#define WRITER_TEST_HEIGHT 21
+#define WRITER_TEST_FIRST_ROWS 5 // Rows go in two calls, so the writers see their rows in pieces.
+
+// The first channel_count channels of each RGBA pixel.
+static u8* PackTestChannels(const u8* rgba, size_t pixel_count, int channel_count)
+{
+	u8* result = (u8*)malloc(pixel_count * channel_count); // @malloc
+	for (size_t i = 0; i < pixel_count; ++i) memcpy(result + i * channel_count, rgba + i * 4, channel_count);
+	return result;
+}
+
+static void TestBmpRoundTrip()
+{
+	u8* rgba = MakeTestPattern(WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT);
+	const char* file_path = "test_writer.bmp";
+	for (int channel_count = 3; channel_count <= 4; ++channel_count)
+	{
+		u8* pixels = PackTestChannels(rgba, WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT, channel_count);
+		size_t stride = (size_t)WRITER_TEST_WIDTH * channel_count;
+		BmpWriter writer;
+		TEST_CHECK(BeginBmpWrite(&writer, file_path, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT, channel_count));
+		TEST_CHECK(WriteBmpRows(&writer, pixels, WRITER_TEST_FIRST_ROWS, stride));
+		TEST_CHECK(WriteBmpRows(&writer, pixels + WRITER_TEST_FIRST_ROWS * stride, WRITER_TEST_HEIGHT - WRITER_TEST_FIRST_ROWS, stride));
+		TEST_CHECK(EndBmpWrite(&writer));
+
+		DecodedImage image;
+		TEST_CHECK(DecodeImageFile(file_path, &image));
+		TEST_CHECK(IsDecodedPattern(&image, rgba, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT, channel_count));
+		FreeDecodedImage(&image);
+		free(pixels);
+	}
+	remove(file_path);
+	free(rgba);
+}
+
+static void TestTgaRoundTrip()
+{
+	u8* rgba = MakeTestPattern(WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT);
+	// Runs for the RLE path to find, next to the rows that have none.
+	for (int x = 0; x < WRITER_TEST_WIDTH / 2; ++x) memcpy(rgba + x * 4, rgba, 4);
+
+	const char* file_path = "test_writer.tga";
+	int channel_counts[] = {1, 3, 4};
+	for (int i = 0; i < (int)ARRAYCOUNT(channel_counts) * 2; ++i)
+	{
+		int channel_count = channel_counts[i / 2];
+		bool is_rle = (i % 2) != 0;
+		u8* pixels = PackTestChannels(rgba, WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT, channel_count);
+		size_t stride = (size_t)WRITER_TEST_WIDTH * channel_count;
+		TgaWriter writer;
+		TEST_CHECK(BeginTgaWrite(&writer, file_path, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT, channel_count, is_rle));
+		TEST_CHECK(WriteTgaRows(&writer, pixels, WRITER_TEST_FIRST_ROWS, stride));
+		TEST_CHECK(WriteTgaRows(&writer, pixels + WRITER_TEST_FIRST_ROWS * stride, WRITER_TEST_HEIGHT - WRITER_TEST_FIRST_ROWS, stride));
+		TEST_CHECK(EndTgaWrite(&writer));
+
+		DecodedImage image;
+		TEST_CHECK(DecodeImageFile(file_path, &image));
+		TEST_CHECK(IsDecodedPattern(&image, rgba, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT, channel_count));
+		FreeDecodedImage(&image);
+		free(pixels);
+	}
+	remove(file_path);
+	free(rgba);
+}
+
+static void TestPngRoundTrip()
+{
+	u8* rgba = MakeTestPattern(WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT);
+	const char* file_path = "test_writer.png";
+	for (int channel_count = 1; channel_count <= 4; ++channel_count)
+	{
+		u8* pixels = PackTestChannels(rgba, WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT, channel_count);
+		size_t stride = (size_t)WRITER_TEST_WIDTH * channel_count;
+		PngWriter writer;
+		TEST_CHECK(BeginPngWrite(&writer, file_path, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT, channel_count, 8, channel_count * 2));
+		TEST_CHECK(WritePngRows(&writer, pixels, WRITER_TEST_FIRST_ROWS, stride));
+		TEST_CHECK(WritePngRows(&writer, pixels + WRITER_TEST_FIRST_ROWS * stride, WRITER_TEST_HEIGHT - WRITER_TEST_FIRST_ROWS, stride));
+		TEST_CHECK(EndPngWrite(&writer));
+
+		DecodedImage image;
+		TEST_CHECK(DecodeImageFile(file_path, &image));
+		TEST_CHECK(IsDecodedPattern(&image, rgba, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT, channel_count));
+		FreeDecodedImage(&image);
+		free(pixels);
+	}
+
+	// 16-bit samples go in native byte order and have to come back the same.
+	u16 wide[WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT * 4];
+	for (int i = 0; i < WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT * 4; ++i) wide[i] = (u16)(rgba[i] * 257 + (i & 0xFF));
+	TEST_CHECK(WritePng(file_path, wide, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT, 4, 16, WRITER_TEST_WIDTH * 8, 0));
+	DecodedImage image;
+	TEST_CHECK(DecodeImageFile(file_path, &image));
+	TEST_CHECK(image.width == WRITER_TEST_WIDTH && image.height == WRITER_TEST_HEIGHT);
+	TEST_CHECK(image.layout.channel_count == 4 && image.layout.type == PixelType::U16);
+	TEST_CHECK(image.pixels && memcmp(image.pixels, wide, sizeof(wide)) == 0);
+	FreeDecodedImage(&image);
+	remove(file_path);
+	free(rgba);
+}
+
+// RGBE keeps 8 bits of mantissa for the brightest channel of each pixel, and the others share its exponent.
+static void TestHdrRoundTrip()
+{
+	const char* file_path = "test_writer.hdr";
+	float pixels[WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT * 3];
+	for (int i = 0; i < WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT; ++i)
+	{
+		// Rows of a single color for the RLE, then a ramp over a wide range.
+		float value = (i < WRITER_TEST_WIDTH * 2) ? 0.5f : (float)i * 0.37f;
+		pixels[i * 3 + 0] = value;
+		pixels[i * 3 + 1] = value * 0.5f;
+		pixels[i * 3 + 2] = 1.0f / (1.0f + value);
+	}
+	size_t stride = WRITER_TEST_WIDTH * 3 * sizeof(float);
+	HdrWriter writer;
+	TEST_CHECK(BeginHdrWrite(&writer, file_path, WRITER_TEST_WIDTH, WRITER_TEST_HEIGHT));
+	TEST_CHECK(WriteHdrRows(&writer, pixels, WRITER_TEST_FIRST_ROWS, stride));
+	TEST_CHECK(WriteHdrRows(&writer, pixels + WRITER_TEST_FIRST_ROWS * WRITER_TEST_WIDTH * 3, WRITER_TEST_HEIGHT - WRITER_TEST_FIRST_ROWS, stride));
+	TEST_CHECK(EndHdrWrite(&writer));
+
+	DecodedImage image;
+	TEST_CHECK(DecodeImageFile(file_path, &image));
+	TEST_CHECK(image.width == WRITER_TEST_WIDTH && image.height == WRITER_TEST_HEIGHT);
+	TEST_CHECK(image.layout.channel_count == 3 && image.layout.type == PixelType::F32);
+	if (image.pixels)
+	{
+		const float* decoded = (const float*)image.pixels;
+		int bad_count = 0;
+		for (int i = 0; i < WRITER_TEST_WIDTH * WRITER_TEST_HEIGHT; ++i)
+		{
+			const float* pixel = pixels + i * 3;
+			float brightest = fmaxf(pixel[0], fmaxf(pixel[1], pixel[2]));
+			for (int c = 0; c < 3; ++c)
+			{
+				if (fabsf(decoded[i * 3 + c] - pixel[c]) > brightest / 128.0f) ++bad_count;
+			}
+		}
+		TEST_CHECK(bad_count == 0);
+	}
+	FreeDecodedImage(&image);
+	remove(file_path);
+}
+
+// JPEG is lossy, so this only checks that a smooth image comes back close, with and without subsampling.
+static void TestJpegRoundTrip()
+{
+	const char* file_path = "test_writer.jpg";
+	const int width = 67;
+	const int height = 45;
+	u8 pixels[width * height * 3];
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			u8* pixel = pixels + (y * width + x) * 3;
+			pixel[0] = (u8)(x * 3);
+			pixel[1] = (u8)(y * 5);
+			pixel[2] = (u8)(128 + x - y);
+		}
+	}
+	for (int channel_count = 1; channel_count <= 3; channel_count += 2)
+	{
+		for (int is_subsampled = 0; is_subsampled < 2; ++is_subsampled)
+		{
+			u8 packed[width * height * 3];
+			for (int i = 0; i < width * height; ++i) memcpy(packed + i * channel_count, pixels + i * 3, channel_count);
+			size_t stride = (size_t)width * channel_count;
+			JpegWriter writer;
+			TEST_CHECK(BeginJpegWrite(&writer, file_path, width, height, channel_count, 95, is_subsampled != 0));
+			TEST_CHECK(WriteJpegRows(&writer, packed, WRITER_TEST_FIRST_ROWS, stride));
+			TEST_CHECK(WriteJpegRows(&writer, packed + WRITER_TEST_FIRST_ROWS * stride, height - WRITER_TEST_FIRST_ROWS, stride));
+			TEST_CHECK(EndJpegWrite(&writer));
+
+			DecodedImage image;
+			TEST_CHECK(DecodeImageFile(file_path, &image));
+			TEST_CHECK(image.width == width && image.height == height && image.layout.channel_count == channel_count);
+			if (image.pixels && image.layout.channel_count == channel_count)
+			{
+				const u8* decoded = (const u8*)image.pixels;
+				double error = 0.0;
+				for (int i = 0; i < width * height * channel_count; ++i) error += abs(decoded[i] - packed[i]);
+				TEST_CHECK(error / (width * height * channel_count) < 2.0);
+			}
+			FreeDecodedImage(&image);
+		}
+	}
+	remove(file_path);
+}
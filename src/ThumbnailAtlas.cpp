@@ -0,0 +1,104 @@
+#include "ThumbnailAtlas.h"
+
+static void ResetThumbnailAtlasPage(ThumbnailAtlasPage* page)
+{
+	stbrp_init_target(&page->packer, THUMBNAIL_ATLAS_SIZE, THUMBNAIL_ATLAS_SIZE, page->nodes, THUMBNAIL_ATLAS_SIZE);
+	++page->generation;
+	page->thumbnail_count = 0;
+}
+
+static bool PackThumbnail(ThumbnailAtlasPage* page, int width, int height, stbrp_rect* rect)
+{
+	*rect = {};
+	rect->w = (stbrp_coord)(width + THUMBNAIL_ATLAS_PADDING * 2);
+	rect->h = (stbrp_coord)(height + THUMBNAIL_ATLAS_PADDING * 2);
+	stbrp_pack_rects(&page->packer, rect, 1);
+	return rect->was_packed != 0;
+}
+
+ThumbnailAtlas* CreateThumbnailAtlas()
+{
+	ThumbnailAtlas* atlas = (ThumbnailAtlas*)calloc(1, sizeof(ThumbnailAtlas)); // @malloc
+	atlas->frame = 1;
+	return atlas;
+}
+
+void DestroyThumbnailAtlas(ThumbnailAtlas* atlas)
+{
+	free(atlas);
+}
+
+void ClearThumbnailAtlas(ThumbnailAtlas* atlas)
+{
+	assert(atlas);
+	for (int i = 0; i < atlas->page_count; ++i) ResetThumbnailAtlasPage(&atlas->pages[i]);
+}
+
+void AdvanceThumbnailAtlasFrame(ThumbnailAtlas* atlas)
+{
+	assert(atlas);
+	++atlas->frame;
+}
+
+bool PlaceThumbnail(ThumbnailAtlas* atlas, int width, int height, ThumbnailPlacement* placement, int* cleared_page)
+{
+	assert(atlas && placement && cleared_page);
+	assert(width > 0 && height > 0 && width + THUMBNAIL_ATLAS_PADDING * 2 <= THUMBNAIL_ATLAS_SIZE && height + THUMBNAIL_ATLAS_PADDING * 2 <= THUMBNAIL_ATLAS_SIZE);
+	*cleared_page = -1;
+
+	// Existing pages first, then a new one, and only then the least recently drawn page that wasn't on
+	// screen last frame.
+	stbrp_rect rect;
+	int page_index = -1;
+	for (int i = 0; i < atlas->page_count && page_index < 0; ++i)
+	{
+		if (PackThumbnail(&atlas->pages[i], width, height, &rect)) page_index = i;
+	}
+	if (page_index < 0 && atlas->page_count < THUMBNAIL_ATLAS_MAX_PAGES)
+	{
+		page_index = atlas->page_count++;
+		ResetThumbnailAtlasPage(&atlas->pages[page_index]);
+		PackThumbnail(&atlas->pages[page_index], width, height, &rect);
+	}
+	if (page_index < 0)
+	{
+		for (int i = 0; i < atlas->page_count; ++i)
+		{
+			ThumbnailAtlasPage* page = &atlas->pages[i];
+			if (page->last_used_frame + 1 >= atlas->frame) continue;
+			if (page_index < 0 || page->last_used_frame < atlas->pages[page_index].last_used_frame) page_index = i;
+		}
+		if (page_index < 0) return false;
+		ResetThumbnailAtlasPage(&atlas->pages[page_index]);
+		PackThumbnail(&atlas->pages[page_index], width, height, &rect);
+		*cleared_page = page_index;
+	}
+
+	ThumbnailAtlasPage* page = &atlas->pages[page_index];
+	++page->thumbnail_count;
+	placement->page = page_index;
+	placement->generation = page->generation;
+	placement->x = (u16)(rect.x + THUMBNAIL_ATLAS_PADDING);
+	placement->y = (u16)(rect.y + THUMBNAIL_ATLAS_PADDING);
+	placement->width = (u16)width;
+	placement->height = (u16)height;
+	return true;
+}
+
+bool IsThumbnailPlaced(const ThumbnailAtlas* atlas, const ThumbnailPlacement* placement)
+{
+	assert(atlas && placement);
+	return placement->page >= 0 && placement->page < atlas->page_count && atlas->pages[placement->page].generation == placement->generation;
+}
+
+void TouchThumbnail(ThumbnailAtlas* atlas, const ThumbnailPlacement* placement)
+{
+	assert(IsThumbnailPlaced(atlas, placement));
+	atlas->pages[placement->page].last_used_frame = atlas->frame;
+}
+
+int GetThumbnailAtlasCapacity(int thumbnail_size)
+{
+	int per_row = THUMBNAIL_ATLAS_SIZE / (thumbnail_size + THUMBNAIL_ATLAS_PADDING * 2);
+	return per_row * per_row * THUMBNAIL_ATLAS_MAX_PAGES;
+}
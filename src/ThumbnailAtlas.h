@@ -0,0 +1,70 @@
+#ifndef _THUMBNAIL_ATLAS_H
+#define _THUMBNAIL_ATLAS_H
+
+// imgui_draw.cpp compiles stb_rect_pack (as static functions) ahead of this in the unity build, and
+// including the header again would compile it a second time.
+#ifndef STB_INCLUDE_STB_RECT_PACK_H
+#include "imgui/imstb_rectpack.h"
+#endif
+
+// Packs thumbnails of different sizes into a few shared atlas pages, so a grid of thousands of them
+// needs a handful of textures instead of one per file. stb_rect_pack can't free single rectangles, so
+// space is reclaimed a whole page at a time: when everything is full, the page that has gone longest
+// without being drawn is emptied and every thumbnail on it has to be placed again. Like TiledImage this is
+// only bookkeeping; the caller owns the page textures and uploads the pixels.
+
+#define THUMBNAIL_ATLAS_SIZE 2048
+#define THUMBNAIL_ATLAS_MAX_PAGES 8
+
+// Empty border around every thumbnail, so filtering at the edges doesn't pick up a neighbor.
+#define THUMBNAIL_ATLAS_PADDING 1
+
+struct ThumbnailAtlasPage
+{
+	stbrp_context packer;
+	stbrp_node nodes[THUMBNAIL_ATLAS_SIZE];
+	u32 generation; // Bumped whenever the page is emptied, which invalidates every placement on it.
+	u64 last_used_frame;
+	int thumbnail_count;
+};
+
+// Where a thumbnail lives. Only valid while IsThumbnailPlaced says so.
+struct ThumbnailPlacement
+{
+	s32 page; // -1 if never placed.
+	u32 generation;
+	u16 x;
+	u16 y;
+	u16 width;
+	u16 height;
+};
+
+struct ThumbnailAtlas
+{
+	ThumbnailAtlasPage pages[THUMBNAIL_ATLAS_MAX_PAGES];
+	int page_count; // Pages in use so far. They are only added, never removed.
+	u64 frame;
+};
+
+ThumbnailAtlas* CreateThumbnailAtlas();
+void DestroyThumbnailAtlas(ThumbnailAtlas* atlas);
+
+// Empties every page, e.g. when the thumbnail size changes.
+void ClearThumbnailAtlas(ThumbnailAtlas* atlas);
+
+// Starts a new frame. Pages drawn from in the previous frame are never emptied to make room.
+void AdvanceThumbnailAtlasFrame(ThumbnailAtlas* atlas);
+
+// Finds room for a width x height thumbnail. Returns false if there is none, i.e. every page is full and
+// was drawn from last frame. cleared_page gets the page that had to be emptied to make room, or -1.
+bool PlaceThumbnail(ThumbnailAtlas* atlas, int width, int height, ThumbnailPlacement* placement, int* cleared_page);
+
+bool IsThumbnailPlaced(const ThumbnailAtlas* atlas, const ThumbnailPlacement* placement);
+
+// Marks the thumbnail's page as drawn from this frame.
+void TouchThumbnail(ThumbnailAtlas* atlas, const ThumbnailPlacement* placement);
+
+// Rough number of thumbnails of this size that fit in the atlas.
+int GetThumbnailAtlasCapacity(int thumbnail_size);
+
+#endif //_THUMBNAIL_ATLAS_H
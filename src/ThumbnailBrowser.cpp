@@ -0,0 +1,359 @@
+#include "ThumbnailBrowser.h"
+
+static const char* browser_size_names[] = {"Small", "Medium", "Large"};
+static const int browser_sizes[] = {96, 160, 256};
+
+ThumbnailBrowser* OpenThumbnailBrowser(const char* directory_path, ThumbnailCache* cache)
+{
+	assert(directory_path);
+	int name_count = 0;
+	char** names = ListImageFileNames(directory_path, &name_count);
+	if (!names) return 0;
+
+	ThumbnailBrowser* browser = (ThumbnailBrowser*)calloc(1, sizeof(ThumbnailBrowser)); // @malloc
+	size_t dir_length = strlen(directory_path);
+	browser->directory_path = (char*)malloc(dir_length + 1); // @malloc
+	memcpy(browser->directory_path, directory_path, dir_length + 1);
+	browser->cache = cache;
+	browser->atlas = CreateThumbnailAtlas();
+	browser->size_index = 1;
+	browser->thumbnail_size = browser_sizes[browser->size_index];
+	browser->selected = -1;
+	browser->is_visible = true;
+
+	bool has_separator = dir_length > 0 && (directory_path[dir_length - 1] == '\\' || directory_path[dir_length - 1] == '/');
+	for (int i = 0; i < name_count; ++i)
+	{
+		size_t path_size = dir_length + 1 + strlen(names[i]) + 1;
+		BrowserEntry entry = {};
+		entry.file_path = (char*)malloc(path_size); // @malloc
+		sprintf_s(entry.file_path, path_size, "%s%s%s", directory_path, has_separator ? "" : "/", names[i]);
+		entry.file_name = entry.file_path + path_size - 1 - strlen(names[i]);
+		entry.placement.page = -1;
+		arrput(browser->entries, entry);
+		free(names[i]);
+	}
+	free(names);
+
+	// The folder's own name goes in the tab; the ### part keeps the window (and its docking) the same
+	// whichever folder is open.
+	size_t start = dir_length - (has_separator ? 1 : 0);
+	while (start > 0 && directory_path[start - 1] != '\\' && directory_path[start - 1] != '/') --start;
+	size_t label_size = dir_length - start + 32;
+	browser->window_label = (char*)malloc(label_size); // @malloc
+	sprintf_s(browser->window_label, label_size, "%.*s###ThumbnailBrowser", (int)(dir_length - start - (has_separator ? 1 : 0)), directory_path + start);
+	return browser;
+}
+
+static void ReleaseBrowserJobs(ThumbnailBrowser* browser)
+{
+	for (int i = 0; i < arrlen(browser->pending); ++i)
+	{
+		BrowserEntry* entry = &browser->entries[browser->pending[i]];
+		ReleaseThumbnailJob(entry->job);
+		entry->job = 0;
+	}
+	arrsetlen(browser->pending, 0);
+}
+
+void ReleaseThumbnailBrowser(ThumbnailBrowser* browser)
+{
+	if (!browser) return;
+	ReleaseBrowserJobs(browser);
+	for (int i = 0; i < THUMBNAIL_ATLAS_MAX_PAGES; ++i)
+	{
+		if (browser->page_srvs[i]) browser->page_srvs[i]->Release();
+		if (browser->page_textures[i]) browser->page_textures[i]->Release();
+	}
+	for (int i = 0; i < arrlen(browser->entries); ++i) free(browser->entries[i].file_path);
+	arrfree(browser->entries);
+	arrfree(browser->pending);
+	DestroyThumbnailAtlas(browser->atlas);
+	free(browser->directory_path);
+	free(browser->window_label);
+	free(browser);
+}
+
+// Thumbnails decoded at the old size are thrown away along with everything in the atlas.
+static void SetThumbnailBrowserSize(ThumbnailBrowser* browser, int size_index)
+{
+	browser->size_index = size_index;
+	browser->thumbnail_size = browser_sizes[size_index];
+	ReleaseBrowserJobs(browser);
+	ClearThumbnailAtlas(browser->atlas);
+}
+
+static bool CreateBrowserAtlasPage(ID3D11Device* device, ThumbnailBrowser* browser, int page)
+{
+	D3D11_TEXTURE2D_DESC tex_desc = {};
+	tex_desc.Width = THUMBNAIL_ATLAS_SIZE;
+	tex_desc.Height = THUMBNAIL_ATLAS_SIZE;
+	tex_desc.MipLevels = 1;
+	tex_desc.ArraySize = 1;
+	tex_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	tex_desc.SampleDesc.Count = 1;
+	tex_desc.Usage = D3D11_USAGE_DEFAULT;
+	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	tex_desc.CPUAccessFlags = 0;
+	if (device->CreateTexture2D(&tex_desc, 0, &browser->page_textures[page]) != S_OK) return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = tex_desc.Format;
+	srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Texture2D.MipLevels = 1;
+	srv_desc.Texture2D.MostDetailedMip = 0;
+	if (device->CreateShaderResourceView(browser->page_textures[page], &srv_desc, &browser->page_srvs[page]) != S_OK)
+	{
+		browser->page_textures[page]->Release();
+		browser->page_textures[page] = 0;
+		return false;
+	}
+	return true;
+}
+
+static bool UploadBrowserThumbnail(ID3D11Device* device, ID3D11DeviceContext* ctx, ThumbnailBrowser* browser, BrowserEntry* entry, const DecodedImage* thumbnail)
+{
+	int cleared_page;
+	if (!PlaceThumbnail(browser->atlas, thumbnail->width, thumbnail->height, &entry->placement, &cleared_page)) return false;
+	int page = entry->placement.page;
+	if (!browser->page_textures[page] && !CreateBrowserAtlasPage(device, browser, page))
+	{
+		entry->placement.page = -1;
+		return false;
+	}
+
+	// The padding gets a copy of the thumbnail's edge pixels rather than whatever was there before, so
+	// filtering at the border never picks up an old neighbor.
+	int pad = THUMBNAIL_ATLAS_PADDING;
+	int width = thumbnail->width + pad * 2;
+	int height = thumbnail->height + pad * 2;
+	u32* padded = (u32*)malloc((size_t)width * height * 4); // @malloc
+	const u32* src = (const u32*)thumbnail->pixels;
+	for (int y = 0; y < height; ++y)
+	{
+		int src_y = Clamp(y - pad, 0, thumbnail->height - 1);
+		for (int x = 0; x < width; ++x)
+		{
+			int src_x = Clamp(x - pad, 0, thumbnail->width - 1);
+			padded[y * width + x] = src[src_y * thumbnail->width + src_x];
+		}
+	}
+
+	const ThumbnailPlacement* placement = &entry->placement;
+	D3D11_BOX box = {};
+	box.left = placement->x - pad;
+	box.top = placement->y - pad;
+	box.right = box.left + width;
+	box.bottom = box.top + height;
+	box.front = 0;
+	box.back = 1;
+	ctx->UpdateSubresource(browser->page_textures[page], 0, &box, padded, width * 4, 0);
+	free(padded);
+	return true;
+}
+
+bool UpdateThumbnailBrowser(ID3D11Device* device, ID3D11DeviceContext* ctx, ThumbnailBrowser* browser)
+{
+	assert(browser);
+	AdvanceThumbnailAtlasFrame(browser->atlas);
+
+	int upload_count = 0;
+	bool has_waiting = false;
+	for (int i = (int)arrlen(browser->pending) - 1; i >= 0; --i)
+	{
+		int index = browser->pending[i];
+		BrowserEntry* entry = &browser->entries[index];
+		ImageLoadState state = GetThumbnailJobState(entry->job);
+		if (state == ImageLoadState::Decoding) continue;
+		if (state == ImageLoadState::Queued)
+		{
+			// Scrolled away before a worker got to it; releasing it now means the decode never happens.
+			if (index < browser->wanted_begin || index >= browser->wanted_end)
+			{
+				ReleaseThumbnailJob(entry->job);
+				entry->job = 0;
+				arrdelswap(browser->pending, i);
+			}
+			continue;
+		}
+		if (state == ImageLoadState::Ready)
+		{
+			if (upload_count == BROWSER_UPLOADS_PER_FRAME)
+			{
+				has_waiting = true;
+				continue;
+			}
+			entry->source_width = entry->job->source_width;
+			entry->source_height = entry->job->source_height;
+			DecodedImage thumbnail = TakeThumbnail(entry->job);
+
+			// Placement only fails if the whole atlas was on screen last frame, which the prefetch limit
+			// in DrawThumbnailBrowser keeps from happening; the entry is simply decoded again later.
+			if (UploadBrowserThumbnail(device, ctx, browser, entry, &thumbnail)) ++upload_count;
+			FreeDecodedImage(&thumbnail);
+		}
+		else
+		{
+			entry->has_failed = true;
+		}
+		ReleaseThumbnailJob(entry->job);
+		entry->job = 0;
+		arrdelswap(browser->pending, i);
+	}
+
+	// Rows on screen first, then the margin below (the usual scroll direction), then the margin above.
+	int ranges[3][2] =
+	{
+		{browser->visible_begin, browser->visible_end},
+		{browser->visible_end, browser->wanted_end},
+		{browser->wanted_begin, browser->visible_begin},
+	};
+	for (int r = 0; r < (int)ARRAYCOUNT(ranges); ++r)
+	{
+		for (int index = ranges[r][0]; index < ranges[r][1] && arrlen(browser->pending) < BROWSER_MAX_JOBS; ++index)
+		{
+			BrowserEntry* entry = &browser->entries[index];
+			if (entry->job || entry->has_failed || IsThumbnailPlaced(browser->atlas, &entry->placement)) continue;
+			entry->job = QueueThumbnailDecode(entry->file_path, browser->thumbnail_size, browser->cache);
+			arrput(browser->pending, index);
+		}
+	}
+	return has_waiting;
+}
+
+static void DrawBrowserCell(ThumbnailBrowser* browser, int index, ImVec2 pos, float cell_size, float cell_height, const char** opened_path)
+{
+	BrowserEntry* entry = &browser->entries[index];
+	ImGui::PushID(index);
+	ImGui::SetCursorScreenPos(pos);
+	ImGui::InvisibleButton("##cell", ImVec2(cell_size, cell_height));
+	bool is_hovered = ImGui::IsItemHovered();
+	if (ImGui::IsItemClicked()) browser->selected = index;
+	if (is_hovered && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) *opened_path = entry->file_path;
+
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	ImVec2 cell_max = ImVec2(pos.x + cell_size, pos.y + cell_height);
+	if (index == browser->selected) draw_list->AddRectFilled(pos, cell_max, ImGui::GetColorU32(ImGuiCol_Header));
+	else if (is_hovered) draw_list->AddRectFilled(pos, cell_max, ImGui::GetColorU32(ImGuiCol_HeaderHovered));
+
+	const ThumbnailPlacement* placement = &entry->placement;
+	if (IsThumbnailPlaced(browser->atlas, placement) && browser->page_srvs[placement->page])
+	{
+		TouchThumbnail(browser->atlas, placement);
+
+		// Thumbnails keep their aspect ratio, so they're centered in the square above the label.
+		ImVec2 image_min = ImVec2(pos.x + floorf((cell_size - placement->width) * 0.5f), pos.y + floorf((cell_size - placement->height) * 0.5f));
+		ImVec2 image_max = ImVec2(image_min.x + placement->width, image_min.y + placement->height);
+		float texel = 1.0f / THUMBNAIL_ATLAS_SIZE;
+		ImVec2 uv_min = ImVec2(placement->x * texel, placement->y * texel);
+		ImVec2 uv_max = ImVec2((placement->x + placement->width) * texel, (placement->y + placement->height) * texel);
+		draw_list->AddImage((ImTextureID)browser->page_srvs[placement->page], image_min, image_max, uv_min, uv_max);
+	}
+	else
+	{
+		float inset = cell_size * 0.1f;
+		ImVec2 slot_min = ImVec2(pos.x + inset, pos.y + inset);
+		ImVec2 slot_max = ImVec2(pos.x + cell_size - inset, pos.y + cell_size - inset);
+		draw_list->AddRectFilled(slot_min, slot_max, ImGui::GetColorU32(ImGuiCol_FrameBg));
+		if (entry->has_failed)
+		{
+			const char* text = "Unreadable";
+			ImVec2 text_size = ImGui::CalcTextSize(text);
+			draw_list->AddText(ImVec2(pos.x + (cell_size - text_size.x) * 0.5f, pos.y + (cell_size - text_size.y) * 0.5f), ImGui::GetColorU32(ImGuiCol_TextDisabled), text);
+		}
+	}
+
+	// Long names are cut off at the edge of the cell; the tooltip has the whole thing.
+	ImVec2 label_min = ImVec2(pos.x, pos.y + cell_size);
+	draw_list->PushClipRect(label_min, cell_max, true);
+	draw_list->AddText(label_min, ImGui::GetColorU32(ImGuiCol_Text), entry->file_name);
+	draw_list->PopClipRect();
+
+	if (is_hovered)
+	{
+		ImGui::BeginTooltip();
+		ImGui::TextUnformatted(entry->file_name);
+		if (entry->source_width) ImGui::TextDisabled("%d x %d", entry->source_width, entry->source_height);
+		ImGui::EndTooltip();
+	}
+	ImGui::PopID();
+}
+
+const char* DrawThumbnailBrowser(ThumbnailBrowser* browser, ImGuiID dockspace_id)
+{
+	assert(browser);
+	const char* opened_path = 0;
+	int entry_count = (int)arrlen(browser->entries);
+
+	// Nothing is decoded for a browser that can't be seen, e.g. a docked tab in the background.
+	browser->visible_begin = browser->visible_end = 0;
+	browser->wanted_begin = browser->wanted_end = 0;
+
+	if (dockspace_id) ImGui::SetNextWindowDockID(dockspace_id, ImGuiCond_Appearing);
+	if (!ImGui::Begin(browser->window_label, &browser->is_visible))
+	{
+		ImGui::End();
+		return 0;
+	}
+
+	ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6.0f);
+	int size_index = browser->size_index;
+	if (ImGui::Combo("Size", &size_index, browser_size_names, (int)ARRAYCOUNT(browser_size_names)) && size_index != browser->size_index)
+	{
+		SetThumbnailBrowserSize(browser, size_index);
+	}
+	ImGui::SameLine();
+	ImGui::TextDisabled("%d images in %s", entry_count, browser->directory_path);
+	ImGui::Separator();
+
+	ImGui::BeginChild("##grid");
+	const ImGuiStyle& style = ImGui::GetStyle();
+	float cell_size = (float)browser->thumbnail_size;
+	float cell_height = cell_size + ImGui::GetTextLineHeight();
+	float column_width = cell_size + style.ItemSpacing.x;
+	int column_count = Max(1, (int)((ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) / column_width));
+	int row_count = (entry_count + column_count - 1) / column_count;
+
+	// Only the rows on screen are submitted at all, whatever the size of the folder.
+	int first_row = row_count;
+	int end_row = 0;
+	ImGuiListClipper clipper;
+	clipper.Begin(row_count, cell_height + style.ItemSpacing.y);
+	while (clipper.Step())
+	{
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+		{
+			ImVec2 row_pos = ImGui::GetCursorScreenPos();
+			for (int column = 0; column < column_count; ++column)
+			{
+				int index = row * column_count + column;
+				if (index >= entry_count) break;
+				DrawBrowserCell(browser, index, ImVec2(row_pos.x + column * column_width, row_pos.y), cell_size, cell_height, &opened_path);
+			}
+
+			// One item per row, so the clipper's idea of the row height holds.
+			ImGui::SetCursorScreenPos(row_pos);
+			ImGui::Dummy(ImVec2(column_count * column_width, cell_height));
+			first_row = Min(first_row, row);
+			end_row = Max(end_row, row + 1);
+		}
+	}
+	ImGui::EndChild();
+	ImGui::End();
+
+	if (first_row < end_row)
+	{
+		// The prefetch margin is capped so that everything wanted fits in half the atlas; the other half
+		// holds what was scrolled past, for scrolling back.
+		int visible_rows = end_row - first_row;
+		int margin_rows = visible_rows * BROWSER_PREFETCH_SCREENS;
+		int capacity_rows = GetThumbnailAtlasCapacity(browser->thumbnail_size) / 2 / column_count;
+		margin_rows = Clamp((capacity_rows - visible_rows) / 2, 0, margin_rows);
+
+		browser->visible_begin = first_row * column_count;
+		browser->visible_end = Min(entry_count, end_row * column_count);
+		browser->wanted_begin = Max(0, first_row - margin_rows) * column_count;
+		browser->wanted_end = Min(entry_count, (end_row + margin_rows) * column_count);
+	}
+	return opened_path;
+}
@@ -0,0 +1,65 @@
+#ifndef _THUMBNAIL_BROWSER_H
+#define _THUMBNAIL_BROWSER_H
+
+#include <d3d11.h>
+#include "ThumbnailDecode.h"
+#include "ThumbnailAtlas.h"
+
+// A dockable grid of every image in a folder. The grid is clipped to the rows on screen, and only those
+// rows (plus a prefetch margin above and below) are ever decoded, so a folder of tens of thousands of
+// images costs about the same per frame as one of a hundred.
+
+#define BROWSER_MAX_JOBS 32 // Thumbnail decodes in flight at once.
+#define BROWSER_UPLOADS_PER_FRAME 32
+#define BROWSER_PREFETCH_SCREENS 1 // How far ahead of the view to decode, in each direction.
+
+struct BrowserEntry
+{
+	char* file_path;
+	char* file_name; // Points into file_path.
+	ThumbnailJob* job; // Pending decode, null when there isn't one.
+	ThumbnailPlacement placement;
+	int source_width; // Zero until the first decode finishes.
+	int source_height;
+	bool has_failed;
+};
+
+struct ThumbnailBrowser
+{
+	char* directory_path;
+	char* window_label;
+	BrowserEntry* entries; // stb_ds array, sorted by name.
+	int* pending; // stb_ds array of the entries that have a job.
+
+	ThumbnailCache* cache; // Optional, and not owned.
+	ThumbnailAtlas* atlas;
+	ID3D11Texture2D* page_textures[THUMBNAIL_ATLAS_MAX_PAGES]; // Created as the atlas grows.
+	ID3D11ShaderResourceView* page_srvs[THUMBNAIL_ATLAS_MAX_PAGES];
+
+	int size_index; // Into the thumbnail size presets.
+	int thumbnail_size;
+
+	// Entries shown by the last draw, and the wider range to have thumbnails ready for.
+	int visible_begin;
+	int visible_end;
+	int wanted_begin;
+	int wanted_end;
+
+	int selected; // -1 if nothing is selected.
+	bool is_visible;
+};
+
+// Lists the images in a folder. Returns null if the folder can't be read. Thumbnails already in the cache
+// (if there is one) aren't decoded again, and new ones are added to it.
+ThumbnailBrowser* OpenThumbnailBrowser(const char* directory_path, ThumbnailCache* cache = 0);
+void ReleaseThumbnailBrowser(ThumbnailBrowser* browser);
+
+// Collects finished decodes, uploads them into the atlas and queues decodes for what the last draw showed.
+// Returns true if finished thumbnails are still waiting for upload, so the browser needs another frame.
+bool UpdateThumbnailBrowser(ID3D11Device* device, ID3D11DeviceContext* ctx, ThumbnailBrowser* browser);
+
+// Draws the grid. Returns the path of an image that was double-clicked, or null. The path belongs to the
+// browser.
+const char* DrawThumbnailBrowser(ThumbnailBrowser* browser, ImGuiID dockspace_id);
+
+#endif //_THUMBNAIL_BROWSER_H
@@ -0,0 +1,271 @@
+#include "ThumbnailCache.h"
+
+#define THUMBNAIL_CACHE_MAGIC 0x48435454 // "TTCH"
+#define THUMBNAIL_CACHE_VERSION 1
+#define THUMBNAIL_CACHE_SEED 0x7468756D62ull
+
+static u64 AlignThumbnailCacheOffset(u64 offset, u64 alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static u64 GetThumbnailCacheSlotOffset(u32 max_page_count)
+{
+	return AlignThumbnailCacheOffset(sizeof(ThumbnailCacheHeader) + (u64)max_page_count * sizeof(ThumbnailCachePage), 64);
+}
+
+static u64 GetThumbnailCacheDataOffset(u32 max_page_count)
+{
+	return AlignThumbnailCacheOffset(GetThumbnailCacheSlotOffset(max_page_count) + (u64)THUMBNAIL_CACHE_SLOT_COUNT * sizeof(ThumbnailCacheSlot), 4096);
+}
+
+// (Re)maps the file with room for page_count pages. Every pointer into the old mapping is invalid after.
+// A private cache is grown with realloc instead, and like the file is never shrunk.
+static bool MapThumbnailCache(ThumbnailCache* cache, u32 max_page_count, u32 page_count)
+{
+	u64 data_offset = GetThumbnailCacheDataOffset(max_page_count);
+	u64 size = data_offset + (u64)page_count * THUMBNAIL_CACHE_PAGE_SIZE;
+	if (cache->is_private)
+	{
+		if (size > cache->file.size)
+		{
+			void* data = realloc(cache->file.data, (size_t)size); // @malloc
+			if (!data) return false;
+			memset((u8*)data + cache->file.size, 0, (size_t)(size - cache->file.size));
+			cache->file.data = data;
+			cache->file.size = size;
+		}
+	}
+	else
+	{
+		Platform::UnmapFile(&cache->file);
+		if (!Platform::MapFileForWrite(cache->file_path, size, &cache->file)) return false;
+	}
+
+	u8* base = (u8*)cache->file.data;
+	cache->header = (ThumbnailCacheHeader*)base;
+	cache->pages = (ThumbnailCachePage*)(base + sizeof(ThumbnailCacheHeader));
+	cache->slots = (ThumbnailCacheSlot*)(base + GetThumbnailCacheSlotOffset(max_page_count));
+	cache->data = base + data_offset;
+	return true;
+}
+
+static void ResetThumbnailCache(ThumbnailCache* cache, u32 max_page_count)
+{
+	memset(cache->file.data, 0, (size_t)GetThumbnailCacheDataOffset(max_page_count));
+	ThumbnailCacheHeader* header = cache->header;
+	header->magic = THUMBNAIL_CACHE_MAGIC;
+	header->version = THUMBNAIL_CACHE_VERSION;
+	header->slot_count = THUMBNAIL_CACHE_SLOT_COUNT;
+	header->page_size = THUMBNAIL_CACHE_PAGE_SIZE;
+	header->max_page_count = max_page_count;
+}
+
+ThumbnailCache* OpenThumbnailCache(const char* cache_path, u64 max_size)
+{
+	assert(cache_path);
+	u64 max_page_count = max_size / THUMBNAIL_CACHE_PAGE_SIZE;
+	if (max_page_count < 2) max_page_count = 2; // One to fill and one to evict.
+	if (max_page_count > 4096) max_page_count = 4096;
+
+	ThumbnailCache* cache = new ThumbnailCache();
+	size_t path_size = strlen(cache_path) + 1;
+	cache->file_path = (char*)malloc(path_size); // @malloc
+	memcpy(cache->file_path, cache_path, path_size);
+
+	// Without the lock, the file belongs to another viewer, and even reading its header races with it.
+	cache->is_private = !Platform::TryLockFile(cache_path, &cache->lock);
+	if (cache->is_private && max_page_count > THUMBNAIL_CACHE_PRIVATE_SIZE / THUMBNAIL_CACHE_PAGE_SIZE) max_page_count = THUMBNAIL_CACHE_PRIVATE_SIZE / THUMBNAIL_CACHE_PAGE_SIZE;
+	if (!MapThumbnailCache(cache, (u32)max_page_count, 0))
+	{
+		free(cache->file.data);
+		Platform::UnlockFile(&cache->lock);
+		free(cache->file_path);
+		delete cache;
+		return 0;
+	}
+	if (cache->is_private)
+	{
+		ResetThumbnailCache(cache, (u32)max_page_count);
+		return cache;
+	}
+
+	// Anything that doesn't look exactly like a cache this build wrote, closed cleanly, starts over. With
+	// the lock held, is_open still set can only be left over from a run that died. The file isn't shrunk;
+	// the pages beyond page_count are just reused as it fills up again.
+	ThumbnailCacheHeader* header = cache->header;
+	bool is_valid = header->magic == THUMBNAIL_CACHE_MAGIC && header->version == THUMBNAIL_CACHE_VERSION &&
+		header->slot_count == THUMBNAIL_CACHE_SLOT_COUNT && header->page_size == THUMBNAIL_CACHE_PAGE_SIZE &&
+		header->max_page_count == (u32)max_page_count && !header->is_open &&
+		header->page_count <= header->max_page_count && header->entry_count < THUMBNAIL_CACHE_SLOT_COUNT &&
+		GetThumbnailCacheDataOffset(header->max_page_count) + (u64)header->page_count * THUMBNAIL_CACHE_PAGE_SIZE <= cache->file.size &&
+		(header->page_count == 0 || (header->current_page < header->page_count && header->current_fill <= THUMBNAIL_CACHE_PAGE_SIZE));
+	if (!is_valid) ResetThumbnailCache(cache, (u32)max_page_count);
+	cache->header->is_open = 1;
+	return cache;
+}
+
+void CloseThumbnailCache(ThumbnailCache* cache)
+{
+	if (!cache) return;
+	if (cache->is_private)
+	{
+		free(cache->file.data);
+	}
+	else
+	{
+		if (cache->header) cache->header->is_open = 0;
+		Platform::UnmapFile(&cache->file);
+		Platform::UnlockFile(&cache->lock);
+	}
+	free(cache->file_path);
+	delete cache;
+}
+
+u64 GetThumbnailCacheKey(const char* file_path, int max_size)
+{
+	assert(file_path);
+	u64 fields[3] = {};
+	if (!Platform::GetFileInfo(file_path, &fields[0], &fields[1])) return 0;
+	fields[2] = (u64)max_size;
+	u64 key = (u64)stbds_hash_bytes((void*)file_path, strlen(file_path), (size_t)THUMBNAIL_CACHE_SEED);
+	key = (u64)stbds_hash_bytes(fields, sizeof(fields), (size_t)key);
+	return key ? key : 1; // Zero marks an empty slot.
+}
+
+// Linear probing. The index is never more than 3/4 full, so there's always an empty slot to stop at.
+static ThumbnailCacheSlot* FindThumbnailCacheSlot(ThumbnailCache* cache, u64 key)
+{
+	u32 mask = THUMBNAIL_CACHE_SLOT_COUNT - 1;
+	for (u32 i = (u32)(key ^ (key >> 32)) & mask;; i = (i + 1) & mask)
+	{
+		ThumbnailCacheSlot* slot = &cache->slots[i];
+		if (slot->key == key || slot->key == 0) return slot;
+	}
+}
+
+// Drops every entry on a page. Deleting from a linear-probing table means moving entries back into the
+// gaps, so the index is simply rebuilt; this happens once per page's worth of new thumbnails.
+static void EvictThumbnailCachePage(ThumbnailCache* cache, u32 page)
+{
+	ThumbnailCacheSlot* kept = (ThumbnailCacheSlot*)malloc(sizeof(ThumbnailCacheSlot) * THUMBNAIL_CACHE_SLOT_COUNT); // @malloc
+	int kept_count = 0;
+	for (int i = 0; i < THUMBNAIL_CACHE_SLOT_COUNT; ++i)
+	{
+		if (cache->slots[i].key && cache->slots[i].page != page) kept[kept_count++] = cache->slots[i];
+	}
+	memset(cache->slots, 0, sizeof(ThumbnailCacheSlot) * THUMBNAIL_CACHE_SLOT_COUNT);
+	for (int i = 0; i < kept_count; ++i) *FindThumbnailCacheSlot(cache, kept[i].key) = kept[i];
+	free(kept);
+
+	cache->header->entry_count = (u32)kept_count;
+	cache->pages[page] = {};
+	if (page == cache->header->current_page) cache->header->current_fill = 0;
+}
+
+// Empty pages count as the oldest, unless only pages holding entries will do. The page being filled is
+// only picked if there's nothing else.
+static u32 GetLeastRecentThumbnailCachePage(ThumbnailCache* cache, bool needs_entries)
+{
+	ThumbnailCacheHeader* header = cache->header;
+	u32 result = header->current_page;
+	for (u32 i = 0; i < header->page_count; ++i)
+	{
+		if (i == header->current_page || (needs_entries && !cache->pages[i].entry_count)) continue;
+		if (result == header->current_page || cache->pages[i].last_used < cache->pages[result].last_used) result = i;
+	}
+	return result;
+}
+
+// Makes room for one more entry of byte_count bytes in the current page.
+static bool MakeThumbnailCacheRoom(ThumbnailCache* cache, u32 byte_count)
+{
+	while (cache->header->entry_count >= THUMBNAIL_CACHE_SLOT_COUNT / 4 * 3)
+	{
+		EvictThumbnailCachePage(cache, GetLeastRecentThumbnailCachePage(cache, true));
+	}
+	ThumbnailCacheHeader* header = cache->header;
+	if (header->page_count > 0 && header->current_fill + byte_count <= THUMBNAIL_CACHE_PAGE_SIZE) return true;
+
+	// Grow the file a page at a time until it's at its limit, then start reusing the oldest page.
+	if (header->page_count < header->max_page_count)
+	{
+		u32 max_page_count = header->max_page_count;
+		u32 page = header->page_count;
+		if (!MapThumbnailCache(cache, max_page_count, page + 1))
+		{
+			// Put the old mapping back (whatever the file grew by is harmless). If even that fails, the
+			// cache is unusable until it's reopened.
+			if (!MapThumbnailCache(cache, max_page_count, page)) cache->header = 0;
+			return false;
+		}
+		header = cache->header;
+		header->page_count = page + 1;
+		header->current_page = page;
+		header->current_fill = 0;
+		cache->pages[page] = {};
+		return true;
+	}
+	u32 page = GetLeastRecentThumbnailCachePage(cache, false);
+	EvictThumbnailCachePage(cache, page);
+	header->current_page = page;
+	header->current_fill = 0;
+	return true;
+}
+
+bool FindCachedThumbnail(ThumbnailCache* cache, u64 key, DecodedImage* thumbnail, int* source_width, int* source_height)
+{
+	assert(thumbnail);
+	*thumbnail = {};
+	if (!cache || !key) return false;
+
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	if (!cache->header) return false;
+	ThumbnailCacheSlot* slot = FindThumbnailCacheSlot(cache, key);
+	if (slot->key != key) return false;
+
+	size_t byte_count = (size_t)slot->width * slot->height * 4;
+	if (slot->page >= cache->header->page_count || slot->offset + byte_count > THUMBNAIL_CACHE_PAGE_SIZE) return false;
+	thumbnail->pixels = malloc(byte_count); // @malloc
+	memcpy(thumbnail->pixels, cache->data + (u64)slot->page * THUMBNAIL_CACHE_PAGE_SIZE + slot->offset, byte_count);
+	thumbnail->width = slot->width;
+	thumbnail->height = slot->height;
+	thumbnail->layout = {4, PixelType::U8};
+	if (source_width) *source_width = (int)slot->source_width;
+	if (source_height) *source_height = (int)slot->source_height;
+	cache->pages[slot->page].last_used = ++cache->header->clock;
+	return true;
+}
+
+void AddCachedThumbnail(ThumbnailCache* cache, u64 key, const DecodedImage* thumbnail, int source_width, int source_height)
+{
+	assert(thumbnail);
+	if (!cache || !key || !thumbnail->pixels) return;
+	assert(thumbnail->layout.channel_count == 4 && thumbnail->layout.type == PixelType::U8);
+	if (thumbnail->width > 0xFFFF || thumbnail->height > 0xFFFF) return;
+	u64 byte_count = (u64)thumbnail->width * thumbnail->height * 4;
+	if (byte_count > THUMBNAIL_CACHE_PAGE_SIZE) return;
+
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	if (!cache->header || FindThumbnailCacheSlot(cache, key)->key == key) return; // Another job got there first.
+	if (!MakeThumbnailCacheRoom(cache, (u32)byte_count)) return;
+
+	// The pixels go in before the slot that points at them.
+	ThumbnailCacheHeader* header = cache->header;
+	u32 page = header->current_page;
+	u32 offset = header->current_fill;
+	memcpy(cache->data + (u64)page * THUMBNAIL_CACHE_PAGE_SIZE + offset, thumbnail->pixels, (size_t)byte_count);
+	header->current_fill = (u32)AlignThumbnailCacheOffset(offset + byte_count, 16);
+
+	ThumbnailCacheSlot* slot = FindThumbnailCacheSlot(cache, key);
+	slot->page = page;
+	slot->offset = offset;
+	slot->width = (u16)thumbnail->width;
+	slot->height = (u16)thumbnail->height;
+	slot->source_width = (u32)source_width;
+	slot->source_height = (u32)source_height;
+	slot->key = key;
+	++header->entry_count;
+	++cache->pages[page].entry_count;
+	cache->pages[page].last_used = ++header->clock;
+}
@@ -0,0 +1,91 @@
+#ifndef _THUMBNAIL_CACHE_H
+#define _THUMBNAIL_CACHE_H
+
+#include <mutex>
+#include "ImageDecode.h"
+
+// Thumbnails kept on disk between runs, so browsing a folder that has been seen before doesn't decode
+// anything. Entries are keyed by a hash of the file's path, size and write time (plus the thumbnail size),
+// so an edited file simply misses and its old entry ages out.
+//
+// The whole cache is one memory-mapped file: a header, an open-addressing index and the thumbnails' RGBA8
+// pixels, packed one after another into fixed-size pages. Like ThumbnailAtlas, space is reclaimed a page
+// at a time: once the file is at its size limit, the least recently used page is emptied and its entries
+// are dropped from the index.
+//
+// Only one process uses the file at a time, holding an advisory lock on it. A viewer that finds it locked
+// by another gets a private cache in memory instead, with the same layout, that starts empty and is gone
+// once it's closed; the other viewer's index is left alone.
+
+#define THUMBNAIL_CACHE_PAGE_SIZE (8 << 20)
+#define THUMBNAIL_CACHE_SLOT_COUNT (1 << 16) // Index entries. Must be a power of two.
+#define THUMBNAIL_CACHE_DEFAULT_SIZE ((u64)512 << 20)
+#define THUMBNAIL_CACHE_PRIVATE_SIZE ((u64)64 << 20) // Most a private cache grows to, whatever max_size says.
+
+struct ThumbnailCacheHeader
+{
+	u32 magic;
+	u32 version;
+	u32 slot_count;
+	u32 page_size;
+	u32 max_page_count;
+	u32 page_count; // Pages the file has grown to so far.
+	u32 current_page; // The page new thumbnails are appended to,
+	u32 current_fill; // and how much of it is used.
+	u32 entry_count;
+	u32 is_open; // Set while the cache is open. Still set when the lock is free means the last run died mid-write.
+	u64 clock; // Ticks on every hit and insert, for the page LRU.
+};
+
+struct ThumbnailCachePage
+{
+	u64 last_used;
+	u32 entry_count;
+	u32 padding;
+};
+
+struct ThumbnailCacheSlot
+{
+	u64 key; // Zero for an empty slot.
+	u32 page;
+	u32 offset; // Of the pixels, within the page.
+	u16 width;
+	u16 height;
+	u32 source_width;
+	u32 source_height;
+	u32 padding;
+};
+
+struct ThumbnailCache
+{
+	std::mutex mutex; // Thumbnail jobs look up and add entries from any worker.
+	char* file_path;
+	Platform::FileLock lock;
+	bool is_private; // Another process had the file locked, so file.data is malloc'd memory instead.
+	Platform::MappedFile file;
+
+	// All of these point into file, and move whenever it grows. header is null if growing it failed
+	// badly enough to lose the mapping.
+	ThumbnailCacheHeader* header;
+	ThumbnailCachePage* pages;
+	ThumbnailCacheSlot* slots;
+	u8* data;
+};
+
+// Opens the cache file, creating it if need be. max_size is the most the file grows to; the pixels of
+// roughly max_size / (thumbnail_size^2 * 4) thumbnails fit. Returns null if the file can't be mapped. If
+// another process has it open, returns a private cache instead (see above).
+ThumbnailCache* OpenThumbnailCache(const char* cache_path, u64 max_size = THUMBNAIL_CACHE_DEFAULT_SIZE);
+void CloseThumbnailCache(ThumbnailCache* cache);
+
+// Zero if the file can't be found. Costs one stat of the file, and nothing else.
+u64 GetThumbnailCacheKey(const char* file_path, int max_size);
+
+// Copies a cached thumbnail out into a new image, freed with FreeDecodedImage like any other. A null cache
+// or a zero key just misses.
+bool FindCachedThumbnail(ThumbnailCache* cache, u64 key, DecodedImage* thumbnail, int* source_width = 0, int* source_height = 0);
+
+// Stores an RGBA8 thumbnail. Does nothing with a null cache or a zero key, or if it's already there.
+void AddCachedThumbnail(ThumbnailCache* cache, u64 key, const DecodedImage* thumbnail, int source_width, int source_height);
+
+#endif //_THUMBNAIL_CACHE_H
@@ -0,0 +1,814 @@
+#include "ThumbnailDecode.h"
+#include "Platform/Platform.h"
+#include "Core/FrameScheduler.h"
+#include <math.h>
+
+// Bits looked up at once when decoding Huffman codes. Longer codes, which are rare, take a slower path.
+#define THUMB_HUFFMAN_FAST_BITS 9
+
+// Position in the 8x8 block of each coefficient, in the order they are coded.
+static const u8 thumb_dezigzag[64] =
+{
+	0, 1, 8, 16, 9, 2, 3, 10,
+	17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63
+};
+
+struct ThumbHuffman
+{
+	u16 fast[1 << THUMB_HUFFMAN_FAST_BITS]; // (length << 8) | symbol, or 0 if the code is longer.
+	u8 symbols[256];
+	int max_code[17]; // Largest code of each length, or -1 if there are none.
+	int value_offset[17]; // Added to a code of each length to get its index in symbols.
+	bool is_defined;
+};
+
+// Entropy coded data, with the stuffed zero bytes taken out. The valid bits are the top count bits of
+// bits. Once a marker (or the end of the data) is reached it feeds zeros, which a valid stream never
+// consumes; padding_count of the buffered bits are those zeros, so a truncated scan shows up as count
+// dropping below it.
+struct ThumbBitReader
+{
+	const u8* data;
+	const u8* end;
+	u64 bits;
+	int count;
+	int padding_count;
+	bool is_at_marker;
+};
+
+struct ThumbComponent
+{
+	int id;
+	int h; // Sampling factors.
+	int v;
+	int quant_index;
+	int dc_table;
+	int ac_table;
+	int dc_prediction;
+
+	u8* plane; // Decoded samples at the reduced scale, a whole number of blocks in each direction.
+	int plane_width;
+	int plane_height;
+};
+
+struct JpegThumbDecoder
+{
+	const u8* data;
+	const u8* end;
+
+	ThumbHuffman dc_tables[4];
+	ThumbHuffman ac_tables[4];
+	u16 quant[4][64]; // In natural order, not zigzag.
+	bool has_quant[4];
+
+	int width;
+	int height;
+	int component_count;
+	ThumbComponent components[3];
+	int h_max;
+	int v_max;
+	int restart_interval;
+	int next_restart; // Number (0 to 7) of the RSTn marker that should end the current interval.
+	int adobe_transform; // -1 without an Adobe segment; 0 means the three components are RGB rather than YCbCr.
+	bool has_frame;
+	bool is_progressive; // Only the first scan is decoded, which has to hold the DC coefficients of every component.
+	int dc_shift; // Successive approximation shift of a progressive DC scan.
+
+	int block_size; // Pixels per decoded block side: 1, 2 or 4.
+	float idct[4][4]; // idct[x][u]: basis value of frequency u at pixel x, for block_size points.
+	ThumbBitReader reader;
+};
+
+static int ReadThumbU16(const u8* p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static bool BuildThumbHuffman(const u8* counts, const u8* symbols, int symbol_count, ThumbHuffman* table)
+{
+	memset(table, 0, sizeof(*table));
+	memcpy(table->symbols, symbols, symbol_count);
+
+	int code = 0;
+	int k = 0;
+	for (int length = 1; length <= 16; ++length)
+	{
+		int count = counts[length - 1];
+		table->value_offset[length] = k - code;
+		if (code + count > (1 << length)) return false; // Over-subscribed, so not a valid code.
+		for (int i = 0; i < count; ++i, ++k, ++code)
+		{
+			if (length <= THUMB_HUFFMAN_FAST_BITS)
+			{
+				int shift = THUMB_HUFFMAN_FAST_BITS - length;
+				for (int j = 0; j < (1 << shift); ++j) table->fast[(code << shift) | j] = (u16)((length << 8) | symbols[k]);
+			}
+		}
+		table->max_code[length] = count ? code - 1 : -1;
+		code <<= 1;
+	}
+	table->is_defined = true;
+	return true;
+}
+
+static void FillThumbBits(ThumbBitReader* reader)
+{
+	while (reader->count <= 56)
+	{
+		u32 byte = 0;
+		if (reader->is_at_marker || reader->data == reader->end)
+		{
+			reader->padding_count += 8;
+		}
+		else
+		{
+			byte = reader->data[0];
+			if (byte == 0xFF)
+			{
+				u8 next = (reader->data + 1 < reader->end) ? reader->data[1] : 0xD9;
+				if (next == 0)
+				{
+					reader->data += 2;
+				}
+				else
+				{
+					reader->is_at_marker = true;
+					reader->padding_count += 8;
+					byte = 0;
+				}
+			}
+			else
+			{
+				++reader->data;
+			}
+		}
+		reader->bits |= (u64)byte << (56 - reader->count);
+		reader->count += 8;
+	}
+}
+
+static u32 TakeThumbBits(ThumbBitReader* reader, int count)
+{
+	u32 result = (u32)(reader->bits >> (64 - count));
+	reader->bits <<= count;
+	reader->count -= count;
+	return result;
+}
+
+// Callers make sure there are at least 16 bits buffered. Returns -1 for a code that isn't in the table.
+static int DecodeThumbSymbol(ThumbBitReader* reader, const ThumbHuffman* table)
+{
+	u32 peek = (u32)(reader->bits >> 48);
+	u16 fast = table->fast[peek >> (16 - THUMB_HUFFMAN_FAST_BITS)];
+	if (fast)
+	{
+		TakeThumbBits(reader, fast >> 8);
+		return fast & 0xFF;
+	}
+	for (int length = THUMB_HUFFMAN_FAST_BITS + 1; length <= 16; ++length)
+	{
+		int code = (int)(peek >> (16 - length));
+		if (code <= table->max_code[length])
+		{
+			TakeThumbBits(reader, length);
+			return table->symbols[code + table->value_offset[length]];
+		}
+	}
+	return -1;
+}
+
+// The value of an s bit magnitude category.
+static int ReceiveThumbValue(ThumbBitReader* reader, int s)
+{
+	if (!s) return 0;
+	int value = (int)TakeThumbBits(reader, s);
+	if (value < (1 << (s - 1))) value -= (1 << s) - 1;
+	return value;
+}
+
+// Decodes one block and writes its block_size x block_size pixels to dst. Coefficients outside the top
+// left block_size x block_size corner still have to be decoded to find where the next block starts, but
+// are then thrown away.
+static bool DecodeThumbBlock(JpegThumbDecoder* decoder, ThumbComponent* component, u8* dst, int stride)
+{
+	ThumbBitReader* reader = &decoder->reader;
+	const u16* quant = decoder->quant[component->quant_index];
+	int n = decoder->block_size;
+	float coefficients[4][4] = {};
+
+	if (reader->count < 32) FillThumbBits(reader);
+	int s = DecodeThumbSymbol(reader, &decoder->dc_tables[component->dc_table]);
+	if (s < 0 || s > 11) return false;
+	component->dc_prediction += ReceiveThumbValue(reader, s);
+	coefficients[0][0] = (float)(component->dc_prediction * (1 << decoder->dc_shift) * quant[0]);
+
+	// A progressive DC scan has nothing else in it.
+	const ThumbHuffman* ac_table = &decoder->ac_tables[component->ac_table];
+	for (int k = decoder->is_progressive ? 64 : 1; k < 64;)
+	{
+		if (reader->count < 32) FillThumbBits(reader);
+		int rs = DecodeThumbSymbol(reader, ac_table);
+		if (rs < 0) return false;
+		int run = rs >> 4;
+		s = rs & 15;
+		if (!s)
+		{
+			if (run != 15) break; // End of block.
+			k += 16;
+			continue;
+		}
+		k += run;
+		if (k > 63) return false;
+		int value = ReceiveThumbValue(reader, s);
+		int position = thumb_dezigzag[k];
+		int row = position >> 3;
+		int column = position & 7;
+		if (row < n && column < n) coefficients[row][column] = (float)(value * quant[position]);
+		++k;
+	}
+	if (reader->count < reader->padding_count) return false; // Ran past the end of the data.
+
+	if (n == 1)
+	{
+		int value = (int)floorf(coefficients[0][0] * 0.125f + 128.5f);
+		dst[0] = (u8)((value < 0) ? 0 : (value > 255 ? 255 : value));
+		return true;
+	}
+
+	// Separable n point inverse DCT over the low frequency corner, which is what an 8 point IDCT followed
+	// by an (8 / n)x box filter comes to, give or take the higher frequencies.
+	float rows[4][4];
+	for (int v = 0; v < n; ++v)
+	{
+		for (int x = 0; x < n; ++x)
+		{
+			float sum = 0.0f;
+			for (int u = 0; u < n; ++u) sum += decoder->idct[x][u] * coefficients[v][u];
+			rows[v][x] = sum;
+		}
+	}
+	for (int y = 0; y < n; ++y)
+	{
+		for (int x = 0; x < n; ++x)
+		{
+			float sum = 128.5f;
+			for (int v = 0; v < n; ++v) sum += decoder->idct[y][v] * rows[v][x];
+			int value = (int)floorf(sum);
+			dst[y * stride + x] = (u8)((value < 0) ? 0 : (value > 255 ? 255 : value));
+		}
+	}
+	return true;
+}
+
+// Skips the RSTn marker that ends the interval and starts over on the next one. Returns false if the
+// interval doesn't end in the expected marker, with no more than the last byte's padding left before
+// it, which means the data is corrupt or an interval went missing.
+static bool RestartThumbScan(JpegThumbDecoder* decoder)
+{
+	ThumbBitReader* reader = &decoder->reader;
+	if (reader->count - reader->padding_count >= 8) return false;
+	if (reader->end - reader->data < 2 || reader->data[0] != 0xFF || reader->data[1] != 0xD0 + decoder->next_restart) return false;
+	reader->data += 2;
+	reader->bits = 0;
+	reader->count = 0;
+	reader->padding_count = 0;
+	reader->is_at_marker = false;
+	decoder->next_restart = (decoder->next_restart + 1) & 7;
+	for (int i = 0; i < decoder->component_count; ++i) decoder->components[i].dc_prediction = 0;
+	return true;
+}
+
+static bool DecodeThumbScan(JpegThumbDecoder* decoder)
+{
+	int n = decoder->block_size;
+	bool is_interleaved = decoder->component_count > 1;
+	int mcu_columns, mcu_rows;
+	if (is_interleaved)
+	{
+		mcu_columns = (decoder->width + 8 * decoder->h_max - 1) / (8 * decoder->h_max);
+		mcu_rows = (decoder->height + 8 * decoder->v_max - 1) / (8 * decoder->v_max);
+	}
+	else
+	{
+		// A single component scan is coded block by block, whatever its sampling factors say.
+		mcu_columns = (decoder->width + 7) / 8;
+		mcu_rows = (decoder->height + 7) / 8;
+		decoder->components[0].h = decoder->components[0].v = 1;
+		decoder->h_max = decoder->v_max = 1;
+	}
+
+	for (int i = 0; i < decoder->component_count; ++i)
+	{
+		ThumbComponent* component = &decoder->components[i];
+		component->plane_width = mcu_columns * component->h * n;
+		component->plane_height = mcu_rows * component->v * n;
+		component->plane = (u8*)malloc((size_t)component->plane_width * component->plane_height); // @malloc
+		if (!component->plane) return false;
+	}
+
+	int restart_count = 0;
+	for (int mcu_y = 0; mcu_y < mcu_rows; ++mcu_y)
+	{
+		for (int mcu_x = 0; mcu_x < mcu_columns; ++mcu_x)
+		{
+			for (int i = 0; i < decoder->component_count; ++i)
+			{
+				ThumbComponent* component = &decoder->components[i];
+				for (int by = 0; by < component->v; ++by)
+				{
+					for (int bx = 0; bx < component->h; ++bx)
+					{
+						int x = (mcu_x * component->h + bx) * n;
+						int y = (mcu_y * component->v + by) * n;
+						u8* dst = component->plane + (size_t)y * component->plane_width + x;
+						if (!DecodeThumbBlock(decoder, component, dst, component->plane_width)) return false;
+					}
+				}
+			}
+
+			// No marker follows the last interval, however long it is.
+			bool is_last = (mcu_y == mcu_rows - 1 && mcu_x == mcu_columns - 1);
+			if (decoder->restart_interval && ++restart_count == decoder->restart_interval && !is_last)
+			{
+				restart_count = 0;
+				if (!RestartThumbScan(decoder)) return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Walks the markers up to the start of the first scan. Returns false for anything the reduced decoder
+// doesn't handle (lossless JPEGs, 12-bit samples, CMYK, progressive JPEGs that don't start with a DC scan
+// of every component), which then go through stb_image instead.
+static bool ReadThumbHeaders(JpegThumbDecoder* decoder)
+{
+	const u8* p = decoder->data;
+	const u8* end = decoder->end;
+	if (end - p < 2 || p[0] != 0xFF || p[1] != 0xD8) return false;
+	p += 2;
+
+	for (;;)
+	{
+		if (end - p < 2 || p[0] != 0xFF) return false;
+		while (p < end && p[0] == 0xFF) ++p; // Fill bytes.
+		if (end - p < 3) return false;
+		u8 marker = *p++;
+		int length = ReadThumbU16(p);
+		if (length < 2 || end - p < length) return false;
+		const u8* segment = p + 2;
+		int segment_size = length - 2;
+		p += length;
+
+		switch (marker)
+		{
+			case 0xC0: // Baseline.
+			case 0xC1: // Extended sequential, Huffman coded.
+			case 0xC2: // Progressive, Huffman coded.
+			{
+				if (segment_size < 6 || segment[0] != 8) return false;
+				decoder->height = ReadThumbU16(segment + 1);
+				decoder->width = ReadThumbU16(segment + 3);
+				decoder->component_count = segment[5];
+				if (!decoder->width || !decoder->height) return false;
+				if (decoder->component_count != 1 && decoder->component_count != 3) return false;
+				if (segment_size < 6 + 3 * decoder->component_count) return false;
+				decoder->h_max = decoder->v_max = 1;
+				for (int i = 0; i < decoder->component_count; ++i)
+				{
+					ThumbComponent* component = &decoder->components[i];
+					component->id = segment[6 + i * 3];
+					component->h = segment[7 + i * 3] >> 4;
+					component->v = segment[7 + i * 3] & 15;
+					component->quant_index = segment[8 + i * 3];
+					if (component->h < 1 || component->h > 4 || component->v < 1 || component->v > 4 || component->quant_index > 3) return false;
+					if (component->h > decoder->h_max) decoder->h_max = component->h;
+					if (component->v > decoder->v_max) decoder->v_max = component->v;
+				}
+				decoder->has_frame = true;
+				decoder->is_progressive = (marker == 0xC2);
+			}
+			break;
+
+			case 0xC4:
+			{
+				const u8* q = segment;
+				const u8* segment_end = segment + segment_size;
+				while (q < segment_end)
+				{
+					if (segment_end - q < 17) return false;
+					int table_class = q[0] >> 4;
+					int table_id = q[0] & 15;
+					int symbol_count = 0;
+					for (int i = 0; i < 16; ++i) symbol_count += q[1 + i];
+					if (table_class > 1 || table_id > 3 || symbol_count > 256 || segment_end - q < 17 + symbol_count) return false;
+					ThumbHuffman* table = table_class ? &decoder->ac_tables[table_id] : &decoder->dc_tables[table_id];
+					if (!BuildThumbHuffman(q + 1, q + 17, symbol_count, table)) return false;
+					q += 17 + symbol_count;
+				}
+			}
+			break;
+
+			case 0xDB:
+			{
+				const u8* q = segment;
+				const u8* segment_end = segment + segment_size;
+				while (q < segment_end)
+				{
+					int precision = q[0] >> 4;
+					int table_id = q[0] & 15;
+					int table_size = precision ? 128 : 64;
+					if (precision > 1 || table_id > 3 || segment_end - q < 1 + table_size) return false;
+					for (int i = 0; i < 64; ++i)
+					{
+						int value = precision ? ReadThumbU16(q + 1 + i * 2) : q[1 + i];
+						decoder->quant[table_id][thumb_dezigzag[i]] = (u16)value;
+					}
+					decoder->has_quant[table_id] = true;
+					q += 1 + table_size;
+				}
+			}
+			break;
+
+			case 0xDD:
+			{
+				if (segment_size < 2) return false;
+				decoder->restart_interval = ReadThumbU16(segment);
+			}
+			break;
+
+			case 0xEE:
+			{
+				if (segment_size >= 12 && memcmp(segment, "Adobe", 5) == 0) decoder->adobe_transform = segment[11];
+			}
+			break;
+
+			case 0xDA:
+			{
+				if (!decoder->has_frame || segment_size < 1) return false;
+				int scan_count = segment[0];
+				if (scan_count != decoder->component_count || segment_size < 4 + 2 * scan_count) return false;
+				for (int i = 0; i < scan_count; ++i)
+				{
+					// Scans may list the components in any order, but baseline ones use frame order.
+					ThumbComponent* component = &decoder->components[i];
+					if (segment[1 + i * 2] != component->id) return false;
+					component->dc_table = segment[2 + i * 2] >> 4;
+					component->ac_table = segment[2 + i * 2] & 15;
+					if (component->dc_table > 3 || component->ac_table > 3) return false;
+					if (!decoder->dc_tables[component->dc_table].is_defined || !decoder->has_quant[component->quant_index]) return false;
+					if (!decoder->is_progressive && !decoder->ac_tables[component->ac_table].is_defined) return false;
+				}
+				const u8* spectral = segment + 1 + 2 * scan_count;
+				if (decoder->is_progressive)
+				{
+					if (spectral[0] != 0 || spectral[1] != 0 || (spectral[2] >> 4) != 0) return false;
+					decoder->dc_shift = spectral[2] & 15;
+				}
+				else if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0)
+				{
+					return false;
+				}
+
+				decoder->reader.data = p;
+				decoder->reader.end = end;
+				return true;
+			}
+
+			case 0xD9: return false;
+
+			default:
+			{
+				// Lossless, arithmetic coded and hierarchical frames.
+				if (marker >= 0xC3 && marker <= 0xCF) return false;
+			}
+			break;
+		}
+	}
+}
+
+static void ConvertThumbPlanesToRGBA(const JpegThumbDecoder* decoder, int width, int height, u8* dst)
+{
+	const ThumbComponent* components = decoder->components;
+	if (decoder->component_count == 1)
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			const u8* src = components[0].plane + (size_t)y * components[0].plane_width;
+			for (int x = 0; x < width; ++x, dst += 4)
+			{
+				dst[0] = dst[1] = dst[2] = src[x];
+				dst[3] = 255;
+			}
+		}
+		return;
+	}
+
+	// Subsampled chroma is simply repeated; at thumbnail sizes nothing better is worth the time.
+	bool is_rgb = (decoder->adobe_transform == 0);
+	for (int y = 0; y < height; ++y)
+	{
+		const u8* rows[3];
+		for (int c = 0; c < 3; ++c) rows[c] = components[c].plane + (size_t)(y * components[c].v / decoder->v_max) * components[c].plane_width;
+		for (int x = 0; x < width; ++x, dst += 4)
+		{
+			int c0 = rows[0][x * components[0].h / decoder->h_max];
+			int c1 = rows[1][x * components[1].h / decoder->h_max];
+			int c2 = rows[2][x * components[2].h / decoder->h_max];
+			if (is_rgb)
+			{
+				dst[0] = (u8)c0;
+				dst[1] = (u8)c1;
+				dst[2] = (u8)c2;
+			}
+			else
+			{
+				// JFIF YCbCr, in 16.16 fixed point.
+				int luma = (c0 << 16) + (1 << 15);
+				int cb = c1 - 128;
+				int cr = c2 - 128;
+				int rgb[3] = {(luma + 91881 * cr) >> 16, (luma - 22554 * cb - 46802 * cr) >> 16, (luma + 116130 * cb) >> 16};
+				for (int c = 0; c < 3; ++c) dst[c] = (u8)((rgb[c] < 0) ? 0 : (rgb[c] > 255 ? 255 : rgb[c]));
+			}
+			dst[3] = 255;
+		}
+	}
+}
+
+// Shrinks any layout to RGBA8 with a box filter, each destination pixel averaging the whole source pixels
+// whose top left corners fall inside it. One source row is converted to 8 bits at a time, so this never
+// needs a full size copy.
+static void AreaAverageToRGBA8(const void* src, PixelLayout layout, int width, int height, u8* dst, int dst_width, int dst_height)
+{
+	int channels = layout.channel_count;
+	size_t src_stride = (size_t)width * GetPixelSize(layout);
+	int* x_ends = (int*)malloc(sizeof(int) * dst_width); // @malloc
+	u64* sums = (u64*)malloc(sizeof(u64) * dst_width * channels); // @malloc
+	u8* row = (layout.type == PixelType::U8) ? 0 : (u8*)malloc((size_t)width * channels); // @malloc
+	u8* averages = (u8*)malloc((size_t)dst_width * channels); // @malloc
+	for (int x = 0; x < dst_width; ++x) x_ends[x] = (int)((u64)(x + 1) * width / dst_width);
+
+	for (int dst_y = 0; dst_y < dst_height; ++dst_y)
+	{
+		int y_begin = (int)((u64)dst_y * height / dst_height);
+		int y_end = (int)((u64)(dst_y + 1) * height / dst_height);
+		if (y_end <= y_begin) y_end = y_begin + 1;
+		memset(sums, 0, sizeof(u64) * dst_width * channels);
+
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			const u8* src_row = (const u8*)src + y * src_stride;
+			if (row)
+			{
+				ConvertPixelsToU8(src_row, layout, width, row);
+				src_row = row;
+			}
+			int x = 0;
+			for (int dst_x = 0; dst_x < dst_width; ++dst_x)
+			{
+				u64* sum = sums + dst_x * channels;
+				int x_end = (x_ends[dst_x] > x) ? x_ends[dst_x] : x + 1;
+				for (; x < x_end; ++x)
+				{
+					for (int c = 0; c < channels; ++c) sum[c] += src_row[x * channels + c];
+				}
+			}
+		}
+
+		int x_begin = 0;
+		for (int dst_x = 0; dst_x < dst_width; ++dst_x)
+		{
+			int x_end = (x_ends[dst_x] > x_begin) ? x_ends[dst_x] : x_begin + 1;
+			u64 count = (u64)(x_end - x_begin) * (y_end - y_begin);
+			for (int c = 0; c < channels; ++c) averages[dst_x * channels + c] = (u8)((sums[dst_x * channels + c] + count / 2) / count);
+			x_begin = x_end;
+		}
+		ExpandPixelsToRGBA(averages, {channels, PixelType::U8}, dst_width, dst + (size_t)dst_y * dst_width * 4);
+	}
+
+	free(averages);
+	free(row);
+	free(sums);
+	free(x_ends);
+}
+
+static void FreeJpegThumbDecoder(JpegThumbDecoder* decoder)
+{
+	for (int i = 0; i < (int)ARRAYCOUNT(decoder->components); ++i) free(decoder->components[i].plane);
+	free(decoder);
+}
+
+// Returns false without touching thumbnail if the data isn't a JPEG this decoder handles, or if the image
+// is too small for a reduced decode to help.
+static bool DecodeJpegThumbnail(const u8* data, u64 size, int max_size, DecodedImage* thumbnail, int* source_width, int* source_height)
+{
+	JpegThumbDecoder* decoder = (JpegThumbDecoder*)calloc(1, sizeof(JpegThumbDecoder)); // @malloc
+	decoder->data = data;
+	decoder->end = data + size;
+	decoder->adobe_transform = -1;
+
+	bool success = ReadThumbHeaders(decoder);
+	int thumbnail_width = 0, thumbnail_height = 0;
+	if (success)
+	{
+		// The biggest reduction that still leaves at least the thumbnail's size to filter down from.
+		GetThumbnailSize(decoder->width, decoder->height, max_size, &thumbnail_width, &thumbnail_height);
+		int divisor = 8;
+		while (divisor > 1 && ((decoder->width + divisor - 1) / divisor < thumbnail_width || (decoder->height + divisor - 1) / divisor < thumbnail_height)) divisor /= 2;
+		// The DC coefficients that start a progressive JPEG are only enough for 1/8 scale.
+		success = (divisor == 8 || (divisor > 1 && !decoder->is_progressive));
+		decoder->block_size = 8 / divisor;
+	}
+	if (success)
+	{
+		int n = decoder->block_size;
+		for (int x = 0; x < n; ++x)
+		{
+			for (int u = 0; u < n; ++u)
+			{
+				float scale = u ? 0.5f : 0.5f * 0.70710678f;
+				decoder->idct[x][u] = scale * cosf((float)((2 * x + 1) * u) * 3.14159265f / (float)(2 * n));
+			}
+		}
+		success = DecodeThumbScan(decoder);
+	}
+
+	if (success)
+	{
+		int n = decoder->block_size;
+		int scaled_width = (decoder->width * n + 7) / 8;
+		int scaled_height = (decoder->height * n + 7) / 8;
+		u8* scaled = (u8*)malloc((size_t)scaled_width * scaled_height * 4); // @malloc
+		ConvertThumbPlanesToRGBA(decoder, scaled_width, scaled_height, scaled);
+
+		if (scaled_width != thumbnail_width || scaled_height != thumbnail_height)
+		{
+			u8* pixels = (u8*)malloc((size_t)thumbnail_width * thumbnail_height * 4); // @malloc
+			AreaAverageToRGBA8(scaled, {4, PixelType::U8}, scaled_width, scaled_height, pixels, thumbnail_width, thumbnail_height);
+			free(scaled);
+			scaled = pixels;
+		}
+		thumbnail->pixels = scaled;
+		thumbnail->width = thumbnail_width;
+		thumbnail->height = thumbnail_height;
+		thumbnail->layout = {4, PixelType::U8};
+		if (source_width) *source_width = decoder->width;
+		if (source_height) *source_height = decoder->height;
+	}
+
+	FreeJpegThumbDecoder(decoder);
+	return success;
+}
+
+bool DecodeJpegPreview(const void* data, u64 size, DecodedImage* preview, int* source_width, int* source_height)
+{
+	assert(data && preview);
+	*preview = {};
+	JpegThumbDecoder* decoder = (JpegThumbDecoder*)calloc(1, sizeof(JpegThumbDecoder)); // @malloc
+	decoder->data = (const u8*)data;
+	decoder->end = decoder->data + size;
+	decoder->adobe_transform = -1;
+	decoder->block_size = 1;
+
+	bool success = ReadThumbHeaders(decoder) && DecodeThumbScan(decoder);
+	if (success)
+	{
+		preview->width = (decoder->width + 7) / 8;
+		preview->height = (decoder->height + 7) / 8;
+		preview->layout = {4, PixelType::U8};
+		preview->pixels = malloc((size_t)preview->width * preview->height * 4); // @malloc
+		ConvertThumbPlanesToRGBA(decoder, preview->width, preview->height, (u8*)preview->pixels);
+		if (source_width) *source_width = decoder->width;
+		if (source_height) *source_height = decoder->height;
+	}
+	FreeJpegThumbDecoder(decoder);
+	return success;
+}
+
+void GetThumbnailSize(int width, int height, int max_size, int* thumbnail_width, int* thumbnail_height)
+{
+	assert(max_size > 0);
+	if (width <= max_size && height <= max_size)
+	{
+		*thumbnail_width = width;
+		*thumbnail_height = height;
+		return;
+	}
+
+	double scale = (double)max_size / (double)((width > height) ? width : height);
+	*thumbnail_width = (int)(width * scale + 0.5);
+	*thumbnail_height = (int)(height * scale + 0.5);
+	if (*thumbnail_width < 1) *thumbnail_width = 1;
+	if (*thumbnail_height < 1) *thumbnail_height = 1;
+}
+
+bool DecodeThumbnailFromMemory(const void* data, u64 size, int max_size, DecodedImage* thumbnail, int* source_width, int* source_height)
+{
+	assert(data && thumbnail && max_size > 0);
+	*thumbnail = {};
+	if (DecodeJpegThumbnail((const u8*)data, size, max_size, thumbnail, source_width, source_height)) return true;
+
+	DecodedImage image;
+	if (!DecodeImageFromMemory(data, size, &image)) return false;
+
+	int width, height;
+	GetThumbnailSize(image.width, image.height, max_size, &width, &height);
+	thumbnail->pixels = malloc((size_t)width * height * 4); // @malloc
+	thumbnail->width = width;
+	thumbnail->height = height;
+	thumbnail->layout = {4, PixelType::U8};
+	AreaAverageToRGBA8(image.pixels, image.layout, image.width, image.height, (u8*)thumbnail->pixels, width, height);
+	if (source_width) *source_width = image.width;
+	if (source_height) *source_height = image.height;
+	FreeDecodedImage(&image);
+	return true;
+}
+
+bool DecodeThumbnail(const char* file_path, int max_size, DecodedImage* thumbnail, int* source_width, int* source_height)
+{
+	assert(file_path && thumbnail);
+	*thumbnail = {};
+	Platform::MappedFile mapped_file = {};
+	if (!Platform::MapFileForRead(file_path, &mapped_file))
+	{
+		Platform::UnmapFile(&mapped_file);
+		return false;
+	}
+	bool success = DecodeThumbnailFromMemory(mapped_file.data, mapped_file.size, max_size, thumbnail, source_width, source_height);
+	Platform::UnmapFile(&mapped_file);
+	return success;
+}
+
+static void DestroyThumbnailJob(void* data)
+{
+	ThumbnailJob* job = (ThumbnailJob*)data;
+	FreeDecodedImage(&job->thumbnail);
+	free(job->file_path);
+	delete job;
+}
+
+static void RunThumbnailJob(void* data)
+{
+	ThumbnailJob* job = (ThumbnailJob*)data;
+	job->state.store(ImageLoadState::Decoding);
+
+	// A cache hit costs a stat and a copy; the image file itself isn't even opened.
+	u64 cache_key = job->cache ? GetThumbnailCacheKey(job->file_path, job->max_size) : 0;
+	bool success = FindCachedThumbnail(job->cache, cache_key, &job->thumbnail, &job->source_width, &job->source_height);
+	if (!success)
+	{
+		success = DecodeThumbnail(job->file_path, job->max_size, &job->thumbnail, &job->source_width, &job->source_height);
+		if (success) AddCachedThumbnail(job->cache, cache_key, &job->thumbnail, job->source_width, job->source_height);
+	}
+	job->state.store(success ? ImageLoadState::Ready : ImageLoadState::Failed);
+	WakeFrameScheduler();
+}
+
+ThumbnailJob* QueueThumbnailDecode(const char* file_path, int max_size, ThumbnailCache* cache)
+{
+	assert(file_path && max_size > 0);
+	ThumbnailJob* job = new ThumbnailJob();
+
+	size_t path_size = strlen(file_path) + 1;
+	job->file_path = (char*)malloc(path_size); // @malloc
+	memcpy(job->file_path, file_path, path_size);
+
+	job->max_size = max_size;
+	job->cache = cache;
+	job->thumbnail = {};
+	job->source_width = 0;
+	job->source_height = 0;
+	job->state.store(ImageLoadState::Queued);
+
+	// Browsers queue thumbnails for whatever is near the screen and drop them again as it scrolls past,
+	// so a lot of these are cancelled before they get to run.
+	PushSharedJob(&job->shared, RunThumbnailJob, DestroyThumbnailJob, job);
+	return job;
+}
+
+ImageLoadState GetThumbnailJobState(ThumbnailJob* job)
+{
+	assert(job);
+	return job->state.load();
+}
+
+DecodedImage TakeThumbnail(ThumbnailJob* job)
+{
+	assert(job && job->state.load() == ImageLoadState::Ready);
+	DecodedImage result = job->thumbnail;
+	job->thumbnail = {};
+	return result;
+}
+
+void ReleaseThumbnailJob(ThumbnailJob* job)
+{
+	if (!job) return;
+	CancelSharedJob(&job->shared);
+	ReleaseSharedJob(&job->shared);
+}
@@ -0,0 +1,55 @@
+#ifndef _THUMBNAIL_DECODE_H
+#define _THUMBNAIL_DECODE_H
+
+#include "ImageDecode.h"
+#include "ThumbnailCache.h"
+
+// Small previews for browsing, decoded for a fraction of what a full DecodeImageFile costs. Baseline
+// JPEGs are decoded straight at 1/2, 1/4 or 1/8 scale with reduced inverse DCTs, so most of the work of a
+// full decode never happens, and progressive JPEGs at 1/8 scale from their first scan alone. Anything else
+// (bigger progressive thumbnails, PNG and the rest) is decoded in full and shrunk with a box filter.
+
+// Thumbnails are never upscaled, so images already within max_size x max_size come out at their own size.
+void GetThumbnailSize(int width, int height, int max_size, int* thumbnail_width, int* thumbnail_height);
+
+// Decodes a thumbnail that fits in max_size x max_size, keeping the aspect ratio. The result is always
+// RGBA8, whatever the file is, and is freed with FreeDecodedImage like any other. source_width and
+// source_height (optional) get the size of the full image. Returns false (and leaves thumbnail zeroed)
+// if the file can't be decoded.
+bool DecodeThumbnail(const char* file_path, int max_size, DecodedImage* thumbnail, int* source_width = 0, int* source_height = 0);
+
+// Same, for a file that is already in memory. data isn't kept.
+bool DecodeThumbnailFromMemory(const void* data, u64 size, int max_size, DecodedImage* thumbnail, int* source_width = 0, int* source_height = 0);
+
+// A JPEG at 1/8 scale (rounded up) in RGBA8, from the DC coefficients alone. Returns false (and leaves
+// preview zeroed) for anything the reduced decoder doesn't handle; unlike DecodeThumbnail, this never
+// falls back to a full decode.
+bool DecodeJpegPreview(const void* data, u64 size, DecodedImage* preview, int* source_width = 0, int* source_height = 0);
+
+// One in-flight thumbnail decode.
+struct ThumbnailJob
+{
+	SharedJob shared;
+	char* file_path; // Owned copy of the requested path.
+	int max_size;
+	ThumbnailCache* cache; // Optional. Checked before decoding, and given the result after.
+	DecodedImage thumbnail;
+	int source_width;
+	int source_height;
+
+	std::atomic<ImageLoadState> state;
+};
+
+// Queues DecodeThumbnail on the job system. The caller owns one reference and must eventually hand it
+// back with ReleaseThumbnailJob. With a cache, a thumbnail found there isn't decoded at all; the cache
+// has to stay open until the job finishes.
+ThumbnailJob* QueueThumbnailDecode(const char* file_path, int max_size, ThumbnailCache* cache = 0);
+ImageLoadState GetThumbnailJobState(ThumbnailJob* job);
+
+// Moves the thumbnail out of a Ready job. The caller becomes responsible for freeing it.
+DecodedImage TakeThumbnail(ThumbnailJob* job);
+
+// Drops the caller's reference. If the decode hasn't started yet, it is skipped.
+void ReleaseThumbnailJob(ThumbnailJob* job);
+
+#endif //_THUMBNAIL_DECODE_H
@@ -0,0 +1,259 @@
+#include "TiledImage.h"
+
+bool ShouldTileImage(int width, int height)
+{
+	return (width > MAX_TEXTURE_DIMENSION || height > MAX_TEXTURE_DIMENSION || (s64)width * height > TILED_IMAGE_MIN_PIXELS);
+}
+
+static void RemoveSlotFromList(TiledImage* image, s32 slot)
+{
+	TileSlot* s = &image->slots[slot];
+	if (s->prev >= 0) image->slots[s->prev].next = s->next;
+	else image->lru_head = s->next;
+	if (s->next >= 0) image->slots[s->next].prev = s->prev;
+	else image->lru_tail = s->prev;
+	s->prev = s->next = -1;
+}
+
+static void PushSlotToFront(TiledImage* image, s32 slot)
+{
+	TileSlot* s = &image->slots[slot];
+	s->prev = -1;
+	s->next = image->lru_head;
+	if (image->lru_head >= 0) image->slots[image->lru_head].prev = slot;
+	image->lru_head = slot;
+	if (image->lru_tail < 0) image->lru_tail = slot;
+}
+
+TiledImage* CreateTiledImage(int width, int height)
+{
+	assert(width > 0 && height > 0);
+	TiledImage* result = (TiledImage*)calloc(1, sizeof(TiledImage)); // @malloc
+	result->width = width;
+	result->height = height;
+
+	// Stop at the first level that fits in one tile; coarser ones would never be picked.
+	int tile_count = 0;
+	for (int level = 0; level < MAX_MIP_LEVELS; ++level)
+	{
+		TileLevel* l = &result->levels[level];
+		l->width = GetMipLevelSize(width, level);
+		l->height = GetMipLevelSize(height, level);
+		l->tiles_x = (l->width + TILE_SIZE - 1) / TILE_SIZE;
+		l->tiles_y = (l->height + TILE_SIZE - 1) / TILE_SIZE;
+		l->first_tile = tile_count;
+		tile_count += l->tiles_x * l->tiles_y;
+		result->level_count = level + 1;
+		if (l->tiles_x == 1 && l->tiles_y == 1) break;
+	}
+
+	result->tile_count = tile_count;
+	result->page_table = (s32*)malloc(sizeof(s32) * tile_count); // @malloc
+	for (int i = 0; i < tile_count; ++i) result->page_table[i] = -1;
+
+	// Every slot starts out free, in the list, so allocation is always "take from the tail".
+	result->lru_head = result->lru_tail = -1;
+	for (s32 i = 0; i < TILE_ATLAS_SLOT_COUNT; ++i)
+	{
+		result->slots[i].tile = -1;
+		PushSlotToFront(result, i);
+	}
+	result->frame = 1;
+	return result;
+}
+
+void DestroyTiledImage(TiledImage* image)
+{
+	if (!image) return;
+	free(image->page_table);
+	free(image);
+}
+
+void GetTileCoords(const TiledImage* image, int tile, int* level, int* tile_x, int* tile_y)
+{
+	assert(tile >= 0 && tile < image->tile_count);
+	int l = image->level_count - 1;
+	while (l > 0 && image->levels[l].first_tile > tile) --l;
+
+	int local = tile - image->levels[l].first_tile;
+	*level = l;
+	*tile_x = local % image->levels[l].tiles_x;
+	*tile_y = local / image->levels[l].tiles_x;
+}
+
+int GetTileIndex(const TiledImage* image, int level, int tile_x, int tile_y)
+{
+	const TileLevel* l = &image->levels[level];
+	assert(tile_x >= 0 && tile_x < l->tiles_x && tile_y >= 0 && tile_y < l->tiles_y);
+	return l->first_tile + tile_y * l->tiles_x + tile_x;
+}
+
+int GetTileLevelForView(const TiledImage* image, TileView view)
+{
+	if (view.size_x <= 0.0f) return image->level_count - 1;
+
+	float texels_per_pixel = (float)image->width / view.size_x;
+	int result = 0;
+	while (result + 1 < image->level_count && texels_per_pixel >= 2.0f)
+	{
+		texels_per_pixel *= 0.5f;
+		++result;
+	}
+	return result;
+}
+
+static float ClampUnit(float value)
+{
+	return (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+}
+
+int GetVisibleTiles(const TiledImage* image, TileView view, int level, int* tiles, int max_tiles)
+{
+	assert(level >= 0 && level < image->level_count);
+	if (view.size_x <= 0.0f || view.size_y <= 0.0f) return 0;
+
+	// Canvas edges in normalized image coordinates.
+	float left = view.canvas_width * 0.5f - view.size_x * 0.5f + view.offset_x;
+	float top = view.canvas_height * 0.5f - view.size_y * 0.5f + view.offset_y;
+	float u0 = ClampUnit(-left / view.size_x);
+	float u1 = ClampUnit((view.canvas_width - left) / view.size_x);
+	float v0 = ClampUnit(-top / view.size_y);
+	float v1 = ClampUnit((view.canvas_height - top) / view.size_y);
+	if (u0 >= u1 || v0 >= v1) return 0;
+
+	const TileLevel* l = &image->levels[level];
+	int x0 = (int)(u0 * l->width) / TILE_SIZE;
+	int y0 = (int)(v0 * l->height) / TILE_SIZE;
+	int x1 = ((int)ceilf(u1 * l->width) - 1) / TILE_SIZE;
+	int y1 = ((int)ceilf(v1 * l->height) - 1) / TILE_SIZE;
+	if (x1 >= l->tiles_x) x1 = l->tiles_x - 1;
+	if (y1 >= l->tiles_y) y1 = l->tiles_y - 1;
+
+	int result = 0;
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			if (result == max_tiles) return result;
+			tiles[result++] = l->first_tile + y * l->tiles_x + x;
+		}
+	}
+	return result;
+}
+
+void BeginTileFrame(TiledImage* image)
+{
+	++image->frame;
+}
+
+int TouchTile(TiledImage* image, int tile)
+{
+	s32 slot = image->page_table[tile];
+	if (slot < 0) return -1;
+
+	image->slots[slot].last_used_frame = image->frame;
+	if (image->lru_head != slot)
+	{
+		RemoveSlotFromList(image, slot);
+		PushSlotToFront(image, slot);
+	}
+	return slot;
+}
+
+int MakeTileResident(TiledImage* image, int tile, bool is_pinned)
+{
+	if (image->page_table[tile] >= 0) return TouchTile(image, tile);
+
+	// Walk up from the least recently used end for a slot nobody needs this frame.
+	s32 slot = image->lru_tail;
+	while (slot >= 0 && (image->slots[slot].is_pinned || image->slots[slot].last_used_frame == image->frame))
+	{
+		slot = image->slots[slot].prev;
+	}
+	if (slot < 0) return -1;
+
+	TileSlot* s = &image->slots[slot];
+	if (s->tile >= 0) image->page_table[s->tile] = -1;
+	s->tile = tile;
+	s->is_pinned = is_pinned;
+	image->page_table[tile] = slot;
+	return TouchTile(image, tile);
+}
+
+bool GetTileQuad(TiledImage* image, int tile, TileQuad* quad)
+{
+	int level, tile_x, tile_y;
+	GetTileCoords(image, tile, &level, &tile_x, &tile_y);
+
+	const TileLevel* l = &image->levels[level];
+	int x1 = (tile_x + 1) * TILE_SIZE;
+	int y1 = (tile_y + 1) * TILE_SIZE;
+	quad->image_min[0] = (float)(tile_x * TILE_SIZE) / l->width;
+	quad->image_min[1] = (float)(tile_y * TILE_SIZE) / l->height;
+	quad->image_max[0] = (float)((x1 < l->width) ? x1 : l->width) / l->width;
+	quad->image_max[1] = (float)((y1 < l->height) ? y1 : l->height) / l->height;
+
+	// Fall back to coarser levels until something covering this area is resident. Levels round down, so
+	// the last tile of an odd sized level can halve to one past the end of the next; that area is in the
+	// next level's last tile.
+	int slot = TouchTile(image, tile);
+	while (slot < 0)
+	{
+		if (++level >= image->level_count) return false;
+		tile_x >>= 1;
+		tile_y >>= 1;
+		if (tile_x >= image->levels[level].tiles_x) tile_x = image->levels[level].tiles_x - 1;
+		if (tile_y >= image->levels[level].tiles_y) tile_y = image->levels[level].tiles_y - 1;
+		slot = TouchTile(image, GetTileIndex(image, level, tile_x, tile_y));
+	}
+
+	// Map the quad's image rectangle into the texels of whichever tile we ended up with.
+	const TileLevel* found = &image->levels[level];
+	float slot_x = (float)((slot % TILE_ATLAS_SLOTS_PER_ROW) * TILE_SIZE);
+	float slot_y = (float)((slot / TILE_ATLAS_SLOTS_PER_ROW) * TILE_SIZE);
+	float origin_x = slot_x - (float)(tile_x * TILE_SIZE);
+	float origin_y = slot_y - (float)(tile_y * TILE_SIZE);
+	quad->atlas_min[0] = (origin_x + quad->image_min[0] * found->width) / TILE_ATLAS_SIZE;
+	quad->atlas_min[1] = (origin_y + quad->image_min[1] * found->height) / TILE_ATLAS_SIZE;
+	quad->atlas_max[0] = (origin_x + quad->image_max[0] * found->width) / TILE_ATLAS_SIZE;
+	quad->atlas_max[1] = (origin_y + quad->image_max[1] * found->height) / TILE_ATLAS_SIZE;
+	return true;
+}
+
+void CopyTilePixels(const TiledImage* image, int tile, const void* source, PixelLayout layout, const MipChain* mips, u8* dst)
+{
+	int level, tile_x, tile_y;
+	GetTileCoords(image, tile, &level, &tile_x, &tile_y);
+	memset(dst, 0, TILE_SIZE * TILE_SIZE * 4);
+
+	const TileLevel* l = &image->levels[level];
+	int x0 = tile_x * TILE_SIZE;
+	int y0 = tile_y * TILE_SIZE;
+	int width = (x0 + TILE_SIZE < l->width) ? TILE_SIZE : l->width - x0;
+	int height = (y0 + TILE_SIZE < l->height) ? TILE_SIZE : l->height - y0;
+
+	if (level > 0)
+	{
+		const MipLevel* mip = &mips->levels[level];
+		assert(mip->pixels && mip->width == l->width);
+		for (int y = 0; y < height; ++y)
+		{
+			memcpy(dst + (size_t)y * TILE_SIZE * 4, mip->pixels + ((size_t)(y0 + y) * mip->width + x0) * 4, (size_t)width * 4);
+		}
+		return;
+	}
+
+	size_t pixel_size = GetPixelSize(layout);
+	PixelLayout u8_layout = {layout.channel_count, PixelType::U8};
+	u8 scratch[TILE_SIZE * 4];
+	for (int y = 0; y < height; ++y)
+	{
+		const u8* row = (const u8*)source + ((size_t)(y0 + y) * image->width + x0) * pixel_size;
+		if (layout.type != PixelType::U8)
+		{
+			ConvertPixelsToU8(row, layout, width, scratch);
+			row = scratch;
+		}
+		ExpandPixelsToRGBA(row, u8_layout, width, dst + (size_t)y * TILE_SIZE * 4);
+	}
+}
@@ -0,0 +1,110 @@
+#ifndef _TILED_IMAGE_H
+#define _TILED_IMAGE_H
+
+#include "MipChain.h"
+
+// Virtual texturing for images too large to live in a single texture. The image (and each of its mip
+// levels) is cut into TILE_SIZE square tiles; a page table maps every virtual tile to a slot in a fixed
+// size atlas, and slots are recycled least-recently-used first. Nothing here touches the renderer: the
+// caller uploads tile pixels into whatever atlas texture it owns.
+
+#define TILE_SIZE 256
+#define TILE_ATLAS_SLOTS_PER_ROW 16
+#define TILE_ATLAS_SLOT_COUNT (TILE_ATLAS_SLOTS_PER_ROW * TILE_ATLAS_SLOTS_PER_ROW)
+#define TILE_ATLAS_SIZE (TILE_SIZE * TILE_ATLAS_SLOTS_PER_ROW)
+
+// Images with more pixels than this (or wider/taller than a texture can be) are drawn from tiles.
+#define TILED_IMAGE_MIN_PIXELS ((s64)8192 * 8192)
+#define MAX_TEXTURE_DIMENSION 16384
+
+struct TileLevel
+{
+	int width; // Size of the level in pixels.
+	int height;
+	int tiles_x;
+	int tiles_y;
+	int first_tile; // Index of the level's first tile in the page table.
+};
+
+struct TileSlot
+{
+	s32 tile; // Virtual tile held by this slot, or -1 if free.
+	s32 prev; // LRU list links (slot indices, -1 terminated). Head is most recently used.
+	s32 next;
+	u64 last_used_frame;
+	bool is_pinned; // Pinned slots are never evicted.
+};
+
+struct TiledImage
+{
+	int width;
+	int height;
+	int level_count; // Levels down to the first that fits in a single tile.
+	TileLevel levels[MAX_MIP_LEVELS];
+
+	int tile_count; // Virtual tiles across all levels.
+	s32* page_table; // Atlas slot for each virtual tile, or -1 if not resident.
+
+	TileSlot slots[TILE_ATLAS_SLOT_COUNT];
+	s32 lru_head;
+	s32 lru_tail;
+	u64 frame;
+};
+
+// What part of the image is on screen, in the same terms DrawImagePanel uses: the image is drawn
+// image_size big, centered in the canvas and then moved by image_offset.
+struct TileView
+{
+	float canvas_width;
+	float canvas_height;
+	float offset_x;
+	float offset_y;
+	float size_x;
+	float size_y;
+};
+
+// Where to draw a resident tile: a rectangle in normalized image coordinates ([0, 1] across the
+// whole image) and the matching rectangle in normalized atlas coordinates.
+struct TileQuad
+{
+	float image_min[2];
+	float image_max[2];
+	float atlas_min[2];
+	float atlas_max[2];
+};
+
+bool ShouldTileImage(int width, int height);
+
+TiledImage* CreateTiledImage(int width, int height);
+void DestroyTiledImage(TiledImage* image);
+
+void GetTileCoords(const TiledImage* image, int tile, int* level, int* tile_x, int* tile_y);
+int GetTileIndex(const TiledImage* image, int level, int tile_x, int tile_y);
+
+// Picks the coarsest level that still has at least one texel per screen pixel.
+int GetTileLevelForView(const TiledImage* image, TileView view);
+
+// Writes the indices of the tiles of a level that intersect the canvas, up to max_tiles. Returns the
+// number written.
+int GetVisibleTiles(const TiledImage* image, TileView view, int level, int* tiles, int max_tiles);
+
+// Starts a new residency frame. Tiles touched during the frame can't be evicted until the next one.
+void BeginTileFrame(TiledImage* image);
+
+// Marks a resident tile as used this frame. Returns its slot, or -1 if it isn't resident.
+int TouchTile(TiledImage* image, int tile);
+
+// Assigns a slot to a tile, evicting the least recently used tile that wasn't touched this frame.
+// Returns the slot, or -1 if every slot is in use this frame.
+int MakeTileResident(TiledImage* image, int tile, bool is_pinned = false);
+
+// Finds the quad to draw for a visible tile: the tile itself if it is resident, otherwise the matching
+// part of its closest resident ancestor. Touches whichever tile it ends up using. Returns false if
+// nothing covering the tile is resident.
+bool GetTileQuad(TiledImage* image, int tile, TileQuad* quad);
+
+// Fills a TILE_SIZE x TILE_SIZE RGBA8 block with the tile's pixels, reading level 0 from the source and
+// the others from the mip chain. Texels outside the image are left transparent.
+void CopyTilePixels(const TiledImage* image, int tile, const void* source, PixelLayout layout, const MipChain* mips, u8* dst);
+
+#endif //_TILED_IMAGE_H
@@ -8,6 +8,8 @@
 
 // Core stuff.
 #include "Core/EngineCore.cpp"
+#include "Core/JobSystem.cpp"
+#include "Core/FrameScheduler.cpp"
 #include "imgui_extensions.cpp"
 
 // Platform stuff.
@@ -16,6 +18,32 @@
 #include "imgui_impl_win32.cpp"
 #include "main.cpp"
 #include "d3d_proto.cpp"
+#include "ImageDecode.cpp"
+#include "ThumbnailDecode.cpp"
+#include "ProgressiveDecode.cpp"
+#include "ThumbnailCache.cpp"
+#include "MipChain.cpp"
+#include "TiledImage.cpp"
+#include "ThumbnailAtlas.cpp"
+#include "ThumbnailBrowser.cpp"
+#include "RenderTargetPool.cpp"
+#include "UploadScheduler.cpp"
+#include "ImageStore.cpp"
+#include "Deflate.cpp"
+#include "EncoderFile.cpp"
+#include "PngWriter.cpp"
+#include "SimpleImageWriters.cpp"
+#include "JpegWriter.cpp"
+#include "BlockCompress.cpp"
+#include "DdsWriter.cpp"
+#include "ImageExport.cpp"
+#include "ImageStats.cpp"
+#include "SummedAreaTable.cpp"
+#include "ImageDiff.cpp"
+#include "ImageSsim.cpp"
+#include "ImagePrefetch.cpp"
+#include "BulkFileRead.cpp"
 #include "ImageLoader.cpp"
+#include "MemoryBudget.cpp"
 
 // External libraries.
@@ -0,0 +1,122 @@
+#include "UploadScheduler.h"
+
+UploadScheduler* CreateUploadScheduler(int slot_count, u64 frame_budget)
+{
+	assert(slot_count > 0);
+	UploadScheduler* scheduler = (UploadScheduler*)calloc(1, sizeof(UploadScheduler)); // @malloc
+	scheduler->slot_frames = (u64*)calloc(slot_count, sizeof(u64)); // @malloc
+	scheduler->slot_count = slot_count;
+	scheduler->frame_budget = frame_budget;
+	return scheduler;
+}
+
+void DestroyUploadScheduler(UploadScheduler* scheduler)
+{
+	if (!scheduler) return;
+	arrfree(scheduler->uploads);
+	free(scheduler->slot_frames);
+	free(scheduler);
+}
+
+void ScheduleUpload(UploadScheduler* scheduler, const void* owner, int level, int width, int height)
+{
+	assert(scheduler && width > 0 && height > 0);
+	PendingUpload upload = {};
+	upload.owner = owner;
+	upload.level = level;
+	upload.width = width;
+	upload.height = height;
+	arrput(scheduler->uploads, upload);
+}
+
+void CancelUploads(UploadScheduler* scheduler, const void* owner)
+{
+	assert(scheduler);
+	for (int i = 0; i < arrlen(scheduler->uploads); ++i)
+	{
+		if (scheduler->uploads[i].owner != owner) continue;
+		arrdel(scheduler->uploads, i);
+		--i;
+	}
+}
+
+bool HasPendingUploads(const UploadScheduler* scheduler, const void* owner)
+{
+	assert(scheduler);
+	for (int i = 0; i < arrlen(scheduler->uploads); ++i)
+	{
+		if (!owner || scheduler->uploads[i].owner == owner) return true;
+	}
+	return false;
+}
+
+void BeginUploadFrame(UploadScheduler* scheduler)
+{
+	assert(scheduler);
+	++scheduler->frame;
+	scheduler->frame_bytes = 0;
+}
+
+bool NextUploadChunk(UploadScheduler* scheduler, UploadChunk* chunk)
+{
+	assert(scheduler && chunk && scheduler->frame > 0);
+	if (arrlen(scheduler->uploads) == 0) return false;
+
+	// Slots are handed out in order, so the next one is always the one that has waited longest.
+	u64 slot_frame = scheduler->slot_frames[scheduler->next_slot];
+	if (slot_frame && scheduler->frame - slot_frame < UPLOAD_FRAME_LATENCY) return false;
+
+	PendingUpload* upload = &scheduler->uploads[0];
+	int chunks_per_row = (upload->width + UPLOAD_CHUNK_SIZE - 1) / UPLOAD_CHUNK_SIZE;
+	int chunk_count = chunks_per_row * ((upload->height + UPLOAD_CHUNK_SIZE - 1) / UPLOAD_CHUNK_SIZE);
+	int x = (upload->next_chunk % chunks_per_row) * UPLOAD_CHUNK_SIZE;
+	int y = (upload->next_chunk / chunks_per_row) * UPLOAD_CHUNK_SIZE;
+	int width = (upload->width - x < UPLOAD_CHUNK_SIZE) ? upload->width - x : UPLOAD_CHUNK_SIZE;
+	int height = (upload->height - y < UPLOAD_CHUNK_SIZE) ? upload->height - y : UPLOAD_CHUNK_SIZE;
+	u64 chunk_bytes = (u64)width * height * 4;
+	if (scheduler->frame_bytes > 0 && scheduler->frame_bytes + chunk_bytes > scheduler->frame_budget) return false;
+
+	*chunk = {};
+	chunk->owner = upload->owner;
+	chunk->level = upload->level;
+	chunk->x = x;
+	chunk->y = y;
+	chunk->width = width;
+	chunk->height = height;
+	chunk->slot = scheduler->next_slot;
+	chunk->is_level_done = (++upload->next_chunk == chunk_count);
+	if (chunk->is_level_done) arrdel(scheduler->uploads, 0);
+
+	scheduler->slot_frames[scheduler->next_slot] = scheduler->frame;
+	scheduler->next_slot = (scheduler->next_slot + 1) % scheduler->slot_count;
+	scheduler->frame_bytes += chunk_bytes;
+	return true;
+}
+
+void ReturnUploadChunk(UploadScheduler* scheduler, const UploadChunk* chunk)
+{
+	assert(scheduler && chunk);
+	if (chunk->is_level_done)
+	{
+		// The last chunk of a level is its bottom right corner, which gives the size of the level back.
+		PendingUpload upload = {};
+		upload.owner = chunk->owner;
+		upload.level = chunk->level;
+		upload.width = chunk->x + chunk->width;
+		upload.height = chunk->y + chunk->height;
+		int chunks_per_row = (upload.width + UPLOAD_CHUNK_SIZE - 1) / UPLOAD_CHUNK_SIZE;
+		upload.next_chunk = chunks_per_row * ((upload.height + UPLOAD_CHUNK_SIZE - 1) / UPLOAD_CHUNK_SIZE) - 1;
+		arrins(scheduler->uploads, 0, upload);
+	}
+	else
+	{
+		assert(arrlen(scheduler->uploads) && scheduler->uploads[0].owner == chunk->owner && scheduler->uploads[0].level == chunk->level);
+		--scheduler->uploads[0].next_chunk;
+	}
+
+	// Nothing was copied through the slot, so it's as free as it was before.
+	assert((chunk->slot + 1) % scheduler->slot_count == scheduler->next_slot);
+	scheduler->slot_frames[chunk->slot] = 0;
+	scheduler->next_slot = chunk->slot;
+	scheduler->frame_bytes -= (u64)chunk->width * chunk->height * 4;
+}
@@ -0,0 +1,79 @@
+#ifndef _UPLOAD_SCHEDULER_H
+#define _UPLOAD_SCHEDULER_H
+
+#include "Core/EngineCore.h"
+
+// Spreads big texture uploads over several frames. Each upload is one mip level of a texture, cut into
+// square chunks of UPLOAD_CHUNK_SIZE that go up one at a time through a ring of staging textures of that
+// size, and no more than a byte budget is handed out per frame. A staging slot is only reused
+// UPLOAD_FRAME_LATENCY frames after its copy was issued, by which time the GPU is done with it, so
+// mapping it again never waits. Like ThumbnailAtlas this is only bookkeeping; the caller owns the staging
+// textures and does the copies.
+
+#define UPLOAD_CHUNK_SIZE 512
+#define UPLOAD_FRAME_BUDGET ((u64)8 << 20) // Bytes handed out per frame, over every upload.
+#define UPLOAD_FRAME_LATENCY 3 // Frames the GPU may still be reading a staging slot after its copy.
+
+// Enough slots to spend the whole budget every frame.
+#define UPLOAD_RING_SIZE ((int)(UPLOAD_FRAME_BUDGET / ((u64)UPLOAD_CHUNK_SIZE * UPLOAD_CHUNK_SIZE * 4)) * UPLOAD_FRAME_LATENCY)
+
+struct PendingUpload
+{
+	const void* owner; // Whatever the caller uploads to; only compared.
+	int level;
+	int width;
+	int height;
+	int next_chunk; // Chunks are handed out in rows, top to bottom.
+};
+
+struct UploadScheduler
+{
+	PendingUpload* uploads; // stb_ds array, in the order they were scheduled.
+	u64* slot_frames; // Frame each staging slot was last handed out in, or 0.
+	int slot_count;
+	int next_slot;
+	u64 frame_budget;
+	u64 frame; // Counts from 1, so 0 means never.
+	u64 frame_bytes; // Handed out so far this frame.
+};
+
+// A piece of a level to copy through a staging slot, all in texels of that level.
+struct UploadChunk
+{
+	const void* owner;
+	int level;
+	int x;
+	int y;
+	int width;
+	int height;
+	int slot;
+	bool is_level_done; // This was the last chunk of the level.
+};
+
+UploadScheduler* CreateUploadScheduler(int slot_count = UPLOAD_RING_SIZE, u64 frame_budget = UPLOAD_FRAME_BUDGET);
+void DestroyUploadScheduler(UploadScheduler* scheduler);
+
+// Queues a level behind everything already scheduled. Callers that want an image to look right as soon as
+// possible schedule its smallest levels first.
+void ScheduleUpload(UploadScheduler* scheduler, const void* owner, int level, int width, int height);
+
+// Drops everything scheduled for owner, for when it's freed before it has been uploaded.
+void CancelUploads(UploadScheduler* scheduler, const void* owner);
+
+// True if anything is left for owner, or for anyone if owner is null.
+bool HasPendingUploads(const UploadScheduler* scheduler, const void* owner = 0);
+
+// Call once per frame, before taking chunks. Starts a new budget.
+void BeginUploadFrame(UploadScheduler* scheduler);
+
+// Takes the next chunk to copy this frame. Returns false once the budget is spent, the next staging slot
+// might still be in use, or there is nothing left. A chunk bigger than the whole budget is still handed out
+// on its own, so a tiny budget slows uploads down rather than stopping them.
+bool NextUploadChunk(UploadScheduler* scheduler, UploadChunk* chunk);
+
+// Puts back the chunk NextUploadChunk last handed out, as if it never had, for when it couldn't be copied.
+// It is the next one handed out again, through the same slot. Call it before taking another chunk, and
+// don't take any more this frame, or the same chunk comes straight back.
+void ReturnUploadChunk(UploadScheduler* scheduler, const UploadChunk* chunk);
+
+#endif //_UPLOAD_SCHEDULER_H
@@ -89,4 +89,26 @@ ID3D11Buffer* CreateConstantBuffer(ID3D11Device* device, ID3D11DeviceContext* ct
 	
 	ctx->Unmap(result, 0);
 	return result;
-}
\ No newline at end of file
+}
+
+// Trilinear when minified, so zoomed out images sample their mip chain instead of aliasing. Magnified
+// images stay point sampled so individual pixels remain visible.
+ID3D11SamplerState* CreateImageSampler(ID3D11Device* device)
+{
+	D3D11_SAMPLER_DESC desc = {};
+	desc.Filter = D3D11_FILTER_MIN_LINEAR_MAG_POINT_MIP_LINEAR;
+	desc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	desc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	desc.MipLODBias = 0.0f;
+	desc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+	desc.MinLOD = 0.0f;
+	desc.MaxLOD = D3D11_FLOAT32_MAX;
+	
+	ID3D11SamplerState* result = 0;
+	if (device->CreateSamplerState(&desc, &result) < 0)
+	{
+		assert(false);
+	}
+	return result;
+}
@@ -18,4 +18,5 @@ struct CoolVertex
 ID3D11Buffer* CreateVertexBuffer(ID3D11Device* device, ID3D11DeviceContext* ctx, CoolVertex* vertices, size_t vertex_count);
 ID3D11Buffer* CreateIndexBuffer(ID3D11Device* device, ID3D11DeviceContext* ctx, unsigned int* indices, size_t index_count);
 ID3D11Buffer* CreateConstantBuffer(ID3D11Device* device, ID3D11DeviceContext* ctx, CoolConstantBuffer* buffer);
+ID3D11SamplerState* CreateImageSampler(ID3D11Device* device);
 #endif //D3D_PROTO_H
@@ -3,12 +3,15 @@
 // Read online: https://github.com/ocornut/imgui/tree/master/docs
 
 #include "ImageLoader.h"
+#include "ThumbnailBrowser.h"
+#include "MemoryBudget.h"
 #include "imgui/imgui.h"
 #include "imgui_impl_win32.h"
 #include "imgui_impl_dx11.h"
 #include "imgui_extensions.h"
 
 #include "d3d_proto.h"
+#include "Core/FrameScheduler.h"
 #include <d3d11.h>
 #define DIRECTINPUT_VERSION 0x0800
 #include <dinput.h>
@@ -25,12 +28,24 @@ object->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof(object##_name) - 1, obj
 static IDXGISwapChain*          g_pSwapChain = NULL;
 static ID3D11RenderTargetView*  g_mainRenderTargetView = NULL;
 static ID3D11Debug* g_pDebug = NULL;
+static ID3D11SamplerState* g_pImageSampler = NULL;
 
 
 ImagePanel* image_panels = 0;
 int* panel_focus_stack = 0;
 static int next_panel_id = 1;
 static int focused_panel_id = 0;
+ExportJob** exports = 0; // Queued and finished exports, oldest first, until they're cleared from the list.
+static int next_export_id = 1;
+static int export_type_index = 0; // Into export_type_names, which follows ImageExportParams::FileType minus None.
+static int compare_panel_id = 0; // The panel picked to compare the focused one against.
+static float compare_threshold = 0.0f;
+static bool compare_failed = false;
+static bool compare_ssim = false;
+static ThumbnailBrowser* thumbnail_browser = 0; // The open folder, if any. Only one at a time.
+static ThumbnailCache* thumbnail_cache = 0; // In the working directory, like fonts/. Null if it can't be opened.
+static ImagePrefetcher* image_prefetcher = 0; // Neighbours of whichever panel last loaded or stepped.
+static MemoryBudget memory_budget = {MEMORY_BUDGET_DEFAULT_CPU, MEMORY_BUDGET_DEFAULT_GPU};
 
 // Forward declarations of helper functions
 bool CreateDeviceD3D(HWND hWnd);
@@ -38,6 +53,9 @@ void CleanupDeviceD3D();
 void CreateRenderTarget();
 void CleanupRenderTarget();
 LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
+void WakeMainLoop(void* data);
+void DrawImagePanelStats(ImagePanel* panel);
+void DrawImagePanelCompare(ImagePanel* panel);
 
 // Main code
 int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
@@ -92,6 +110,13 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
     ImGui_ImplWin32_Init(hwnd);
     ImGui_ImplDX11_Init(g_pd3dDevice, g_pd3dDeviceContext);
 	
+    // Image decoding runs on the worker pool so opening files doesn't stall the frame.
+    StartJobSystem();
+    SetFrameWakeFunction(WakeMainLoop, hwnd);
+    g_pImageSampler = CreateImageSampler(g_pd3dDevice);
+    thumbnail_cache = OpenThumbnailCache("thumbnails.cache");
+    image_prefetcher = CreateImagePrefetcher();
+	
     // Load Fonts
     // - If no fonts are loaded, dear imgui will use the default font. You can also load multiple fonts and use ImGui::PushFont()/PopFont() to select them.
     // - AddFontFromFileTTF() will return the ImFont* so you can store it if you need to select the font among multiple.
@@ -121,12 +146,26 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
-        if (::PeekMessage(&msg, NULL, 0U, 0U, PM_REMOVE))
+        //
+        // When nothing needs redrawing, sleep until a message arrives, a worker wakes us up or the next
+        // animation deadline passes, instead of spinning on the same frame.
+        double wait_time = GetFrameWaitTime();
+        if (wait_time != 0.0)
+        {
+            DWORD timeout = (wait_time < 0.0) ? INFINITE : (DWORD)(wait_time * 1000.0) + 1;
+            ::MsgWaitForMultipleObjectsEx(0, NULL, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        }
+        while (::PeekMessage(&msg, NULL, 0U, 0U, PM_REMOVE))
         {
             ::TranslateMessage(&msg);
             ::DispatchMessage(&msg);
-            continue;
+            if (msg.message == WM_QUIT) break;
+            
+            // WM_NULL is just WakeMainLoop; the scheduler already knows why it was sent.
+            if (msg.message != WM_NULL) RequestFrames(FRAME_SETTLE_COUNT);
         }
+        if (msg.message == WM_QUIT) break;
+        if (!BeginScheduledFrame()) continue;
 		
         // Start the Dear ImGui frame
         ImGui_ImplDX11_NewFrame();
@@ -163,6 +202,33 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 			}
 		}
 		
+		// Canvases released by closed or resized panels are only freed after sitting unused for a while.
+		UpdateRenderTargetPool();
+		
+		// Upload any images that finished decoding since last frame. A newly opened image starts its
+		// neighbours decoding, so stepping away from it is quick too.
+		UpdateImagePrefetcher(image_prefetcher);
+		if (UpdateImageStoreUploads(g_pd3dDevice, g_pd3dDeviceContext)) RequestFrames(); // Big images come in a slice at a time while they decode, then sharpen as their levels upload.
+		for (int i = 0; i < arrlen(image_panels); ++i)
+		{
+			ImagePanel* panel = &image_panels[i];
+			if (UpdateImagePanelLoad(g_pd3dDevice, g_pd3dDeviceContext, panel) && !panel->load_failed && !panel->sequence_paths)
+			{
+				PrefetchImagePanelNeighbours(panel, image_prefetcher);
+			}
+			UpdateImagePanelPrefetch(g_pd3dDevice, g_pd3dDeviceContext, panel, image_prefetcher);
+			if (UpdateImagePanelDiff(g_pd3dDevice, panel)) RequestFrames();
+		}
+		
+		// Same for the thumbnail browser, which also decides here what to decode next.
+		bool has_waiting_thumbnails = false;
+		if (thumbnail_browser && !thumbnail_browser->is_visible)
+		{
+			ReleaseThumbnailBrowser(thumbnail_browser);
+			thumbnail_browser = 0;
+		}
+		if (thumbnail_browser) has_waiting_thumbnails = UpdateThumbnailBrowser(g_pd3dDevice, g_pd3dDeviceContext, thumbnail_browser);
+		
 		// Show our cool image window
 		static float img_clear_color[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 		
@@ -174,6 +240,29 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 			{
 				focused_panel_id = image_panels[i].panel_id;
 			}
+			if (image_panels[i].navigation_step)
+			{
+				StepImagePanel(g_pd3dDevice, g_pd3dDeviceContext, &image_panels[i], image_panels[i].navigation_step, image_prefetcher);
+				image_panels[i].navigation_step = 0;
+				RequestFrames();
+			}
+		}
+		
+		// Double-clicking a thumbnail opens the image in a panel of its own.
+		if (thumbnail_browser)
+		{
+			const char* opened_path = DrawThumbnailBrowser(thumbnail_browser, dockspace_id);
+			if (opened_path)
+			{
+				size_t path_size = strlen(opened_path) + 1;
+				char* image_path = (char*)malloc(path_size); // @malloc
+				memcpy(image_path, opened_path, path_size);
+				float tab_height = ImGui::GetFontSize() + ImGui::GetStyle().FramePadding.y * 2;
+				Vec2 node_size = (Vec2)ImGui::GetDockNodeSize(dockspace_id) - Vec2(0, tab_height);
+				ImagePanel new_panel = LoadImageFromFile(g_pd3dDevice, g_pd3dDeviceContext, image_path, next_panel_id, node_size);
+				++next_panel_id;
+				arrput(image_panels, new_panel);
+			}
 		}
 		
 		// If we got a valid ID, we need to clear it from the focus stack and re-add it to the end (the top).
@@ -207,6 +296,11 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 			if (!focused_panel) arrpop(panel_focus_stack);
 			else break;
 		}
+		
+		// Panels that were evicted to stay in budget load again once they're looked at, which may in turn
+		// push others out.
+		if (focused_panel) RestoreImagePanel(focused_panel);
+		EnforceMemoryBudget(g_pd3dDevice, g_pd3dDeviceContext, &memory_budget, image_panels, (int)arrlen(image_panels), panel_focus_stack, (int)arrlen(panel_focus_stack));
 		// Search the list of panels for any with a matching ID, so we know which one is being modified.
 		//if (focused_panel_id)
 		//{
@@ -225,13 +319,22 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
             
             float dummy_spacing = ImGui::GetFontSize();
             
+            static const char* export_type_names[] = {"PNG", "BMP", "TGA", "JPG", "HDR", "DDS (BC7)"};
+            static const char* export_extensions[] = {"png", "bmp", "tga", "jpg", "hdr", "dds"};
+            ImGui::Combo("Format", &export_type_index, export_type_names, (int)ARRAYCOUNT(export_type_names));
             if (ImGui::Button("Save"))
             {
-                const char* filename = "test_img.png";
+                // Exports run in the background and several can be in flight, so each gets its own file.
+                char filename[64];
+                sprintf_s(filename, sizeof(filename), "test_img_%d.%s", next_export_id, export_extensions[export_type_index]);
                 ImageExportParams params = {};
-                params.type = ImageExportParams::FileType::PNG;
-                SaveSelectedImagePanelRegion(focused_panel, filename, params);
-                
+                params.type = (ImageExportParams::FileType)(export_type_index + 1);
+                ExportJob* job = QueueSelectedImagePanelRegionExport(focused_panel, filename, params);
+                if (job)
+                {
+                    arrput(exports, job);
+                    ++next_export_id;
+                }
             }
 			ImGui::Checkbox("Red", &focused_panel->show_r);
 			ImGui::Checkbox("Green", &focused_panel->show_g);
@@ -239,12 +342,109 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 			ImGui::Checkbox("Alpha", &focused_panel->show_a);
             ImGui::Dummy(ImVec2(dummy_spacing, dummy_spacing));
 			
+            // Same as the arrow and page keys over the panel.
+            if (ImGui::Button("< Previous")) StepImagePanel(g_pd3dDevice, g_pd3dDeviceContext, focused_panel, -1, image_prefetcher);
+            ImGui::SameLine();
+            if (ImGui::Button("Next >")) StepImagePanel(g_pd3dDevice, g_pd3dDeviceContext, focused_panel, 1, image_prefetcher);
+            ImGui::Text("Prefetch: %llu hits, %llu misses, %.0f MB cached", image_prefetcher->hit_count, image_prefetcher->miss_count, image_prefetcher->used_bytes / (1024.0 * 1024.0));
+            ImGui::Dummy(ImVec2(dummy_spacing, dummy_spacing));
+            
             ImGui::Text("Image Info");
             ImGui::Separator();
             ImGui::Text("File Path: %s", focused_panel->file_path);
-            ImGui::Text("Image Size: (%d, %d)", focused_panel->source_width, focused_panel->source_height);
-            ImGui::Text("Channels in Source: %d", focused_panel->source_channel_count);
+            MemoryUsage panel_usage = GetImagePanelMemoryUsage(focused_panel);
+            ImGui::Text("Memory: %.0f MB CPU, %.0f MB GPU", panel_usage.cpu_bytes / (1024.0 * 1024.0), panel_usage.gpu_bytes / (1024.0 * 1024.0));
+            if (!focused_panel->source_data && !focused_panel->load_failed) ImGui::Text("Loading...");
+            else if (focused_panel->load_failed) ImGui::Text("Unable to load image.");
+            else
+            {
+                ImGui::Text("Image Size: (%d, %d)", focused_panel->source_width, focused_panel->source_height);
+                ImGui::Text("Channels in Source: %d", focused_panel->source_layout.channel_count);
+                ImGui::Text("Bits per Channel: %d%s", GetPixelTypeSize(focused_panel->source_layout.type) * 8, (focused_panel->source_layout.type == PixelType::F32) ? " (float)" : "");
+                
+                // These follow the selection while it's being dragged, which the summed-area table makes
+                // cheap enough to do every frame.
+                double sums[4], means[4];
+                if (GetImagePanelSelectionSums(focused_panel, sums, means))
+                {
+                    bool is_float = (focused_panel->source_layout.type == PixelType::F32);
+                    char mean_text[128] = "";
+                    char sum_text[128] = "";
+                    for (int c = 0; c < focused_panel->source_layout.channel_count; ++c)
+                    {
+                        size_t mean_length = strlen(mean_text);
+                        size_t sum_length = strlen(sum_text);
+                        sprintf_s(mean_text + mean_length, sizeof(mean_text) - mean_length, "%s%.3f", c ? ", " : "", means[c]);
+                        sprintf_s(sum_text + sum_length, sizeof(sum_text) - sum_length, is_float ? "%s%g" : "%s%.0f", c ? ", " : "", sums[c]);
+                    }
+                    ImGui::Text("Selection Mean: (%s)", mean_text);
+                    ImGui::Text("Selection Sum: (%s)", sum_text);
+                }
+                
+                // Collapsed by default, since the first look at a big image has to scan all of it.
+                ImGui::Dummy(ImVec2(dummy_spacing, dummy_spacing));
+                if (ImGui::CollapsingHeader("Statistics")) DrawImagePanelStats(focused_panel);
+                if (arrlen(image_panels) > 1 && ImGui::CollapsingHeader("Compare")) DrawImagePanelCompare(focused_panel);
+            }
+		}
+		
+		if (arrlen(image_panels) > 0)
+		{
+			ImGui::Dummy(ImVec2(ImGui::GetFontSize(), ImGui::GetFontSize()));
+			ImGui::Text("Memory");
+			ImGui::Separator();
+			MemoryUsage usage = memory_budget.usage;
+			ImGui::Text("CPU: %.0f / %llu MB", usage.cpu_bytes / (1024.0 * 1024.0), memory_budget.cpu_budget >> 20);
+			ImGui::Text("GPU: %.0f / %llu MB", usage.gpu_bytes / (1024.0 * 1024.0), memory_budget.gpu_budget >> 20);
+			if (memory_budget.evicted_count) ImGui::TextDisabled("%d panel(s) reduced to a preview", memory_budget.evicted_count);
+			int cpu_budget_mb = (int)(memory_budget.cpu_budget >> 20);
+			int gpu_budget_mb = (int)(memory_budget.gpu_budget >> 20);
+			if (ImGui::DragInt("CPU Budget (MB)", &cpu_budget_mb, 16.0f, 64, 1 << 20)) memory_budget.cpu_budget = (u64)cpu_budget_mb << 20;
+			if (ImGui::DragInt("GPU Budget (MB)", &gpu_budget_mb, 16.0f, 64, 1 << 20)) memory_budget.gpu_budget = (u64)gpu_budget_mb << 20;
+		}
+		
+		if (arrlen(exports) > 0)
+		{
+			ImGui::Dummy(ImVec2(ImGui::GetFontSize(), ImGui::GetFontSize()));
+			ImGui::Text("Exports");
+			ImGui::Separator();
+			bool has_finished = false;
+			for (int i = 0; i < arrlen(exports); ++i)
+			{
+				ExportJob* job = exports[i];
+				ExportState state = GetExportState(job);
+				ImGui::PushID(job);
+				ImGui::Text("%s", job->file_path);
+				if (state == ExportState::Queued || state == ExportState::Encoding)
+				{
+					ImGui::ProgressBar(GetExportProgress(job), ImVec2(-ImGui::GetFontSize() * 5.0f, 0.0f));
+					ImGui::SameLine();
+					if (ImGui::Button("Cancel")) CancelExport(job);
+				}
+				else
+				{
+					has_finished = true;
+					if (state == ExportState::Done) ImGui::TextDisabled("Saved.");
+					else if (state == ExportState::Cancelled) ImGui::TextDisabled("Cancelled.");
+					else ImGui::TextDisabled("Unable to save image.");
+				}
+				ImGui::PopID();
+			}
+			if (has_finished && ImGui::Button("Clear Finished"))
+			{
+				for (int i = (int)arrlen(exports) - 1; i >= 0; --i)
+				{
+					ExportState state = GetExportState(exports[i]);
+					if (state == ExportState::Queued || state == ExportState::Encoding) continue;
+					ReleaseExport(exports[i]);
+					arrdel(exports, i);
+				}
+			}
 		}
+		
+		FrameSchedulerStats frame_stats = GetFrameSchedulerStats();
+		ImGui::Dummy(ImVec2(ImGui::GetFontSize(), ImGui::GetFontSize()));
+		ImGui::TextDisabled("Frames rendered: %llu, skipped: %llu", (unsigned long long)frame_stats.frames_rendered, (unsigned long long)frame_stats.frames_skipped);
 		//ImGui::DragFloat2("Offset", img.image_offset.data, 1.0f);
 		//ImGui::DragFloat2("Size", img.image_size.data, 1.0f);
 		//ImGui::ColorEdit4("Background", img_clear_color);
@@ -288,6 +488,20 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 					//arrput(image_panels, new_panel);
 					//}
 				}
+				if (ImGui::MenuItem("Open Folder..."))
+				{
+					char* folder_path = Platform::ShowOpenFolderDialog();
+					if (folder_path)
+					{
+						ThumbnailBrowser* new_browser = OpenThumbnailBrowser(folder_path, thumbnail_cache);
+						if (new_browser)
+						{
+							ReleaseThumbnailBrowser(thumbnail_browser);
+							thumbnail_browser = new_browser;
+						}
+						free(folder_path);
+					}
+				}
 				ImGui::EndMenu();
 			}
 			if (ImGui::BeginMenu("Edit"))
@@ -314,10 +528,13 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 		{
 			ImagePanel* panel = &image_panels[i];
 			
-			// If the image hasn't changed, no need to redraw it.
-			if (!panel->should_redraw) continue;
+			// If the image hasn't changed (or hasn't finished loading), no need to redraw it.
+			if (!panel->should_redraw || !panel->texture) continue;
 			panel->should_redraw = false;
 			
+			// Tiled images stream in over several frames; keep redrawing until every visible tile is in.
+			if (panel->tiled && UpdateImagePanelTiles(g_pd3dDeviceContext, panel)) panel->should_redraw = true;
+			
 			// Re-upload the constant buffer for our image.
 			{
 				D3D11_MAPPED_SUBRESOURCE mapped_resource;
@@ -328,13 +545,8 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 				Mat4 ortho = CreateOrthoMatrix(ortho_size.x, ortho_size.y, 1, 0.0f);
 				ortho[1][1] *= -1;
 				
-				D3D11_TEXTURE2D_DESC src_desc = {};
-				D3D11_TEXTURE2D_DESC dst_desc = {};
-				panel->texture->GetDesc(&src_desc);
-				panel->render_target->GetDesc(&dst_desc);
-				
-				IVec2 src_size = {(int)src_desc.Width, (int)src_desc.Height};
-				IVec2 dst_size = {(int)dst_desc.Width, (int)dst_desc.Height};
+				// The canvas target is usually bigger than the panel; everything is drawn into its top-left corner.
+				IVec2 dst_size = {(int)panel->last_image_size.x, (int)panel->last_image_size.y};
 				
 				Vec2 offset = ortho_size * panel->image_offset / (Vec2)dst_size;
 				
@@ -346,16 +558,16 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 			}
 			
 			
-			g_pd3dDeviceContext->OMSetRenderTargets(1, &panel->rtv, 0);
-			g_pd3dDeviceContext->ClearRenderTargetView(panel->rtv, img_clear_color);
+			g_pd3dDeviceContext->OMSetRenderTargets(1, &panel->canvas.rtv, 0);
+			g_pd3dDeviceContext->ClearRenderTargetView(panel->canvas.rtv, img_clear_color);
 			
 			// Setup viewport
 			{
 				D3D11_VIEWPORT vp = {};
-				D3D11_TEXTURE2D_DESC desc = {};
-				panel->render_target->GetDesc(&desc);
-				vp.Width = (float)desc.Width;
-				vp.Height = (float)desc.Height;
+				LONG canvas_width = (LONG)panel->last_image_size.x;
+				LONG canvas_height = (LONG)panel->last_image_size.y;
+				vp.Width = (float)canvas_width;
+				vp.Height = (float)canvas_height;
 				vp.MinDepth = 0.0f;
 				vp.MaxDepth = 1.0f;
 				vp.TopLeftX = vp.TopLeftY = 0;
@@ -370,12 +582,13 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 				g_pd3dDeviceContext->VSSetShader(g_pVertexShader, NULL, 0);
 				g_pd3dDeviceContext->VSSetConstantBuffers(0, 1, &panel->constant_buffer);
 				g_pd3dDeviceContext->PSSetShader(g_pPixelShader, NULL, 0);
-				g_pd3dDeviceContext->PSSetSamplers(0, 1, &g_pFontSampler);
+				// Tiles sit next to unrelated tiles in the atlas, so they have to be point sampled.
+				g_pd3dDeviceContext->PSSetSamplers(0, 1, panel->tiled ? &g_pFontSampler : &g_pImageSampler);
 				g_pd3dDeviceContext->GSSetShader(NULL, NULL, 0);
 				g_pd3dDeviceContext->HSSetShader(NULL, NULL, 0);
 				g_pd3dDeviceContext->DSSetShader(NULL, NULL, 0);
 				g_pd3dDeviceContext->CSSetShader(NULL, NULL, 0);
-				D3D11_RECT scissor = {0, 0, (LONG)desc.Width, (LONG)desc.Height};
+				D3D11_RECT scissor = {0, 0, canvas_width, canvas_height};
 				g_pd3dDeviceContext->RSSetScissorRects(1, &scissor);
 				
 				// Setup blend state
@@ -386,7 +599,16 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 				
 				// Bind texture, Draw
 				g_pd3dDeviceContext->PSSetShaderResources(0, 1, &panel->src_srv);
-				g_pd3dDeviceContext->DrawIndexed(6, 0, 0);
+				if (panel->tiled)
+				{
+					g_pd3dDeviceContext->IASetVertexBuffers(0, 1, &panel->tile_vertex_buffer, &stride, &offset);
+					g_pd3dDeviceContext->IASetIndexBuffer(panel->tile_index_buffer, DXGI_FORMAT_R32_UINT, 0);
+					g_pd3dDeviceContext->DrawIndexed(panel->tile_quad_count * 6, 0, 0);
+				}
+				else
+				{
+					g_pd3dDeviceContext->DrawIndexed(6, 0, 0);
+				}
 			}
 		}
 		
@@ -405,6 +627,22 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 		
 		g_pSwapChain->Present(1, 0); // Present with vsync
 		//g_pSwapChain->Present(0, 0); // Present without vsync
+		
+		// Work out whether anything will change without new input.
+		for (int i = 0; i < arrlen(image_panels); ++i)
+		{
+			// Canvases waiting to settle after a resize need a few more frames to count down.
+			if (image_panels[i].should_redraw || image_panels[i].canvas_settle_frames > 0) RequestFrames();
+		}
+		for (int i = 0; i < arrlen(exports); ++i)
+		{
+			// Finishing wakes the loop on its own, but the progress bars only move if someone looks.
+			ExportState state = GetExportState(exports[i]);
+			if (state == ExportState::Queued || state == ExportState::Encoding) RequestFrameIn(0.1);
+		}
+		if (has_waiting_thumbnails) RequestFrames(); // Uploads are spread over frames.
+		if (io.WantTextInput) RequestFrameIn(0.5); // Text cursor blink.
+		if (ImGui::IsAnyMouseDown()) RequestFrames(); // Drags can move things without the mouse moving.
 	}
 	
 	// Cleanup
@@ -418,6 +656,20 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 	}
 	arrfree(image_panels);
 	arrfree(panel_focus_stack);
+	DestroyImagePrefetcher(image_prefetcher);
+	DestroyImageStore();
+	for (int i = 0; i < arrlen(exports); ++i)
+	{
+		// Unfinished exports are abandoned rather than waited on; their partial files get deleted.
+		CancelExport(exports[i]);
+		ReleaseExport(exports[i]);
+	}
+	arrfree(exports);
+	ReleaseThumbnailBrowser(thumbnail_browser);
+	DestroyRenderTargetPool();
+	StopJobSystem();
+	CloseThumbnailCache(thumbnail_cache); // Only once no thumbnail job can be using it.
+	if (g_pImageSampler) { g_pImageSampler->Release(); g_pImageSampler = NULL; }
 	
 	CleanupDeviceD3D();
 	::DestroyWindow(hwnd);
@@ -428,6 +680,112 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 
 // Helper functions
 
+static float GetHistogramBin(void* data, int index)
+{
+    return (float)((const u64*)data)[index];
+}
+
+// Histogram and min/max/mean/stddev per channel, for the selection or the whole image.
+void DrawImagePanelStats(ImagePanel* panel)
+{
+    IVec2 top_left, bottom_right;
+    const ImageStats* stats = GetImagePanelStats(panel, &top_left, &bottom_right);
+    if (!stats) return;
+    
+    IVec2 size = bottom_right - top_left;
+    if (size.x == panel->source_width && size.y == panel->source_height) ImGui::Text("Whole image");
+    else ImGui::Text("Selection: (%d, %d) to (%d, %d), %d x %d", top_left.x, top_left.y, bottom_right.x, bottom_right.y, size.x, size.y);
+    
+    static const char* gray_names[] = {"Gray", "Alpha"};
+    static const char* color_names[] = {"Red", "Green", "Blue", "Alpha"};
+    static const ImVec4 gray_colors[] = {ImVec4(0.8f, 0.8f, 0.8f, 1.0f), ImVec4(0.5f, 0.5f, 0.5f, 1.0f)};
+    static const ImVec4 color_colors[] = {ImVec4(0.9f, 0.3f, 0.3f, 1.0f), ImVec4(0.3f, 0.8f, 0.3f, 1.0f), ImVec4(0.3f, 0.5f, 0.9f, 1.0f), ImVec4(0.5f, 0.5f, 0.5f, 1.0f)};
+    bool is_gray = (stats->channel_count <= 2);
+    bool is_float = (panel->source_layout.type == PixelType::F32);
+    
+    for (int c = 0; c < stats->channel_count; ++c)
+    {
+        const ChannelStats* channel = &stats->channels[c];
+        const char* name = is_gray ? gray_names[c] : color_names[c];
+        
+        // Scale to the tallest bin other than the two ends, which tend to swamp everything else when an
+        // image is clipped or has a flat background.
+        u64 tallest = 1;
+        for (int bin = 1; bin < STATS_HISTOGRAM_BINS - 1; ++bin)
+        {
+            if (stats->histogram[c][bin] > tallest) tallest = stats->histogram[c][bin];
+        }
+        
+        ImGui::PushID(c);
+        ImGui::PushStyleColor(ImGuiCol_PlotHistogram, is_gray ? gray_colors[c] : color_colors[c]);
+        ImGui::PlotHistogram("##histogram", GetHistogramBin, (void*)stats->histogram[c], STATS_HISTOGRAM_BINS, 0, name, 0.0f, (float)tallest, ImVec2(-1.0f, ImGui::GetFontSize() * 4.0f));
+        ImGui::PopStyleColor();
+        ImGui::PopID();
+        
+        if (is_float) ImGui::Text("Min %g  Max %g  Mean %g  Stddev %g", channel->min, channel->max, channel->mean, channel->stddev);
+        else ImGui::Text("Min %.0f  Max %.0f  Mean %.2f  Stddev %.2f", channel->min, channel->max, channel->mean, channel->stddev);
+    }
+}
+
+// Picks another panel to diff against and shows the result of the last comparison.
+void DrawImagePanelCompare(ImagePanel* panel)
+{
+    ImagePanel* other = 0;
+    for (int i = 0; i < arrlen(image_panels); ++i)
+    {
+        if (image_panels[i].panel_id == compare_panel_id && compare_panel_id != panel->panel_id) other = &image_panels[i];
+    }
+    
+    if (ImGui::BeginCombo("With", other ? other->file_name : "None"))
+    {
+        for (int i = 0; i < arrlen(image_panels); ++i)
+        {
+            ImagePanel* candidate = &image_panels[i];
+            if (candidate->panel_id == panel->panel_id || !candidate->source_data) continue;
+            ImGui::PushID(candidate->panel_id);
+            if (ImGui::Selectable(candidate->file_name, candidate == other)) compare_panel_id = candidate->panel_id;
+            ImGui::PopID();
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SliderFloat("Threshold", &compare_threshold, 0.0f, 0.25f, "%.3f");
+    ImGui::Checkbox("SSIM", &compare_ssim);
+    if (other && ImGui::Button("Compare"))
+    {
+        compare_failed = !DiffImagePanels(panel, other, compare_threshold, compare_ssim);
+    }
+    if (compare_failed) ImGui::TextDisabled("Both images have to be loaded and the same size.");
+    if (panel->diff_job) ImGui::TextDisabled("Comparing...");
+    
+    const ImageDiff* diff = panel->diff;
+    if (!diff) return;
+    
+    double pixel_count = (double)diff->width * (double)diff->height;
+    ImGui::Text("Compared with panel %d as %d x %d-bit", panel->diff_panel_id, diff->layout.channel_count, GetPixelTypeSize(diff->layout.type) * 8);
+    if (isinf(diff->total_psnr)) ImGui::Text("Identical");
+    else ImGui::Text("PSNR: %.2f dB", diff->total_psnr);
+    ImGui::Text("Mismatched Pixels: %llu (%.4f%%)", (unsigned long long)diff->mismatch_count, 100.0 * (double)diff->mismatch_count / pixel_count);
+    for (int c = 0; c < diff->layout.channel_count; ++c)
+    {
+        ImGui::Text("Channel %d: max error %g, PSNR %.2f dB", c, diff->max_error[c], diff->psnr[c]);
+    }
+    if (panel->ssim)
+    {
+        ImGui::Text("SSIM: %.5f", panel->ssim->ssim);
+        ImGui::Text("MS-SSIM: %.5f (%d scales)", panel->ssim->ms_ssim, panel->ssim->scale_count);
+    }
+    else if (panel->ssim_job) ImGui::TextDisabled("Computing SSIM...");
+    ImGui::Checkbox("Show Mismatches", &panel->show_diff_overlay);
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) ClearImagePanelDiff(panel);
+}
+
+// Called by the frame scheduler, possibly from a worker thread, to break the loop out of its wait.
+void WakeMainLoop(void* data)
+{
+    ::PostMessage((HWND)data, WM_NULL, 0, 0);
+}
+
 bool CreateDeviceD3D(HWND hWnd)
 {
     // Setup swap chain